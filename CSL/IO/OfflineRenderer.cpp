@@ -0,0 +1,235 @@
+//
+//  OfflineRenderer.cpp -- faster-than-real-time rendering of a DSP graph to a sound file or buffer
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "OfflineRenderer.h"
+#include "CSL_Includes.h"			// the concrete SoundFile class (as FileIO uses)
+#ifndef CSL_WINDOWS
+	#include <sys/time.h>
+#else
+	#include <windows.h>
+#endif
+
+using namespace csl;
+
+// answer the wall-clock time in seconds
+
+static double wallTime() {
+#ifndef CSL_WINDOWS
+	struct timeval now;
+	gettimeofday(& now, NULL);
+	return (double) now.tv_sec + (double) now.tv_usec * 1.0e-6;
+#else
+	LARGE_INTEGER ticksPerSecond, tick;		// (clock() is CPU time on some systems)
+	QueryPerformanceFrequency(& ticksPerSecond);
+	QueryPerformanceCounter(& tick);
+	return (double) tick.QuadPart / (double) ticksPerSecond.QuadPart;
+#endif
+}
+
+OfflineRenderer::OfflineRenderer(unsigned numChannels)
+		: IO(CGestalt::frameRate(), CGestalt::blockSize(), -1, -1, 0, numChannels),
+		  mBlockSize(CGestalt::blockSize()),
+		  mNumBlocks(0), mNumFrames(0), mElapsed(0.0), mWorkers(NULL),
+		  mHead(0), mTail(0), mCount(0), mDone(false), mFile(NULL) {
+	mQueue.resize(CSL_OFFLINE_QUEUE, NULL);
+	pthread_mutex_init(& mMutex, NULL);
+	pthread_cond_init(& mFilled, NULL);
+	pthread_cond_init(& mEmptied, NULL);
+}
+
+OfflineRenderer::~OfflineRenderer() {
+	setExecutor(NULL);
+	if (mWorkers)
+		delete mWorkers;
+	freeQueue();
+	pthread_cond_destroy(& mFilled);
+	pthread_cond_destroy(& mEmptied);
+	pthread_mutex_destroy(& mMutex);
+}
+
+// the render workers are a GraphExecutor that isn't real-time (there's no deadline to meet)
+
+void OfflineRenderer::setThreads(unsigned numThreads) {
+	setExecutor(NULL);
+	if (mWorkers)
+		delete mWorkers;
+	mWorkers = numThreads ? new GraphExecutor(numThreads, false) : NULL;
+	setExecutor(mWorkers);
+}
+
+void OfflineRenderer::setQueueSize(unsigned numBlocks) {
+	freeQueue();
+	mQueue.resize(csl_max(numBlocks, 1u), NULL);
+}
+
+// the queue blocks are allocated on the first render (and again if the block size grows)
+
+void OfflineRenderer::allocateQueue() {
+	for (unsigned i = 0; i < mQueue.size(); i++) {
+		if (mQueue[i] && (mQueue[i]->mNumAlloc < mBlockSize)) {
+			delete mQueue[i];
+			mQueue[i] = NULL;
+		}
+		if (mQueue[i] == NULL) {
+			mQueue[i] = new Buffer(mNumOutChannels, mBlockSize);
+			mQueue[i]->allocateBuffers();
+		}
+	}
+}
+
+void OfflineRenderer::freeQueue() {
+	for (unsigned i = 0; i < mQueue.size(); i++) {
+		if (mQueue[i])
+			delete mQueue[i];
+		mQueue[i] = NULL;
+	}
+}
+
+void OfflineRenderer::startRender(UnitGenerator & root, unsigned blockSize) {
+	mBlockSize = blockSize ? blockSize : CGestalt::blockSize();
+	setRoot(root);
+	allocateQueue();
+	mHead = mTail = mCount = 0;
+	mDone = false;
+	mStatus = kIORunning;
+}
+
+void OfflineRenderer::endRender(double startTime, unsigned numFrames) {
+	mElapsed = wallTime() - startTime;
+	mNumFrames = numFrames;
+	mNumFramesPlayed += numFrames;
+	mStatus = kIOOpen;
+	clearRoot();
+	logMsg("OfflineRenderer: %d blocks of %d in %.3f sec (%.1f blocks/sec, %.1f x real time)",
+			mNumBlocks, mBlockSize, mElapsed, blocksPerSecond(), realTimeFactor());
+}
+
+double OfflineRenderer::blocksPerSecond() {
+	return (mElapsed > 0.0) ? (double) mNumBlocks / mElapsed : 0.0;
+}
+
+double OfflineRenderer::realTimeFactor() {
+	return (mElapsed > 0.0) ? (double) mNumFrames / (CGestalt::frameRateF() * mElapsed) : 0.0;
+}
+
+// Render to a file: this thread renders into the free blocks of the queue as fast as it can,
+// and the writer thread writes the full ones in order
+
+unsigned OfflineRenderer::render(UnitGenerator & root, Abst_SoundFile & file, float seconds,
+			unsigned blockSize) throw (CException) {
+	unsigned totalFrames = (unsigned) (seconds * CGestalt::frameRateF());
+	unsigned numSlots = mQueue.size();
+	startRender(root, blockSize);
+	mFile = & file;
+	pthread_t writer;
+	if (pthread_create(& writer, NULL, writerLoop, this) != 0) {
+		clearRoot();
+		throw RunTimeError("OfflineRenderer: can't start the writer thread");
+	}
+	double startTime = wallTime();
+	unsigned frame = 0;
+	mNumBlocks = 0;
+	while (frame < totalFrames) {
+		pthread_mutex_lock(& mMutex);			// wait for a free block
+		while (mCount == numSlots)
+			pthread_cond_wait(& mEmptied, & mMutex);
+		Buffer * block = mQueue[mHead];
+		pthread_mutex_unlock(& mMutex);
+
+		unsigned numFrames = csl_min(mBlockSize, totalFrames - frame);
+		block->setSizeOnly(mNumOutChannels, numFrames);
+		pullInput(* block);						// render it
+		frame += numFrames;
+		mNumBlocks++;
+
+		pthread_mutex_lock(& mMutex);			// and queue it
+		mHead = (mHead + 1) % numSlots;
+		mCount++;
+		pthread_cond_signal(& mFilled);
+		pthread_mutex_unlock(& mMutex);
+	}
+	pthread_mutex_lock(& mMutex);				// let the writer finish
+	mDone = true;
+	pthread_cond_signal(& mFilled);
+	pthread_mutex_unlock(& mMutex);
+	pthread_join(writer, NULL);
+	mFile = NULL;
+	endRender(startTime, frame);
+	return frame;
+}
+
+// Render to a new file, using the name's extension for the type (as FileIO does)
+
+unsigned OfflineRenderer::render(UnitGenerator & root, const char * path, float seconds,
+			unsigned bitDepth, unsigned blockSize) throw (CException) {
+	SoundFileFormat format = kSoundFileFormatAIFF;	// default = AIFF files
+	const char * dot = strrchr(path, '.');
+	if (dot && (strcmp(dot, ".wav") == 0))
+		format = kSoundFileFormatWAV;
+	else if (dot && (strcmp(dot, ".snd") == 0))
+		format = kSoundFileFormatSND;
+	SoundFile file(path);
+	file.openForWrite(format, mNumOutChannels, CGestalt::frameRate(), bitDepth);
+	if ( ! file.isValid())
+		throw IOError("OfflineRenderer: can't open the output file");
+	unsigned numFrames = render(root, file, seconds, blockSize);
+	file.close();
+	return numFrames;
+}
+
+// Render into a buffer (no writer thread); the blocks are rendered in place, using the
+// output's channel pointers
+
+unsigned OfflineRenderer::render(UnitGenerator & root, Buffer & output, unsigned blockSize) throw (CException) {
+	unsigned totalFrames = output.mNumFrames;
+	unsigned numChannels = output.mNumChannels;
+	startRender(root, blockSize);
+	Buffer block(numChannels, mBlockSize);		// a header that points into the output
+	block.mAreBuffersAllocated = true;
+	double startTime = wallTime();
+	unsigned frame = 0;
+	mNumBlocks = 0;
+	while (frame < totalFrames) {
+		unsigned numFrames = csl_min(mBlockSize, totalFrames - frame);
+		for (unsigned i = 0; i < numChannels; i++)
+			block.setBuffer(i, output.buffer(i) + frame);
+		block.setSizeOnly(numChannels, numFrames);
+		pullInput(block);
+		frame += numFrames;
+		mNumBlocks++;
+	}
+	endRender(startTime, frame);
+	return frame;
+}
+
+// The writer thread: write the queued blocks in order until the render is done
+
+void * OfflineRenderer::writerLoop(void * arg) {
+	OfflineRenderer * me = (OfflineRenderer *) arg;
+	unsigned numSlots = me->mQueue.size();
+	while (true) {
+		pthread_mutex_lock(& me->mMutex);
+		while ((me->mCount == 0) && ( ! me->mDone))
+			pthread_cond_wait(& me->mFilled, & me->mMutex);
+		if (me->mCount == 0) {					// done and drained
+			pthread_mutex_unlock(& me->mMutex);
+			break;
+		}
+		Buffer * block = me->mQueue[me->mTail];
+		pthread_mutex_unlock(& me->mMutex);
+		try {
+			me->mFile->writeBuffer(* block);
+		} catch (CException & ex) {
+			logMsg(kLogError, "OfflineRenderer write error: %s", ex.what());
+		}
+		pthread_mutex_lock(& me->mMutex);
+		me->mTail = (me->mTail + 1) % numSlots;
+		me->mCount--;
+		pthread_cond_signal(& me->mEmptied);
+		pthread_mutex_unlock(& me->mMutex);
+	}
+	return NULL;
+}
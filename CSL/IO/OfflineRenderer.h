@@ -0,0 +1,95 @@
+//
+//  OfflineRenderer.h -- faster-than-real-time rendering of a DSP graph to a sound file or buffer
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#ifndef CSL_OfflineRenderer_H
+#define CSL_OfflineRenderer_H
+
+#include "CSL_Core.h"
+#include "SoundFile.h"
+#include "GraphExecutor.h"
+#include <pthread.h>
+
+namespace csl {
+
+#define CSL_OFFLINE_QUEUE 8					///< # of blocks queued for the file writer
+
+///
+/// OfflineRenderer -- an IO that pulls its graph as fast as the CPU allows. Unlike FileIO, it
+/// doesn't pace itself like a device: each block is rendered as soon as the last one is done,
+/// in large blocks, optionally with the independent sub-graphs (e.g., the voices of a mixer)
+/// on a GraphExecutor's worker threads. File output is streamed through a queue of blocks to a
+/// writer thread, so the render loop doesn't wait for the disk.
+///
+/// The block size is passed to each render (it's carried by the blocks, and CGestalt is left
+/// alone, so a real-time graph can keep running). The UGens size their buffers from
+/// CGestalt::blockSize() when they're made, so a render's block size mustn't be larger than
+/// that was when the graph was built; the default is the current CGestalt::blockSize().
+///
+/// Usage:
+///		OfflineRenderer rend(2);				// stereo
+///		rend.setThreads(4);						// render the mixer's inputs in parallel
+///		... build the graph ...
+///		rend.render(mix, "stem.aiff", 180.0f);	// 3 minutes, as fast as possible
+///		logMsg("%g blocks/sec", rend.blocksPerSecond());
+///
+
+class OfflineRenderer : public IO {
+public:
+	OfflineRenderer(unsigned numChannels = 2);	///< Constructor
+	~OfflineRenderer();
+												/// render independent sub-graphs on N worker threads
+												/// (0 = all on the calling thread)
+	void setThreads(unsigned numThreads);
+	void setQueueSize(unsigned numBlocks);		///< set the # of blocks queued for the writer
+
+												/// render seconds of the graph to a file opened for writing,
+												/// in blocks of the given size (0 = CGestalt::blockSize())
+	unsigned render(UnitGenerator & root, Abst_SoundFile & file, float seconds,
+				unsigned blockSize = 0) throw (CException);
+												/// render to a new file (the type is taken from the name,
+												/// e.g., xx.aiff, yy.wav, zz.snd)
+	unsigned render(UnitGenerator & root, const char * path, float seconds,
+				unsigned bitDepth = 16, unsigned blockSize = 0) throw (CException);
+												/// render into a buffer (its mNumFrames frames)
+	unsigned render(UnitGenerator & root, Buffer & output, unsigned blockSize = 0) throw (CException);
+
+	unsigned blockSize() { return mBlockSize; };			///< answer the block size of the last render
+	unsigned numBlocks() { return mNumBlocks; };			///< answer the # of blocks in the last render
+	double elapsedSeconds() { return mElapsed; };			///< answer the duration of the last render
+	double blocksPerSecond();								///< answer the throughput of the last render
+	double realTimeFactor();								///< answer how many times faster than real time
+
+	Buffer & getInput() throw(CException) { return mInputBuffer; };
+	Buffer & getInput(unsigned numFrames, unsigned numChannels) throw(CException) { return mInputBuffer; };
+
+protected:
+	unsigned mBlockSize;						///< frames per block (of the current/last render)
+	unsigned mNumBlocks;						///< statistics of the last render
+	unsigned mNumFrames;
+	double mElapsed;
+	GraphExecutor * mWorkers;					///< the render worker threads (NULL = serial)
+												/// the writer's queue (a ring of blocks)
+	std::vector<Buffer *> mQueue;
+	unsigned mHead;								///< next block to render into
+	unsigned mTail;								///< next block to write
+	unsigned mCount;							///< # of blocks waiting to be written
+	bool mDone;									///< set when the last block is queued
+	Abst_SoundFile * mFile;					///< the file being written
+	pthread_mutex_t mMutex;						///< queue lock
+	pthread_cond_t mFilled;						///< signalled when a block is queued
+	pthread_cond_t mEmptied;					///< signalled when a block has been written
+
+	void allocateQueue();						///< (re-)allocate the queue blocks for mBlockSize
+	void freeQueue();
+												/// set up before/clean up after a render
+	void startRender(UnitGenerator & root, unsigned blockSize);
+	void endRender(double startTime, unsigned numFrames);
+	static void * writerLoop(void * arg);		///< the writer thread function
+};
+
+}
+
+#endif
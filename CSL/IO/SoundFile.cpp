@@ -121,7 +121,9 @@ Abst_SoundFile::Abst_SoundFile(string tpath, int tstart, int tstop) :
 			mRate(1.0),
 			mNumFrames(0),
 			mBytesPerSample(0),
-			mBase(0) { /* no-op */}
+			mBase(0) {
+	setSharedTable(NULL);				// the wavetable holds the samples, not the default sine
+}
 
 ///< Copy constructor -- shares sample buffer
 
@@ -286,10 +288,10 @@ void Abst_SoundFile::setBase(int val) {
 // Rate and transposition
 
 void Abst_SoundFile::setRate(UnitGenerator & frequency) { 
-	if ( ! mInputs[CSL_RATE])
+	if ( ! mPortSlots[CSL_RATE])
 		this->addInput(CSL_RATE, frequency);
 	else
-		mInputs[CSL_RATE]->mUGen = & frequency;
+		mPortSlots[CSL_RATE]->mUGen = & frequency;
 }
 
 void Abst_SoundFile::setRate(float frequency) { 
@@ -407,7 +409,20 @@ void Abst_SoundFile::nextBuffer(Buffer &outputBuffer) throw(CException) {
 				SampleBuffer outPtr = outputBuffer.buffer(i);
 				memcpy(outPtr, sndPtr, numBytes);					// here's the memcpy
 			}
-		} else {													// else loop applying scale/offset
+		} else if (IS_LINEAR_SCALABLE) {							// fixed/control-rate scale/offset
+			DECLARE_SCALABLE_RAMPS;									// loop w/o port access
+			float scale0 = scaleValue, offset0 = offsetValue;
+			for (unsigned i = 0; i < outputBuffer.mNumChannels; i++) {
+				SampleBuffer buffer = outputBuffer.buffer(i);
+				SampleBuffer dPtr = mWavetable.buffer(csl_min(i, (mNumChannels - 1))) + currentFrame;
+				scaleValue = scale0;								// each channel starts at the block's values
+				offsetValue = offset0;
+				for (unsigned j = 0; j < numFrames; j++) {
+					*buffer++ = (*dPtr++ * scaleValue) + offsetValue;
+					UPDATE_SCALABLE_RAMPS;							// step the ramped scale/offset (if any)
+				}
+			}
+		} else {													// else loop applying audio-rate scale/offset
 			sample samp;
 			for (unsigned i = 0; i < outputBuffer.mNumChannels; i++) {
 				SampleBuffer buffer = outputBuffer.buffer(i);	// get pointer to the selected output channel
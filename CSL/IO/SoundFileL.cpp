@@ -54,7 +54,8 @@ LSoundFile::LSoundFile(string tpath, int tstart, int tstop, bool doRead, float m
 			: Abst_SoundFile(tpath, tstart, tstop), 
 			  mSFInfo(new SF_INFO), 
 			  mSndfile(NULL),
-			  mMaxDurInSecs (maxDurInSecs) {
+			  mMaxDurInSecs (maxDurInSecs),
+			  mDither(false) {
 	mSFInfo->format = 0;
 	mNumFrames = 0;
 #ifdef CSL_USE_SRConv
@@ -77,7 +78,8 @@ LSoundFile::LSoundFile(float maxDurInSecs, string tpath)
 		: Abst_SoundFile(tpath, -1, -1), 
 		  mSFInfo(new SF_INFO), 
 		  mSndfile(NULL),
-		  mMaxDurInSecs (maxDurInSecs) {
+		  mMaxDurInSecs (maxDurInSecs),
+		  mDither(false) {
 	mSFInfo->format = 0;
 	mNumFrames = 0;
 #ifdef CSL_USE_SRConv
@@ -95,7 +97,8 @@ LSoundFile::LSoundFile(float maxDurInSecs, string tpath)
 LSoundFile::LSoundFile(LSoundFile & otherSndFile)
 			: Abst_SoundFile(otherSndFile), 
 			  mSFInfo(otherSndFile.sfInfo()), 
-			  mSndfile(otherSndFile.sndFile()) {
+			  mSndfile(otherSndFile.sndFile()),
+			  mDither(otherSndFile.dither()) {
 	if ( ! otherSndFile.isCached())
 		logMsg(kLogError, "Cannot copy uncached sound file \"%s\"", mPath.c_str());
 //	logMsg("Open sound file \"%s\"", mPath.c_str());
@@ -366,11 +369,19 @@ void LSoundFile::nextBuffer(Buffer &outputBuffer) throw(CException) {
 	return;
 }
 
-// write a CSL buffer to the interleaved output file
+// write a CSL buffer to the interleaved output file; with dither on, 16-bit files are converted
+// (and dithered) while interleaving, rather than having libsndfile convert the floats afterwards
 
 void LSoundFile::writeBuffer(Buffer &inputBuffer) throw(CException) {
 	unsigned numFrames = inputBuffer.mNumFrames;
-	if (mSFInfo->channels > 1) {				// interleave stereo-to-mono
+	CSL_RT_CHECK_CALL(kRTBlockingIO, "LSoundFile::writeBuffer");
+	if (mDither && ((mSFInfo->format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_16)) {
+		mWavetable.setSize(1, mNumChannels * numFrames);	// (floats are big enough for the shorts)
+		mWavetable.allocateBuffers();
+		short * shorts = (short *) mWavetable.buffer(0);
+		mInterleaver.interleave(inputBuffer, shorts, numFrames, mSFInfo->channels, true);
+		sf_writef_short(mSndfile, shorts, numFrames);		// libsndfile write 
+	} else if (mSFInfo->channels > 1) {			// interleave stereo-to-mono
 		mWavetable.setSize(1, mNumChannels * numFrames);
 		mWavetable.allocateBuffers();
 												// call interleaver
@@ -391,6 +402,7 @@ void LSoundFile::readBufferFromFile(unsigned numFrames) {
 	unsigned currentFrame = mCurrentFrame;
 	unsigned myChannels = mSFInfo->channels;
 
+	CSL_RT_CHECK_CALL(kRTBlockingIO, "LSoundFile::readBufferFromFile");
 	this->checkBuffer(numFrames);			// check my buffer, allocate if necessary
 	SampleBuffer sampleBufferPtr;
 	if ((myChannels > 1)) {					// read into temp buffer to multichannel files, then de-interleave
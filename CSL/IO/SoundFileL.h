@@ -96,6 +96,10 @@ public:							/// Constructor with defaults
 	bool isCached();								///< answer if file has all of its samples in RAM
 	bool isCached(unsigned samps);					///< answer if file has X samples in RAM
 
+													/// whether 16-bit writes get TPDF dither (default false)
+	void setDither(bool whether) { mDither = whether; };
+	bool dither() { return mDither; };
+
 	SF_INFO * sfInfo() { return mSFInfo; }			///< libsndfile sf-info struct
 	SNDFILE * sndFile() { return mSndfile; }		///< libsndfile handle
 
@@ -104,6 +108,7 @@ protected:
 	SNDFILE * mSndfile;								///< libsndfile handle
 	Interleaver mInterleaver;						///< File IO interleaver/deinterleaver
 	float mMaxDurInSecs;							///< max size to read from file. In seconds so it can deal with varying sample rates.
+	bool mDither;									///< whether to dither 16-bit writes
 	
 //#ifdef CSL_USE_SRConv
 //	Buffer mSRConvBuffer;							///< used by the sample rate convertor
@@ -240,6 +240,7 @@ class FMAKComponent;			// forward declaration of FMAK component class
 extern FMAKComponent * gComp;
 
 void csl::vlogMsg(bool cz, LogLevel level, const char * format, va_list args) {
+	CSL_RT_CHECK_CALL(kRTBlockingIO, "logMsg");
 	char message[CSL_LINE_LEN];
 	vsprintf(message, format, args);
 	if (cz)
@@ -256,6 +257,7 @@ void csl::vlogMsg(bool cz, LogLevel level, const char * format, va_list args) {
 #ifndef CSL_ANDROID
 
 void csl::vlogMsg(bool cz, LogLevel level, const char * format, va_list args) {
+	CSL_RT_CHECK_CALL(kRTBlockingIO, "logMsg");
 	switch(level) {
 		case kLogInfo:
 			if (mVerbosity < 3)		return;
@@ -290,6 +292,7 @@ void csl::vlogMsg(bool cz, LogLevel level, const char * format, va_list args) {
 // Sam's Android printing
 
 void csl::vlogMsg(bool cz, LogLevel level, const char * format, va_list args) {
+	CSL_RT_CHECK_CALL(kRTBlockingIO, "logMsg");
 	switch(level) {
 		case kLogInfo:
 			if (mVerbosity < 3)		return;
@@ -413,6 +416,7 @@ float log2f(float n) {
 
 bool csl::sleepUsec(float dur_in_usec) {
 	if (dur_in_usec <= 0.0) return false;
+	CSL_RT_CHECK_CALL(kRTSleep, "sleepUsec");
 	int interval;
 	int periods = (int) ((dur_in_usec / 1000000.0f) / TIMER_INTERVAL);
 	if (periods < 1) {
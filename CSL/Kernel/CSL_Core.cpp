@@ -5,6 +5,11 @@
 //
 
 #include "CSL_Core.h"	// it's all declared here
+#include "GraphExecutor.h"	// optional parallel pre-rendering
+#include "BufferArena.h"	// aligned sample storage
+#include "VectorOps.h"		// SIMD kernels
+#include "RealTimeCheck.h"	// RT-safety debugging hooks
+#include "UGenProfiler.h"	// per-UGen profiling hooks
 //#include "RingBuffer.h"	// UnitGenerator uses RingBuffers
 #include <string.h>		// for bzero / memset
 #include <stdlib.h>		// for malloc
@@ -49,8 +54,12 @@ Buffer::Buffer(unsigned numChannels, unsigned numFrames) :
 		mDidIAllocateBuffers(false),
 		mIsPopulated(false),
 		mAreBuffersZero(true),
+		mIsView(false),
+		mSilentChannels(0),
 		mType(kSamples),
-		mBuffers(0) {
+		mBuffers(0),
+		mStorage(0),
+		mStorageSize(0) {
 	setSize(numChannels, numFrames);
 }
 
@@ -115,7 +124,7 @@ float Buffer::duration() {
 	return ((float) mNumFrames / CGestalt::frameRateF()); 
 }
 
-// allocate the sample arrays
+// allocate the sample arrays as one aligned block from the arena
 
 //#define FVERBOSE_MALLOC			// define for verbose debugging of buffer alloc/free
 
@@ -123,12 +132,18 @@ void Buffer::allocateBuffers() throw (MemoryError) {
 #ifdef FVERBOSE_MALLOC
 	logMsg("			Buffer::allocateBuffers(%x  %d  %d)", this, mNumChannels, mNumFrames);
 #endif
+	BufferArena * arena = BufferArena::defaultArena();
+	if (mStorage && mDidIAllocateBuffers)			// re-allocating: drop my old block
+		arena->release(mStorage, mStorageSize);
 	if (mBuffers == NULL)
 		mBuffers = new SampleBuffer[mNumChannels];	// reserve space for buffers
-	for (unsigned i = 0; i < mNumChannels; i++) {
-		SAFE_MALLOC(mBuffers[i], sample, mNumFrames);
-		memset(mBuffers[i], 0, mNumFrames * sizeof(sample));
-	}
+	unsigned stride = BufferArena::stride(mNumFrames);
+	mStorageSize = stride * mNumChannels;
+	mStorage = arena->allocate(mStorageSize);
+	memset(mStorage, 0, mStorageSize);
+	for (unsigned i = 0; i < mNumChannels; i++)
+		mBuffers[i] = (SampleBuffer) ((char *) mStorage + (i * stride));
+	mIsView = false;
 //	if (mNumFrames < 16)
 //		logMsg("Small buffer: %d", mNumFrames);
 	mAreBuffersAllocated = true;
@@ -149,10 +164,16 @@ void Buffer::freeBuffers() {
 	logMsg("			Buffer::freeBuffers    (%x  %d  %d)", this, mNumChannels, mNumFrames);
 #endif
 	try {
-		for (unsigned i = 0; i < mNumChannels; i++) {
-			if (mBuffers[i]) {
-				delete mBuffers[i];		// do the delete
-				mBuffers[i] = NULL;		// set to zero right away
+		if (mStorage) {					// one block from the arena
+			BufferArena::defaultArena()->release(mStorage, mStorageSize);
+			mStorage = NULL;
+			mStorageSize = 0;
+		} else {						// or separate arrays (allocated by someone else)
+			for (unsigned i = 0; i < mNumChannels; i++) {
+				if (mBuffers[i]) {
+					delete mBuffers[i];		// do the delete
+					mBuffers[i] = NULL;		// set to zero right away
+				}
 			}
 		}
 	} catch (std::exception ex) {
@@ -168,16 +189,99 @@ void Buffer::freeBuffers() {
 	mMonoBufferByteSize = 0;
 }
 
+// Use the given block (e.g., shared by a BufferPlan) for my channels; it must hold
+// mNumChannels * BufferArena::stride(mNumAlloc) bytes. I don't free it.
+
+void Buffer::shareStorage(SampleBuffer storage) throw (MemoryError) {
+	unsigned numCh = mNumChannels;
+	unsigned numFr = mNumAlloc ? mNumAlloc : mNumFrames;
+	unsigned numUsed = mNumFrames;
+	this->freeBuffers();						// drop my own block (this clears the sizes)
+	mNumChannels = numCh;
+	mNumFrames = numUsed;
+	mNumAlloc = numFr;
+	mMonoBufferByteSize = mNumFrames * sizeof(sample);
+	if (mBuffers == NULL)
+		mBuffers = new SampleBuffer[mNumChannels];
+	unsigned stride = BufferArena::stride(numFr);
+	for (unsigned i = 0; i < mNumChannels; i++)
+		mBuffers[i] = (SampleBuffer) ((char *) storage + (i * stride));
+	mStorage = storage;
+	mStorageSize = stride * mNumChannels;
+	mAreBuffersAllocated = true;
+	mDidIAllocateBuffers = false;
+	mIsView = false;
+}
+
+// Point my channels at the given buffer's samples; this only works if I have a block of my
+// own to go back to (see endView()) and the source has at least as many channels and frames
+
+bool Buffer::viewOf(Buffer & src) {
+	if ((mStorage == NULL) || (src.mNumChannels < mNumChannels) || (src.mNumFrames < mNumFrames))
+		return false;
+	for (unsigned i = 0; i < mNumChannels; i++)
+		mBuffers[i] = src.buffer(i);
+	mIsView = true;
+	mAreBuffersZero = false;
+	mSilentChannels = src.mSilentChannels;		// (a view is silent where its source is)
+	return true;
+}
+
+// go back to my own storage (the samples there are stale)
+
+void Buffer::endView() {
+	if ( ! mIsView)
+		return;
+	unsigned stride = BufferArena::stride(mNumAlloc);
+	for (unsigned i = 0; i < mNumChannels; i++)
+		mBuffers[i] = (SampleBuffer) ((char *) mStorage + (i * stride));
+	mIsView = false;
+	mSilentChannels = 0;
+}
+
+// copy-on-write: copy the viewed samples into my own storage before someone writes into them
+
+void Buffer::makeWritable() {
+	if ( ! mIsView)
+		return;
+	unsigned stride = BufferArena::stride(mNumAlloc);
+	for (unsigned i = 0; i < mNumChannels; i++) {
+		SampleBuffer mine = (SampleBuffer) ((char *) mStorage + (i * stride));
+		memcpy(mine, mBuffers[i], mMonoBufferByteSize);
+		mBuffers[i] = mine;
+	}
+	mIsView = false;
+}
+
 // empty the sample buffers
 
 void Buffer::zeroBuffers() {
 	if ( ! mAreBuffersAllocated)
 		return;
+	endView();								// (never write into a view's source)
 	for (unsigned i = 0; i < mNumChannels; i++)
 		memset(mBuffers[i], 0, mMonoBufferByteSize);
 	mAreBuffersZero = true;
 }
 
+// Silence flags: all channels, or set/clear one
+
+bool Buffer::isSilent() {
+	if ((mNumChannels == 0) || (mNumChannels > 64))
+		return false;
+	unsigned long long all = (mNumChannels == 64) ? ~0ULL : ((1ULL << mNumChannels) - 1);
+	return ((mSilentChannels & all) == all);
+}
+
+void Buffer::setSilent(unsigned ch, bool whether) {
+	if (ch >= 64)
+		return;
+	if (whether)
+		mSilentChannels |= (1ULL << ch);
+	else
+		mSilentChannels &= ~(1ULL << ch);
+}
+
 /// answer a samp ptr tested for extent (offset + maxFrame)
 
 sample * Buffer::samplePtrFor(unsigned channel, unsigned offset){
@@ -201,16 +305,10 @@ bool Buffer::canStore(unsigned numFrames) {
 // fill with a constant
 
 void Buffer::fillWith(sample value) {
-	float * bbuffer = NULL;
-	unsigned outBufNum, i;
-	unsigned numChans = mNumChannels;
-	unsigned numFrames = mNumFrames;
-	for (outBufNum = 0; outBufNum < numChans; outBufNum++) {
-		bbuffer = mBuffers[outBufNum];
-		for (i = 0; i < numFrames; i++)
-			*bbuffer++ = value;
-	}
+	for (unsigned outBufNum = 0; outBufNum < mNumChannels; outBufNum++)
+		VectorOps::fill(mBuffers[outBufNum], value, mNumFrames);
 	mAreBuffersZero = false;
+	mSilentChannels = 0;
 }
 
 // copy the "header" info
@@ -243,6 +341,9 @@ void Buffer::copyFrom(Buffer & source) throw (RunTimeError) {
 	for (unsigned outBufNum = 0; outBufNum < mNumChannels; outBufNum++) {
 		mBuffers[outBufNum] = source.buffer(outBufNum);
 	}
+	mStorage = source.mStorage;					// and the block they're in (in case the caller
+	mStorageSize = source.mStorageSize;			// hands ownership over to me)
+	mSilentChannels = source.mSilentChannels;
 	mAreBuffersZero = false;					// set flags
 	mAreBuffersAllocated = true;
 	mDidIAllocateBuffers = false;
@@ -256,12 +357,15 @@ void Buffer::copySamplesFrom(Buffer & source) throw (RunTimeError) {
 				mNumChannels, source.mNumChannels, mNumAlloc, source.mNumFrames);
 		throw RunTimeError("Can't reallocate buffers at run-time");
 	} 
+	endView();									// (all of them get overwritten)
 	mNumChannels = source.mNumChannels;
 	mNumFrames = source.mNumFrames;
 	mMonoBufferByteSize = mNumFrames * sizeof(sample);
+	mSilentChannels = 0;
 	for (unsigned outBufNum = 0; outBufNum < mNumChannels; outBufNum++) {			// copy loop
 		unsigned sBufNum = csl_min(outBufNum, (source.mNumChannels - 1));
 		memcpy(mBuffers[outBufNum], source.buffer(sBufNum), mMonoBufferByteSize);
+		setSilent(outBufNum, source.isSilent(sBufNum));	// (and the silence flags)
 	}
 	mAreBuffersZero = false;
 }
@@ -272,9 +376,12 @@ void Buffer::copyOnlySamplesFrom(Buffer & source) throw (RunTimeError) {
 				mNumChannels, source.mNumChannels, mNumFrames, source.mNumFrames);
 		throw RunTimeError("Can't reallocate buffers at run-time");
 	} 
+	endView();
+	mSilentChannels = 0;
 	for (unsigned outBufNum = 0; outBufNum < mNumChannels; outBufNum++) {
 		unsigned sBufNum = csl_min(outBufNum, (source.mNumChannels - 1));
 		memcpy(mBuffers[outBufNum], source.buffer(sBufNum), mMonoBufferByteSize);
+		setSilent(outBufNum, source.isSilent(sBufNum));
 	}
 }
 
@@ -286,11 +393,13 @@ void Buffer::copySamplesFromTo(Buffer & source, unsigned offset) throw (RunTimeE
 			   mNumChannels, source.mNumChannels, mNumFrames, source.mNumFrames);
 		throw RunTimeError("Can't reallocate buffers at run-time");
 	} 
+	makeWritable();								// (only part of it gets overwritten)
 	for (unsigned outBufNum = 0; outBufNum < mNumChannels; outBufNum++) {
 		unsigned sBufNum = csl_min(outBufNum, (source.mNumChannels - 1));
 		memcpy(mBuffers[outBufNum] + offset, source.buffer(sBufNum), 
 				(source.mNumFrames * sizeof(sample)));
 	}
+	mSilentChannels = 0;						// (only part of each channel was written)
 }
 
 // read a buffer from a snd file; answer success
@@ -329,63 +438,47 @@ bool Buffer::readFromFile(char * finam) {
 // normalize the buffer(s) to the given max val; answer the prior max val
 
 float Buffer::normalize(float maxVal) {
-	float * bbuffer = NULL;
-	unsigned outBufNum, i;
+	unsigned outBufNum;
 	unsigned numChans = mNumChannels;
 	unsigned numFrames = mNumFrames;
 	float maxSamp = 0.0f;
 	for (outBufNum = 0; outBufNum < numChans; outBufNum++) {
-		bbuffer = mBuffers[outBufNum];
-		for (i = 0; i < numFrames; i++) {
-			float samp = fabs(*bbuffer++);
-			if (samp > maxSamp)
-				maxSamp = samp;
-		}
+		float samp = VectorOps::maxAbs(mBuffers[outBufNum], numFrames);
+		if (samp > maxSamp)
+			maxSamp = samp;
 	}
 	if (maxSamp == 0.0f)
 		return maxSamp;
 	float scaleV = maxVal / maxSamp;
-	for (outBufNum = 0; outBufNum < numChans; outBufNum++) {
-		bbuffer = mBuffers[outBufNum];
-		for (i = 0; i < numFrames; i++) {
-			*bbuffer *= scaleV;
-			bbuffer++;
-		}
-	}
+	for (outBufNum = 0; outBufNum < numChans; outBufNum++)
+		VectorOps::mul(mBuffers[outBufNum], mBuffers[outBufNum], scaleV, numFrames);
 	return maxSamp;
 }
 
 // normalize the given region only
 
 float Buffer::normalize(float maxVal, float from, float to) {
-	float * bbuffer = NULL;
-	unsigned outBufNum, i;
+	unsigned outBufNum;
 	unsigned numChans = mNumChannels;
-	unsigned numFrames = mNumFrames;
 	float maxSamp = 0.0f;
 	unsigned samp0 = (unsigned)(from * CGestalt::frameRateF());
 	unsigned sampN = (unsigned)(to * CGestalt::frameRateF());
+	if (sampN <= samp0)
+		return maxSamp;
+	unsigned numFrames = sampN - samp0;
 	
 	for (outBufNum = 0; outBufNum < numChans; outBufNum++) {
-		bbuffer = mBuffers[outBufNum] + samp0;
-		for (i = samp0; i < sampN; i++) {
-			float samp = fabs(*bbuffer++);
-			if (samp > maxSamp)
-				maxSamp = samp;
-		}
+		float samp = VectorOps::maxAbs(mBuffers[outBufNum] + samp0, numFrames);
+		if (samp > maxSamp)
+			maxSamp = samp;
 	}
 	if (maxSamp == 0.0f)
 		return maxSamp;
 	if (maxSamp == maxVal)
 		return maxSamp;
 	float scaleV = maxVal / maxSamp;
-	for (outBufNum = 0; outBufNum < numChans; outBufNum++) {
-		bbuffer = mBuffers[outBufNum] + samp0;
-		for (i = samp0; i < sampN; i++) {
-			*bbuffer *= scaleV;
-			bbuffer++;
-		}
-	}
+	for (outBufNum = 0; outBufNum < numChans; outBufNum++)
+		VectorOps::mul(mBuffers[outBufNum] + samp0, mBuffers[outBufNum] + samp0, scaleV, numFrames);
 	return maxSamp;
 }
 
@@ -445,20 +538,15 @@ Status Buffer::convertRate(int fromRate, int toRate) {
 
 #ifdef CSL_DSP_BUFFER				/// Buffer Sample Processing (optional)
 
-#include <libtsp.h>					// for the autocorrelation
+// These use the VectorOps kernels for the reductions
 
 ///< get the root-mean-square of the samples
 
 sample Buffer::rms(unsigned chan) {
 	unsigned thech = chan % mNumChannels;
 	unsigned numFrames = mNumFrames;
-	sample val, sum = 0.0;
 	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++) {
-		val = *buffer++;
-		sum += (val * val);
-	}
-	return sum / numFrames;
+	return sqrtf(VectorOps::dot(buffer, buffer, numFrames) / numFrames);
 }
 
 ///< get the average of the samples
@@ -466,39 +554,23 @@ sample Buffer::rms(unsigned chan) {
 sample Buffer::avg(unsigned chan) {
 	unsigned thech = chan % mNumChannels;
 	unsigned numFrames = mNumFrames;
-	sample sum = 0.0;
-	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++)
-		sum += *buffer++;
-	return sum / numFrames;
+	return VectorOps::sum(mBuffers[thech], numFrames) / numFrames;
 }
 
-///< get the max of the samples
+///< get the max of the absolute value of the samples
 
 sample Buffer::max(unsigned chan) {
 	unsigned thech = chan % mNumChannels;
-	unsigned numFrames = mNumFrames;
-	sample val, tmax = 0.0;
-	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++) {
-		val = *buffer++;
-		if (fabs(val) > tmax)		tmax - fabs(val);
-	}
-	return tmax;
+	return VectorOps::maxAbs(mBuffers[thech], mNumFrames);
 }
 
 ///< get the min of the samples
 
 sample Buffer::min(unsigned chan) {
 	unsigned thech = chan % mNumChannels;
-	unsigned numFrames = mNumFrames;
-	sample val, tmax = 0.0;
-	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++) {
-		val = *buffer++;
-		if (fabs(val) > tmax)		tmax - fabs(val);
-	}
-	return tmax;
+	sample minV, maxV;
+	VectorOps::minMax(mBuffers[thech], mNumFrames, & minV, & maxV);
+	return minV;
 }
 
 ///< count the zero-crossings in the samples
@@ -518,81 +590,52 @@ unsigned int Buffer::zeroX(unsigned chan) {
 	return count;
 }
 
+// find the extreme value with the vector kernel, then look for its (first) index
+
+static unsigned indexOfValue(sample * buffer, unsigned lo, unsigned hi, bool findMax) {
+	if (hi <= lo)
+		return lo;
+	sample minV, maxV;
+	VectorOps::minMax(buffer + lo, hi - lo, & minV, & maxV);
+	sample target = findMax ? maxV : minV;
+	for (unsigned i = lo; i < hi; i++)
+		if (buffer[i] == target)
+			return i;
+	return lo;
+}
+
 ///< answer the index of the peak value
 
 unsigned int Buffer::indexOfPeak(unsigned chan) {
-	unsigned thech = chan % mNumChannels;
-	unsigned numFrames = mNumFrames, index;
-	sample val, tmax = -1000000.0;
-	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++) {
-		val = *buffer++;
-		if (val > tmax) {
-			tmax = val;
-			index = i;
-		}
-	}
-	return index;
+	return indexOfValue(mBuffers[chan % mNumChannels], 0, mNumFrames, true);
 }
 
 ///< answer the index of the peak value
 
 unsigned int Buffer::indexOfPeak(unsigned chan, unsigned lo, unsigned hi) {
-	unsigned index = 0, thech = chan % mNumChannels;
-	sample val, tmax = -100000.0;
-	sample* buffer = mBuffers[thech] + lo;
-	for (unsigned i = lo; i < hi; i++) {
-		val = *buffer++;
-		if (val > tmax) {
-			tmax = val;
-			index = i;
-		}
-	}
-	return index;
+	return indexOfValue(mBuffers[chan % mNumChannels], lo, hi, true);
 }
 
-///< answer the index of the peak value
+///< answer the index of the min value
 
 unsigned int Buffer::indexOfMin(unsigned chan) {
-	unsigned thech = chan % mNumChannels;
-	unsigned numFrames = mNumFrames, index;
-	sample val, tmin = 1000000.0;
-	sample* buffer = mBuffers[thech];
-	for (unsigned i = 0; i < numFrames; i++) {
-		val = *buffer++;
-		if (val < tmin) {
-			tmin = val;
-			index = i;
-		}
-	}
-	return index;
+	return indexOfValue(mBuffers[chan % mNumChannels], 0, mNumFrames, false);
 }
 
-///< answer the index of the peak value
+///< answer the index of the min value
 
 unsigned int Buffer::indexOfMin(unsigned chan, unsigned lo, unsigned hi) {
-	unsigned index = 0, thech = chan % mNumChannels;
-	sample val, tmin = 1000000.0;
-	sample* buffer = mBuffers[thech] + lo;
-	for (unsigned i = lo; i < hi; i++) {
-		val = *buffer++;
-		if (val < tmin) {
-			tmin = val;
-			index = i;
-		}
-	}
-	return index;
+	return indexOfValue(mBuffers[chan % mNumChannels], lo, hi, false);
 }
 
-///< write the autocorrelation into the given array
+///< write the autocorrelation into the given array; result[i] is the autocorrelation with lag i
 
 void Buffer::autocorrelation(unsigned chan, SampleBuffer result) {
 	unsigned thech = chan % mNumChannels;
 	unsigned numFrames = mNumFrames;
 	sample* buffer = mBuffers[thech];
-		//	SPautoc (const float in[], int in_size, float out[], int out_size)
-		//		- out[i] is autocorrelation with lag i
-	SPautoc (buffer, numFrames, result, numFrames);			// perform autocorrelation
+	for (unsigned lag = 0; lag < numFrames; lag++)
+		result[lag] = VectorOps::dot(buffer, buffer + lag, numFrames - lag);
 }
 
 #endif // CSL_DSP_BUFFER
@@ -627,9 +670,17 @@ UnitGenerator::UnitGenerator(unsigned rate, unsigned chans) :  Model(),
 				mFrameRate(rate),
 				mNumChannels(chans),
 				mCopyPolicy(kCopy),
+				mEvalRate(kAudioRate),
 				mNumOutputs(0),
 				mOutputCache(0),
-				mSequence(0)
+				mSequence(0),
+				mCacheOutput(false),
+				mZeroCopy(true),
+				mFanOutLock(0),
+				mViewLocked(false),
+				mSleepAfter(CSL_SLEEP_BLOCKS),
+				mQuietBlocks(0),
+				mBlockQuiet(false)
 			/*	mName(0) */
 	{ }
 
@@ -639,9 +690,13 @@ UnitGenerator::~UnitGenerator() {
 //	logMsg("		~UnitGenerator %x", this);
 }
 
+// zero a channel and flag it as silent
+
 void UnitGenerator::zeroBuffer(Buffer & outputBuffer, unsigned outBufNum) {
+	outputBuffer.makeWritable();
 	float * buffer = outputBuffer.buffer(outBufNum);
 	memset(buffer, 0, outputBuffer.mMonoBufferByteSize);
+	outputBuffer.setSilent(outBufNum);
 }
 
 // output management and auto-fan-out
@@ -656,6 +711,30 @@ void UnitGenerator::addOutput(UnitGenerator * ugen) {
 	mNumOutputs++;
 }
 
+// the sequence # of the block this thread is computing (per-thread, so that several IOs, e.g.,
+// an OfflineRenderer and a live IO, can render at once; GraphExecutor workers set it per batch)
+
+static CSL_THREAD_LOCAL unsigned sBlockSequence = 0;
+
+unsigned UnitGenerator::blockSequence() {
+	return sBlockSequence;
+}
+
+void UnitGenerator::setBlockSequence(unsigned seq) {
+	sBlockSequence = seq;
+}
+
+// cache my output even if I have only 1 output (so that pre-rendered blocks can be re-used)
+
+void UnitGenerator::setCacheOutput(bool whether) {
+	if (whether && (mOutputCache == 0)) {
+		mOutputCache = new Buffer(mNumChannels, CGestalt::blockSize());
+		mOutputCache->allocateBuffers();
+		csl_memory_barrier();				// (the callback may be looking at cachesOutput())
+	}
+	mCacheOutput = whether;
+}
+
 void UnitGenerator::removeOutput(UnitGenerator * ugen) {
 	UGenVector::iterator pos;
 	for (pos = mOutputs.begin(); pos != mOutputs.end(); ++pos) {
@@ -674,12 +753,21 @@ void UnitGenerator::dump() {
 }
 
 // check for fan-out; if fanning out, copy previous buffer & return true
+// The fan-out lock is taken here and held until handleFanOut(), so that if several
+// threads pull me in the same block (see GraphExecutor), only the first one computes.
 
 bool UnitGenerator::checkFanOut(Buffer & outputBuffer) throw (CException) {
-	if (mNumOutputs > 1) {					// if we're doing auto-fan-out
+	outputBuffer.makeWritable();			// (I'm about to write into it)
+	if (outputBuffer.mSequence == 0)		// un-stamped buffer: assume it's for the current block
+		outputBuffer.mSequence = blockSequence();
+	if (cachesOutput()) {					// if we're doing auto-fan-out
+		if ( ! (mViewLocked && (& outputBuffer == mOutputCache)))
+			lockFanOut();					// (unless outputView() already holds it for this render)
 		if (outputBuffer.mSequence <= mSequence) {		// if we've already computed this seq #
 											// and block copy samples from the cache into the output
-			outputBuffer.copyOnlySamplesFrom(*mOutputCache);
+			if (& outputBuffer != mOutputCache)
+				outputBuffer.copyOnlySamplesFrom(*mOutputCache);
+			unlockFanOut();
 //			logMsg("UnitGenerator::checkFanOut");
 			return true;					// finished!
 		}
@@ -690,12 +778,52 @@ bool UnitGenerator::checkFanOut(Buffer & outputBuffer) throw (CException) {
 // if fanning out, store last output and set seq number
 
 void UnitGenerator::handleFanOut(Buffer & outputBuffer) throw (CException) {
-	if (mNumOutputs > 1)					// if we're doing auto-fan-out and this is the first time
-		mOutputCache->copySamplesFrom(outputBuffer);			// store it in the buffer
-	mSequence = csl_max(mSequence, outputBuffer.mSequence);		// remember my seq #
+	if (mFanOutLock) {						// if we're doing auto-fan-out and this is the first time
+		if (& outputBuffer != mOutputCache)	// store it in the buffer (unless we rendered into it)
+			mOutputCache->copySamplesFrom(outputBuffer);
+		mSequence = csl_max(mSequence, outputBuffer.mSequence);	// remember my seq #
+		unlockFanOut();
+	} else
+		mSequence = csl_max(mSequence, outputBuffer.mSequence);	// remember my seq #
 //	this->changed((void *) & outputBuffer);						// signal dependents (if any) of my change
 }
 
+// Cached output: the first reader of a block has me render straight into the cache;
+// the others read the cache itself (or copy it, if I'm not zero-copy). This works the same
+// whether or not my nextBuffer() does the fan-out handling, so a GraphExecutor can pre-render
+// any UGen this way. The fan-out lock is taken before the cache's header is
+// touched and held over the render (checkFanOut() and unlockFanOut() see mViewLocked and leave
+// it to me), so concurrent readers wait for the block; the cache isn't overwritten until the
+// next block.
+
+Buffer * UnitGenerator::outputView(unsigned numFrames, unsigned sequence) throw (CException) {
+	if (( ! cachesOutput()) || (mOutputCache == NULL) || (mOutputCache->mNumAlloc < numFrames))
+		return NULL;
+	if (sequence == 0)						// un-stamped: assume it's for the current block
+		sequence = blockSequence();
+	lockFanOut();
+	if (sequence > mSequence) {				// not yet rendered
+		mOutputCache->mNumFrames = numFrames;
+		mOutputCache->mMonoBufferByteSize = numFrames * sizeof(sample);
+		mOutputCache->mSequence = sequence;
+		mOutputCache->clearSilence();
+		mViewLocked = true;
+		try {
+			CSL_RT_UGEN_SCOPE(this);
+			CSL_PROFILE_SCOPE(this);
+			this->nextBuffer(* mOutputCache);
+		} catch (CException & ex) {
+			mViewLocked = false;
+			unlockFanOut();
+			throw;
+		}
+		mViewLocked = false;
+		mSequence = csl_max(mSequence, sequence);	// (in case my nextBuffer() doesn't handle fan-out)
+	}
+	unlockFanOut();
+	return mOutputCache;
+}
+
 //
 // Generic next buffer function: call the private (mono) version for each I/O channel;
 // copy or expand depending on the mCopyPolicy;
@@ -710,25 +838,44 @@ void UnitGenerator::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	logMsg("UnitGenerator::nextBuffer");
 #endif
 	if (checkFanOut(outputBuffer)) return;
-											// Copy the output buffer samples
-	switch (mCopyPolicy) {
-	default:
-	case kCopy:								// compute 1 channel and copy it
-		this->nextBuffer(outputBuffer, 0);	// this is where most of the work gets done in CSL
-		for (unsigned i = 1; i < numOutputChannels; i += mNumChannels)
-			memcpy (outputBuffer.buffer(i), buffer0, bufferByteSize);
-		break;
-	case kExpand:							// loop through the requested output channels
-		for (unsigned i = 0; i < numOutputChannels; i += mNumChannels)
-			nextBuffer(outputBuffer, i);	// call private nextBuffer per-channel
-		break;
-	case kIgnore:							// Only do as many channels as I have
-		this->nextBuffer(outputBuffer, 0);
-		break;
+	CSL_RT_UGEN_SCOPE(this);
+	CSL_PROFILE_SCOPE(this);
+	try {									// Copy the output buffer samples
+		switch (mCopyPolicy) {
+		default:
+		case kCopy:							// compute 1 channel and copy it
+			this->nextBuffer(outputBuffer, 0);	// this is where most of the work gets done in CSL
+			for (unsigned i = 1; i < numOutputChannels; i += mNumChannels) {
+				memcpy (outputBuffer.buffer(i), buffer0, bufferByteSize);
+				outputBuffer.setSilent(i, outputBuffer.isSilent(0));
+			}
+			break;
+		case kExpand:						// loop through the requested output channels
+			for (unsigned i = 0; i < numOutputChannels; i += mNumChannels)
+				nextBuffer(outputBuffer, i);	// call private nextBuffer per-channel
+			break;
+		case kIgnore:						// Only do as many channels as I have
+			this->nextBuffer(outputBuffer, 0);
+			break;
+		case kParallel:						// all the channels in one call
+			this->nextParallel(outputBuffer);
+			break;
+		}
+	} catch (CException & ex) {				// don't leave the fan-out lock held
+		if (mFanOutLock)
+			unlockFanOut();
+		throw;
 	}
 	handleFanOut(outputBuffer);				// process possible fan-out
 }
 
+// Default parallel version: call the mono nextBuffer per channel (as kExpand does)
+
+void UnitGenerator::nextParallel(Buffer & outputBuffer) throw (CException) {
+	for (unsigned i = 0; i < outputBuffer.mNumChannels; i += mNumChannels)
+		nextBuffer(outputBuffer, i);
+}
+
 // Generic private next buffer implementation; by default, just zero out the buffer
 
 void UnitGenerator::nextBuffer(Buffer & outputBuffer,  unsigned outBufNum) throw (CException) {
@@ -747,13 +894,19 @@ Port::Port() :
 				mBuffer(new Buffer(1, CGestalt::blockSize())),
 				mValue(0),
 				mValuePtr(& mValue),
-				mPtrIncrement(0) { }
+				mPtrIncrement(0),
+				mRampStep(0),
+				mIsRamped(false),
+				mLastValue(0) { }
 
 Port::Port(UnitGenerator * ug) :
 				mUGen(ug),
 				mBuffer(new Buffer(ug->numChannels(), CGestalt::blockSize())),
 				mValue(0),
-				mPtrIncrement(1) {
+				mPtrIncrement(1),
+				mRampStep(0),
+				mIsRamped(false),
+				mLastValue(0) {
 	mBuffer->allocateBuffers();
 	mValuePtr = mBuffer->buffer(0) - 1;		// set to -1 since nextValue does pre-increment
 }
@@ -763,7 +916,10 @@ Port::Port(float value) :
 				mBuffer(NULL),
 				mValue(value),
 				mValuePtr(& mValue),
-				mPtrIncrement(0) { }
+				mPtrIncrement(0),
+				mRampStep(0),
+				mIsRamped(false),
+				mLastValue(value) { }
 
 Port::~Port() {
 
@@ -815,6 +971,13 @@ void Port::dump() {
 //
 // Controllable implementation -- Grab the dynamic values for the scale and offset controls
 
+// Constructor clears the port slots
+
+Controllable::Controllable() : mInputs() {
+	for (unsigned i = 0; i < CSL_NUM_PORT_SLOTS; i++)
+		mPortSlots[i] = NULL;
+}
+
 ///< Destructor
 
  Controllable::~Controllable() {
@@ -843,14 +1006,62 @@ void Controllable::pullInput(Port * thePort, unsigned numFrames) throw (CExcepti
 	}
 	thePort->checkBuffer();
 	theBuffer->mNumFrames = numFrames;
+	theBuffer->mMonoBufferByteSize = numFrames * sizeof(sample);
+	theBuffer->mSequence = UnitGenerator::blockSequence();	// stamp the block's seq # (for fan-out)
 	theBuffer->mType = kSamples;
-	theBuffer->zeroBuffers();
-	
-	theUG->nextBuffer(* theBuffer);			//////// and ask the UGen for nextBuffer()
-	
+	CSL_RT_UGEN_SCOPE(theUG);
+	CSL_PROFILE_SCOPE(theUG);
+											// if the UGen caches its output, read the cache in place
+											// (or copy it)
+	Buffer * view = theUG->outputView(numFrames, theBuffer->mSequence);
+	if (view != NULL) {
+		if ( ! (theUG->zeroCopy() && theBuffer->viewOf(* view)))
+			theBuffer->copyOnlySamplesFrom(* view);
+	} else {
+		theBuffer->endView();
+		theBuffer->zeroBuffers();			// (all of them: the reader may have written into one
+		theBuffer->clearSilence();			// flagged silent); the producer flags what it leaves silent
+		theUG->nextBuffer(* theBuffer);		//////// and ask the UGen for nextBuffer()
+	}
 	theBuffer->mIsPopulated = true;
-	thePort->mValuePtr = (thePort->mBuffer->buffer(0)) - 1;
 	thePort->mValueIndex = 0;
+	if (theUG->evalRate() == kRampedRate)	// the ramp is written in place: copy-on-write
+		theBuffer->makeWritable();
+	SampleBuffer vals = theBuffer->buffer(0);
+	switch (theUG->evalRate()) {
+	case kControlRate:						// control-rate: hold the block's first value
+		thePort->mValue = vals[0];
+		thePort->mValuePtr = & thePort->mValue;
+		thePort->mPtrIncrement = 0;
+		thePort->mIsRamped = false;
+		break;
+	case kRampedRate: {						// ramped: interpolate from the last block's value
+		if (numFrames == 0)					// (an empty block has nothing to ramp to)
+			return;
+		float target = vals[numFrames - 1];	// to this block's final value (in place)
+		if ( ! thePort->mIsRamped)			// first time: start at the first value
+			thePort->mLastValue = vals[0];
+		float step = (target - thePort->mLastValue) / (float) numFrames;
+		float val = thePort->mLastValue;
+		for (unsigned i = 0; i < numFrames; i++) {
+			val += step;
+			vals[i] = val;
+		}
+		vals[numFrames - 1] = target;
+		theBuffer->setSilent(0, false);
+		thePort->mLastValue = target;
+		thePort->mRampStep = step;
+		thePort->mIsRamped = true;
+		thePort->mPtrIncrement = 1;
+		thePort->mValuePtr = vals - 1;
+		break;
+	}
+	default:								// audio-rate: walk the buffer
+		thePort->mPtrIncrement = 1;
+		thePort->mIsRamped = false;
+		thePort->mValuePtr = vals - 1;
+		break;
+	}
 }
 
 // Controllable implementation -- this version writes into the buffer you pass it
@@ -861,6 +1072,10 @@ void Controllable::pullInput(Port * thePort, Buffer & theBuffer) throw (CExcepti
 	UnitGenerator * theUG = thePort->mUGen;			// get its UGen
 	if (theUG == NULL)								// if it's a static variable
 		return;										// ignore it
+	CSL_RT_UGEN_SCOPE(theUG);
+	CSL_PROFILE_SCOPE(theUG);
+	theBuffer.makeWritable();
+	theBuffer.clearSilence();
 	theUG->nextBuffer(theBuffer);			///////// and ask the UGen for nextBuffer()
 	
 	theBuffer.mIsPopulated = true;
@@ -874,11 +1089,11 @@ void Controllable::addInput(CSL_MAP_KEY key, UnitGenerator & uGen) {
 #ifdef CSL_DEBUG
 	logMsg("Controllable::set input \"%d\" UGen", key);
 #endif
-	Port * thePort = mInputs[key];		// get the named port
+	Port * thePort = findPort(key);		// get the named port
 	if (thePort != 0) 					// if port found
 		delete thePort;
 	thePort = new Port(&uGen);
-	mInputs[key] = thePort;				// add it to the list of inputs
+	setPort(key, thePort);				// add it to the list of inputs
 	uGen.addOutput((UnitGenerator *) this);	// be sure to add me as an output of the other guy
 }
 
@@ -886,10 +1101,10 @@ void Controllable::addInput(CSL_MAP_KEY key, float value) {
 #ifdef CSL_DEBUG
 	logMsg("Controllable::set input \"%d\" to %g", key, value);
 #endif
-	Port * thePort = mInputs[key];		// get the named port
+	Port * thePort = findPort(key);		// get the named port
 	if (thePort == 0) {					// if no port found
 		thePort = new Port(value);
-		mInputs[key] = thePort;			// add it to the list of inputs
+		setPort(key, thePort);			// add it to the list of inputs
 	} else
 		thePort->mValue = value;
 }
@@ -897,7 +1112,24 @@ void Controllable::addInput(CSL_MAP_KEY key, float value) {
 // get a port
 
 Port * Controllable::getPort(CSL_MAP_KEY name) {
-	return(mInputs[name]);
+	return(port(name));
+}
+
+// look up a port in the map without adding an empty entry
+
+Port * Controllable::findPort(CSL_MAP_KEY name) {
+	PortMap::iterator pos = mInputs.find(name);
+	if (pos == mInputs.end())
+		return NULL;
+	return(pos->second);
+}
+
+// store a port in the map, and in its slot if the key is small
+
+void Controllable::setPort(CSL_MAP_KEY name, Port * thePort) {
+	mInputs[name] = thePort;
+	if (name < CSL_NUM_PORT_SLOTS)
+		mPortSlots[name] = thePort;
 }
 
 // Pretty-print the receiver
@@ -933,7 +1165,7 @@ void Controllable::dump() {
 // Phased implementation -- Constructors
 
 Phased::Phased() : Controllable(), mPhase(0.0f) {
-	mInputs[CSL_FREQUENCY] = new Port;
+	setPort(CSL_FREQUENCY, new Port);
 #ifdef CSL_DEBUG
 	logMsg("Phased::add freq input");
 #endif
@@ -968,8 +1200,8 @@ void Phased::setFrequency(float frequency) {
 // Scalable -- Constructors
 
 Scalable::Scalable() {
-	mInputs[CSL_SCALE] = new Port;
-	mInputs[CSL_OFFSET] = new Port;
+	setPort(CSL_SCALE, new Port);
+	setPort(CSL_OFFSET, new Port);
 #ifdef CSL_DEBUG
 	logMsg("Scalable::add null inputs");
 #endif
@@ -977,7 +1209,7 @@ Scalable::Scalable() {
 
 Scalable::Scalable(float scale) {
 	this->addInput(CSL_SCALE, scale);
-	mInputs[CSL_OFFSET] = new Port;
+	setPort(CSL_OFFSET, new Port);
 #ifdef CSL_DEBUG
 	logMsg("Scalable::add scale input");
 #endif
@@ -1046,10 +1278,10 @@ void Scalable::setOffset(float offset) {
 // trigger passed on here
 
 void Scalable::trigger() {
-	if (mInputs[CSL_SCALE])
-		mInputs[CSL_SCALE]->trigger();
-	if (mInputs[CSL_OFFSET])
-		mInputs[CSL_OFFSET]->trigger();
+	if (mPortSlots[CSL_SCALE])
+		mPortSlots[CSL_SCALE]->trigger();
+	if (mPortSlots[CSL_OFFSET])
+		mPortSlots[CSL_OFFSET]->trigger();
 }
 
 // answer whether scale = 1 & offset = 0
@@ -1066,6 +1298,7 @@ void Scalable::trigger() {
 
 Effect::Effect() : Controllable(), UnitGenerator() {
 	isInline = false;
+	mInputSilence = 0;
 //	mInputs[CSL_INPUT] = new Port;
 #ifdef CSL_DEBUG
 	logMsg("Effect::add null input");
@@ -1074,6 +1307,7 @@ Effect::Effect() : Controllable(), UnitGenerator() {
 
 Effect::Effect(UnitGenerator & input) : Controllable(), UnitGenerator() {
 	isInline = false;
+	mInputSilence = 0;
 	mNumChannels = input.numChannels();
 	this->addInput(CSL_INPUT, input);
 #ifdef CSL_DEBUG
@@ -1082,10 +1316,10 @@ Effect::Effect(UnitGenerator & input) : Controllable(), UnitGenerator() {
 }
 
 bool Effect::isActive() {
-	Port * iPort = mInputs[CSL_INPUT];
+	Port * iPort = mPortSlots[CSL_INPUT];
 	if (iPort)
 		return (iPort->isActive());
-	return true;			// subclasses might not use mInputs[CSL_INPUT]
+	return true;			// subclasses might not use mPortSlots[CSL_INPUT]
 }
 
 void Effect::setInput(UnitGenerator & input) {
@@ -1102,31 +1336,88 @@ void Effect::pullInput(Buffer & outputBuffer) throw (CException) {
 #ifdef CSL_DEBUG
 	logMsg("Effect::pullInput");
 #endif
-	if (isInline)			// if inline, just use the input pointer
+	if (isInline) {			// if inline, just use the input pointer (I'll write over it)
+		outputBuffer.makeWritable();
 		mInputPtr = outputBuffer.buffer(0);
-	else {
-		Port * iPort = mInputs[CSL_INPUT];
+	} else {
+		Port * iPort = mPortSlots[CSL_INPUT];
 							// else pull a buffer from my input
 		Controllable::pullInput(iPort, outputBuffer);
 		
 		mInputPtr = outputBuffer.buffer(0);
 	}
+	mInputSilence = outputBuffer.mSilentChannels;
+	outputBuffer.clearSilence();	// (I'll write my output over it)
 }
 
 void Effect::pullInput(unsigned numFrames) throw (CException) {
 #ifdef CSL_DEBUG
 	logMsg("Effect::pullInput");
 #endif
-	Port * iPort = mInputs[CSL_INPUT];
+	Port * iPort = mPortSlots[CSL_INPUT];
 	Controllable::pullInput(iPort, numFrames);
 	mInputPtr = iPort->mBuffer->buffer(0);
+	mInputSilence = iPort->mUGen ? iPort->mBuffer->mSilentChannels : 0;
+}
+
+// Sleeping: the quiet-block count is kept per block (on channel 0, which comes first); once it
+// reaches mSleepAfter, channels with silent input just get silence
+
+bool Effect::sleeping(Buffer & outputBuffer, unsigned outBufNum) {
+	if (outBufNum == 0) {
+		if (mBlockQuiet)
+			mQuietBlocks++;
+		else
+			mQuietBlocks = 0;
+		mBlockQuiet = true;
+	}
+	if (isAsleep() && inputIsSilent(outBufNum)) {
+		zeroBuffer(outputBuffer, outBufNum);
+		return true;
+	}
+	return false;
+}
+
+// A block is quiet if the input was silent and the output is below the silence level (a decayed
+// tail); the output itself is left alone (it isn't flagged silent, since it isn't all 0)
+
+void Effect::noteOutput(Buffer & outputBuffer, unsigned outBufNum) {
+	outputBuffer.setSilent(outBufNum, false);
+	if (inputIsSilent(outBufNum)) {
+		SampleBuffer out = outputBuffer.buffer(outBufNum);
+		unsigned numFrames = outputBuffer.mNumFrames;
+		unsigned i = 0;
+		while ((i < numFrames) && (fabsf(out[i]) < CSL_SILENCE_LEVEL))
+			i++;
+		if (i == numFrames)
+			return;
+	}
+	mBlockQuiet = false;
+}
+
+// For nextParallel(): the channels that have their own input (an inline effect works on channel 0)
+
+unsigned Effect::parallelChannels(Buffer & outputBuffer) {
+	Port * iPort = mPortSlots[CSL_INPUT];
+	if (isInline || (iPort == NULL) || (iPort->mUGen == NULL))
+		return 1;
+	return csl_max(csl_min(iPort->mUGen->numChannels(), outputBuffer.mNumChannels), 1u);
+}
+
+// Copy the computed channels into the rest of the output (as kCopy does with channel 0)
+
+void Effect::copyChannels(Buffer & outputBuffer, unsigned numDone) {
+	for (unsigned i = numDone; i < outputBuffer.mNumChannels; i++) {
+		memcpy(outputBuffer.buffer(i), outputBuffer.buffer(i % numDone), outputBuffer.mMonoBufferByteSize);
+		outputBuffer.setSilent(i, outputBuffer.isSilent(i % numDone));
+	}
 }
 
 ///< trigger passed on here
 
 void Effect::trigger() {
-	if (mInputs[CSL_INPUT])
-		mInputs[CSL_INPUT]->trigger();
+	if (mPortSlots[CSL_INPUT])
+		mPortSlots[CSL_INPUT]->trigger();
 }
 
 // FanOut methods
@@ -1152,7 +1443,7 @@ void FanOut::nextBuffer(Buffer & outputBuffer) throw (CException) {
 		mCurrent = 0;
 //		logMsg("	reset");
 	}						// Copy the output buffer samples
-	Buffer * buf = mInputs[CSL_INPUT]->mBuffer;
+	Buffer * buf = mPortSlots[CSL_INPUT]->mBuffer;
 	outputBuffer.copyOnlySamplesFrom(*buf);
 //	logMsg("FanOut %d", mCurrent);
 	mCurrent++;
@@ -1178,13 +1469,14 @@ void Splitter::nextBuffer(Buffer & outputBuffer) throw (CException) {
 		pullInput(outputBuffer.mNumFrames);
 		mCurrent = 0;
 	}
-	Buffer * buf = mInputs[CSL_INPUT]->mBuffer;
+	Buffer * buf = mPortSlots[CSL_INPUT]->mBuffer;
 	if (buf == 0) 
 		throw LogicError("Missing buffer in channel splitter");
 	unsigned bufferByteSize = outputBuffer.mMonoBufferByteSize;
 	SampleBuffer dest = outputBuffer.buffer(0);
 	SampleBuffer src = buf->buffer(mCurrent);
 	memcpy(dest, src, bufferByteSize);
+	outputBuffer.setSilent(0, buf->isSilent(mCurrent));
 	mCurrent++;
 }
 
@@ -1203,7 +1495,7 @@ void Joiner::addInput(UnitGenerator & in) {	///< add the argument to vector of i
 
 bool Joiner::isActive() {
 	for (unsigned i = 0; i < mNumChannels; i++) {
-		if (mInputs[i]->mUGen->isActive())
+		if (port(i)->mUGen->isActive())
 			return true;
 	}
 	return false;
@@ -1227,8 +1519,10 @@ void Joiner::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	for (unsigned i = 0; i < mNumChannels; i++) {
 						// put the mono in samples into 1 channel of the output
 		tempBuffer.setBuffer(0, outputBuffer.buffer(i));
+		tempBuffer.clearSilence();
 						// get a buffer of mono samples from one of the inputs
-		mInputs[i]->mUGen->nextBuffer(tempBuffer);
+		port(i)->mUGen->nextBuffer(tempBuffer);
+		outputBuffer.setSilent(i, tempBuffer.isSilent(0));
 	}
 }
 
@@ -1236,7 +1530,7 @@ void Joiner::nextBuffer(Buffer & outputBuffer) throw (CException) {
 
 void Joiner::trigger() {
 	for (unsigned i = 0; i < mNumChannels; i++)
-		mInputs[i]->trigger();
+		port(i)->trigger();
 }
 
 // Writeable implementation
@@ -1259,104 +1553,102 @@ void Seekable::reset() throw (CException) {		// reset-to-zero
 		throw IOError("Error seeking");
 }
 
+// Interleaver constructor seeds the 4 dither generators (xorshift state must not be 0)
+
+Interleaver::Interleaver() {
+	for (unsigned i = 0; i < 4; i++)
+		mDitherState[i] = 0x9e3779b9 * (i + 1);
+}
+
+#define CSL_INTERLEAVE_GROUP 16			// # of channels handed to the kernels at a time
+
+// The shared interleave: pass the channels to VectorOps in groups (so there's no pointer array
+// the size of the file), then zero the channels beyond the ones the output has
+
+void Interleaver::interleaveChannels(Buffer & output, unsigned * channelMap, void * samples, 
+			unsigned numFrames, unsigned numChannels, PCMFormat format, bool dither) {
+
+	unsigned numChannelsToInterleave = csl_min(output.mNumChannels, numChannels);
+	unsigned bytesPerSample = VectorOps::formatBytes(format);
+	SampleBuffer chans[CSL_INTERLEAVE_GROUP];
+
+	for (unsigned first = 0; first < numChannelsToInterleave; first += CSL_INTERLEAVE_GROUP) {
+		unsigned count = csl_min(numChannelsToInterleave - first, (unsigned) CSL_INTERLEAVE_GROUP);
+		for (unsigned i = 0; i < count; i++)
+			chans[i] = output.buffer(channelMap ? channelMap[first + i] : first + i);
+		VectorOps::interleave(chans, count, (char *) samples + first * bytesPerSample, numChannels,
+					numFrames, format, dither ? mDitherState : NULL);
+	}
+	if (numChannelsToInterleave < numChannels) {
+		unsigned frameBytes = numChannels * bytesPerSample;
+		unsigned beyondBytes = (numChannels - numChannelsToInterleave) * bytesPerSample;
+		char * beyond = (char *) samples + numChannelsToInterleave * bytesPerSample;
+		for (unsigned frame = 0; frame < numFrames; frame++, beyond += frameBytes)
+			memset(beyond, 0, beyondBytes);
+	}
+}
+
 // Interleave = copy from CSL-style Buffer object to an interleaved sample vector
 
 void Interleaver::interleave(Buffer & output, SampleBuffer samples, 
 			unsigned numFrames, unsigned numChannels) throw (CException) {
-
-	unsigned numOutputChannels = output.mNumChannels;
-	unsigned numChannelsToInterleave = csl_min(numOutputChannels, numChannels);
-	unsigned numChannelsBeyond = numChannels - numChannelsToInterleave;
-
-	for (unsigned frame = 0; frame < numFrames; frame++) {
-		for (unsigned channel = 0; channel < numChannelsToInterleave; channel++)
-			*samples++ = output.buffer(channel)[frame];
-		for (unsigned j = 0; j < numChannelsBeyond; j++)
-			*samples++ = 0;
-	}
+	interleaveChannels(output, NULL, samples, numFrames, numChannels, kPCMFloat32, false);
 }
 
-// Interleave, short * version
+// Interleave, short * version (clips, and rounds or dithers)
 
 void Interleaver::interleave(Buffer & output, short * samples, unsigned numFrames, 
-			unsigned numChannels) throw (CException) {
+			unsigned numChannels, bool dither) throw (CException) {
+	interleaveChannels(output, NULL, samples, numFrames, numChannels, kPCMInt16, dither);
+}
 
-	unsigned numOutputChannels = output.mNumChannels;
-	unsigned numChannelsToInterleave = csl_min(numOutputChannels, numChannels);
-	unsigned numChannelsBeyond = numChannels - numChannelsToInterleave;
-
-	for (unsigned frame = 0; frame < numFrames; frame++) {
-		for (unsigned channel = 0; channel < numChannelsToInterleave; channel++)
-			*samples++ = (short) ((output.buffer(channel)[frame]) * 32767.0);
-		for (unsigned j = 0; j < numChannelsBeyond; j++)
-			*samples++ = 0;
-	}
+// Interleave to any of the PCM formats
+
+void Interleaver::interleave(Buffer & output, void * samples, unsigned numFrames, 
+			unsigned numChannels, PCMFormat format, bool dither) throw (CException) {
+	interleaveChannels(output, NULL, samples, numFrames, numChannels, format, dither);
 }
 
 /// Remap = re-assign channels from the source buffer to the target while interleaving
 
 void Interleaver::interleaveAndRemap(Buffer & output, SampleBuffer samples, unsigned numFrames, 
 			unsigned numChannels, unsigned *channelMap) throw (CException) {
-
-	unsigned numOutputChannels = output.mNumChannels;
-	unsigned numChannelsToInterleave = csl_min(numOutputChannels, numChannels);
-	unsigned numChannelsBeyond = numChannels - numChannelsToInterleave;
-	unsigned *map = channelMap;
-
-	for (unsigned frame = 0; frame < numFrames; frame++) {
-		for (unsigned channel = 0; channel < numChannelsToInterleave; channel++)
-			*samples++ = output.buffer(map[channel])[frame];
-		for (unsigned j = 0; j < numChannelsBeyond; j++)
-			*samples++ = 0;
-	}
+	interleaveChannels(output, channelMap, samples, numFrames, numChannels, kPCMFloat32, false);
 }
 
 // De-interleave = copy from interleaved SampleBuffer to CSL Buffer object
 
 void Interleaver::deinterleave(Buffer & output, SampleBuffer samples, unsigned numFrames, 
 			unsigned numChannels) throw (CException) {
-
-	unsigned numOutputChannels = output.mNumChannels;
-	unsigned numChannelsToDeinterleave = csl_min(numOutputChannels, numChannels);
-	SampleBuffer currentOutputBuffer;
-	SampleBuffer inputBuffer;
-	unsigned i;
-
-	for (i = 0; i < numChannelsToDeinterleave; i++) {
-		currentOutputBuffer = output.buffer(i);
-		inputBuffer = samples + i;
-		for (unsigned j = 0; j < numFrames; j++, inputBuffer += numChannels) {
-			*currentOutputBuffer++ = *inputBuffer;
-		}
-	}
-	if (numOutputChannels > numChannelsToDeinterleave) {
-		for (i = numChannelsToDeinterleave; i < numOutputChannels; i++)
-			memset(output.buffer(i), 0, output.mMonoBufferByteSize);
-	}
+	deinterleave(output, (void *) samples, numFrames, numChannels, kPCMFloat32);
 }
 
 // De-interleave, short * version
 
 void Interleaver::deinterleave(Buffer & output, short * samples, unsigned numFrames, 
 			unsigned numChannels) throw (CException) {
+	deinterleave(output, (void *) samples, numFrames, numChannels, kPCMInt16);
+}
+
+// De-interleave from any of the PCM formats; zero the output channels the samples don't have
+
+void Interleaver::deinterleave(Buffer & output, void * samples, unsigned numFrames, 
+			unsigned numChannels, PCMFormat format) throw (CException) {
 
 	unsigned numOutputChannels = output.mNumChannels;
 	unsigned numChannelsToDeinterleave = csl_min(numOutputChannels, numChannels);
-	SampleBuffer currentOutputBuffer;
-	short * inputBuffer;
-	unsigned i;
-
-	for (i = 0; i < numChannelsToDeinterleave; i++) {
-		currentOutputBuffer = output.buffer(i);
-		inputBuffer = samples + i;
-		for (unsigned j = 0; j < numFrames; j++, inputBuffer += numChannels) {
-			*currentOutputBuffer++ = ((float )*inputBuffer) / 32767.0f;
-		}
-	}
-	if (numOutputChannels > numChannelsToDeinterleave) {
-		for (i = numChannelsToDeinterleave; i < numOutputChannels; i++)
-			memset(output.buffer(i), 0, output.mMonoBufferByteSize);
+	unsigned bytesPerSample = VectorOps::formatBytes(format);
+	SampleBuffer chans[CSL_INTERLEAVE_GROUP];
+
+	for (unsigned first = 0; first < numChannelsToDeinterleave; first += CSL_INTERLEAVE_GROUP) {
+		unsigned count = csl_min(numChannelsToDeinterleave - first, (unsigned) CSL_INTERLEAVE_GROUP);
+		for (unsigned i = 0; i < count; i++)
+			chans[i] = output.buffer(first + i);
+		VectorOps::deinterleave((char *) samples + first * bytesPerSample, numChannels, chans, count,
+					numFrames, format);
 	}
+	for (unsigned i = numChannelsToDeinterleave; i < numOutputChannels; i++)
+		memset(output.buffer(i), 0, output.mMonoBufferByteSize);
 }
 
 //////////////////////////// IO class methods /////////////////////////////////
@@ -1371,7 +1663,7 @@ vector < IODevice *> gIODevices;
 
 IO::IO(unsigned s_rate, unsigned b_size, int in_device, int out_device, 
 				unsigned in_chans, unsigned out_chans)
-		: mGraph(NULL), mNumFramesPlayed(0), mSequence(0), 
+		: mGraph(NULL), mExecutor(NULL), mNumFramesPlayed(0), mSequence(0), 
 		  mLoggingPeriod(CGestalt::loggingPeriod()),
 		  mNumInChannels(in_chans), mNumOutChannels(out_chans), 
 		  mNumRealInChannels(in_chans), mNumRealOutChannels(out_chans),
@@ -1383,19 +1675,32 @@ IO::IO(unsigned s_rate, unsigned b_size, int in_device, int out_device,
 
 void IO::setRoot(UnitGenerator & root) {
 	root.addOutput((UnitGenerator *) this);
+	if (mExecutor)							// (allocates the sub-graphs' caches)
+		mExecutor->prepare(root);
 	mGraph = & root;
 }
 
+// set the optional parallel executor, and prepare the graph for it
+
+void IO::setExecutor(GraphExecutor * exec) {
+	if (exec && mGraph)
+		exec->prepare(* mGraph);
+	mExecutor = exec;
+}
+
 void IO::clearRoot() {
 	if (mGraph != NULL)
 		mGraph->removeOutput((UnitGenerator *) this);
 	mGraph = NULL;
 }
 
-// increment and answer my seq #
+// increment and answer my seq #; the numbers are taken from a counter shared by all the IOs,
+// so a graph moved from one IO to another never sees a block # it has already rendered
+
+static AtomicCounter sNextSequence = 0;
 
 unsigned IO::getAndIncrementSequence() {
-	mSequence++;
+	mSequence = (unsigned) csl_atomic_add(& sNextSequence, 1) + 1;
 	return mSequence;
 }
 
@@ -1412,10 +1717,16 @@ void IO::pullInput(Buffer & outBuffer, SampleBuffer out) throw(CException) {
 //	unsigned numFrames = outBuffer.mNumFrames;
 //	unsigned numChans = outBuffer.mNumChannels;
 	
+	CSL_RT_CALLBACK_SCOPE();				// (a no-op unless CSL_RT_CHECK is defined)
 	if (mGraph) {
 		try {
 			outBuffer.mSequence = this->getAndIncrementSequence();
-			
+			UnitGenerator::setBlockSequence(outBuffer.mSequence);
+			if (mExecutor)						// pre-render independent subgraphs in parallel
+				mExecutor->prefetch(*mGraph, outBuffer);
+			CSL_RT_UGEN_SCOPE(mGraph);
+			CSL_PROFILE_SCOPE(mGraph);
+			outBuffer.clearSilence();
 			mGraph->nextBuffer(outBuffer);		////// call the graph's nextBuffer method //////
 			
 		} catch (CException ex) {
@@ -102,6 +102,22 @@ typedef enum {
 /// Note also that Buffers are *not* thread-safe; they hand out pointers (sample*)
 /// that are assumed to be volatile.
 ///
+/// allocateBuffers() takes a single planar block for all channels from the BufferArena; each
+/// channel starts on a 64-byte boundary. copyFrom() passes the block along with the channel
+/// pointers, so whichever buffer ends up with mDidIAllocateBuffers set frees it.
+///
+/// A buffer with its own block can also be a read-only view onto another buffer's samples
+/// (viewOf()); this is how fanned-out UGens hand their cached output to their port readers.
+/// Anything that writes into such a buffer calls makeWritable() first (copy-on-write), or endView()
+/// if it overwrites all of it: the zeroing and copying methods, zeroBuffer(), checkFanOut() and the
+/// in-place (inline) Effects do this, so a view's source is never written through it.
+///
+/// Each channel also has a silence flag (mSilentChannels): the producer of a block sets it when it
+/// knows the channel holds only zeros (e.g., an envelope that's done, or a filter whose input and
+/// output have died away), so readers can skip their work on it. The flags are cleared before
+/// each pull, and only set by the producer that zeroed the channel; code that writes into a
+/// channel that's flagged silent must clear its flag. Channels past the 64th are never flagged.
+///
 
 class Buffer {
 public:									/// Constructor: default is mono and default-size
@@ -121,6 +137,8 @@ public:									/// Constructor: default is mono and default-size
 	bool mDidIAllocateBuffers;			///< who allocated my data buffers?
 	bool mIsPopulated;					///< does the buffer have data?
 	bool mAreBuffersZero;				///< have the buffers been zeroed out?
+	bool mIsView;						///< do my channels point at another buffer's samples (read-only)?
+	unsigned long long mSilentChannels;	///< bit mask of the channels known to hold only zeros
 	BufferContentType mType;			///< Data type flag
 										/// set the internal size variables (no buffer allocation takes place)
 	void setSize(unsigned numChannels, unsigned numFrames);
@@ -130,10 +148,20 @@ public:									/// Constructor: default is mono and default-size
 	void checkBuffers() throw (MemoryError);	///< allocate if not already there
 	void allocateBuffers() throw (MemoryError);	///< fcn to malloc storage buffers
 	void freeBuffers();							///< fcn to free them
+												/// use the given (shared, aligned) block for my channels
+	void shareStorage(SampleBuffer storage) throw (MemoryError);
+	bool viewOf(Buffer & src);					///< point my channels at src's samples (no copy); answer success
+	void endView();								///< point my channels back at my own storage (no copy)
+	void makeWritable();						///< copy-on-write: if I'm a view, copy the samples to my storage
 	bool canStore(unsigned numFrames);			///< answer whether the recevei can store numFrames more frames
 
-	void zeroBuffers();							///< fill all data with 0
+	void zeroBuffers();							///< fill all data with 0 (this doesn't set the silence flags)
 	void fillWith(sample value);				///< fill data with the given value
+												/// silence flags: is the channel known to hold only zeros?
+	bool isSilent(unsigned ch) { return (ch < 64) && ((mSilentChannels >> ch) & 1); };
+	bool isSilent();							///< are all my channels known to be silent?
+	void setSilent(unsigned ch, bool whether = true);	///< set/clear a channel's flag
+	void clearSilence() { mSilentChannels = 0; };		///< clear all the flags
 												// import data from the given buffer
 	void copyFrom(Buffer & src) throw (RunTimeError);			
 	void copyHeaderFrom(Buffer & source) throw (RunTimeError);	///< copy the "header" fields of a buffer
@@ -178,7 +206,8 @@ public:									/// Constructor: default is mono and default-size
 
 protected:
 	SampleBufferVector mBuffers;		///< the storage vector -- pointers to (SampleBuffer) buffers
-
+	SampleBuffer mStorage;				///< the contiguous block the channels live in (from the BufferArena)
+	unsigned mStorageSize;				///< and its size in bytes
 };
 
 ///
@@ -209,16 +238,37 @@ public:
 typedef enum {
 	kCopy,				///< compute 1 channel and copy
 	kExpand,			///< call monoNextBuffer multiple times
-	kIgnore				///< ignore extra buffer channels
+	kIgnore,			///< ignore extra buffer channels
+	kParallel			///< compute all the channels in one call (nextParallel())
 } BufferCopyPolicy;
 #else
 	#define kCopy 0
 	#define kExpand 1
 	#define kIgnore 2
+	#define kParallel 3
 	typedef int BufferCopyPolicy;
 #endif
 
+///
+/// UnitGenerator evaluation rate flags; a control-rate UGen is still computed a block at a time,
+/// but the Port that reads it only passes on one value per block (or a linear ramp between them)
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kAudioRate,			///< one value per sample (the default)
+	kControlRate,		///< one value per block (step)
+	kRampedRate			///< one value per block, linearly interpolated
+} EvalRate;
+#else
+	#define kAudioRate 0
+	#define kControlRate 1
+	#define kRampedRate 2
+	typedef int EvalRate;
+#endif
+
 class RingBuffer; 	///< forward declaration
+class GraphExecutor;	///< forward declaration
 
 //-------------------------------------------------------------------------------------------------//
 ///
@@ -254,6 +304,10 @@ public:
 	BufferCopyPolicy copyPolicy() { return mCopyPolicy; };		///< get/set the receiver's buffer copy policy
 	void setCopyPolicy(BufferCopyPolicy ch) { mCopyPolicy = ch; }
 
+	EvalRate evalRate() { return mEvalRate; };					///< get/set the rate at which my readers see me
+	void setEvalRate(EvalRate rate) { mEvalRate = rate; }
+	void setControlRate(bool ramped = false) { mEvalRate = ramped ? kRampedRate : kControlRate; }
+
 //	string name() { return mName; };							///< get/set the receiver's name string
 //	void setName(char * ch) { mName = string(ch); }
 //	void setName(string ch) { mName = ch; }
@@ -266,6 +320,10 @@ public:
 									/// this is called by nextBuffer, possibly multiple times
 	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
 
+									/// compute all the channels at once (for kParallel, e.g., in SIMD
+									/// lanes with shared controls); the default does what kExpand does
+	virtual void nextParallel(Buffer & outputBuffer) throw (CException);
+
 									/// query whether I'm fixed (StaticVariable overrides this)
 	virtual bool isFixed() { return false; };
 									/// query whether I'm currently active (Envelopes can go inactive)
@@ -278,6 +336,35 @@ public:
 									/// check for fan-out and copy previous buffer; return true if fanning out
 	bool checkFanOut(Buffer & outputBuffer) throw (CException);
 	void handleFanOut(Buffer & outputBuffer) throw (CException);
+									/// keep each block in the output cache even with 1 output, so that
+									/// later pulls with the same sequence # are served from the cache
+									/// (used by the GraphExecutor to pre-render subgraphs)
+	void setCacheOutput(bool whether);
+	bool cachesOutput() { return (mNumOutputs > 1) || mCacheOutput; };
+									/// answer my output cache holding the given block (rendering into it
+									/// for the first reader), to be used read-only, or NULL if not cached
+	Buffer * outputView(unsigned numFrames, unsigned sequence) throw (CException);
+									/// get/set whether my readers' port buffers may be views onto my
+									/// output cache, rather than copies (zero-copy fan-out; on by default)
+	bool zeroCopy() { return mZeroCopy; };
+	void setZeroCopy(bool whether) { mZeroCopy = whether; };
+									/// append (up to maxInputs of) the inputs that can be rendered
+									/// independently of each other (e.g., the sources of a mixer or
+									/// panner) to the given vector
+	virtual void parallelInputs(UGenVector & inputs, unsigned maxInputs) { };
+									/// answer whether I read my inputs' port buffers after my nextBuffer()
+									/// returns (so a BufferPlan mustn't share them)
+	virtual bool keepsInputs() { return false; };
+									/// get/set the sequence # of the block the calling thread is computing;
+									/// port buffers are stamped with this so that fan-out works below
+									/// control inputs
+	static unsigned blockSequence();
+	static void setBlockSequence(unsigned seq);
+									/// get/set the # of blocks with silent input and output after which
+									/// I stop computing and just answer silence (0 = never); see Effect
+	unsigned sleepAfter() { return mSleepAfter; };
+	void setSleepAfter(unsigned blocks) { mSleepAfter = blocks; mQuietBlocks = 0; };
+	bool isAsleep() { return (mSleepAfter > 0) && (mQuietBlocks >= mSleepAfter); };
 
 									/// set/get the value (not allowed in the abstract, useful for static values)
 	virtual void setValue(sample theValue) { throw LogicError("can't set value of a generator"); };
@@ -290,13 +377,24 @@ protected:				// My data members
 	unsigned mFrameRate;			///< the frame rate -- initialized to be the default by the constructor
 	unsigned mNumChannels;			///< my "expected" number of output channels
 	BufferCopyPolicy mCopyPolicy;	///< the policy I use if asked for more or fewer channels
+	EvalRate mEvalRate;				///< audio, control or ramped-control rate
 	UGenVector mOutputs;			///< the vector of my output UGens
 	unsigned mNumOutputs;			///< the number of outputs
 	Buffer * mOutputCache;			///< my past output ring buffer (only used in case of fan-out)
 	unsigned mSequence;				///< the highest-seen buffer seq number
+	bool mCacheOutput;				///< whether to cache my output even without fan-out
+	bool mZeroCopy;					///< whether readers may share my output cache instead of copying it
+	AtomicCounter mFanOutLock;		///< spin-lock held while computing a fanned-out block
+	bool mViewLocked;				///< whether outputView() holds the lock (while it renders into the cache)
+	unsigned mSleepAfter;			///< # of quiet blocks before I sleep (0 = never)
+	unsigned mQuietBlocks;			///< # of quiet blocks in a row so far
+	bool mBlockQuiet;				///< has the current block been quiet so far?
 //	string mName;					///< my name (used for editors)
-									/// utility method to zero out an outputBuffer
+									/// utility method to zero out an outputBuffer channel (and flag it silent)
 	void zeroBuffer(Buffer & outputBuffer, unsigned outBufNum);
+									/// lock/unlock the fan-out cache (needed if several threads pull me)
+	inline void lockFanOut() { while ( ! csl_atomic_cas(& mFanOutLock, 0, 1)) { } };
+	inline void unlockFanOut() { if ( ! mViewLocked) { csl_memory_barrier(); mFanOutLock = 0; } };
 };
 
 //-------------------------------------------------------------------------------------------------//
@@ -322,6 +420,9 @@ public:
 	float *mValuePtr;					///< my value's address (const or buffer pointer)
 	unsigned mPtrIncrement;				///< the inter-sample ptr increment (0 for const, 1 for dynamic)
 	unsigned mValueIndex;				///< my index (into the UGen's buffer)
+	float mRampStep;					///< the per-sample increment if I'm a ramped control-rate input
+	bool mIsRamped;						///< whether I'm a ramped control-rate input
+	float mLastValue;					///< the previous block's control value (for ramping)
 
 	void checkBuffer() throw (LogicError);	///< check the port's buffer and allocate it if needed
 	inline float nextValue();				///< answer the next value (dynamic or constant)
@@ -331,6 +432,12 @@ public:
 	virtual bool isActive();			///< answer whether I'm active
 	void dump();						///< pretty-print the receiver
 	bool isFixed() { return (mPtrIncrement == 0); };			///< am I fixed or dynamic
+													/// am I constant or a linear ramp over this block?
+	bool isLinear() { return (mPtrIncrement == 0) || mIsRamped; };
+	float rampStep() { return mIsRamped ? mRampStep : 0.0f; };	///< the per-sample increment (0 if fixed)
+													/// is my value 0 throughout this block (a fixed 0 or a
+													/// UGen whose buffer is flagged silent)?
+	bool isSilent() { return mUGen ? (mBuffer && mBuffer->isSilent(0)) : (mValue == 0.0f); };
 	virtual void trigger() { if (mUGen) mUGen->trigger(); };	///< trigger passed on here
 
 };
@@ -366,15 +473,29 @@ inline bool Port::isReady() {
 /// offset in the case of an oscillator that supports AM and FM.
 /// The pullInput() message is used to call the nextBuffer() method of a given port.
 ///
+/// Ports with small integer keys (the CSL_SCALE, CSL_FREQUENCY, etc. defaults) are also kept in
+/// a fixed slot array, so the per-block lookups in the DECLARE_*_CONTROLS macros are a single
+/// indexed load rather than a map search. The map stays the master list (for construction,
+/// getPort(), dump(), and the destructor); use setPort() or addInput() to change it.
+///
 
 class Controllable {
 public:
-	Controllable() : mInputs() { };			///< Constructor takes no arguments
+	Controllable();							///< Constructor takes no arguments
 	virtual ~Controllable();				///< Destructor (remove the output links of the ports)
 
 	Port * getPort(CSL_MAP_KEY name);
+	PortMap & inputs() { return mInputs; };	///< answer the port map (for graph walkers)
+											/// fast port accessor (slot array for small keys)
+	inline Port * port(CSL_MAP_KEY name) {
+		return (name < CSL_NUM_PORT_SLOTS) ? mPortSlots[name] : findPort(name);
+	};
 protected:
 	PortMap mInputs;						///< the map of my inputs or controls (used by the mix-in classes)
+	Port * mPortSlots[CSL_NUM_PORT_SLOTS];	///< the same ports indexed by key (for keys < CSL_NUM_PORT_SLOTS)
+
+	void setPort(CSL_MAP_KEY name, Port * thePort);	///< store a port in the map and the slot array
+	Port * findPort(CSL_MAP_KEY name);		///< look up a port in the map (w/o adding an entry)
 
 											/// Plug in a unit generator to the named input slot
 	void addInput(CSL_MAP_KEY name, UnitGenerator & ugen);
@@ -426,8 +547,8 @@ public:
 /// Declare the pointer to scale/offset buffers (if used) and current scale/offset values
 
 #define DECLARE_SCALABLE_CONTROLS							\
-	Port * scalePort = mInputs[CSL_SCALE];					\
-	Port * offsetPort = mInputs[CSL_OFFSET];				\
+	Port * scalePort = mPortSlots[CSL_SCALE];				\
+	Port * offsetPort = mPortSlots[CSL_OFFSET];				\
 	float scaleValue, offsetValue
 
 /// Load the scale/offset-related values at the start
@@ -454,6 +575,27 @@ public:
 	(scalePort->isFixed()) && (offsetPort->isFixed()) &&	\
 		(scaleValue == 1.0) && (offsetValue == 0.0)
 
+/// Rate-specialized versions: if the scale and offset are fixed, control-rate or ramped
+/// (i.e., linear over the block), the loop can step the values itself rather than
+/// reading them from the ports; declare the steps after LOAD_SCALABLE_CONTROLS
+
+#define IS_LINEAR_SCALABLE									\
+	(scalePort->isLinear() && offsetPort->isLinear())
+
+#define DECLARE_SCALABLE_RAMPS								\
+	float scaleStep = scalePort->rampStep();				\
+	float offsetStep = offsetPort->rampStep()
+
+#define UPDATE_SCALABLE_RAMPS								\
+	scaleValue += scaleStep;								\
+	offsetValue += offsetStep
+
+/// The output is silent whatever the signal if the scale is silent and the offset is a fixed 0;
+/// generators can then just zero (and flag) their output (use after LOAD_SCALABLE_CONTROLS)
+
+#define IS_SCALED_TO_SILENCE								\
+	(scalePort->isSilent() && offsetPort->isFixed() && (offsetValue == 0.0f))
+
 
 //-------------------------------------------------------------------------------------------------//
 ///
@@ -461,6 +603,11 @@ public:
 ///
 /// Note that this always uses a separate buffer for the input.
 ///
+/// Effects with state (filters, reverbs) call sleeping() after pulling their input and noteOutput()
+/// after their DSP loop: once the input has been silent and the output below CSL_SILENCE_LEVEL for
+/// sleepAfter() blocks, they skip the loop and answer flagged silence until the input comes back.
+/// (The output of a quiet block is left as it is; only sleeping replaces the tail with silence.)
+///
 
 class Effect : public UnitGenerator, public virtual Controllable {
 public:
@@ -476,12 +623,26 @@ public:
 	
 protected:
 	SampleBuffer mInputPtr;						///< A pointer to my input's data.
+	unsigned long long mInputSilence;			///< the silence flags of my input's last buffer
 												/// method to read the input value
 	void pullInput(Buffer & outputBuffer) throw (CException);
 	void pullInput(unsigned numFrames) throw (CException);
+												/// answer whether my input's channel was silent
+	bool inputIsSilent(unsigned ch) { return (ch < 64) && ((mInputSilence >> ch) & 1); };
+												/// call after pulling the input: if I'm asleep and the
+												/// input channel is silent, write silence and answer true
+	bool sleeping(Buffer & outputBuffer, unsigned outBufNum);
+												/// call after writing the output: note whether the block
+												/// was quiet (silent input, output below CSL_SILENCE_LEVEL)
+	void noteOutput(Buffer & outputBuffer, unsigned outBufNum);
+												/// for nextParallel(): answer how many of the output's
+												/// channels have their own input channel (at least 1)
+	unsigned parallelChannels(Buffer & outputBuffer);
+												/// and copy the first numDone channels into the rest
+	void copyChannels(Buffer & outputBuffer, unsigned numDone);
 	virtual void trigger();						///< trigger passed on here
 												/// get the input port
-	inline Port * inPort() { return mInputs[CSL_INPUT]; };
+	inline Port * inPort() { return mPortSlots[CSL_INPUT]; };
 };
 
 //-------------------------------------------------------------------------------------------------//
@@ -514,10 +675,10 @@ protected:
 /// i.e., the number of frames to compute must be named "numFrames."
 /// Use this: 	unsigned numFrames = outputBuffer.mNumFrames;
 
-/// Declare the frequency port (accessing the mInputs map) and current value.
+/// Declare the frequency port (from the port slot array) and current value.
 
 #define DECLARE_PHASED_CONTROLS								\
-	Port * freqPort = mInputs[CSL_FREQUENCY];				\
+	Port * freqPort = mPortSlots[CSL_FREQUENCY];			\
 	float freqValue
 
 /// Load the freq-related values at the start of the callback; if the frequency is a dynamic UGen input,
@@ -537,6 +698,17 @@ protected:
 	if (freqPort)											\
 		freqValue = freqPort->nextValue()
 
+/// Rate-specialized versions for fixed, control-rate or ramped frequency inputs
+
+#define IS_LINEAR_PHASED									\
+	(freqPort->isLinear())
+
+#define DECLARE_PHASED_RAMPS								\
+	float freqStep = freqPort->rampStep()
+
+#define UPDATE_PHASED_RAMPS									\
+	freqValue += freqStep
+
 //-------------------------------------------------------------------------------------------------//
 ///
 /// Writeable -- a mix-in for buffers and streams that one can write to
@@ -618,6 +790,7 @@ public:
 
 	virtual void nextBuffer(Buffer & outputBuffer) throw(CException);
 	virtual void nextBuffer(Buffer & outputBuffer,  unsigned outBufNum) throw(CException);
+	bool keepsInputs() { return true; };	///< (the input is pulled once for all the taps)
 
 protected:
 	Buffer mBuffer;			///< my temp buffer
@@ -663,19 +836,45 @@ protected:
 //	UGenVector mInputs;						///< my vector of inputs
 };
 
+///
+/// Sample formats for interleaved buffers (int24 is packed 3-byte little-endian)
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kPCMFloat32 = 0,			///< native floats (-1.0 to 1.0)
+	kPCMInt16,					///< shorts
+	kPCMInt24,					///< packed 3-byte ints
+	kPCMInt32					///< ints
+} PCMFormat;
+#else
+	#define kPCMFloat32 0
+	#define kPCMInt16 1
+	#define kPCMInt24 2
+	#define kPCMInt32 3
+	typedef int PCMFormat;
+#endif
+
 ///
 /// Interleaver handles copying interleaved sample buffers (like sound files and inter-process sockets)
 /// to/from non-interleaved CSL-style Buffer objects.
+/// The copies use the SIMD transposition kernels in VectorOps, and the integer versions convert
+/// (with clipping and optional TPDF dither) in the same pass.
 ///
 
 class Interleaver {
 
 public:
+	Interleaver();	///< Constructor seeds the dither generator
+
 					/// Interleave = copy from CSL-style Buffer object to an interleaved sample vector
 	void interleave(Buffer & output, SampleBuffer samples, unsigned numFrames, 
 					unsigned numChannels) throw (CException);
 	void interleave(Buffer & output, short * samples, unsigned numFrames, 
-					unsigned numChannels) throw (CException);
+					unsigned numChannels, bool dither = false) throw (CException);
+					/// Interleave and convert to the given format (dither = add TPDF noise of +-1 LSB)
+	void interleave(Buffer & output, void * samples, unsigned numFrames, 
+					unsigned numChannels, PCMFormat format, bool dither = false) throw (CException);
 
 					/// Interleave = copy from CSL-style Buffer object to an interleaved sample vector
 					/// Remap = re-assign channels from the source buffer to the target while interleaving
@@ -687,6 +886,16 @@ public:
 					unsigned numChannels) throw (CException);
 	void deinterleave(Buffer & output, short * samples, unsigned numFrames, 
 					unsigned numChannels) throw (CException);
+					/// De-interleave from the given format
+	void deinterleave(Buffer & output, void * samples, unsigned numFrames, 
+					unsigned numChannels, PCMFormat format) throw (CException);
+
+protected:
+	unsigned mDitherState[4];		///< xorshift generator state (one per SIMD lane)
+	
+					/// the shared implementation (channelMap may be NULL)
+	void interleaveChannels(Buffer & output, unsigned * channelMap, void * samples, unsigned numFrames, 
+					unsigned numChannels, PCMFormat format, bool dither);
 };
 
 //-------------------------------------------------------------------------------------------------//
@@ -769,6 +978,9 @@ public:
 	virtual Buffer & getInput() throw(CException);	///< Get the current input from the sound card
 	virtual Buffer & getInput(unsigned numFrames, unsigned numChannels) throw(CException);
 	unsigned getAndIncrementSequence();		///< increment and answer my seq #
+												/// set/clear the multi-threaded executor used to
+												/// pre-render independent subgraphs (NULL = serial)
+	void setExecutor(GraphExecutor * exec);
 
 							// Data members
 	UnitGenerator * mGraph;					///< the root of my client DSP graph, often a mixer or panner
@@ -776,6 +988,7 @@ public:
 	Buffer mOutputBuffer;					///< the output buffer I use (passed to nextBuffer calls)
 	SampleBuffer mInputPointer;				///< the buffer for holding the sound card input (if open)
 	unsigned * mChannelMap;					///< the output channel remapping array
+	GraphExecutor * mExecutor;				///< the optional parallel graph executor
 
 	unsigned mNumFramesPlayed;  			///< counter of frames I've played
 	unsigned mSequence;						///< sequence counter
@@ -22,6 +22,7 @@
 
 #include <exception>		// Standard C++ exception library
 #include <string>	
+#include "CSL_Types.h"		// for CSL_RT_CHECK_CALL
 
 namespace csl {
 
@@ -51,7 +52,9 @@ typedef enum {
 class CException : public std::exception {
 public:
 	string mMessage;
-	CException(const string & msg) throw() : mMessage(msg) { };
+	CException(const string & msg) throw() : mMessage(msg) { 
+		CSL_RT_CHECK_CALL(kRTException, "CException");
+	};
 	~CException() throw() { };
 	const char * what() { return mMessage.c_str(); };
 };
@@ -81,6 +81,9 @@
 #define CSL_ENUMS				// define this to use the various enumerations (which are problematic with SWIG)
 // #define CSL_DEBUG			// define this for very verbose debugging of constructors and call-backs
 // #define CSL_DSP_BUFFER		// define this for Buffer Sample Processing (feature extraction)
+// #define CSL_RT_CHECK			// define this to flag allocation, locks, sleeps, exceptions and I/O
+								// in the audio callback (debugging; see RealTimeCheck.h)
+// #define CSL_PROFILE			// define this to time each UGen call (see UGenProfiler.h)
 // #define USE_JUCE				// use JUCE for all IO (now set as a compile-time flag)
 
 ////
@@ -106,6 +109,9 @@
 
 #define DEFAULT_WTABLE_SIZE CGestalt::maxBufferFrames()	///< size of wavetables, or use blockSize?
 
+#define CSL_SILENCE_LEVEL 1.0e-6f			///< peak level below which an effect's output counts as silent (-120 dB)
+#define CSL_SLEEP_BLOCKS 4					///< # of silent blocks before an effect with silent input sleeps
+
 #define CSL_mVerbosity 3					///< very verbose logging
 #define CSL_mLoggingPeriod 10				///< log CPU usage every N sec
 
@@ -279,6 +285,8 @@ typedef struct {
 #define	CSL_FILTER_AMOUNT 11
 #define CSL_RATE 12
 
+#define CSL_NUM_PORT_SLOTS 16	///< keys below this are also kept in a Controllable's port slot array
+
 
 ////
 //// Min/max, Boolean, statistics macros
@@ -358,6 +366,64 @@ typedef struct {
 
 #endif // CSL_WINDOWS
 
+///
+/// Atomic integer operations (used by the parallel graph executor and fan-out locks)
+///		csl_atomic_add(ptr, val) -- add val to *ptr, answer the *prior* value
+///		csl_atomic_cas(ptr, old, new) -- if (*ptr == old) *ptr = new; answer whether it was swapped
+///		csl_memory_barrier() -- full read/write fence
+///
+
+#ifdef CSL_WINDOWS
+	#define csl_atomic_add(ptr, val)		InterlockedExchangeAdd((volatile long *) (ptr), (long) (val))
+	#define csl_atomic_cas(ptr, old, nval)	\
+		(InterlockedCompareExchange((volatile long *) (ptr), (long) (nval), (long) (old)) == (long) (old))
+	#define csl_memory_barrier()			MemoryBarrier()
+#else
+	#define csl_atomic_add(ptr, val)		__sync_fetch_and_add((ptr), (val))
+	#define csl_atomic_cas(ptr, old, nval)	__sync_bool_compare_and_swap((ptr), (old), (nval))
+	#define csl_memory_barrier()			__sync_synchronize()
+#endif
+
+typedef volatile long AtomicCounter;			///< an integer for use with the atomic macros
+
+#ifdef CSL_WINDOWS								///< storage class for per-thread variables
+	#define CSL_THREAD_LOCAL __declspec(thread)
+#else
+	#define CSL_THREAD_LOCAL __thread
+#endif
+
+///
+/// Real-time safety hooks: the calls that mustn't happen in the audio callback report themselves
+/// with CSL_RT_CHECK_CALL(kind, "what"); this compiles to nothing unless CSL_RT_CHECK is defined.
+/// See RealTimeCheck.h for the checker.
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kRTAllocation = 0,			///< heap allocation or free
+	kRTLock,					///< mutex lock or condition wait
+	kRTSleep,					///< sleeping
+	kRTException,				///< throwing a CException
+	kRTBlockingIO				///< logging, file or socket I/O
+} RTViolation;
+#else
+	#define kRTAllocation 0
+	#define kRTLock 1
+	#define kRTSleep 2
+	#define kRTException 3
+	#define kRTBlockingIO 4
+	typedef int RTViolation;
+#endif
+
+#define CSL_NUM_RT_VIOLATIONS 5
+
+#ifdef CSL_RT_CHECK
+	void rtCheckCall(RTViolation kind, const char * what);	///< report the call if we're in the callback
+	#define CSL_RT_CHECK_CALL(kind, what)	csl::rtCheckCall(kind, what)
+#else
+	#define CSL_RT_CHECK_CALL(kind, what)
+#endif
+
 } // end of namespace
 
 #endif // _CSLTypes_H
@@ -43,7 +43,7 @@ bool BinaryOp::isFixed() {
 // Set the operand from a fixed float
 
 void BinaryOp::setOperand(float op) {
-	Port * opPort = mInputs[CSL_OPERAND];
+	Port * opPort = mPortSlots[CSL_OPERAND];
 	if (opPort->mUGen != 0)
 		throw RunTimeError("Can't set value of UGen port");
 	opPort->mValue = op;
@@ -55,7 +55,7 @@ void BinaryOp::dump() {
 	fprintf(stderr, "BinaryOp left: ");
 	Effect::inPort()->dump();
 	fprintf(stderr, "right: ");
-	mInputs[CSL_OPERAND]->dump();
+	mPortSlots[CSL_OPERAND]->dump();
 	fprintf(stderr, "\n");
 }
 
@@ -76,6 +76,10 @@ void AddOp::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExcept
 	unsigned numFrames = outputBuffer.mNumFrames;
 	DECLARE_OPERAND_CONTROLS;						// Declare and load the operand
 	LOAD_OPERAND_CONTROLS;
+	if (inputIsSilent(0) && opPort->isSilent()) {	// 0 + 0
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
 	for (unsigned i = 0; i < numFrames; i++) {
 		*outputBufferPtr++ = *inValue + opValue;		// Do the actual add
 		UPDATE_OPERAND_CONTROLS;					// Update both the operand
@@ -97,7 +101,10 @@ void MulOp::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExcept
 	unsigned numFrames = outputBuffer.mNumFrames;
 	DECLARE_OPERAND_CONTROLS;							// Declare and load the operand
 	LOAD_OPERAND_CONTROLS;
-
+	if (inputIsSilent(0) || opPort->isSilent()) {		// anything times 0
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
 	for (unsigned i = 0; i < numFrames; i++) {
 		*outputBufferPtr++ = * inValue * opValue;			// Do the actual multiply
 		UPDATE_OPERAND_CONTROLS;						// Update both the operand
@@ -53,13 +53,13 @@ inline bool BinaryOp::inputIsFixed() {
 }
 
 inline bool BinaryOp::operandIsFixed() {
-	return mInputs[CSL_OPERAND]->isFixed();
+	return mPortSlots[CSL_OPERAND]->isFixed();
 }
 
 /// Declare the operand port (accessing the mInputs map) and current value.
 
 #define DECLARE_OPERAND_CONTROLS						\
-	Port * opPort = mInputs[CSL_OPERAND];				\
+	Port * opPort = mPortSlots[CSL_OPERAND];			\
 	SampleBuffer inValue;								\
 	sample opValue
 
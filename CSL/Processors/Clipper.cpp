@@ -4,15 +4,21 @@
 //
 
 #include "Clipper.h"
+#include "VectorOps.h"
 #include <math.h>
+#include <float.h>
 
 using namespace csl;
 
 // Generic Clipper implementation
 
 // Constructor takes the input UGen and optionally the flags, min and max.
+// With a multichannel input, all the channels are clipped in one call (see nextParallel())
+
 Clipper::Clipper(UnitGenerator & input, float min, float max, ClipperFlags flags)
-				: Effect(input), mFlags(flags), mMin(min), mMax(max) { }
+				: Effect(input), mFlags(flags), mMin(min), mMax(max) {
+	setCopyPolicy(kParallel);
+}
 
 Clipper::~Clipper() { }
 
@@ -21,52 +27,54 @@ void Clipper::dump() {
 	UnitGenerator::dump();
 }
 
+// Answer whether 0 gets through unclipped (so silent input gives silent output)
+
+bool Clipper::passesZero() {
+	return ((mFlags == kMax) || (mMin <= 0.0f)) && ((mFlags == kMin) || (mMax >= 0.0f));
+}
+
+// Clip the samples in place (an unused limit is +- FLT_MAX)
+
+void Clipper::clip(SampleBuffer samples, unsigned numFrames) {
+	float lo = (mFlags == kMax) ? -FLT_MAX : mMin;
+	float hi = (mFlags == kMin) ? FLT_MAX : mMax;
+	VectorOps::clip(samples, samples, lo, hi, numFrames);
+}
+
 // nextBuffer does the dirty work
-void Clipper::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException) {
 
-	float tempSample;
+void Clipper::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException) {
 	sample * outp = outputBuffer.buffer(outBufNum);
 	unsigned numFrames = outputBuffer.mNumFrames;
-
 	pullInput(outputBuffer);
-	sample * inPtr = mInputPtr;
-	
+	if (inputIsSilent(0) && passesZero()) {			// silent input (if 0 isn't clipped)
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
 #ifdef CSL_DEBUG
 	logMsg("Clipper nextBuffer");
 #endif		
+	if (outp != mInputPtr)
+		memcpy(outp, mInputPtr, numFrames * sizeof(sample));
+	clip(outp, numFrames);
+}
 
-		switch(mFlags) {
-			case kMin:
-				for (unsigned i = 0; i < numFrames; i++) {
-					tempSample = inPtr[i];
-					if (inPtr[i] < mMin )
-						tempSample = mMin;
-						
-					*outp++ = tempSample;
-				}
-				break;
-			case kMax:
-				for (unsigned i = 0; i < numFrames; i++) {
-					tempSample = inPtr[i];
-					if (inPtr[i] > mMax )
-						tempSample = mMax;
-						
-					*outp++ = tempSample;					
-				}
-				break;
-			case kBoth:
-				for (unsigned i = 0; i < numFrames; i++) {
-					tempSample = inPtr[i];
-					if (inPtr[i] < mMin )
-						tempSample = mMin;
-					if (inPtr[i] > mMax )
-						tempSample = mMax;
-						
-					*outp++ = tempSample;
-				}
-				break;
-		}
-
-	return;
+// The multichannel version pulls the input once (into the output buffer) and clips each channel
 
+void Clipper::nextParallel(Buffer &outputBuffer) throw (CException) {
+	unsigned numFrames = outputBuffer.mNumFrames;
+	unsigned numChans = parallelChannels(outputBuffer);
+	if (numChans < 2) {								// mono input: compute 1 channel and copy
+		nextBuffer(outputBuffer, 0);
+		copyChannels(outputBuffer, 1);
+		return;
+	}
+	pullInput(outputBuffer);
+	for (unsigned i = 0; i < numChans; i++) {
+		if (inputIsSilent(i) && passesZero())
+			zeroBuffer(outputBuffer, i);
+		else
+			clip(outputBuffer.buffer(i), numFrames);
+	}
+	copyChannels(outputBuffer, numChans);
 }
@@ -32,10 +32,14 @@ public:
 	void dump();						///< print the receiver for debugging
 
 	void nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException);
+										/// clip all the channels of a multichannel input at once
+	void nextParallel(Buffer &outputBuffer) throw (CException);
 
 private:
 	ClipperFlags mFlags;
 	float mMin, mMax;
+	bool passesZero();					///< answer whether 0 gets through unclipped
+	void clip(SampleBuffer samples, unsigned numFrames);	///< clip in place
 };
 
 }
@@ -0,0 +1,510 @@
+///
+/// Convolver.cpp -- low-latency partitioned convolution
+///	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+///
+
+#include "Convolver.h"
+#include "VectorOps.h"
+#include <sched.h>
+#include <sys/time.h>
+
+using namespace csl;
+
+#define CSL_CONV_WAIT_USEC 2000			// how long an idle worker sleeps before looking again
+
+// Level constructor makes the FFTs and the spectrum storage. The FFTs' scaling and format are found
+// by transforming an impulse at 1 (as in FIR::planFFT()): the magnitude of every bin is the forward
+// scale, and if the FFT packs the Nyquist term into the imaginary part of bin 0, that is -scale.
+
+ConvolverLevel::ConvolverLevel(unsigned partSize, unsigned start, unsigned numParts,
+				unsigned numInputs, unsigned numIRs, unsigned numOutputs)
+		: mPartSize(partSize), mStart(start), mNumParts(numParts), mBackground(false),
+		  mSlot(0), mJobTime(0), mState(kConvJobIdle) {
+	unsigned fftSize = 2 * partSize;
+	mForward = new FFTWrapper(fftSize, CSL_FFT_COMPLEX, CSL_FFT_FORWARD);
+	mInverse = new FFTWrapper(fftSize, CSL_FFT_COMPLEX, CSL_FFT_INVERSE);
+	mTime.setSize(1, fftSize);
+	mTime.allocateBuffers();
+	mResult.setSize(1, fftSize);
+	mResult.allocateBuffers();
+	mSpectrum.setSize(1, fftSize + 2);			// (room for fftSize / 2 + 1 complex #s)
+	mSpectrum.allocateBuffers();
+	mSum.setSize(1, fftSize + 2);
+	mSum.allocateBuffers();
+	mOutput.setSize(numOutputs, partSize);
+	mOutput.allocateBuffers();
+
+	SampleBuffer time = mTime.buffer(0);		// probe the FFT
+	memset(time, 0, fftSize * sizeof(sample));
+	time[1] = 1.0f;
+	mForward->nextBuffer(mTime, mSpectrum);
+	SampleBuffer spect = mSpectrum.buffer(0);
+	float scale = hypotf(spect[2], spect[3]);
+	mPacked = (fabsf(spect[1]) > 0.5f * scale);
+	mNumBins = mPacked ? partSize : (partSize + 1);
+	mGain = 1.0f / ((float) fftSize * scale * scale);
+	time[1] = 0.0f;
+
+	SAFE_MALLOC(mIRSpectra, float, numIRs * numParts * spectrumSize());
+	SAFE_MALLOC(mInSpectra, float, numInputs * numParts * spectrumSize());
+	memset(mInSpectra, 0, numInputs * numParts * spectrumSize() * sizeof(float));
+}
+
+ConvolverLevel::~ConvolverLevel() {
+	delete mForward;
+	delete mInverse;
+	SAFE_FREE(mIRSpectra);
+	SAFE_FREE(mInSpectra);
+}
+
+// Constructors read the IR and set up the convolver
+
+#define CONV_INIT													\
+		mNumInputs(0), mNumIRs(0), mNumOutputs(0), mNumPaths(0),	\
+		mIRLength(0), mWet(1.0f), mDry(0.0f),						\
+		mHeadSize(0), mHeadTaps(NULL), mHeadLines(NULL), mNumLevels(0),	\
+		mRingMask(0), mInRing(NULL), mOutRing(NULL), mTime(0),		\
+		mQuietFrames(0), mSleepFrames(0), mLateJobs(0),				\
+		mNumThreads(0), mRunning(true), mWakeups(0)
+
+Convolver::Convolver(UnitGenerator & in, Abst_SoundFile & impulseResp, ConvolverLayout layout,
+				unsigned numThreads) throw (CException) : Effect(in), CONV_INIT {
+	if (impulseResp.isValid() && ! impulseResp.isCached())
+		impulseResp.openForRead(true);			// read the whole file
+	if ( ! (impulseResp.isValid() && impulseResp.isCached()))
+		throw IOError("Convolver: can't read the impulse response file");
+	if (impulseResp.frameRate() != mFrameRate) {
+		logMsg(kLogWarning, "Convolver: converting the IR from %d Hz", impulseResp.frameRate());
+		impulseResp.convertRate(impulseResp.frameRate(), mFrameRate);
+	}
+	unsigned numIRs = impulseResp.channels();
+	if (numIRs > CSL_CONV_MAX_PATHS)
+		throw ValueError("Convolver: too many IR channels");
+	SampleBuffer chans[CSL_CONV_MAX_PATHS];
+	for (unsigned i = 0; i < numIRs; i++)
+		chans[i] = impulseResp.buffer(i);
+	initialize(in, chans, numIRs, impulseResp.duration(), layout, numThreads);
+}
+
+Convolver::Convolver(UnitGenerator & in, Buffer & impulseResp, ConvolverLayout layout,
+				unsigned numThreads) throw (CException) : Effect(in), CONV_INIT {
+	unsigned numIRs = impulseResp.mNumChannels;
+	if (numIRs > CSL_CONV_MAX_PATHS)
+		throw ValueError("Convolver: too many IR channels");
+	SampleBuffer chans[CSL_CONV_MAX_PATHS];
+	for (unsigned i = 0; i < numIRs; i++)
+		chans[i] = impulseResp.buffer(i);
+	initialize(in, chans, numIRs, impulseResp.mNumFrames, layout, numThreads);
+}
+
+// Destructor stops the workers and frees everything
+
+Convolver::~Convolver() {
+	if (mNumThreads > 0) {
+		pthread_mutex_lock(& mMutex);
+		mRunning = false;
+		pthread_cond_broadcast(& mCond);
+		pthread_mutex_unlock(& mMutex);
+		for (unsigned i = 0; i < mNumThreads; i++)
+			pthread_join(mThreads[i], NULL);
+		pthread_mutex_destroy(& mMutex);
+		pthread_cond_destroy(& mCond);
+	}
+	for (unsigned i = 0; i < mNumLevels; i++)
+		delete mLevels[i];
+	SAFE_FREE(mHeadTaps);
+	SAFE_FREE(mHeadLines);
+	SAFE_FREE(mInRing);
+	SAFE_FREE(mOutRing);
+}
+
+// Set up the paths for the layout, the head (the block size rounded up to a power of 2, within
+// CSL_CONV_MIN_PART..CSL_CONV_MAX_HEAD) and the levels. Level 0 ends where level 1 may start
+// (twice its partition size), and so on; the last level takes the rest of the IR.
+
+void Convolver::initialize(UnitGenerator & in, SampleBuffer * ir, unsigned numIRs, unsigned numFrames,
+				ConvolverLayout layout, unsigned numThreads) throw (CException) {
+	if ((numIRs == 0) || (numFrames == 0))
+		throw ValueError("Convolver: empty impulse response");
+	mNumInputs = csl_max(in.numChannels(), 1u);
+	mNumIRs = numIRs;
+	mIRLength = numFrames;
+	if (layout == kConvolveAuto)
+		layout = ((mNumInputs > 1) && (numIRs == mNumInputs * mNumInputs))
+				? kConvolveMatrix : kConvolveParallel;
+	if (layout == kConvolveMatrix) {			// IR channel i * outputs + o takes input i to output o
+		if ((numIRs % mNumInputs) != 0)
+			throw ValueError("Convolver: the IR's channels don't make a matrix for the input");
+		mNumOutputs = numIRs / mNumInputs;
+		if (numIRs > CSL_CONV_MAX_PATHS)
+			throw ValueError("Convolver: too many paths");
+		for (unsigned i = 0; i < mNumInputs; i++)
+			for (unsigned o = 0; o < mNumOutputs; o++) {
+				mPathIn[mNumPaths] = i;
+				mPathIR[mNumPaths] = i * mNumOutputs + o;
+				mPathOut[mNumPaths++] = o;
+			}
+	} else {									// each output has its own input and IR channel
+		mNumOutputs = csl_max(mNumInputs, numIRs);
+		if (mNumOutputs > CSL_CONV_MAX_PATHS)
+			throw ValueError("Convolver: too many paths");
+		for (unsigned o = 0; o < mNumOutputs; o++) {
+			mPathIn[mNumPaths] = o % mNumInputs;
+			mPathIR[mNumPaths] = o % numIRs;
+			mPathOut[mNumPaths++] = o;
+		}
+	}
+	mNumChannels = mNumOutputs;
+												// the head, in direct form
+	unsigned blockSize = CGestalt::blockSize();
+	mHeadSize = CSL_CONV_MIN_PART;
+	while ((mHeadSize < blockSize) && (mHeadSize < CSL_CONV_MAX_HEAD))
+		mHeadSize <<= 1;
+	SAFE_MALLOC(mHeadTaps, sample, numIRs * mHeadSize);
+	for (unsigned c = 0; c < numIRs; c++)
+		for (unsigned i = 0; i < mHeadSize; i++)
+			mHeadTaps[c * mHeadSize + mHeadSize - 1 - i] = (i < numFrames) ? ir[c][i] : 0.0f;
+	SAFE_MALLOC(mHeadLines, sample, mNumInputs * (2 * mHeadSize - 1));
+	memset(mHeadLines, 0, mNumInputs * (2 * mHeadSize - 1) * sizeof(sample));
+												// the levels
+	unsigned size = mHeadSize;
+	unsigned start = mHeadSize;
+	while ((start < numFrames) && (mNumLevels < CSL_CONV_MAX_LEVELS)) {
+		unsigned next = size * CSL_CONV_RATIO;
+		bool last = (next > CSL_CONV_MAX_PART) || (mNumLevels == CSL_CONV_MAX_LEVELS - 1);
+		unsigned end = last ? numFrames : csl_min(2 * next, numFrames);
+		unsigned numParts = (end - start + size - 1) / size;
+		ConvolverLevel * level = new ConvolverLevel(size, start, numParts,
+				mNumInputs, numIRs, mNumOutputs);
+		level->mBackground = (numThreads > 0) && (size >= 2 * blockSize) && (start >= 2 * size);
+		planLevel(level, ir);
+		mLevels[mNumLevels++] = level;
+		start += numParts * size;
+		size = next;
+	}
+												// the input and output rings
+	unsigned longest = mNumLevels ? mLevels[mNumLevels - 1]->mPartSize : mHeadSize;
+	unsigned ringSize = 4 * longest;
+	mRingMask = ringSize - 1;
+	SAFE_MALLOC(mInRing, sample, mNumInputs * ringSize);
+	memset(mInRing, 0, mNumInputs * ringSize * sizeof(sample));
+	SAFE_MALLOC(mOutRing, sample, mNumOutputs * ringSize);
+	memset(mOutRing, 0, mNumOutputs * ringSize * sizeof(sample));
+	mSleepFrames = numFrames + 2 * ringSize;	// by then, the rings, lines and spectra are all 0
+	mQuietFrames = mSleepFrames;				// (and they are to start with)
+
+	bool background = false;
+	for (unsigned i = 0; i < mNumLevels; i++)
+		background |= mLevels[i]->mBackground;
+	if (background)
+		startThreads(numThreads);
+}
+
+// Compute the spectra of a level's IR partitions, scaled by 1 / (the gain of the FFTs)
+
+void Convolver::planLevel(ConvolverLevel * level, SampleBuffer * ir) {
+	unsigned size = level->mPartSize;
+	unsigned specSize = level->spectrumSize();
+	SampleBuffer time = level->mTime.buffer(0);
+	for (unsigned c = 0; c < mNumIRs; c++) {
+		for (unsigned j = 0; j < level->mNumParts; j++) {
+			unsigned first = level->mStart + j * size;
+			unsigned count = (first < mIRLength) ? csl_min(size, mIRLength - first) : 0;
+			memset(time, 0, 2 * size * sizeof(sample));
+			for (unsigned i = 0; i < count; i++)
+				time[i] = ir[c][first + i] * level->mGain;
+			level->mForward->nextBuffer(level->mTime, level->mSpectrum);
+			memcpy(level->mIRSpectra + (c * level->mNumParts + j) * specSize,
+					level->mSpectrum.buffer(0), specSize * sizeof(float));
+		}
+	}
+	memset(time, 0, 2 * size * sizeof(sample));
+}
+
+// Start the workers; they run at a (low) real-time priority if we're allowed to ask for it, below
+// the IO and GraphExecutor threads
+
+void Convolver::startThreads(unsigned numThreads) {
+	mNumThreads = csl_min(numThreads, (unsigned) CSL_CONV_MAX_THREADS);
+	pthread_mutex_init(& mMutex, NULL);
+	pthread_cond_init(& mCond, NULL);
+	pthread_attr_t attr;
+	pthread_attr_init(& attr);
+	struct sched_param param;
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+	pthread_attr_setinheritsched(& attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(& attr, SCHED_FIFO);
+	pthread_attr_setschedparam(& attr, & param);
+	for (unsigned i = 0; i < mNumThreads; i++) {
+		if (pthread_create(& mThreads[i], & attr, workerLoop, this) != 0)
+			pthread_create(& mThreads[i], NULL, workerLoop, this);	// retry w/o RT scheduling
+	}
+	pthread_attr_destroy(& attr);
+}
+
+// Convolve a level's block that ends at the given time: transform the last 2N inputs, put their
+// spectrum in the frequency-domain delay line, sum its products with the IR partitions' spectra
+// per output, and transform back; the last N samples of that are the output (due at time - N +
+// the level's start). Background levels leave it in mOutput for collect().
+
+void Convolver::convolve(ConvolverLevel * level, unsigned time) {
+	unsigned size = level->mPartSize;
+	unsigned numParts = level->mNumParts;
+	unsigned numBins = level->mNumBins;
+	unsigned specSize = level->spectrumSize();
+	unsigned ringSize = mRingMask + 1;
+	SampleBuffer fftIn = level->mTime.buffer(0);
+	SampleBuffer spect = level->mSpectrum.buffer(0);
+	SampleBuffer sum = level->mSum.buffer(0);
+	unsigned slot = (level->mSlot + 1) % numParts;
+	level->mSlot = slot;
+	unsigned from = (time - 2 * size) & mRingMask;
+	unsigned first = csl_min(2 * size, ringSize - from);
+	for (unsigned i = 0; i < mNumInputs; i++) {		// transform the inputs
+		SampleBuffer ring = mInRing + i * ringSize;
+		memcpy(fftIn, ring + from, first * sizeof(sample));
+		memcpy(fftIn + first, ring, (2 * size - first) * sizeof(sample));
+		level->mForward->nextBuffer(level->mTime, level->mSpectrum);
+		memcpy(level->mInSpectra + (i * numParts + slot) * specSize, spect, specSize * sizeof(float));
+	}
+	for (unsigned o = 0; o < mNumOutputs; o++) {	// sum the products per output
+		memset(sum, 0, specSize * sizeof(float));
+		for (unsigned p = 0; p < mNumPaths; p++) {
+			if (mPathOut[p] != o)
+				continue;
+			float * inSpect = level->mInSpectra + mPathIn[p] * numParts * specSize;
+			float * irSpect = level->mIRSpectra + mPathIR[p] * numParts * specSize;
+			for (unsigned j = 0; j < numParts; j++) {
+				float * x = inSpect + ((slot + numParts - j) % numParts) * specSize;
+				float * h = irSpect + j * specSize;
+				float dc = sum[0];
+				float nyquist = sum[1];
+				VectorOps::complexMulAdd(sum, x, h, numBins);
+				if (level->mPacked) {				// bin 0 is 2 reals: DC and Nyquist
+					sum[0] = dc + x[0] * h[0];
+					sum[1] = nyquist + x[1] * h[1];
+				}
+			}
+		}
+		level->mInverse->nextBuffer(level->mSum, level->mResult);
+		SampleBuffer result = level->mResult.buffer(0) + size;
+		if (level->mBackground) {
+			memcpy(level->mOutput.buffer(o), result, size * sizeof(sample));
+		} else {
+			SampleBuffer ring = mOutRing + o * ringSize;
+			unsigned to = time - size + level->mStart;
+			for (unsigned k = 0; k < size; k++)
+				ring[(to + k) & mRingMask] += result[k];
+		}
+	}
+}
+
+// Take a background level's job: if no thread has started it, do it now, else wait for it to be
+// done. Its output starts now (one block after it was handed off), so it's added into the ring.
+
+void Convolver::collect(ConvolverLevel * level) {
+	if (level->mState == kConvJobIdle)
+		return;
+	if (csl_atomic_cas(& level->mState, kConvJobPending, kConvJobRunning)) {
+		convolve(level, level->mJobTime);
+		mLateJobs++;
+	} else if (level->mState != kConvJobDone) {
+		mLateJobs++;
+		while (level->mState != kConvJobDone)
+			sched_yield();
+	}
+	csl_memory_barrier();
+	unsigned size = level->mPartSize;
+	unsigned ringSize = mRingMask + 1;
+	unsigned to = level->mJobTime - size + level->mStart;
+	for (unsigned o = 0; o < mNumOutputs; o++) {
+		SampleBuffer ring = mOutRing + o * ringSize;
+		SampleBuffer result = level->mOutput.buffer(o);
+		for (unsigned k = 0; k < size; k++)
+			ring[(to + k) & mRingMask] += result[k];
+	}
+	level->mState = kConvJobIdle;
+}
+
+// Finish all the background jobs, before the convolver stops for silent input (their output is 0)
+
+void Convolver::finishJobs() {
+	for (unsigned i = 0; i < mNumLevels; i++) {
+		ConvolverLevel * level = mLevels[i];
+		if (level->mState == kConvJobIdle)
+			continue;
+		if (csl_atomic_cas(& level->mState, kConvJobPending, kConvJobRunning))
+			convolve(level, level->mJobTime);
+		else
+			while (level->mState != kConvJobDone)
+				sched_yield();
+		csl_memory_barrier();
+		level->mState = kConvJobIdle;
+	}
+}
+
+// At the end of each head block, run the levels whose blocks end here: the foreground ones now,
+// and the background ones are collected and handed off again. The workers are woken if the mutex
+// is free; if a worker holds it, it will see mWakeups change before it waits.
+
+void Convolver::endOfBlock() {
+	bool handedOff = false;
+	for (unsigned i = 0; i < mNumLevels; i++) {
+		ConvolverLevel * level = mLevels[i];
+		if ((mTime & (level->mPartSize - 1)) != 0)
+			continue;
+		if (level->mBackground) {
+			collect(level);
+			level->mJobTime = mTime;
+			csl_atomic_cas(& level->mState, kConvJobIdle, kConvJobPending);
+			handedOff = true;
+		} else
+			convolve(level, mTime);
+	}
+	if (handedOff) {
+		csl_atomic_add(& mWakeups, 1);
+		if (pthread_mutex_trylock(& mMutex) == 0) {
+			pthread_cond_broadcast(& mCond);
+			pthread_mutex_unlock(& mMutex);
+		}
+	}
+}
+
+// Claim and run the waiting job with the earliest deadline (the levels are in order of size);
+// answer whether there was one
+
+bool Convolver::runJobs() {
+	for (unsigned i = 0; i < mNumLevels; i++) {
+		ConvolverLevel * level = mLevels[i];
+		if (level->mBackground && csl_atomic_cas(& level->mState, kConvJobPending, kConvJobRunning)) {
+			convolve(level, level->mJobTime);
+			csl_memory_barrier();
+			level->mState = kConvJobDone;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Worker thread function: run jobs while there are any, else wait to be woken (or time out)
+
+void * Convolver::workerLoop(void * arg) {
+	Convolver * conv = (Convolver *) arg;
+	while (conv->mRunning) {
+		long seen = conv->mWakeups;
+		if (conv->runJobs())
+			continue;
+		pthread_mutex_lock(& conv->mMutex);
+		if (conv->mRunning && (conv->mWakeups == seen)) {
+			struct timeval now;
+			struct timespec until;
+			gettimeofday(& now, NULL);
+			long usec = now.tv_usec + CSL_CONV_WAIT_USEC;
+			until.tv_sec = now.tv_sec + usec / 1000000;
+			until.tv_nsec = (usec % 1000000) * 1000;
+			pthread_cond_timedwait(& conv->mCond, & conv->mMutex, & until);
+		}
+		pthread_mutex_unlock(& conv->mMutex);
+	}
+	return NULL;
+}
+
+// nextBuffer does the buffer in pieces that end at the head's block boundaries: each piece's
+// inputs go into the head lines and the input rings, and its output is the head's (a dot product
+// per path and frame) plus what the levels have added into the output ring. Once the input has been
+// silent long enough for all that to be 0, the convolver just writes silence.
+
+void Convolver::nextBuffer(Buffer & outputBuffer) throw (CException) {
+	unsigned numFrames = outputBuffer.mNumFrames;
+	unsigned outChans = outputBuffer.mNumChannels;
+#ifdef CSL_DEBUG
+	logMsg("Convolver nextBuffer");
+#endif
+	Effect::pullInput(numFrames);
+	Buffer * inBuf = inPort()->mBuffer;
+	unsigned inChans = inBuf->mNumChannels;
+	bool silent = true;
+	for (unsigned i = 0; i < mNumInputs; i++)
+		silent &= inputIsSilent(i % inChans);
+	if ( ! silent)
+		mQuietFrames = 0;
+	else if (mQuietFrames < mSleepFrames)
+		mQuietFrames += numFrames;
+	if (mQuietFrames >= mSleepFrames) {			// asleep: write (and flag) silence
+		finishJobs();
+		for (unsigned o = 0; o < outChans; o++)
+			zeroBuffer(outputBuffer, o);
+		return;
+	}
+	unsigned headSize = mHeadSize;
+	unsigned lineSize = 2 * headSize - 1;
+	unsigned ringSize = mRingMask + 1;
+	sample head[CSL_CONV_MAX_HEAD];
+	unsigned done = 0;
+	while (done < numFrames) {
+		unsigned pos = mTime & (headSize - 1);
+		unsigned count = csl_min(numFrames - done, headSize - pos);
+		unsigned at = mTime & mRingMask;
+		unsigned first = csl_min(count, ringSize - at);
+		for (unsigned i = 0; i < mNumInputs; i++) {	// store the inputs
+			SampleBuffer in = inBuf->buffer(i % inChans) + done;
+			SampleBuffer ring = mInRing + i * ringSize;
+			memcpy(mHeadLines + i * lineSize + headSize - 1 + pos, in, count * sizeof(sample));
+			memcpy(ring + at, in, first * sizeof(sample));
+			memcpy(ring, in + first, (count - first) * sizeof(sample));
+		}
+		for (unsigned o = 0; o < mNumOutputs; o++) {	// head + levels' output
+			SampleBuffer ring = mOutRing + o * ringSize;
+			for (unsigned k = 0; k < count; k++) {
+				unsigned index = (at + k) & mRingMask;
+				head[k] = ring[index];
+				ring[index] = 0.0f;
+			}
+			for (unsigned p = 0; p < mNumPaths; p++) {
+				if (mPathOut[p] != o)
+					continue;
+				sample * taps = mHeadTaps + mPathIR[p] * headSize;
+				sample * line = mHeadLines + mPathIn[p] * lineSize + pos;
+				for (unsigned k = 0; k < count; k++)
+					head[k] += VectorOps::dot(taps, line + k, headSize);
+			}
+			if (o >= outChans)
+				continue;
+			SampleBuffer out = outputBuffer.buffer(o) + done;
+			if (mDry != 0.0f) {
+				SampleBuffer in = inBuf->buffer((o % mNumInputs) % inChans) + done;
+				for (unsigned k = 0; k < count; k++)
+					out[k] = mWet * head[k] + mDry * in[k];
+			} else {
+				for (unsigned k = 0; k < count; k++)
+					out[k] = mWet * head[k];
+			}
+		}
+		mTime += count;
+		done += count;
+		if ((mTime & (headSize - 1)) == 0) {			// end of a head block
+			for (unsigned i = 0; i < mNumInputs; i++) {
+				sample * line = mHeadLines + i * lineSize;
+				memmove(line, line + headSize, (headSize - 1) * sizeof(sample));
+			}
+			endOfBlock();
+		}
+	}
+	for (unsigned o = mNumOutputs; o < outChans; o++)	// copy into any extra channels
+		memcpy(outputBuffer.buffer(o), outputBuffer.buffer(o % mNumOutputs), numFrames * sizeof(sample));
+}
+
+// I'm active while my input is, and until the tail has died away
+
+bool Convolver::isActive() {
+	return (Effect::isActive() || (mQuietFrames < mSleepFrames));
+}
+
+void Convolver::dump() {
+	logMsg("a Convolver: %d in, %d IR channels, %d out; IR %d frames; head %d; %d threads, %d late jobs",
+			mNumInputs, mNumIRs, mNumOutputs, mIRLength, mHeadSize, mNumThreads, mLateJobs);
+	for (unsigned i = 0; i < mNumLevels; i++)
+		logMsg("\tlevel %d: %d x %d from %d%s", i, mLevels[i]->mNumParts, mLevels[i]->mPartSize,
+				mLevels[i]->mStart, mLevels[i]->mBackground ? " (background)" : "");
+	UnitGenerator::dump();
+}
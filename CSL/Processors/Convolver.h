@@ -0,0 +1,172 @@
+///
+/// Convolver.h -- low-latency partitioned convolution (e.g., for impulse-response reverbs)
+///	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+///
+/// The impulse response is cut into partitions that get longer further into the IR, so the
+/// first samples are cheap to do at once and the long tail is done in big FFTs:
+///
+///		head		the first CSL_CONV_MIN_PART..CSL_CONV_MAX_HEAD taps, in direct form
+///					(VectorOps::dot(), as in the FIR class), so there's no latency
+///		level 0		partitions of the head's size N, starting at N
+///		level k		partitions of N * CSL_CONV_RATIO^k, each level starting at twice its
+///					partition size (the rest of the IR goes into the last level)
+///
+/// Each level is a uniformly-partitioned overlap-save convolver (a frequency-domain delay line of
+/// the spectra of its past input blocks, multiplied by the spectra of its IR partitions and summed).
+/// When a level's block of input is complete, the result is due one block later (the level starts
+/// at twice its size), so levels whose blocks are at least 2 IO buffers long are handed to the
+/// convolver's worker threads; the workers take the waiting jobs shortest-deadline first. If a job
+/// isn't done when it's due, the audio thread waits for it (or, if no worker has started it, does it
+/// itself), so a slow thread costs time but never drops output; lateJobs() counts those.
+///
+/// The IR's channels are applied to the input's channels in one of the layouts below; e.g.,
+/// a mono IR on each input channel, a stereo or 4-channel IR on a mono input (2 or 4 outputs),
+/// or a 4-channel "true stereo" IR (L->L, L->R, R->L, R->R) on a stereo input.
+///
+
+#ifndef CSL_Convolver_H
+#define CSL_Convolver_H
+
+#include "CSL_Core.h"
+#include "FFT_Wrapper.h"
+#include "SoundFile.h"
+#include <pthread.h>
+
+namespace csl {
+
+#define CSL_CONV_MIN_PART 64			///< shortest partition (and head)
+#define CSL_CONV_MAX_HEAD 256			///< longest head (the block size, rounded up, within these)
+#define CSL_CONV_MAX_PART 16384			///< longest partition
+#define CSL_CONV_RATIO 4				///< ratio of the partition sizes of successive levels
+#define CSL_CONV_MAX_LEVELS 8			///< max # of levels
+#define CSL_CONV_MAX_PATHS 64			///< max # of (input, IR channel, output) paths
+#define CSL_CONV_MAX_THREADS 8			///< max # of worker threads
+
+/// How the IR's channels map the input's channels to the outputs
+
+typedef enum {
+	kConvolveAuto,			///< matrix if the IR has (# inputs)^2 channels (> 1), else parallel
+	kConvolveParallel,		///< output i = input (i % # inputs) * IR channel (i % # IR channels)
+	kConvolveMatrix			///< IR channel (i * # outputs + o) takes input i to output o
+} ConvolverLayout;
+
+/// The state of a level's background job
+
+typedef enum {
+	kConvJobIdle = 0,		///< nothing handed off
+	kConvJobPending,		///< waiting for a thread
+	kConvJobRunning,		///< being computed
+	kConvJobDone			///< result ready
+} ConvolverJobState;
+
+///
+/// ConvolverLevel -- one uniformly-partitioned overlap-save convolver (FFT size 2 * partition)
+///
+
+class ConvolverLevel {
+public:
+	ConvolverLevel(unsigned partSize, unsigned start, unsigned numParts,
+				unsigned numInputs, unsigned numIRs, unsigned numOutputs);
+	~ConvolverLevel();
+
+	unsigned mPartSize;			///< partition (and block) size N
+	unsigned mStart;			///< offset of the first partition in the IR
+	unsigned mNumParts;			///< # of partitions
+	unsigned mNumBins;			///< # of complex #s in a spectrum
+	bool mPacked;				///< whether the FFT packs the Nyquist term into bin 0's imaginary part
+	float mGain;				///< 1 / (the gain of a forward and inverse FFT)
+	bool mBackground;			///< whether the level is done by the worker threads
+	FFTWrapper * mForward;		///< forward and inverse FFTs (size 2N)
+	FFTWrapper * mInverse;
+	float * mIRSpectra;			///< [IR channel][partition] spectra (with the FFTs' scaling taken out)
+	float * mInSpectra;			///< [input channel][slot] spectra of the past input blocks
+	unsigned mSlot;				///< slot of the newest input spectrum
+	Buffer mTime;				///< FFT input (2N), spectrum, spectrum sum and inverse FFT output
+	Buffer mSpectrum;
+	Buffer mSum;
+	Buffer mResult;
+	Buffer mOutput;				///< the background job's output (N per output channel)
+	unsigned mJobTime;			///< end of the job's input block (in frames)
+	AtomicCounter mState;		///< ConvolverJobState of the job
+
+	unsigned spectrumSize() { return 2 * mNumBins; };	///< # of floats in a spectrum
+};
+
+///
+/// Convolver -- the partitioned convolution Effect
+///
+
+class Convolver : public Effect {
+public:					/// Constructors take the input, the IR, its layout and the # of worker threads
+						/// (with 0 threads, all levels are done in the audio thread)
+	Convolver(UnitGenerator & in, Abst_SoundFile & impulseResp,
+				ConvolverLayout layout = kConvolveAuto, unsigned numThreads = 1) throw (CException);
+	Convolver(UnitGenerator & in, Buffer & impulseResp,
+				ConvolverLayout layout = kConvolveAuto, unsigned numThreads = 1) throw (CException);
+	~Convolver();
+
+	void setWetLevel(float level) { mWet = level; };	///< gain of the convolved signal (default 1)
+	float wetLevel() { return mWet; };
+	void setDryLevel(float level) { mDry = level; };	///< gain of the input (default 0)
+	float dryLevel() { return mDry; };
+
+	unsigned numChannels() { return mNumOutputs; };
+	unsigned irLength() { return mIRLength; };		///< # of frames in the IR
+	unsigned numLevels() { return mNumLevels; };	///< # of partition levels (besides the head)
+	unsigned numThreads() { return mNumThreads; };
+	unsigned lateJobs() { return mLateJobs; };		///< # of background jobs that weren't done when due
+	bool isActive();
+	void dump();
+
+	void nextBuffer(Buffer & outputBuffer) throw (CException);
+
+protected:
+	unsigned mNumInputs;		///< # of input, IR and output channels
+	unsigned mNumIRs;
+	unsigned mNumOutputs;
+	unsigned mNumPaths;			///< # of (input, IR channel, output) paths
+	unsigned mPathIn[CSL_CONV_MAX_PATHS];
+	unsigned mPathIR[CSL_CONV_MAX_PATHS];
+	unsigned mPathOut[CSL_CONV_MAX_PATHS];
+	unsigned mIRLength;			///< # of frames in the IR
+	float mWet, mDry;			///< output gains
+
+	unsigned mHeadSize;			///< # of taps done in direct form
+	sample * mHeadTaps;			///< [IR channel] the head taps, reversed
+	sample * mHeadLines;		///< [input] the last mHeadSize - 1 inputs and the current head block
+	unsigned mNumLevels;		///< the partition levels
+	ConvolverLevel * mLevels[CSL_CONV_MAX_LEVELS];
+
+	unsigned mRingMask;			///< (size of the rings) - 1
+	sample * mInRing;			///< [input] the last input frames
+	sample * mOutRing;			///< [output] the levels' output, added in ahead of time
+	unsigned mTime;				///< # of frames done so far (mod 2^32)
+	unsigned mQuietFrames;		///< # of frames of silent input so far
+	unsigned mSleepFrames;		///< # of them after which all the state is 0 (and I stop)
+	unsigned mLateJobs;			///< # of jobs finished by the audio thread
+
+	unsigned mNumThreads;		///< the worker threads
+	pthread_t mThreads[CSL_CONV_MAX_THREADS];
+	pthread_mutex_t mMutex;		///< wake-up mutex/condition
+	pthread_cond_t mCond;
+	volatile bool mRunning;		///< cleared to stop the workers
+	AtomicCounter mWakeups;		///< incremented for each job handed off
+
+								/// set up the paths, head, levels and rings for the IR
+	void initialize(UnitGenerator & in, SampleBuffer * ir, unsigned numIRs, unsigned numFrames,
+				ConvolverLayout layout, unsigned numThreads) throw (CException);
+								/// compute the IR spectra of a level
+	void planLevel(ConvolverLevel * level, SampleBuffer * ir);
+	void startThreads(unsigned numThreads);		///< start the workers
+	void endOfBlock();							///< at the end of a head block, run the levels
+								/// convolve a level's block that ends at the given time
+	void convolve(ConvolverLevel * level, unsigned time);
+	void collect(ConvolverLevel * level);		///< wait for a level's job and add in its output
+	void finishJobs();							///< wait for all jobs (dropping their output)
+	bool runJobs();								///< claim and run waiting jobs (answer if any)
+	static void * workerLoop(void * arg);		///< worker thread function
+};
+
+}
+
+#endif
@@ -0,0 +1,266 @@
+///
+/// FDNReverb.cpp -- a feedback-delay-network reverb
+///	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+///
+
+#include "FDNReverb.h"
+#include "VectorOps.h"
+
+using namespace csl;
+
+#define CSL_FDN_SPREAD 2.5f				// ratio of the longest delay to the shortest
+#define CSL_FDN_FLUSH 1e-20f			// low-pass states below this are set to 0 (before they're denormal)
+
+// Answer the first prime >= n
+
+static unsigned nextPrime(unsigned n) {
+	for ( ; ; n++) {
+		bool prime = (n > 1);
+		for (unsigned d = 2; prime && (d * d <= n); d++)
+			prime = ((n % d) != 0);
+		if (prime)
+			return n;
+	}
+}
+
+// Constructor allocates the lines for the biggest room (and deepest modulation) and sets the
+// input gains: each input channel has its own pattern of signs
+
+FDNReverb::FDNReverb(UnitGenerator & in, unsigned numLines, unsigned numOutputs,
+				FDNMatrix matrix) throw (CException)
+		: Effect(in), mNumLines(numLines), mNumOutputs(numOutputs), mNumInputs(csl_max(in.numChannels(), 1u)),
+		  mHouseholder(matrix == kFDNHouseholder), mRoomSize(0.5f), mDecayTime(2.0f), mDamping(0.5f),
+		  mModDepth(0.5f), mModRate(0.7f), mWet(1.0f), mDry(0.0f), mLines(NULL), mLineMask(0), mWrite(0),
+		  mBlock(NULL), mInGains(NULL), mDepth(0.0f), mQuietFrames(0), mSleepFrames(0) {
+	if ((numLines != 8) && (numLines != 16) && (numLines != 32))
+		throw ValueError("FDNReverb: the # of lines must be 8, 16 or 32");
+	if ((numOutputs == 0) || (numOutputs > numLines))
+		throw ValueError("FDNReverb: the # of outputs must be 1 to the # of lines");
+	mNumChannels = mNumOutputs;
+	float longest = (0.050f * CSL_FDN_SPREAD + CSL_FDN_MAX_DEPTH * 0.001f) * mFrameRate;
+	unsigned size = 1;
+	while (size < (unsigned) longest + 2 * CSL_FDN_CHUNK + mNumLines)
+		size <<= 1;
+	mLineMask = size - 1;
+	SAFE_MALLOC(mLines, sample, mNumLines * size);
+	SAFE_MALLOC(mBlock, sample, mNumLines * CSL_FDN_CHUNK);
+	SAFE_MALLOC(mInGains, sample, mNumInputs * mNumLines);
+	float gain = 1.0f / sqrtf((float) mNumLines);
+	for (unsigned c = 0; c < mNumInputs; c++)
+		for (unsigned i = 0; i < mNumLines; i++)
+			mInGains[c * mNumLines + i] = (VectorOps::randomHash(c * CSL_FDN_MAX_LINES + i) & 1) ? gain : -gain;
+	for (unsigned i = 0; i < mNumLines; i++)		// spread the modulation phases
+		mPhase[i] = (float) i / (float) mNumLines - 0.5f;
+	updateLines();
+	clear();
+}
+
+FDNReverb::~FDNReverb() {
+	SAFE_FREE(mLines);
+	SAFE_FREE(mBlock);
+	SAFE_FREE(mInGains);
+}
+
+// Compute the delays (primes, spread geometrically from the shortest), the low-passes and the
+// modulation rates. Line i's gain is g = 10^(-3 delay / (decay time * rate)) at DC, and g^(1 / r)
+// at Nyquist (r = the HF decay time ratio), so y = a x + b y' with b = (g - g') / (g + g'), a = g (1 - b).
+// The delays never get shorter than a chunk (plus the modulation depth), so a chunk's reads never
+// see its own writes.
+
+void FDNReverb::updateLines() {
+	float rate = (float) mFrameRate;
+	float shortest = (0.010f + 0.040f * mRoomSize) * rate;
+	float hfRatio = 1.0f - 0.9f * mDamping;
+	mDepth = mModDepth * 0.001f * rate;
+	unsigned minDelay = CSL_FDN_CHUNK + 4 + (unsigned) ceilf(mDepth);
+	unsigned prev = 0;
+	for (unsigned i = 0; i < mNumLines; i++) {
+		float t = (float) i / (float) (mNumLines - 1);
+		unsigned delay = (unsigned) (shortest * powf(CSL_FDN_SPREAD, t));
+		delay = nextPrime(csl_max(delay, csl_max(minDelay, prev + 1)));
+		mDelay[i] = prev = delay;
+		float gain = powf(10.0f, -3.0f * (float) delay / (mDecayTime * rate));
+		float hfGain = powf(gain, 1.0f / hfRatio);
+		float b = (gain - hfGain) / (gain + hfGain);
+		mCoeffB[i] = b;
+		mCoeffA[i] = gain * (1.0f - b);
+		mPhaseInc[i] = mModRate * (0.75f + 0.5f * t) / rate;
+	}
+	mSleepFrames = (unsigned) (mDecayTime * rate * (100.0f / 60.0f)) + mLineMask + 1;
+}
+
+void FDNReverb::setRoomSize(float size) {
+	mRoomSize = csl_max(csl_min(size, 1.0f), 0.0f);
+	updateLines();
+}
+
+void FDNReverb::setDecayTime(float seconds) {
+	mDecayTime = csl_max(seconds, 0.01f);
+	updateLines();
+}
+
+void FDNReverb::setDamping(float damp) {
+	mDamping = csl_max(csl_min(damp, 1.0f), 0.0f);
+	updateLines();
+}
+
+// The fastest line's delay changes by up to (depth in frames) * 2 pi * 1.25 rate / (frame rate)
+// per frame, so limit the rate to keep that under CSL_FDN_MAX_SWING frames per chunk
+
+void FDNReverb::setModulation(float depth, float rate) {
+	mModDepth = csl_max(csl_min(depth, CSL_FDN_MAX_DEPTH), 0.0f);
+	mModRate = csl_max(rate, 0.0f);
+	if (mModDepth > 0.0f) {
+		float maxRate = (float) CSL_FDN_MAX_SWING / (CSL_TWOPI * 1.25f * mModDepth * 0.001f * CSL_FDN_CHUNK);
+		mModRate = csl_min(mModRate, maxRate);
+	}
+	updateLines();
+}
+
+// Clear the lines and low-passes (and sleep until there's input)
+
+void FDNReverb::clear() {
+	memset(mLines, 0, mNumLines * (mLineMask + 1) * sizeof(sample));
+	memset(mFilter, 0, sizeof(mFilter));
+	mQuietFrames = mSleepFrames;
+}
+
+// Read the lines' output for the next count frames into the block, then low-pass them. A modulated
+// delay is interpolated linearly between its values at the chunk's ends; it changes by at most
+// CSL_FDN_MAX_SWING frames per chunk, so the chunk is read from a copy of the frames around it, in runs over
+// which the integer part of the delay doesn't change (and which the compiler can vectorize).
+// The low-passes run across the lines for each frame, so their recursions overlap.
+
+void FDNReverb::readLines(unsigned count) {
+	unsigned size = mLineMask + 1;
+	sample window[CSL_FDN_CHUNK + CSL_FDN_MAX_SWING + 4];
+	for (unsigned i = 0; i < mNumLines; i++) {
+		sample * line = mLines + i * size;
+		sample * out = mBlock + i * CSL_FDN_CHUNK;
+		if (mDepth > 0.0f) {
+			float phase = mPhase[i] + mPhaseInc[i] * (float) count;
+			if (phase >= 0.5f)
+				phase -= 1.0f;
+			float delay0 = (float) mDelay[i] + mDepth * VectorOps::sinCycles(mPhase[i]);
+			float delay1 = (float) mDelay[i] + mDepth * VectorOps::sinCycles(phase);
+			mPhase[i] = phase;
+			float slope = (delay0 - delay1) / (float) count;	// frame k is read at k - delay0 + k * slope
+			unsigned start = mWrite + size - (unsigned) ceilf(csl_max(delay0, delay1)) - 1;
+			float offset = (float) (mWrite + size - start) - delay0;	// (>= 1, from start)
+			unsigned index = start & mLineMask;
+			unsigned span = count + CSL_FDN_MAX_SWING + 4;
+			unsigned first = csl_min(span, size - index);
+			memcpy(window, line + index, first * sizeof(sample));
+			memcpy(window + first, line, (span - first) * sizeof(sample));
+			unsigned k = 0;
+			while (k < count) {
+				float pos = offset + (float) k * slope;
+				unsigned base = (unsigned) pos;
+				float frac = pos - (float) base;
+				unsigned end = count;				// run until the fraction leaves [0, 1)
+				if (slope > 0.0f)
+					end = csl_min(count, k + (unsigned) ((1.0f - frac) / slope) + 1);
+				else if (slope < 0.0f)
+					end = csl_min(count, k + (unsigned) (frac / -slope) + 1);
+				sample * x = window + base;
+				for (unsigned j = k; j < end; j++) {
+					float f = frac + (float) (j - k) * slope;
+					out[j] = x[j] + (x[j + 1] - x[j]) * f;
+				}
+				k = end;
+			}
+		} else {
+			unsigned index = (mWrite + size - mDelay[i]) & mLineMask;
+			unsigned first = csl_min(count, size - index);
+			memcpy(out, line + index, first * sizeof(sample));
+			memcpy(out + first, line, (count - first) * sizeof(sample));
+		}
+	}
+	float * y = mFilter;
+	for (unsigned k = 0; k < count; k++) {
+		sample * out = mBlock + k;
+		for (unsigned i = 0; i < mNumLines; i++, out += CSL_FDN_CHUNK) {
+			y[i] = mCoeffA[i] * *out + mCoeffB[i] * y[i];
+			*out = y[i];
+		}
+	}
+	for (unsigned i = 0; i < mNumLines; i++)
+		if (fabsf(y[i]) < CSL_FDN_FLUSH)
+			y[i] = 0.0f;
+}
+
+// Write the block into the lines and move on
+
+void FDNReverb::writeLines(unsigned count) {
+	unsigned size = mLineMask + 1;
+	unsigned first = csl_min(count, size - mWrite);
+	for (unsigned i = 0; i < mNumLines; i++) {
+		sample * line = mLines + i * size;
+		sample * in = mBlock + i * CSL_FDN_CHUNK;
+		memcpy(line + mWrite, in, first * sizeof(sample));
+		memcpy(line, in + first, (count - first) * sizeof(sample));
+	}
+	mWrite = (mWrite + count) & mLineMask;
+}
+
+// Do the work: for each chunk, read and mix the lines; output o is mixed line o (plus the dry
+// input), and the input is added to the lines before they're written back
+
+void FDNReverb::nextBuffer(Buffer & outputBuffer) throw (CException) {
+	unsigned numFrames = outputBuffer.mNumFrames;
+	unsigned outChans = outputBuffer.mNumChannels;
+#ifdef CSL_DEBUG
+	logMsg("FDNReverb nextBuffer");
+#endif
+	Effect::pullInput(numFrames);
+	Buffer * inBuf = inPort()->mBuffer;
+	unsigned inChans = csl_max(csl_min(inBuf->mNumChannels, mNumInputs), 1u);
+	bool silent = true;
+	for (unsigned c = 0; c < inChans; c++)
+		silent &= inputIsSilent(c);
+	if ( ! silent)
+		mQuietFrames = 0;
+	else if (mQuietFrames < mSleepFrames) {
+		mQuietFrames += numFrames;
+		if (mQuietFrames >= mSleepFrames)		// the tail has died away
+			clear();
+	}
+	if (mQuietFrames >= mSleepFrames) {			// asleep: write (and flag) silence
+		for (unsigned o = 0; o < outChans; o++)
+			zeroBuffer(outputBuffer, o);
+		return;
+	}
+	unsigned count;
+	for (unsigned frame = 0; frame < numFrames; frame += count) {
+		count = csl_min(numFrames - frame, (unsigned) CSL_FDN_CHUNK);
+		readLines(count);
+		VectorOps::fdnMix(mBlock, mNumLines, CSL_FDN_CHUNK, count, mHouseholder);
+		for (unsigned o = 0; o < outChans; o++) {
+			SampleBuffer out = outputBuffer.buffer(o) + frame;
+			VectorOps::mul(out, mBlock + (o % mNumOutputs) * CSL_FDN_CHUNK, mWet, count);
+			if (mDry != 0.0f)
+				VectorOps::scaleAdd(out, inBuf->buffer(o % inChans) + frame, mDry, count);
+		}
+		for (unsigned c = 0; c < inChans; c++) {
+			if (inputIsSilent(c))
+				continue;
+			SampleBuffer in = inBuf->buffer(c) + frame;
+			for (unsigned i = 0; i < mNumLines; i++)
+				VectorOps::scaleAdd(mBlock + i * CSL_FDN_CHUNK, in, mInGains[c * mNumLines + i], count);
+		}
+		writeLines(count);
+	}
+}
+
+// I'm active while my input is, and until the tail has died away
+
+bool FDNReverb::isActive() {
+	return (Effect::isActive() || (mQuietFrames < mSleepFrames));
+}
+
+void FDNReverb::dump() {
+	logMsg("an FDNReverb: %d lines (%s), %d in, %d out; delays %d - %d frames; decay %g sec, damping %g",
+			mNumLines, mHouseholder ? "Householder" : "Hadamard", mNumInputs, mNumOutputs,
+			mDelay[0], mDelay[mNumLines - 1], mDecayTime, mDamping);
+	UnitGenerator::dump();
+}
@@ -0,0 +1,111 @@
+///
+/// FDNReverb.h -- a feedback-delay-network reverb
+///	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+///
+/// 8, 16 or 32 delay lines (of prime lengths spread geometrically over the room size) feed back
+/// into each other through an orthogonal (Hadamard or Householder) matrix, so the echo density
+/// builds up fast and the tail is smooth. Each line has a 1-pole low-pass that sets its gain for
+/// the decay time (and a shorter decay at high frequencies), and its delay is slowly modulated
+/// (read with linear interpolation, which damps the highs a little more) to break up the modes.
+///
+/// The lines are processed in chunks of CSL_FDN_CHUNK frames (shorter than the shortest delay):
+/// each line's delayed and damped output for the chunk is read into a block, the blocks are mixed
+/// frame-by-frame by VectorOps::fdnMix() (in SIMD, over the frames), the input is added in and the
+/// blocks are written back into the lines. Output channel o is mixed line o, so the outputs are
+/// decorrelated (up to the # of lines).
+///
+/// The input's channels are summed into the lines (each with its own pattern of signs), so it
+/// can be used as a single shared send reverb: mix the sources' sends into it and mix its output
+/// (with the default wet 1, dry 0) into the main output.
+///
+
+#ifndef CSL_FDNReverb_H
+#define CSL_FDNReverb_H
+
+#include "CSL_Core.h"
+
+namespace csl {
+
+#define CSL_FDN_MAX_LINES 32		///< max # of delay lines
+#define CSL_FDN_CHUNK 64			///< # of frames mixed at a time
+#define CSL_FDN_MAX_DEPTH 5.0f		///< max modulation depth (msec)
+#define CSL_FDN_MAX_SWING 16		///< max change of a modulated delay per chunk (frames)
+
+/// The feedback matrix
+
+typedef enum {
+	kFDNHadamard,			///< Hadamard / sqrt(N): every line feeds every line equally (the default)
+	kFDNHouseholder			///< I - (2 / N) 1 1': mostly each line back into itself (less dense)
+} FDNMatrix;
+
+///
+/// FDNReverb -- the feedback-delay-network reverb Effect
+///
+
+class FDNReverb : public Effect {
+public:					/// Constructor takes the input, the # of lines (8, 16 or 32) and outputs,
+						/// and the feedback matrix
+	FDNReverb(UnitGenerator & in, unsigned numLines = 16, unsigned numOutputs = 2,
+				FDNMatrix matrix = kFDNHadamard) throw (CException);
+	~FDNReverb();
+
+	float roomSize() { return mRoomSize; };
+	void setRoomSize(float size);		///< 0 - 1: delays from 10 - 25 msec to 50 - 125 msec (default 0.5)
+	float decayTime() { return mDecayTime; };
+	void setDecayTime(float seconds);	///< time to decay by 60 dB at low frequencies (default 2 sec)
+	float damping() { return mDamping; };
+	void setDamping(float damp);		///< 0 - 1: the high-frequency decay time is 1 to 0.1 times that
+	float modDepth() { return mModDepth; };
+	float modRate() { return mModRate; };
+										/// delay modulation depth in msec and rate in Hz
+										/// (default 0.5 msec at 0.7 Hz; a depth of 0 turns it off);
+										/// the rate is limited so a delay moves by at most
+										/// CSL_FDN_MAX_SWING frames per chunk (about 6 Hz at 5 msec)
+	void setModulation(float depth, float rate);
+	float wetLevel() { return mWet; };
+	void setWetLevel(float level) { mWet = level; };	///< gain of the reverb (default 1)
+	float dryLevel() { return mDry; };
+	void setDryLevel(float level) { mDry = level; };	///< gain of the input (default 0)
+
+	unsigned numChannels() { return mNumOutputs; };
+	unsigned numLines() { return mNumLines; };
+	bool isActive();
+	void clear();						///< silence the tail
+	void dump();
+
+	void nextBuffer(Buffer & outputBuffer) throw (CException);
+
+protected:
+	unsigned mNumLines;			///< # of delay lines
+	unsigned mNumOutputs;		///< # of output channels
+	unsigned mNumInputs;		///< # of input channels
+	bool mHouseholder;			///< whether the matrix is Householder (else Hadamard)
+	float mRoomSize, mDecayTime, mDamping;	///< settings
+	float mModDepth, mModRate;
+	float mWet, mDry;
+
+	sample * mLines;			///< [line][mLineMask + 1] the delay lines
+	unsigned mLineMask;			///< (line size) - 1
+	unsigned mWrite;			///< position of the next frame to write (in all the lines)
+	sample * mBlock;			///< [line][CSL_FDN_CHUNK] a chunk of the lines' output
+	sample * mInGains;			///< [input][line] input gains (+- 1 / sqrt(# lines))
+
+	unsigned mDelay[CSL_FDN_MAX_LINES];		///< the lines' delays (frames)
+	float mCoeffA[CSL_FDN_MAX_LINES];		///< low-pass: y = a x + b y' (the DC gain is the line's gain)
+	float mCoeffB[CSL_FDN_MAX_LINES];
+	float mFilter[CSL_FDN_MAX_LINES];		///< low-pass states
+	float mPhase[CSL_FDN_MAX_LINES];		///< modulation phases (cycles, -0.5 - 0.5)
+	float mPhaseInc[CSL_FDN_MAX_LINES];		///< and per-frame increments
+	float mDepth;							///< modulation depth (frames)
+
+	unsigned mQuietFrames;		///< # of frames of silent input so far
+	unsigned mSleepFrames;		///< # of them after which the tail is below -100 dB (and I stop)
+
+	void updateLines();			///< compute the delays, low-passes and modulation
+	void readLines(unsigned count);		///< read the next chunk's damped line outputs into the block
+	void writeLines(unsigned count);	///< write the block into the lines
+};
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 // 
 
 #include "FIR.h"
+#include "VectorOps.h"
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
@@ -61,13 +62,10 @@ void FilterSpecification::setWeights(double *weights) {
 }
 
 void FilterSpecification::setNumTaps(unsigned numTaps) {
-	if (numTaps < 128) {
-		mNumTaps = numTaps;
-		if (mTapData != NULL)
-			delete[] mTapData;
-		mTapData = new double[mNumTaps];
-	} else logMsg(kLogError, "Too many taps. The use of convolution is faster if more taps needed.");
-
+	mNumTaps = numTaps;
+	if (mTapData != NULL)
+		delete[] mTapData;
+	mTapData = new double[mNumTaps];
 }
 
 // method to plan the filter (execute the search/iterate algorithm)
@@ -92,51 +90,119 @@ void FilterSpecification::planFilter() {
 
 // FIR class
 
-FIR::FIR(UnitGenerator & in, unsigned numTaps,  float * tapDelays) : Effect(in) {
+#define FIR_INIT mNumTaps(0), mFFTThreshold(CSL_FIR_FFT_TAPS), mTaps(NULL), mDLine(NULL),	\
+			mForward(NULL), mInverse(NULL), mFFTSize(0), mNumBins(0), mPacked(false)
+
+FIR::FIR(UnitGenerator & in, unsigned numTaps,  float * tapDelays) : Effect(in), FIR_INIT {
 	mFilterSpec = new FilterSpecification;
 	setTaps(numTaps, tapDelays);
 
 	if (tapDelays == NULL) {			// If passed num taps, but no IR, then just make a cheap lowpass averaging filter.
 		for (unsigned i = 0; i < numTaps; i++)
 			mFilterSpec->mTapData[i] = 0.5;
+		resetDLine();
 	}
 }
 
 // Read in a tap data file
-FIR::FIR(UnitGenerator & in, char * fileName) : Effect(in) {
+FIR::FIR(UnitGenerator & in, char * fileName) : Effect(in), FIR_INIT {
 	mFilterSpec = new FilterSpecification;
 	readTaps(fileName);
 }
 
 // give it a filter specification object
 
-FIR::FIR (FilterSpecification & fs) : mFilterSpec(&fs) {
-	resetDLine();
+FIR::FIR (FilterSpecification & fs) : mFilterSpec(&fs), FIR_INIT {
 	fs.planFilter();
+	resetDLine();
 }
 					
-FIR::FIR (UnitGenerator & in, FilterSpecification & fs) : Effect(in), mFilterSpec(&fs) {
-	resetDLine();
+FIR::FIR (UnitGenerator & in, FilterSpecification & fs) : Effect(in), mFilterSpec(&fs), FIR_INIT {
 	fs.planFilter();
+	resetDLine();
 }
 
 FIR::~FIR () {
-	delete[] mDLine;
+	freeState();
 }
 
+void FIR::freeState() {
+	SAFE_FREE(mTaps);
+	SAFE_FREE(mDLine);
+	mTaps = mDLine = NULL;
+	delete mForward;
+	delete mInverse;
+	mForward = mInverse = NULL;
+}
+
+// Copy the spec's taps (reversed, as floats), and set up the direct form's mirrored delay line, or
+// the FFTs if there are enough taps
+
 void FIR::resetDLine() {
-	mDLine = new sample[mFilterSpec->mNumTaps];	
-	for (unsigned i = 0; i < mFilterSpec->mNumTaps; i++)	// empty the delay line
+	freeState();
+	mNumTaps = csl_max(mFilterSpec->mNumTaps, 1u);
+	SAFE_MALLOC(mTaps, sample, mNumTaps);
+	for (unsigned i = 0; i < mNumTaps; i++)
+		mTaps[i] = (i < mFilterSpec->mNumTaps) ? (sample) mFilterSpec->mTapData[mNumTaps - 1 - i] : 0.0f;
+	if (mNumTaps >= mFFTThreshold) {
+		planFFT();
+		return;
+	}
+	SAFE_MALLOC(mDLine, sample, mNumTaps - 1 + CSL_FIR_CHUNK);
+	for (unsigned i = 0; i < mNumTaps - 1 + CSL_FIR_CHUNK; i++)	// empty the delay line
 		mDLine[i] = 0.0;
-	mOffset = 0;
+}
+
+void FIR::setFFTThreshold(unsigned numTaps) {
+	mFFTThreshold = numTaps;
+	resetDLine();
+}
+
+// The FFT is long enough for a block and the numTaps - 1 before it (the larger of these, as a power
+// of 2). The taps' spectrum is scaled by 1 / (the gain of a forward and inverse FFT), which is found
+// by transforming an impulse at 1; that also tells whether the FFT packs the Nyquist term (real)
+// into the imaginary part of bin 0 (FFTReal) or answers it as bin N/2 (FFTW).
+
+void FIR::planFFT() {
+	unsigned minSize = csl_max(CGestalt::blockSize(), mNumTaps) + mNumTaps - 1;
+	mFFTSize = 2;
+	while (mFFTSize < minSize)
+		mFFTSize <<= 1;
+	mForward = new FFTWrapper(mFFTSize, CSL_FFT_COMPLEX, CSL_FFT_FORWARD);
+	mInverse = new FFTWrapper(mFFTSize, CSL_FFT_COMPLEX, CSL_FFT_INVERSE);
+	mHistory.setSize(1, mFFTSize);
+	mHistory.allocateBuffers();
+	mResult.setSize(1, mFFTSize);
+	mResult.allocateBuffers();
+	mSpectrum.setSize(1, mFFTSize + 2);			// (room for mFFTSize / 2 + 1 complex #s)
+	mSpectrum.allocateBuffers();
+	mProduct.setSize(1, mFFTSize + 2);
+	mProduct.allocateBuffers();
+	mKernel.setSize(1, mFFTSize + 2);
+	mKernel.allocateBuffers();
+
+	SampleBuffer time = mHistory.buffer(0);		// probe the FFT with an impulse at 1
+	time[1] = 1.0f;
+	mForward->nextBuffer(mHistory, mSpectrum);
+	SampleBuffer spect = mSpectrum.buffer(0);
+	float scale = hypotf(spect[2], spect[3]);	// (the magnitude of every bin)
+	mPacked = (fabsf(spect[1]) > 0.5f * scale);	// bin 0 imaginary = -scale if packed
+	mNumBins = mPacked ? (mFFTSize / 2) : (mFFTSize / 2 + 1);
+	float gain = 1.0f / ((float) mFFTSize * scale * scale);
+	time[1] = 0.0f;
+	for (unsigned i = 0; i < mNumTaps; i++)		// the taps' spectrum
+		time[i] = mTaps[mNumTaps - 1 - i] * gain;
+	mForward->nextBuffer(mHistory, mKernel);
+	memset(time, 0, mFFTSize * sizeof(sample));
+	memset(mSpectrum.buffer(0), 0, (mFFTSize + 2) * sizeof(sample));
 }
 
 void FIR::setTaps(unsigned numTaps,  float *tapDelays) {
 	mFilterSpec->setNumTaps(numTaps);
 	if (tapDelays != NULL)
-		memcpy(mFilterSpec->mTapData, tapDelays, (numTaps * sizeof(double)));
+		for (unsigned i = 0; i < numTaps; i++)
+			mFilterSpec->mTapData[i] = tapDelays[i];
 	resetDLine();
-	mOffset = 0;
 }
 
 void FIR::readTaps(char * fileName) {
@@ -144,11 +210,19 @@ void FIR::readTaps(char * fileName) {
 	FILE * configData;
 	
 	configData = fopen(fileName, "r");		// open config file
-	fscanf(configData, "%d\n", &numTaps);	// read # of taps
-		
+	if (configData == NULL) {
+		logMsg(kLogError, "FIR: can't open the tap file %s", fileName);
+		return;
+	}
+	if (fscanf(configData, "%u\n", &numTaps) != 1) {	// read # of taps
+		logMsg(kLogError, "FIR: bad tap file %s", fileName);
+		fclose(configData);
+		return;
+	}
 	float * theTapData = new float[numTaps];
 	for (i = 0; i < numTaps; i++)	// read tap coefficients
-		fscanf(configData, "%f\n", &theTapData[i]);
+		if (fscanf(configData, "%f\n", &theTapData[i]) != 1)
+			theTapData[i] = 0.0f;
 	setTaps(numTaps, theTapData);
 	fclose(configData);
 	
@@ -157,36 +231,64 @@ void FIR::readTaps(char * fileName) {
 	for (i = 0; i < numTaps; i++)
 		logMsg("\t%g\n ", theTapData[i]);
 #endif		
-	resetDLine();
+	delete[] theTapData;
 }
 
+// Direct form: a chunk of input is copied in after the last numTaps - 1, so output i is the dot
+// product of the (reversed) taps with the run that starts at i; then the last numTaps - 1 are moved
+// to the front. (Writing each sample just before the dot product that reads it would stall the
+// vector loads on the store.)
+
 void FIR::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException) {
-	float sum;
-	int tap;
 	sample * outPtr = outputBuffer.buffer(outBufNum);
 	unsigned numFrames = outputBuffer.mNumFrames;
-	unsigned numTaps = mFilterSpec->mNumTaps;
-	double *tapDataPtr = mFilterSpec->mTapData;
+	unsigned numTaps = mNumTaps;
 #ifdef CSL_DEBUG
 	logMsg("FIR nextBuffer");
 #endif
 	Effect::pullInput(numFrames);					// get some input
 	sample *inputPtr = mInputPtr;
 
-	for (unsigned i = 0; i < numFrames; i++) {		// sample block loop
-		sum = 0.0;									// output sample accumulator
-		mDLine[mOffset] = inputPtr[i];				// write input sample into delay line
-		tap = mOffset;								// initial reader tap position
-		for (unsigned j = 0; j < numTaps; j++) {	// loop through delay line taps
-			sum += mDLine[tap] * tapDataPtr[j];		// sum scaled d_line data (previous sample * weighting)
-			tap--;									// decrement tap offset
-			if (tap < 0) tap = numTaps - 1;			// wrap around
-		}											// end of tap-per-sample loop
-		outPtr[i] = sum;							// write sum sample to output buffer
-		mOffset++;									// increment and wrap offset
-		mOffset %= numTaps;							// "%=" means modulo-assignment
-	}												// end of sample block loop
-	return;
+	if (mForward) {									// long filter: FFT convolution
+		convolve(inputPtr, outPtr, numFrames);
+		return;
+	}
+	for (unsigned done = 0; done < numFrames; done += CSL_FIR_CHUNK) {
+		unsigned count = csl_min(numFrames - done, (unsigned) CSL_FIR_CHUNK);
+		memcpy(mDLine + numTaps - 1, inputPtr + done, count * sizeof(sample));
+		for (unsigned i = 0; i < count; i++)		// sample block loop
+			outPtr[done + i] = VectorOps::dot(mTaps, mDLine + i, numTaps);
+		memmove(mDLine, mDLine + count, (numTaps - 1) * sizeof(sample));
+	}
+}
+
+// Overlap-save: the history holds the last mFFTSize inputs; after a circular convolution with the
+// taps, its last count samples are the output (the first numTaps - 1 wrap around). Blocks longer
+// than the FFT allows are done in pieces.
+
+void FIR::convolve(SampleBuffer in, SampleBuffer out, unsigned numFrames) {
+	SampleBuffer hist = mHistory.buffer(0);
+	SampleBuffer prod = mProduct.buffer(0);
+	SampleBuffer spect = mSpectrum.buffer(0);
+	SampleBuffer kern = mKernel.buffer(0);
+	unsigned hop = mFFTSize - mNumTaps + 1;
+	while (numFrames > 0) {
+		unsigned count = csl_min(numFrames, hop);
+		memmove(hist, hist + count, (mFFTSize - count) * sizeof(sample));
+		memcpy(hist + mFFTSize - count, in, count * sizeof(sample));
+		mForward->nextBuffer(mHistory, mSpectrum);
+		memset(prod, 0, 2 * mNumBins * sizeof(sample));
+		VectorOps::complexMulAdd(prod, spect, kern, mNumBins);
+		if (mPacked) {								// bin 0 is 2 reals: DC and Nyquist
+			prod[0] = spect[0] * kern[0];
+			prod[1] = spect[1] * kern[1];
+		}
+		mInverse->nextBuffer(mProduct, mResult);
+		memcpy(out, mResult.buffer(0) + mFFTSize - count, count * sizeof(sample));
+		in += count;
+		out += count;
+		numFrames -= count;
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////////
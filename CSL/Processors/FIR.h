@@ -6,15 +6,24 @@
 /// It is provided under GPL by Jake Janovetz (janovetz@uiuc.edu)
 ///
 /// The FIR implementation is based on a minimal version written for the MAT 240B course;
-/// it does not use the CSL RingBuffer helper class.
+/// it does not use the CSL RingBuffer helper class. Short filters run in direct form: the delay
+/// line holds the last numTaps - 1 inputs followed by the block's (the past is copied to the front
+/// again after each block), so the taps of each output sample are one contiguous run, summed with
+/// VectorOps::dot(). From CSL_FIR_FFT_TAPS taps up, the same FIR switches to
+/// FFT block convolution (overlap-save, through the FFTWrapper), with no added latency: each
+/// block's input and the last numTaps - 1 are transformed, multiplied by the taps' spectrum and
+/// transformed back.
 
 #ifndef CSL_FIR_H
 #define CSL_FIR_H
 
 #include "CSL_Core.h"
+#include "FFT_Wrapper.h"
 
 namespace csl {
 
+#define CSL_FIR_FFT_TAPS 128		///< # of taps from which the FIR uses FFT convolution
+#define CSL_FIR_CHUNK 256			///< # of frames the direct form does at a time
 
 class FIR; 	///< forward declaration
 
@@ -84,16 +93,36 @@ public:						/// Various constructors
 	
 	void setTaps(unsigned numTaps,  float *tapDelays);
 	void readTaps(char *fileName);
+	void setFFTThreshold(unsigned numTaps);	///< set the # of taps from which to use FFT convolution
+	unsigned numTaps() { return mNumTaps; };
+	bool usesFFT() { return (mForward != NULL); };	///< whether the taps are applied by FFT
 					/// The work method...
 	void nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException);
 
 protected:
 	FilterSpecification *mFilterSpec;
-	unsigned mOffset;		///< offset "pointer" for loop counting
+	unsigned mNumTaps;		///< # of taps in use
+	unsigned mFFTThreshold;	///< # of taps from which to use the FFT
 							/// Here are the sample buffers (dynamically allocated)
-	sample *mDLine;			///< mNumTaps length delay line
-	
-	void resetDLine();		///< zero-out mDline and reallocate memory if necessary;
+	sample *mTaps;			///< the taps as floats, in reverse order
+	sample *mDLine;			///< delay line: mNumTaps - 1 past inputs + CSL_FIR_CHUNK new ones
+							/// FFT convolution
+	FFTWrapper * mForward;	///< forward and inverse FFTs (NULL in direct form)
+	FFTWrapper * mInverse;
+	unsigned mFFTSize;		///< FFT length
+	unsigned mNumBins;		///< # of complex #s in the FFT's output
+	bool mPacked;			///< whether the FFT packs the Nyquist term into bin 0's imaginary part
+	Buffer mHistory;		///< the last mFFTSize input samples
+	Buffer mSpectrum;		///< spectrum of the history, and its product with the taps' spectrum
+	Buffer mProduct;
+	Buffer mKernel;			///< spectrum of the taps (with the FFTs' scaling taken out)
+	Buffer mResult;			///< the inverse FFT's output
+
+	void resetDLine();		///< set up the taps and the direct-form or FFT state for the spec's taps
+	void freeState();		///< free the delay line and FFT state
+	void planFFT();			///< make the FFTs and the taps' spectrum
+							/// filter numFrames by FFT
+	void convolve(SampleBuffer in, SampleBuffer out, unsigned numFrames);
 	
 							/// Parks-McClellan/Remez FIR filter design algorithm
 	void remez(double h[], int numtaps, int numband, double bands[], double des[], double weight[], int type);
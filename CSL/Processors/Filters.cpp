@@ -9,6 +9,7 @@
 #include <math.h>
 
 #include "Filters.h"
+#include "VectorOps.h"
 
 using namespace csl;
 
@@ -91,6 +92,14 @@ void Filter::init(unsigned a, unsigned b) {
 	mPrevOutputs->allocateBuffers();
 	mPrevInputs->allocateBuffers();
 	mFrameRate = CGestalt::frameRate();
+	mNumSections = 0;
+	mDesigned = false;
+	memset(mState, 0, sizeof(mState));
+	mNumLanes = 0;
+	mLaneState = NULL;
+	mLaneRows = NULL;
+	mLanePtrs = NULL;
+	setCopyPolicy(kParallel);
 }
 
 /// Filter destructor frees temp memory
@@ -98,9 +107,38 @@ void Filter::init(unsigned a, unsigned b) {
 Filter::~Filter (void) { 
 	if (mPrevOutputs) delete mPrevOutputs;
 	if (mPrevInputs) delete mPrevInputs;
+	if (mLaneState) delete[] mLaneState;
+	if (mLaneRows) delete[] mLaneRows;
+	if (mLanePtrs) delete[] mLanePtrs;
 };
 
-// This version does in-place filtering
+// The body of the canonical N-quad filter loop (shared by the rate-specialized loops below)
+
+#define FILTER_TICK												\
+	*prevOPtr = 0.f;											\
+	*prevIPtr = scaleValue * *inputPtr++ + offsetValue;			\
+	for (unsigned j = mBNum - 1; j > 0; j--) {					\
+		*prevOPtr += mBCoeff[j] * prevIns[j];					\
+		prevIns[j] = prevIns[j-1];								\
+	}															\
+	*prevOPtr += mBCoeff[0] * prevIns[0];						\
+	for (unsigned j = mANum - 1; j > 0; j--) {					\
+		*prevOPtr += -mACoeff[j] * prevOuts[j];					\
+		prevOuts[j] = prevOuts[j-1];							\
+	}															\
+	*out++ = (*prevOPtr * scaleValue) + offsetValue
+
+// One transposed-direct-form-II 2nd-order section: x in, y out, state in z1/z2
+
+#define BIQUAD_TICK(x, y, b0, b1, b2, a1, a2, z1, z2)			\
+	y = b0 * x + z1;											\
+	z1 = b1 * x - a1 * y + z2;									\
+	z2 = b2 * x - a2 * y
+
+// The filter loop runs the input through the cascade of sections in runs of up to
+// CSL_FILTER_CONTROL_FRAMES frames; a run's coefficients ramp from their current values to those
+// of the freq/bw at its last frame (for dynamic controls), or of the block (for fixed/control-rate ones),
+// reaching them on that last frame
 
 void Filter::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
 #ifdef CSL_DEBUG
@@ -108,49 +146,507 @@ void Filter::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExcep
 #endif	
 	SampleBuffer out = outputBuffer.buffer(outBufNum);		// get ptr to output channel
 	unsigned numFrames = outputBuffer.mNumFrames;				// get buffer length
-	SampleBuffer prevOuts = mPrevOutputs->buffer(0);
-	SampleBuffer prevIns = mPrevInputs->buffer(0);	
 	SampleBuffer inputPtr;
 
 	DECLARE_SCALABLE_CONTROLS;						// declare the scale/offset buffers and values
 	DECLARE_FILTER_CONTROLS;						// declare the freq/bw buffers and values
 	LOAD_SCALABLE_CONTROLS;
 	LOAD_FILTER_CONTROLS;
-
-	bool isDynamic = false;
+													// audio-rate or ramped freq/bw: new coefficients
+	bool isDynamic = false;							// every CSL_FILTER_CONTROL_FRAMES
 	if ((freqPort && ( ! freqPort->isFixed())) || (bwPort && ( ! bwPort->isFixed())))
 		isDynamic = true;
+	else if (freqPort || bwPort)					// fixed or control-rate: new coefficients
+		this->setupCoeffs();						// every block (ramped in if they changed)
 
 	if (! isInline) {
 		Effect::pullInput(numFrames);				// get some input
 		inputPtr = mInputPtr;						// get a pointer to the input samples
+		if (sleeping(outputBuffer, outBufNum))		// silent input, and my tail has died away
+			return;
 	} else
 		inputPtr = out;
 
+	bool isLinear = IS_LINEAR_SCALABLE;
+	float scaleStep = scalePort->rampStep();		// (0 if the scale/offset aren't ramped)
+	float offsetStep = offsetPort->rampStep();
+	if (isDynamic && ( ! mDesigned)) {				// the first time, start at frame 0's coefficients
+		this->seekControls(0);
+		this->setupCoeffs();
+		this->planSections(1);
+	}
+	unsigned frame = 0;
+	while (frame < numFrames) {
+		unsigned count = numFrames - frame;
+		bool ramping = false;
+		if (isDynamic || (frame == 0)) {			// set up the next run's coefficients
+			if (count > CSL_FILTER_CONTROL_FRAMES)
+				count = CSL_FILTER_CONTROL_FRAMES;
+			if (isDynamic) {
+				this->seekControls(frame + count - 1);
+				this->setupCoeffs();
+			}
+			ramping = this->planSections(count);
+			if (( ! ramping) && ( ! isDynamic))		// no change: do the whole block in one run
+				count = numFrames;
+		}
+		if (mNumSections == 0) {					// unfactorable filter: the rest in direct form
+			this->directForm(inputPtr, out, numFrames - frame, isDynamic, scaleValue, offsetValue, frame);
+			break;
+		}
+		if (isLinear && (mNumSections == 1)) {		// fast loops: one section, state in registers
+			float b0 = mSections[0][0], b1 = mSections[0][1], b2 = mSections[0][2];
+			float a1 = mSections[0][3], a2 = mSections[0][4];
+			float z1 = mState[0][0], z2 = mState[0][1];
+			float x, y;
+			if (ramping) {
+				float db0 = mSteps[0][0], db1 = mSteps[0][1], db2 = mSteps[0][2];
+				float da1 = mSteps[0][3], da2 = mSteps[0][4];
+				for (unsigned i = 0; i < count; i++) {
+					b0 += db0; b1 += db1; b2 += db2; a1 += da1; a2 += da2;
+					x = scaleValue * *inputPtr++ + offsetValue;
+					BIQUAD_TICK(x, y, b0, b1, b2, a1, a2, z1, z2);
+					*out++ = (y * scaleValue) + offsetValue;
+					scaleValue += scaleStep;
+					offsetValue += offsetStep;
+				}
+			} else {
+				for (unsigned i = 0; i < count; i++) {
+					x = scaleValue * *inputPtr++ + offsetValue;
+					BIQUAD_TICK(x, y, b0, b1, b2, a1, a2, z1, z2);
+					*out++ = (y * scaleValue) + offsetValue;
+					scaleValue += scaleStep;
+					offsetValue += offsetStep;
+				}
+			}
+			mState[0][0] = z1;
+			mState[0][1] = z2;
+		} else {									// general loop: N sections, dynamic scale/offset
+			for (unsigned i = 0; i < count; i++) {
+				float x = scaleValue * *inputPtr++ + offsetValue;
+				float y = x;
+				for (unsigned s = 0; s < mNumSections; s++) {
+					float * c = mSections[s];
+					float * z = mState[s];
+					if (ramping) {
+						for (unsigned k = 0; k < 5; k++)
+							c[k] += mSteps[s][k];
+					}
+					BIQUAD_TICK(x, y, c[0], c[1], c[2], c[3], c[4], z[0], z[1]);
+					x = y;
+				}
+				*out++ = (y * scaleValue) + offsetValue;
+				if (isLinear) {
+					UPDATE_SCALABLE_RAMPS;
+				} else {
+					UPDATE_SCALABLE_CONTROLS;		// update the dynamic scale/offset
+				}
+			}
+		}
+		if (ramping)								// land exactly on the targets
+			memcpy(mSections, mTargets, mNumSections * sizeof(mSections[0]));
+		frame += count;
+	}
+	noteOutput(outputBuffer, outBufNum);			// (flag the output if it's gone quiet)
+}
+
+// The multichannel version: the controls and coefficients are set up once per run of frames (as
+// above), and each run is interleaved into rows of channels and put through the sections' lane
+// kernels; scale and offset are applied across each row
+
+void Filter::nextParallel(Buffer & outputBuffer) throw (CException) {
+	unsigned numLanes = parallelChannels(outputBuffer);
+	if (numLanes < 2) {								// mono input: compute 1 channel and copy
+		this->nextBuffer(outputBuffer, 0);
+		copyChannels(outputBuffer, 1);
+		return;
+	}
+	unsigned numFrames = outputBuffer.mNumFrames;
+	DECLARE_SCALABLE_CONTROLS;
+	DECLARE_FILTER_CONTROLS;
+	LOAD_SCALABLE_CONTROLS;
+	LOAD_FILTER_CONTROLS;
+	bool isDynamic = false;
+	if ((freqPort && ( ! freqPort->isFixed())) || (bwPort && ( ! bwPort->isFixed())))
+		isDynamic = true;
+	else if (freqPort || bwPort)
+		this->setupCoeffs();
+
+	Effect::pullInput(numFrames);
+	Buffer * inBuf = inPort()->mBuffer;
+	unsigned numAsleep = 0;
+	for (unsigned c = 0; c < numLanes; c++)
+		if (sleeping(outputBuffer, c))
+			numAsleep++;
+	if (numAsleep == numLanes) {					// all asleep: they're all silent now
+		copyChannels(outputBuffer, numLanes);
+		return;
+	}
+	checkLanes(numLanes);
+	if (isDynamic && ( ! mDesigned)) {
+		this->seekControls(0);
+		this->setupCoeffs();
+		this->planSections(1);
+	}
+	bool isLinear = IS_LINEAR_SCALABLE;
+	bool isUnscaled = IS_UNSCALED;
+	float scaleStep = scalePort->rampStep();
+	float offsetStep = offsetPort->rampStep();
+	float scales[CSL_FILTER_CONTROL_FRAMES];
+	float offsets[CSL_FILTER_CONTROL_FRAMES];
+	SampleBuffer * ins = mLanePtrs;
+	SampleBuffer * outs = mLanePtrs + numLanes;
+	unsigned count;
+	for (unsigned frame = 0; frame < numFrames; frame += count) {
+		count = csl_min(numFrames - frame, (unsigned) CSL_FILTER_CONTROL_FRAMES);
+		bool ramping = false;
+		if (isDynamic || (frame == 0)) {
+			if (isDynamic) {
+				this->seekControls(frame + count - 1);
+				this->setupCoeffs();
+			}
+			ramping = this->planSections(count);
+		}
+		if (mNumSections == 0) {					// unfactorable: the rest of the 1st channel in direct form
+			this->directForm(inBuf->buffer(0) + frame, outputBuffer.buffer(0) + frame, numFrames - frame,
+						isDynamic, scaleValue, offsetValue, frame);
+			noteOutput(outputBuffer, 0);
+			copyChannels(outputBuffer, 1);
+			return;
+		}
+		for (unsigned c = 0; c < numLanes; c++) {
+			ins[c] = inBuf->buffer(c) + frame;
+			outs[c] = outputBuffer.buffer(c) + frame;
+		}
+		VectorOps::interleave(ins, numLanes, mLaneRows, numLanes, count);
+		if ( ! isUnscaled) {						// x = in * scale + offset
+			for (unsigned j = 0; j < count; j++) {
+				scales[j] = scaleValue;
+				offsets[j] = offsetValue;
+				if (isLinear) {
+					UPDATE_SCALABLE_RAMPS;
+				} else {
+					UPDATE_SCALABLE_CONTROLS;
+				}
+				float * row = mLaneRows + j * numLanes;
+				for (unsigned c = 0; c < numLanes; c++)
+					row[c] = row[c] * scales[j] + offsets[j];
+			}
+		}
+		for (unsigned s = 0; s < mNumSections; s++) {
+			float * z = mLaneState + 2 * s * mNumLanes;
+			VectorOps::biquadLanes(mLaneRows, numLanes, count, mSections[s], ramping ? mSteps[s] : NULL,
+						z, z + mNumLanes);
+		}
+		if ( ! isUnscaled) {						// out = y * scale + offset
+			for (unsigned j = 0; j < count; j++) {
+				float * row = mLaneRows + j * numLanes;
+				for (unsigned c = 0; c < numLanes; c++)
+					row[c] = row[c] * scales[j] + offsets[j];
+			}
+		}
+		VectorOps::deinterleave(mLaneRows, numLanes, outs, numLanes, count);
+		if (ramping)
+			memcpy(mSections, mTargets, mNumSections * sizeof(mSections[0]));
+	}
+	for (unsigned c = 0; c < numLanes; c++)
+		noteOutput(outputBuffer, c);
+	copyChannels(outputBuffer, numLanes);
+}
+
+// Make the lane buffers big enough for numLanes channels (the state starts at 0)
+
+void Filter::checkLanes(unsigned numLanes) {
+	if (numLanes <= mNumLanes)
+		return;
+	if (mLaneState) delete[] mLaneState;
+	if (mLaneRows) delete[] mLaneRows;
+	if (mLanePtrs) delete[] mLanePtrs;
+	mNumLanes = numLanes;
+	mLaneState = new float[2 * FILTER_MAX_SECTIONS * numLanes];
+	memset(mLaneState, 0, 2 * FILTER_MAX_SECTIONS * numLanes * sizeof(float));
+	mLaneRows = new float[CSL_FILTER_CONTROL_FRAMES * numLanes];
+	mLanePtrs = new SampleBuffer[2 * numLanes];
+}
+
+// The canonical direct-form N-quad filter loop, for filters that couldn't be factored into sections;
+// it runs numFrames frames starting at firstFrame of the block (which the pointers are already at)
+
+void Filter::directForm(SampleBuffer inputPtr, SampleBuffer out, unsigned numFrames, bool isDynamic,
+						float scaleValue, float offsetValue, unsigned firstFrame) {
+	Port * scalePort = mPortSlots[CSL_SCALE];
+	Port * offsetPort = mPortSlots[CSL_OFFSET];
+	SampleBuffer prevOuts = mPrevOutputs->buffer(0);
+	SampleBuffer prevIns = mPrevInputs->buffer(0);	
 	SampleBuffer prevOPtr = prevOuts;
 	SampleBuffer prevIPtr = prevIns;
-		
+
+	if (( ! isDynamic) && IS_LINEAR_SCALABLE) {		// fast loop: no per-sample port access
+		DECLARE_SCALABLE_RAMPS;
+		for (unsigned i = 0; i < numFrames; i++) {
+			FILTER_TICK;
+			UPDATE_SCALABLE_RAMPS;					// step the ramped scale/offset (if any)
+		}
+		return;
+	}
 	for (unsigned i = 0; i < numFrames; i++) {		// here's the canonical N-quad filter loop
-		if (isDynamic)
+		if (isDynamic) {
+			this->seekControls(firstFrame + i);
 			this->setupCoeffs();					// calculate new coefficients for next sample
-		*prevOPtr = 0.f;
-		*prevIPtr = scaleValue * *inputPtr++ + offsetValue;		// get next input sample, scale & offset
-		for (unsigned j = mBNum - 1; j > 0; j--) {
-			*prevOPtr += mBCoeff[j] * prevIns[j];				// prevIns or prevOuts?
-			prevIns[j] = prevIns[j-1];
-		}
-		*prevOPtr += mBCoeff[0] * prevIns[0];
-		for (unsigned j = mANum - 1; j > 0; j--) {
-			*prevOPtr += -mACoeff[j] * prevOuts[j];
-			prevOuts[j] = prevOuts[j-1];
 		}
-													// put current output in the buffer and increment
-		*out++ = (*prevOPtr * scaleValue) + offsetValue;	
-
+		FILTER_TICK;
 		UPDATE_SCALABLE_CONTROLS;					// update the dynamic scale/offset
 	} 
 }
 
+// Point the dynamic freq/bw ports at the given frame of this block (for setupCoeffs()'s nextValue())
+
+void Filter::seekControls(unsigned frame) {
+	Port * ports[2] = { mPortSlots[CSL_FILTER_FREQUENCY], mPortSlots[CSL_FILTER_AMOUNT] };
+	for (unsigned i = 0; i < 2; i++) {
+		if (ports[i] && ( ! ports[i]->isFixed()))
+			ports[i]->mValuePtr = ports[i]->mBuffer->buffer(0) + frame - 1;	// (nextValue pre-increments)
+	}
+}
+
+// Load the target sections from the coefficients and set up the ramps to them over numFrames.
+// When a high-order filter is re-factored into the same # of sections, the new sections are paired
+// up with the current ones and ramped too (a ramp between two stable sections stays stable); the
+// first time, or when the # of sections changes, jump to them instead
+
+bool Filter::planSections(unsigned numFrames) {
+	bool jump = ! mDesigned;
+	if ((mBNum <= 3) && (mANum <= 3)) {				// 1st/2nd order: one section (a[0] taken as 1)
+		mNumSections = 1;
+		for (unsigned k = 0; k < 3; k++)
+			mTargets[0][k] = (k < mBNum) ? mBCoeff[k] : 0.f;
+		for (unsigned k = 1; k < 3; k++)
+			mTargets[0][k + 2] = (k < mANum) ? mACoeff[k] : 0.f;
+	} else if (( ! mDesigned) || memcmp(mDesignB, mBCoeff, mBNum * sizeof(float))
+			|| memcmp(mDesignA, mACoeff, mANum * sizeof(float))) {
+		unsigned oldSections = mNumSections;
+		if ( ! this->designSections()) {			// can't factor it: use the direct form
+			if (mNumSections != 0) {
+				mPrevInputs->zeroBuffers();
+				mPrevOutputs->zeroBuffers();
+			}
+			mNumSections = 0;
+			mDesigned = true;
+			return false;
+		}
+		if (mNumSections != oldSections) {
+			memset(mState, 0, sizeof(mState));
+			jump = true;
+		} else if ( ! jump)
+			this->matchSections();
+	}
+	mDesigned = true;
+	if (jump) {
+		memcpy(mSections, mTargets, mNumSections * sizeof(mSections[0]));
+		return false;
+	}
+	bool ramping = false;
+	float inc = 1.f / (float) numFrames;
+	for (unsigned s = 0; s < mNumSections; s++) {
+		for (unsigned k = 0; k < 5; k++) {
+			mSteps[s][k] = (mTargets[s][k] - mSections[s][k]) * inc;
+			if (mSteps[s][k] != 0.f)
+				ramping = true;
+		}
+	}
+	return ramping;
+}
+
+// Reorder the new target sections so each follows the current section with the nearest poles
+// (greedily), so the ramps don't swap the poles around; the numerator's gain stays in section 0
+// (designSections() puts it in the highest-order numerator coefficient of its first section)
+
+void Filter::matchSections() {
+	float targets[FILTER_MAX_SECTIONS][5];
+	bool used[FILTER_MAX_SECTIONS];
+	memcpy(targets, mTargets, mNumSections * sizeof(targets[0]));
+	memset(used, 0, sizeof(used));
+	float gain = (targets[0][2] != 0.f) ? targets[0][2] : ((targets[0][1] != 0.f) ? targets[0][1] : targets[0][0]);
+	unsigned gainAt = 0;
+	for (unsigned s = 0; s < mNumSections; s++) {
+		unsigned best = 0;
+		float bestDist = -1.f;
+		for (unsigned t = 0; t < mNumSections; t++) {
+			if (used[t])
+				continue;
+			float dist = fabsf(targets[t][3] - mSections[s][3]) + fabsf(targets[t][4] - mSections[s][4]);
+			if ((bestDist < 0.f) || (dist < bestDist)) {
+				best = t;
+				bestDist = dist;
+			}
+		}
+		used[best] = true;
+		if (best == 0)
+			gainAt = s;
+		memcpy(mTargets[s], targets[best], sizeof(targets[0]));
+	}
+	if ((gainAt != 0) && (gain != 0.f)) {			// move the gain back to section 0
+		for (unsigned k = 0; k < 3; k++) {
+			mTargets[gainAt][k] /= gain;
+			mTargets[0][k] *= gain;
+		}
+	}
+}
+
+// Factor the polynomial p[0] + p[1] x + ... + p[n] x^n (p[n] != 0) into p[n] times the quadratics
+// x^2 + u[i] x + v[i] (and x + w if n is odd) by Bairstow's method; answer the # of quadratics,
+// or -1 if it doesn't converge
+
+static int factorPolynomial(const double * p, unsigned n, double * u, double * v, double * w) {
+	double a[FILTER_MAX_COEFFICIENTS], b[FILTER_MAX_COEFFICIENTS], c[FILTER_MAX_COEFFICIENTS];
+	for (unsigned i = 0; i <= n; i++)				// make it monic
+		a[i] = p[i] / p[n];
+	int numQuads = 0;
+	while (n > 2) {									// find x^2 - r x - s factors
+		static const double guesses[][2] = { { 0.1, -0.5 }, { -1.3, -0.9 }, { 1.7, 0.2 }, { 0.4, 1.1 } };
+		double norm = 0;							// (the remainder b[0], b[1] must get small
+		for (unsigned i = 0; i <= n; i++)			// relative to this; repeated roots, e.g., of
+			norm += fabs(a[i]);						// Butterworth numerators, converge slowly)
+		bool converged = false;
+		double r = 0, s = 0;
+		for (unsigned g = 0; (g < 4) && ( ! converged); g++) {
+			r = guesses[g][0];
+			s = guesses[g][1];
+			for (unsigned iter = 0; iter < 500; iter++) {
+				b[n] = a[n];
+				b[n - 1] = a[n - 1] + r * b[n];
+				for (int i = n - 2; i >= 0; i--)
+					b[i] = a[i] + r * b[i + 1] + s * b[i + 2];
+				double rem = fabs(b[0]) + fabs(b[1]);
+				if (rem <= 1e-14 * norm) {
+					converged = true;
+					break;
+				}
+				c[n] = b[n];
+				c[n - 1] = b[n - 1] + r * c[n];
+				for (int i = n - 2; i >= 1; i--)
+					c[i] = b[i] + r * c[i + 1] + s * c[i + 2];
+				double det = c[2] * c[2] - c[3] * c[1];
+				if (det == 0.0) {
+					converged = (rem <= 1e-9 * norm);
+					break;
+				}
+				double dr = (b[0] * c[3] - b[1] * c[2]) / det;
+				double ds = (b[1] * c[1] - b[0] * c[2]) / det;
+				r += dr;
+				s += ds;
+				if ((fabs(dr) + fabs(ds)) <= 1e-13 * (1.0 + fabs(r) + fabs(s))) {
+					converged = true;
+					break;
+				}
+				if (iter == 499)						// slow, but maybe close enough
+					converged = (rem <= 1e-9 * norm);
+			}
+		}
+		if ( ! converged)
+			return -1;
+		b[n] = a[n];								// deflate (with the final r, s)
+		b[n - 1] = a[n - 1] + r * b[n];
+		for (int i = n - 2; i >= 2; i--)
+			b[i] = a[i] + r * b[i + 1] + s * b[i + 2];
+		for (unsigned i = 2; i <= n; i++)
+			a[i - 2] = b[i];
+		n -= 2;
+		u[numQuads] = -r;
+		v[numQuads] = -s;
+		numQuads++;
+	}
+	if (n == 2) {
+		u[numQuads] = a[1];
+		v[numQuads] = a[0];
+		numQuads++;
+	} else if (n == 1)
+		*w = a[0];
+	return numQuads;
+}
+
+// Factor b(z^-1) and a(z^-1) (a[0] taken as 1) into 2nd-order sections; the numerator's gain
+// goes into the first section. Answer false if the factoring fails or doesn't multiply back out
+
+bool Filter::designSections() {
+	double bp[FILTER_MAX_COEFFICIENTS], ap[FILTER_MAX_COEFFICIENTS];
+	double bu[FILTER_MAX_SECTIONS], bv[FILTER_MAX_SECTIONS], au[FILTER_MAX_SECTIONS], av[FILTER_MAX_SECTIONS];
+	double bw = 0, aw = 0;
+	memcpy(mDesignB, mBCoeff, mBNum * sizeof(float));
+	memcpy(mDesignA, mACoeff, mANum * sizeof(float));
+	int nb = mBNum - 1;								// the degrees, without trailing 0s
+	int na = mANum - 1;
+	while ((nb > 0) && (mBCoeff[nb] == 0.f))
+		nb--;
+	while ((na > 0) && (mACoeff[na] == 0.f))
+		na--;
+	for (int i = 0; i <= nb; i++)
+		bp[i] = mBCoeff[i];
+	ap[0] = 1.0;
+	for (int i = 1; i <= na; i++)
+		ap[i] = mACoeff[i];
+	if (bp[nb] == 0.0)								// all-zero numerator
+		nb = 0;
+	int bq = (nb > 0) ? factorPolynomial(bp, nb, bu, bv, & bw) : 0;
+	int aq = (na > 0) ? factorPolynomial(ap, na, au, av, & aw) : 0;
+	if ((bq < 0) || (aq < 0))
+		return false;
+	unsigned numB = bq + (nb & 1);					// # of numerator/denominator factors
+	unsigned numA = aq + (na & 1);
+	mNumSections = (numB > numA) ? numB : numA;
+	if (mNumSections == 0)
+		mNumSections = 1;
+	for (unsigned s = 0; s < mNumSections; s++) {
+		double sec[5] = { 1, 0, 0, 0, 0 };
+		if (s < (unsigned) bq) {					// x^2 + u x + v in z^-1: v + u z^-1 + z^-2
+			sec[0] = bv[s]; sec[1] = bu[s]; sec[2] = 1;
+		} else if (s < numB) {						// x + w
+			sec[0] = bw; sec[1] = 1;
+		}
+		if (s < (unsigned) aq) {					// normalized to 1 + (u/v) z^-1 + (1/v) z^-2
+			if (av[s] == 0.0)
+				return false;
+			sec[3] = au[s] / av[s]; sec[4] = 1.0 / av[s];
+		} else if (s < numA) {
+			if (aw == 0.0)
+				return false;
+			sec[3] = 1.0 / aw;
+		}
+		if (s == 0)									// the numerator's gain
+			for (unsigned k = 0; k < 3; k++)
+				sec[k] *= bp[nb];
+		for (unsigned k = 0; k < 5; k++)
+			mTargets[s][k] = (float) sec[k];
+	}
+	double prodB[FILTER_MAX_COEFFICIENTS + 2] = { 1 };	// check: multiply the sections back out
+	double prodA[FILTER_MAX_COEFFICIENTS + 2] = { 1 };
+	unsigned deg = 0;
+	for (unsigned s = 0; s < mNumSections; s++) {
+		for (int i = deg + 2; i >= 0; i--) {
+			double sb = 0, sa = 0;
+			for (unsigned k = 0; k < 3; k++) {
+				if ((i - (int) k >= 0) && (i - k <= deg)) {
+					sb += mTargets[s][k] * prodB[i - k];
+					sa += ((k == 0) ? 1.0 : mTargets[s][k + 2]) * prodA[i - k];
+				}
+			}
+			prodB[i] = sb;
+			prodA[i] = sa;
+		}
+		deg += 2;
+	}
+	double bMax = 0, aMax = 0, bErr = 0, aErr = 0;
+	for (unsigned i = 0; i <= deg; i++) {
+		double bi = ((int) i <= nb) ? bp[i] : 0.0;
+		double ai = ((int) i <= na) ? ap[i] : 0.0;
+		bMax = fmax(bMax, fabs(bi));
+		aMax = fmax(aMax, fabs(ai));
+		bErr = fmax(bErr, fabs(prodB[i] - bi));
+		aErr = fmax(aErr, fabs(prodA[i] - ai));
+	}
+	return (bErr <= 1e-4 * bMax) && (aErr <= 1e-4 * aMax);
+}
+
 /// this version is to be inherited by the subclasses. provides a way to directly supply the filter info
 
 void Filter::setupCoeffs(SampleBuffer bCoeffs, SampleBuffer aCoeffs, unsigned num_b, unsigned num_a ) {
@@ -163,6 +659,9 @@ void Filter::setupCoeffs(SampleBuffer bCoeffs, SampleBuffer aCoeffs, unsigned nu
 void Filter::clear(void) {
 	mPrevInputs->zeroBuffers();
 	mPrevOutputs->zeroBuffers();
+	memset(mState, 0, sizeof(mState));
+	if (mLaneState)
+		memset(mLaneState, 0, 2 * FILTER_MAX_SECTIONS * mNumLanes * sizeof(float));
 }
 
 /// log information about myself
@@ -246,8 +745,8 @@ Butter::Butter (UnitGenerator & in, ButterworthType type, UnitGenerator & center
 
 void Butter::setupCoeffs () {
 	float C, D; 					// handy intermediate variables
-	float centreFreq = mInputs[CSL_FILTER_FREQUENCY]->nextValue();
-	float bandwidth = mInputs[CSL_FILTER_AMOUNT]->nextValue();
+	float centreFreq = mPortSlots[CSL_FILTER_FREQUENCY]->nextValue();
+	float bandwidth = mPortSlots[CSL_FILTER_AMOUNT]->nextValue();
 
 	mACoeff[0] = 0.f;
 	switch (mFilterType) {			// These are the Butterworth equations
@@ -314,8 +813,8 @@ void Formant::setNormalize(bool normalize) {
 //	to be done every sample for dynamic controls
 
 void Formant::setupCoeffs () {
-	float centreFreq = mInputs[CSL_FILTER_FREQUENCY]->nextValue();
-	float radius = mInputs[CSL_FILTER_AMOUNT]->nextValue();
+	float centreFreq = mPortSlots[CSL_FILTER_FREQUENCY]->nextValue();
+	float radius = mPortSlots[CSL_FILTER_AMOUNT]->nextValue();
 	    
 	mACoeff[0] = 1.0F;
 	mACoeff[1] = cos(CSL_TWOPI * centreFreq * 1.f / mFrameRate ) * (-2.0F) * radius;
@@ -345,8 +844,8 @@ Notch::Notch (UnitGenerator & in, UnitGenerator & cutoff, float radius) : Filter
 
 //	Calculate the filter coefficients based on the frequency characteristics
 void Notch::setupCoeffs () {
-	float centreFreq = mInputs[CSL_FILTER_FREQUENCY]->nextValue();
-	float radius = mInputs[CSL_FILTER_AMOUNT]->nextValue();
+	float centreFreq = mPortSlots[CSL_FILTER_FREQUENCY]->nextValue();
+	float radius = mPortSlots[CSL_FILTER_AMOUNT]->nextValue();
 	
 	//coeff's similar to formant but opposite
 	mBCoeff[0] = 1.0F;
@@ -373,7 +872,7 @@ Allpass::Allpass (UnitGenerator & in, UnitGenerator & coeff) : Filter(in,2,2) {
 
 //	Calculate the filter coefficients based on supplied coeffs
 void Allpass::setupCoeffs () {
-	float coefficient = mInputs[CSL_FILTER_FREQUENCY]->nextValue();
+	float coefficient = mPortSlots[CSL_FILTER_FREQUENCY]->nextValue();
 	
 	mACoeff[0] = mBCoeff[1] = 1.0;
 	mBCoeff[0] = mACoeff[1] = coefficient; 
@@ -419,7 +918,7 @@ void Moog::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExcepti
 #endif	
 	sample* out = outputBuffer.buffer(outBufNum);	// get ptr to output channel
 	unsigned numFrames = outputBuffer.mNumFrames;		// get buffer length
-	SampleBuffer inputPtr = mInputs[CSL_INPUT]->mBuffer->buffer(outBufNum);
+	SampleBuffer inputPtr = mPortSlots[CSL_INPUT]->mBuffer->buffer(outBufNum);
 	DECLARE_SCALABLE_CONTROLS;							// declare the scale/offset buffers and values
 	DECLARE_FILTER_CONTROLS;							// declare the freq/bw buffers and values
 	LOAD_SCALABLE_CONTROLS;
@@ -449,8 +948,8 @@ void Moog::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExcepti
 // Calculate the filter coefficients based on the frequency characteristics
 
 void Moog::setupCoeffs () {
-	float centreFreq = mInputs[CSL_FILTER_FREQUENCY]->nextValue();
-	float resonance = mInputs[CSL_FILTER_AMOUNT]->nextValue();
+	float centreFreq = mPortSlots[CSL_FILTER_FREQUENCY]->nextValue();
+	float resonance = mPortSlots[CSL_FILTER_AMOUNT]->nextValue();
 
 	float f, scale;
 	f = 2 * centreFreq / mFrameRate;				 //[0 - 1] 
@@ -23,6 +23,18 @@
 /// memcopy the input to the output, then pounce on that; or do the in-place stuff in the Effect port 
 /// and finally copy to output, say with scale & offset performed there.
 ///	
+///	The filter core runs the coefficients as a cascade of 2nd-order sections in transposed direct
+/// form II (2 state variables per section, held in registers across the sample loop). 1st- and
+/// 2nd-order filters (Butter, Formant, Notch, Allpass) are a single section; higher orders are
+/// factored into sections (falling back to the direct-form loop if the factoring fails).
+/// Dynamic frequency/amount inputs are read every CSL_FILTER_CONTROL_FRAMES frames, and the
+/// coefficients are interpolated linearly between these updates (and across changes of
+/// fixed or control-rate inputs), so sweeps cost one setupCoeffs() per control period
+/// rather than one per sample, and don't zipper.
+/// Filters use the kParallel copy policy: with a multichannel input, all its channels run through
+/// the cascade at once, one channel per SIMD lane (VectorOps::biquadLanes()), sharing the control
+/// inputs and coefficients; each channel keeps its own state.
+///	
 ///	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
 ///
 
@@ -30,6 +42,8 @@
 #define CSL_Filters_H
 
 #define FILTER_MAX_COEFFICIENTS (16)			// seems reasonable?
+#define FILTER_MAX_SECTIONS (FILTER_MAX_COEFFICIENTS / 2)	// 2nd-order sections of the cascade
+#define CSL_FILTER_CONTROL_FRAMES 32			// frames between coefficient updates of swept filters
 
 #include "CSL_Core.h"
 
@@ -54,8 +68,8 @@ typedef enum {
 /// Declare the pointer to freq/bw buffers (if used) and current scale/offset values
 
 #define DECLARE_FILTER_CONTROLS										\
-	Port * freqPort = mInputs[CSL_FILTER_FREQUENCY];				\
-	Port * bwPort = mInputs[CSL_FILTER_AMOUNT]
+	Port * freqPort = mPortSlots[CSL_FILTER_FREQUENCY];				\
+	Port * bwPort = mPortSlots[CSL_FILTER_AMOUNT]
 
 /// Load the freq/bw-related values at the start
 
@@ -103,19 +117,46 @@ public:
 	void setupCoeffs(SampleBuffer bCoeffs, SampleBuffer aCoeffs, unsigned num_b, unsigned num_a );
 	
 	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
+													/// filter all the channels of a multichannel input
+	virtual void nextParallel(Buffer & outputBuffer) throw (CException);
 	
 	void dump();									///< log information about myself
 	
 protected:
 	void init(unsigned a, unsigned b);				///< shared initialization function
+													/// set up the sections' coefficients for the next
+													/// numFrames (answer whether they're ramping)
+	bool planSections(unsigned numFrames);
+	bool designSections();							///< factor the coefficients into mTargets
+	void matchSections();							///< reorder mTargets to pair up with mSections
+	void seekControls(unsigned frame);				///< point dynamic freq/bw ports at a frame of the block
+													/// the direct-form loop (for unfactorable filters),
+													/// from the given frame of the block
+	void directForm(SampleBuffer inputPtr, SampleBuffer out, unsigned numFrames, bool isDynamic,
+						float scaleValue, float offsetValue, unsigned firstFrame = 0);
 
 	float mBCoeff[FILTER_MAX_COEFFICIENTS];			///< array of numerator coeffs
-	float mACoeff[FILTER_MAX_COEFFICIENTS];			///< array of denominator coeffs
+	float mACoeff[FILTER_MAX_COEFFICIENTS];			///< array of denominator coeffs (a[0] is taken as 1)
 	unsigned mBNum;									///< number of coeffs in b
 	unsigned mANum;									///< number of coeffs in a
 	Buffer * mPrevInputs;							///< arrays of past input and output samples
 	Buffer * mPrevOutputs;
 	float mFrame;									///< to keep hold of sample rate for calculating coeffs
+
+	unsigned mNumSections;							///< # of sections in the cascade (0 = use direct form)
+	float mSections[FILTER_MAX_SECTIONS][5];		///< current b0, b1, b2, a1, a2 of each section
+	float mTargets[FILTER_MAX_SECTIONS][5];			///< the coefficients they're ramping to
+	float mSteps[FILTER_MAX_SECTIONS][5];			///< and their per-sample increments
+	float mState[FILTER_MAX_SECTIONS][2];			///< z1, z2 of each section
+	float mDesignB[FILTER_MAX_COEFFICIENTS];		///< the (higher-order) coefficients mTargets came from
+	float mDesignA[FILTER_MAX_COEFFICIENTS];
+	bool mDesigned;									///< whether the sections have been set up yet
+
+	unsigned mNumLanes;								///< # of channels the lane buffers are for
+	float * mLaneState;								///< [section][z1/z2][channel] state of the lanes
+	float * mLaneRows;								///< a run of frames, interleaved
+	SampleBuffer * mLanePtrs;						///< the channels' input and output pointers
+	void checkLanes(unsigned numLanes);				///< (re-)allocate the lane buffers if needed
 };
 
 /// Butterworth IIR (2nd order recursive) filter.
@@ -219,6 +260,11 @@ public:
 	void setupCoeffs ();
 	
 	void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);	
+									/// (a multichannel input's 1st channel, copied, as before)
+	void nextParallel(Buffer & outputBuffer) throw (CException) {
+		nextBuffer(outputBuffer, 0);
+		copyChannels(outputBuffer, 1);
+	};
 
 protected:
 	float k, p, r; 	// coefficients
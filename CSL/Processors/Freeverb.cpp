@@ -5,6 +5,7 @@
 // 
 
 #include "Freeverb.h"
+#include "VectorOps.h"
 
 //#undef GCC_AUTO_VECTORIZATION
 
@@ -36,6 +37,7 @@ const int	kStereoSpread	= 23;
 
 const int kCombBufferSizes[] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
 const int kAllpassBufferSizes[] = { 556, 441, 341, 225 };
+const unsigned kLaneFrames = 64;	// frames per run of the multichannel version (< the shortest line)
 
 // ~~~~~~ Comb implementation ~~~~~~~~~~ //
 
@@ -68,8 +70,10 @@ void FAllpass::mute() {
 
 // ~~~~~~~ Freeverb implementation ~~~~~~ //
 
-Freeverb::Freeverb(UnitGenerator &input) : Effect(input) { 
+Freeverb::Freeverb(UnitGenerator &input) : Effect(input), mNumLanes(0), mCombLanes(0), mAllpassLanes(0),
+			mCombStores(0), mCombIndices(0), mAllpassIndices(0), mLaneRows(0), mLaneSums(0), mLanePtrs(0) { 
 	constructReverbGraph(); 
+	setCopyPolicy(kParallel);
 }
 
 Freeverb::~Freeverb() {
@@ -86,6 +90,7 @@ Freeverb::~Freeverb() {
 	std::vector<FAllpass*>::iterator iAllpass = mAllpassFilters.begin();
 	for (; iAllpass != mAllpassFilters.end(); ++iAllpass) 
 		delete *iAllpass;		
+	freeLanes();
 }
 
 void Freeverb::constructReverbGraph() {
@@ -180,6 +185,8 @@ void Freeverb::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CExce
 	unsigned numFrames = outputBuffer.mNumFrames;
 	sample * fp = outputBuffer.buffer(outBufNum);
 	this->pullInput(outputBuffer);
+	if (sleeping(outputBuffer, outBufNum))			// silent input, and the tail has died away
+		return;
 	sample * inputBuf = mInputPtr;
 	float out, input;
 	unsigned i;
@@ -199,6 +206,110 @@ void Freeverb::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CExce
 			out = (*iAllpass)->process(out);
 		*fp++ = out * mWetLevel + inputBuf[i] * mDryLevel; // Calculate output REPLACING anything already there
 	}
+	noteOutput(outputBuffer, outBufNum);
+}
+
+// The multichannel version: the input is interleaved (scaled by the gain) in runs of kLaneFrames,
+// each comb adds all the channels' outputs into the sums at once, and the sums go through the
+// allpasses in series; the combs and allpasses have the same feedback and damping as the mono ones.
+
+void Freeverb::nextParallel(Buffer &outputBuffer) throw (CException) {
+	unsigned numLanes = parallelChannels(outputBuffer);
+	if (numLanes < 2) {								// mono input: as before
+		this->nextBuffer(outputBuffer, 0);
+		copyChannels(outputBuffer, 1);
+		return;
+	}
+	unsigned numFrames = outputBuffer.mNumFrames;
+	this->pullInput(outputBuffer);					// all the input channels, in place
+	unsigned numAsleep = 0;
+	for (unsigned c = 0; c < numLanes; c++)
+		if (sleeping(outputBuffer, c))
+			numAsleep++;
+	if (numAsleep == numLanes) {
+		copyChannels(outputBuffer, numLanes);
+		return;
+	}
+	checkLanes(numLanes);
+	SampleBuffer * chans = mLanePtrs;
+	unsigned count;
+	for (unsigned frame = 0; frame < numFrames; frame += count) {
+		count = csl_min(numFrames - frame, kLaneFrames);
+		unsigned numSamples = count * numLanes;
+		for (unsigned c = 0; c < numLanes; c++)
+			chans[c] = outputBuffer.buffer(c) + frame;
+		VectorOps::interleave(chans, numLanes, mLaneRows, numLanes, count);
+		VectorOps::mul(mLaneSums, mLaneRows, mGain, numSamples);	// (the combs' input)
+		memset(mLaneRows, 0, numSamples * sizeof(sample));
+		for (unsigned i = 0; i < kNumCombs; i++) {	// accumulate the combs in parallel
+			Comb * comb = mCombFilters[i];
+			VectorOps::combLanes(mLaneRows, mLaneSums, numLanes, count, mCombLanes[i],
+						kCombBufferSizes[i], mCombIndices[i], mCombStores[i],
+						comb->damp(), 1.0f - comb->damp(), comb->feedback());
+			mCombIndices[i] = (mCombIndices[i] + count) % kCombBufferSizes[i];
+		}
+		for (unsigned i = 0; i < kNumAllpasses; i++) {	// then the allpasses in series
+			VectorOps::allpassLanes(mLaneRows, numLanes, count, mAllpassLanes[i],
+						kAllpassBufferSizes[i], mAllpassIndices[i], mAllpassFilters[i]->feedback());
+			mAllpassIndices[i] = (mAllpassIndices[i] + count) % kAllpassBufferSizes[i];
+		}
+													// out = wet * reverb + dry * input (the sums are input * gain)
+		VectorOps::mul(mLaneRows, mLaneRows, mWetLevel, numSamples);
+		VectorOps::scaleAdd(mLaneRows, mLaneSums, mDryLevel / mGain, numSamples);
+		VectorOps::deinterleave(mLaneRows, numLanes, chans, numLanes, count);
+	}
+	for (unsigned c = 0; c < numLanes; c++)
+		noteOutput(outputBuffer, c);
+	copyChannels(outputBuffer, numLanes);
+}
+
+// Allocate the interleaved lines for numLanes channels (if there aren't enough), all silent
+
+void Freeverb::checkLanes(unsigned numLanes) {
+	if (numLanes <= mNumLanes)
+		return;
+	freeLanes();
+	mNumLanes = numLanes;
+	mCombLanes = new SampleBuffer[kNumCombs];
+	mCombStores = new SampleBuffer[kNumCombs];
+	mCombIndices = new unsigned[kNumCombs];
+	for (int i = 0; i < kNumCombs; i++) {
+		mCombLanes[i] = new sample[kCombBufferSizes[i] * numLanes];
+		memset(mCombLanes[i], 0, kCombBufferSizes[i] * numLanes * sizeof(sample));
+		mCombStores[i] = new sample[numLanes];
+		memset(mCombStores[i], 0, numLanes * sizeof(sample));
+		mCombIndices[i] = 0;
+	}
+	mAllpassLanes = new SampleBuffer[kNumAllpasses];
+	mAllpassIndices = new unsigned[kNumAllpasses];
+	for (int i = 0; i < kNumAllpasses; i++) {
+		mAllpassLanes[i] = new sample[kAllpassBufferSizes[i] * numLanes];
+		memset(mAllpassLanes[i], 0, kAllpassBufferSizes[i] * numLanes * sizeof(sample));
+		mAllpassIndices[i] = 0;
+	}
+	mLaneRows = new sample[kLaneFrames * numLanes];
+	mLaneSums = new sample[kLaneFrames * numLanes];
+	mLanePtrs = new SampleBuffer[numLanes];
+}
+
+void Freeverb::freeLanes() {
+	if ( ! mNumLanes)
+		return;
+	for (int i = 0; i < kNumCombs; i++) {
+		delete[] mCombLanes[i];
+		delete[] mCombStores[i];
+	}
+	for (int i = 0; i < kNumAllpasses; i++)
+		delete[] mAllpassLanes[i];
+	delete[] mCombLanes;
+	delete[] mCombStores;
+	delete[] mCombIndices;
+	delete[] mAllpassLanes;
+	delete[] mAllpassIndices;
+	delete[] mLaneRows;
+	delete[] mLaneSums;
+	delete[] mLanePtrs;
+	mNumLanes = 0;
 }
 
 //// Stereoverb ////////////////////////////////
@@ -19,6 +19,10 @@ class FAllpass;
 ///
 /// CSL port of the public domain Freeverb reverberator
 ///
+/// With a multichannel input (the kParallel copy policy), each channel gets its own reverb
+/// with the same settings; the channels' combs and allpasses run side-by-side in SIMD lanes
+/// (VectorOps::combLanes() and allpassLanes()), their delay lines interleaved by channel.
+///
 
 class Freeverb : public Effect, public Scalable {
 
@@ -38,6 +42,7 @@ public:
 	void setWidth(float width);		///< Currently not used, as this reverb became mono in/out.
 	
 	void nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException);
+	void nextParallel(Buffer &outputBuffer) throw (CException);	///< reverb each input channel
 
 protected:			// accessable parameters
 	float mRoomSize;
@@ -53,8 +58,20 @@ protected:			// accessable parameters
 
 	SampleBufferVector mCombBuffers;
 	SampleBufferVector mAllpassBuffers;	
+					// the multichannel version's state
+	unsigned mNumLanes;				///< # of channels the lanes are for
+	SampleBufferVector mCombLanes;	///< [comb][frame][channel] delay lines
+	SampleBufferVector mAllpassLanes;
+	SampleBufferVector mCombStores;	///< [comb][channel] comb low-pass states
+	unsigned * mCombIndices;		///< the lines' positions
+	unsigned * mAllpassIndices;
+	sample * mLaneRows;				///< [frame][channel] input and sum scratch
+	sample * mLaneSums;
+	SampleBuffer * mLanePtrs;		///< the channels' input and output pointers
 
 	void constructReverbGraph();
+	void checkLanes(unsigned numLanes);	///< (re-)allocate the lanes if needed
+	void freeLanes();
 	void updateParameters();
 };
 
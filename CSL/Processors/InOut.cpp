@@ -83,7 +83,7 @@ void InOut::nextBuffer(Buffer & outputBuffer) throw (CException) {
 		inputBuffer = &(mIO->mInputBuffer);
 	} else {
 		Effect::pullInput(numFrames);
-		Port * tinPort = mInputs[CSL_INPUT];
+		Port * tinPort = mPortSlots[CSL_INPUT];
 		inputBuffer = tinPort->mBuffer;
 	}
 
@@ -4,6 +4,9 @@
 //
 
 #include "Mixer.h"
+#include "VectorOps.h"		// SIMD kernels for the sums and gains
+#include "RealTimeCheck.h"		// debugging/profiling hooks
+#include "UGenProfiler.h"
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
@@ -145,13 +148,16 @@ unsigned Mixer::activeSources() {
 //	return false;
 //}
 
-// Here's the mixing part -- fill the buffer with the next num_frames values
+// Here's the mixing part -- fill the buffer with the next num_frames values; inputs (or channels)
+// flagged silent are skipped, and output channels nothing was added to are flagged silent
 
 void Mixer::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	SampleBuffer out1, out2, opp;
+	Buffer * src;
 	unsigned numIns = mSources.size();
 	unsigned numFrames = outputBuffer.mNumFrames;
-	unsigned j, k, ich;
+	unsigned j, ich;
+	unsigned long long mixed = 0;						// bit mask of the channels summed into
 //	unsigned ins = mSources.size();
 
 //	logMsg("Mixer %x - nxt_b %d - %d in - S %d", this, numFrames, numIns, outputBuffer.mSequence);
@@ -165,41 +171,47 @@ void Mixer::nextBuffer(Buffer & outputBuffer) throw (CException) {
 			ich = input->numChannels();
 //			printf("\tnext_b %d, inp %x active, %d ch\n", numFrames, input, ich);
 			float scal = mScaleValues[i];
-			mOpBuffer.mNumChannels = ich;
-			mOpBuffer.mSequence = outputBuffer.mSequence;
-			mOpBuffer.zeroBuffers();					// clear operation buffer
-			
-			input->nextBuffer(mOpBuffer);				// get the input's nextBuffer
-
+										// if the input caches its output (fan-out or pre-rendered
+										// by a GraphExecutor), sum straight from the cache
+			src = input->outputView(numFrames, outputBuffer.mSequence);
+			if ((src == NULL) || (src->mNumChannels < ich)) {
+				mOpBuffer.mNumChannels = ich;
+				mOpBuffer.mSequence = outputBuffer.mSequence;
+				mOpBuffer.zeroBuffers();				// clear operation buffer
+				mOpBuffer.clearSilence();
+				CSL_RT_UGEN_SCOPE(input);
+				CSL_PROFILE_SCOPE(input);
+				input->nextBuffer(mOpBuffer);			// get the input's nextBuffer
+				src = & mOpBuffer;
+			}
 			if (ich == mNumChannels) {					// if input and mixer have same # of channels
 				for (j = 0; j < ich; j++)	{			// j loops through channels
+					if (src->isSilent(j))				// (nothing to add)
+						continue;
+					if (j < 64)
+						mixed |= (1ULL << j);
 					out1 = outputBuffer.buffer(j);
-					opp = mOpBuffer.buffer(j);
-//					if ((out1 == 0) || (opp == 0))
-//						return;
-					if (scal == 1.0f) {
-						for (k = 0; k < numFrames; k++)	// k loops through sample buffers
-							*out1++ += *opp++;			// summing samples into the output buffer
-					} else {
-						for (k = 0; k < numFrames; k++)	// k loops through sample buffers
-							*out1++ += (*opp++ * scal);	// summing samples into the output buffer
-					}
+					opp = src->buffer(j);
+					if (scal == 1.0f)					// sum the samples into the output buffer
+						VectorOps::add(out1, opp, numFrames);
+					else
+						VectorOps::scaleAdd(out1, opp, scal, numFrames);
 				}
 			}											// special case: mix mono to stereo
 			else if ((ich == 1) && (mNumChannels == 2)) {
+				if (src->isSilent(0))
+					continue;
+				mixed |= 3;
 				out1 = outputBuffer.buffer(0);
 				out2 = outputBuffer.buffer(1);
-				opp = mOpBuffer.buffer(0);
-				if (scal == 1.0f)
-					for (k = 0; k < numFrames; k++) {	// k loops through sample buffers
-						*out1++ += *opp;				// sum mono-to-stereo
-						*out2++ += *opp++;
-					}
-				else
-					for (k = 0; k < numFrames; k++) {	// k loops through sample buffers
-						*out1++ += *opp * scal;				// sum mono-to-stereo
-						*out2++ += *opp++ * scal;
-					}
+				opp = src->buffer(0);
+				if (scal == 1.0f) {						// sum mono-to-stereo
+					VectorOps::add(out1, opp, numFrames);
+					VectorOps::add(out2, opp, numFrames);
+				} else {
+					VectorOps::scaleAdd(out1, opp, scal, numFrames);
+					VectorOps::scaleAdd(out2, opp, scal, numFrames);
+				}
 			} else {									// ??? -- channel # mismatch
 				logMsg(kLogError, "Error in mix: in = %d ch, out = %d ch\n", ich, mNumChannels);
 			}
@@ -211,7 +223,7 @@ void Mixer::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	sample samp;			// loop through output buffer per-channel applying scale/offset
 	for (j = 0; j < mNumChannels; j++) {
 		out1 = outputBuffer.buffer(j];
-		for (k = 0; k < numFrames; k++)	 {
+		for (unsigned k = 0; k < numFrames; k++)	 {
 			samp = *out1;
 			samp = (samp * scaleValue) + offsetValue;
 			*out1++ = samp;
@@ -224,7 +236,8 @@ void Mixer::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	}
 #endif
 	mOpBuffer.mAreBuffersZero = false;
-
+	for (j = 0; j < outputBuffer.mNumChannels; j++)		// flag the channels nothing was added to
+		outputBuffer.setSilent(j, (j < 64) && ! ((mixed >> j) & 1));
 }
 
 // print info about this instance
@@ -298,15 +311,39 @@ void Panner::nextBuffer(Buffer &outputBuffer) throw (CException) {
 
 //	logMsg("	Panner: nxt_b %d", numFrames);
 	DECLARE_SCALABLE_CONTROLS;						// declare the scale/offset buffers and values
-	LOAD_SCALABLE_CONTROLS;
-
-	Effect::pullInput(numFrames);					// get the input samples via Effect
+	Port * posPort = mPortSlots[CSL_POSITION];
+	try {
+		LOAD_SCALABLE_CONTROLS;
+		Effect::pullInput(numFrames);				// get the input samples via Effect
+		Controllable::pullInput(posPort, numFrames);	// get the position UGen's data
+	} catch (CException & ex) {						// don't leave the fan-out lock held
+		if (mFanOutLock)
+			unlockFanOut();
+		throw;
+	}
+	if (inputIsSilent(0) || scalePort->isSilent()) {			// silent input: silent output
+		zeroBuffer(outputBuffer, 0);
+		zeroBuffer(outputBuffer, 1);
+		handleFanOut(outputBuffer);
+		return;
+	}
 	SampleBuffer inpp = mInputPtr;
-
-	Port * posPort = mInputs[CSL_POSITION];
-	Controllable::pullInput(posPort, numFrames);				// get the position UGen's data
 	float posValue = posPort->nextValue() * 0.5;				// get and scale the first position value
-	
+										// if the gains are linear over the block (i.e., position
+										// and scale aren't both changing), use the gain-ramp kernel
+	if (posPort->isLinear() && scalePort->isLinear()
+			&& ((posPort->rampStep() == 0.0f) || (scalePort->rampStep() == 0.0f))) {
+		float posStep = posPort->rampStep() * 0.5f;
+		float scaleStep = scalePort->rampStep();
+		float gainL = (0.5f - posValue) * scaleValue;
+		float gainR = (posValue + 0.5f) * scaleValue;
+		float stepL = (scaleStep * (0.5f - posValue)) - (posStep * scaleValue);
+		float stepR = (scaleStep * (posValue + 0.5f)) + (posStep * scaleValue);
+		VectorOps::mulRamp(out1, inpp, gainL, stepL, numFrames);
+		VectorOps::mulRamp(out2, inpp, gainR, stepR, numFrames);
+		handleFanOut(outputBuffer);
+		return;
+	}
 	for (unsigned i = 0; i < numFrames; i++) {
 		*out1++ = (*inpp) * (0.5 - posValue) * scaleValue;		// L sample
 		*out2++ = (*inpp++) * (posValue + 0.5) * scaleValue;	// R sample
@@ -374,7 +411,7 @@ void NtoMPanner::setY(float pan) {
 
 void NtoMPanner::nextBuffer(Buffer &outputBuffer) throw (CException) {
 	unsigned numFrames = outputBuffer.mNumFrames;
-	float a_scale, dist, l_samp, r_samp, o_samp;
+	float a_scale, dist;
 	CPoint l_pos, r_pos;
 #ifdef CSL_WINDOWS
 	float l_weights[MAX_OUTPUTS], r_weights[MAX_OUTPUTS];
@@ -387,10 +424,10 @@ void NtoMPanner::nextBuffer(Buffer &outputBuffer) throw (CException) {
 
 	Effect::pullInput(numFrames);					// get the input samples via Effect
 
-	Port * posXPort = mInputs[CSL_POSITIONX];
+	Port * posXPort = mPortSlots[CSL_POSITIONX];
 	Controllable::pullInput(posXPort, numFrames);	// get the position UGen's data
 	float posXValue = posXPort->nextValue();			// get and scale the first position value
-	Port * posYPort = mInputs[CSL_POSITIONY];
+	Port * posYPort = mPortSlots[CSL_POSITIONY];
 	Controllable::pullInput(posYPort, numFrames);	// get the position UGen's data
 	float posYValue = posYPort->nextValue();			// get and scale the first position value
 
@@ -423,18 +460,13 @@ void NtoMPanner::nextBuffer(Buffer &outputBuffer) throw (CException) {
 	SampleBuffer inL = mInputPtr;
 	SampleBuffer inR = NULL;
 	if (mInCh > 1)
-		inR = mInputs[CSL_INPUT]->mBuffer->buffer(1);
-//	outputBuffer.zeroBuffers();
-	for (unsigned i = 0; i < numFrames; i++) {			// now do the output loop -- per frame
-		l_samp = *inL++;								// get input sample(s)
-		if (mInCh > 1)
-			r_samp = *inR++;
-		for (unsigned j = 0; j < mOutCh; j++) {		// generate output per channel
-			o_samp = l_samp * a_scale * l_weights[j];	// scale input sample
-			if (mInCh > 1)								// right channel if stereo
-				o_samp += r_samp * a_scale * r_weights[j];
-			outputBuffer.setBuffer(j, i, o_samp);   // write output sample
-		}
+		inR = mPortSlots[CSL_INPUT]->mBuffer->buffer(1);
+	a_scale = scaleValue;								// the weights are fixed over the block,
+	for (unsigned j = 0; j < mOutCh; j++) {			// so do the output loop per channel
+		SampleBuffer out = outputBuffer.buffer(j);
+		VectorOps::mul(out, inL, a_scale * l_weights[j], numFrames);	// scale input sample
+		if (mInCh > 1)									// right channel if stereo
+			VectorOps::scaleAdd(out, inR, a_scale * r_weights[j], numFrames);
 	}
 }
 
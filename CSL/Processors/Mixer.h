@@ -45,6 +45,11 @@ public:
 	void dump();
 	unsigned activeSources();
 	bool isActive() { return mSources.size() > 0; };	///< mixers with inputs are always active
+												/// my sources can be rendered in parallel
+	void parallelInputs(UGenVector & inputs, unsigned maxInputs) {
+		unsigned count = csl_min((unsigned) mSources.size(), maxInputs);
+		inputs.insert(inputs.end(), mSources.begin(), mSources.begin() + count);
+	};
 
 protected:
 	UGenVector mSources;						///< *vector* of inputs, arbitrary # of channels
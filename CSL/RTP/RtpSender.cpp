@@ -130,7 +130,7 @@ void RtpSender :: nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (Ex
 {	
 	if (outBufNum != 0) return;	// We want to work with the multi-channel buffers only
 
-	Port * inPort = mInputs[CSL_INPUT_L];
+	Port * inPort = mPortSlots[CSL_INPUT_L];
 	this->pullInput(inPort, outputBuffer.mNumFrames);
 	mInputPtr = inPort->mBuffer->mMonoBuffers[0];
 //	UnitGenerator :: nextBuffer(outputBuffer);
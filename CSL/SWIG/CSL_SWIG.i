@@ -41,6 +41,7 @@
 	#include "DelayLine.h"
 	#include "Mixer.h"
 	#include "Convolver.h"
+	#include "FDNReverb.h"
 	#include "FIR.h"
 
 	#include "PAIO.h"
@@ -77,6 +78,7 @@
 	%include "DelayLine.h"
 	%include "Mixer.h"
 	%include "Convolver.h"
+	%include "FDNReverb.h"
 	%include "FIR.h"
 
 	%include "PAIO.h"
@@ -303,6 +303,11 @@ void Envelope::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CExce
 										// if the envelope is finished, just write the final value into the buffer
 	if (mCurrentMark >= mDuration) {
 		x =  mSegments[mSize - 1]->end(); //  mPoints[mSize - 1]->y;
+		if (((x == 0.0f) || scalePort->isSilent()) && offsetPort->isFixed() && (offsetValue == 0.0f)) {
+			memset(outPtr, 0, numFrames * sizeof(sample));	// ended at 0: flag the silence
+			outputBuffer.setSilent(outBufNum);
+			return;
+		}
 		for (i = 0; i < numFrames; i++) {
 			*outPtr++ = (x * scaleValue) + offsetValue;
 			UPDATE_SCALABLE_CONTROLS;	// update the dynamic scale/offset
@@ -343,6 +348,7 @@ void Envelope::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CExce
 				mCurrentMark += ((float) (numFrames + 1) / rate);
 				outputBuffer.setBuffer(outBufNum, outPtr);
 				outputBuffer.mNumFrames = numFrames;
+				outputBuffer.setSilent(outBufNum, false);	// (only the end may have been silent)
 				if (i == (mSize - 1)) {
 #ifdef CSL_DEBUG
 					logMsg("Envelope finished");
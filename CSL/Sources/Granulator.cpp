@@ -1,15 +1,17 @@
 //
-//  Granulator.h -- CSL class for doing granular synthesis
+//  Granulator.cpp -- CSL class for doing granular synthesis
 //
 //	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
 //
 
 #include "Granulator.h"
+#include "VectorOps.h"
+#include <math.h>
 
 using namespace csl;
 using namespace std;
 
-// GrainPlayer implementation - pretty simple
+// GrainPlayer implementation - pretty simple: the cloud does the work
 
 GrainPlayer::GrainPlayer(GrainCloud * cloud) : UnitGenerator(), mCloud(cloud) {
 	mNumChannels = 2;					// I'm always stereo
@@ -19,235 +21,198 @@ GrainPlayer::~GrainPlayer() {
 	mCloud->isPlaying = false;
 }
 
-// The nextBuffer method does all the work of the synthesis, looping through the playing grains
+// Clear the output and add the cloud's grains into it (a mono output gets the sum of the pans)
 
 void GrainPlayer::nextBuffer(Buffer & outputBuffer) throw (CException) {
-	sample * out1;						// assumes stereo output -- ToDo: fix me
-	sample * out2;
-	int index, length;
-	sample samp, env;
-	float durHalf;
 	unsigned numFrames = outputBuffer.mNumFrames;
-	out1 = outputBuffer.buffer(0);
-	out2 = outputBuffer.buffer(1);
-	memset(out1, 0, numFrames * sizeof(sample));
-	memset(out2, 0, numFrames * sizeof(sample));
-		
-	while (mCloud->gState != kFree) {	// wait until done creating grains in other thread
-//		printf("!\n");
-		csl::sleepUsec(100);
-	}
-	mCloud->gState = kDSP;				// set flag to keep scheduler from running while I'm calculating samples
-										// grain loop
-	for (Grain * curGrain = mCloud->mPlayingGrains; curGrain != 0; 
-			curGrain = curGrain->nextGrain) {
-//		printf(".");
-		out1 = outputBuffer.buffer(0);							// assume stereo output
-		out2 = outputBuffer.buffer(1);
-		length = curGrain->numSamples;
-		sample * sPtr = curGrain->samples;
-		for (unsigned i = 0; i < numFrames; i++) {					// sample loop
-			if (curGrain->time >= curGrain->duration)				// if grain has ended already
-				break;
-			if (curGrain->delay) {									// if grain hasn't started yet
-				curGrain->delay--;
-				continue;
-			}
-			index = (int)(curGrain->position);						// get index and wrap it
-			while (index < 0)
-				index += length;
-			while (index >= length)
-				index -= length;
-			samp = sPtr[index];										// get sample value (should interpolate samples)
-			durHalf = curGrain->duration * curGrain->env;			// really cheap triangle envelope
-			if (curGrain->time < durHalf)							// if before middle
-				env = (float) curGrain->time / durHalf;	
-			else													// else after middle
-				env = (float)(curGrain->duration - curGrain->time) 
-						/ (curGrain->duration - durHalf);		
-			samp *= curGrain->amplitude * env;						// scale by envelope
-																	// Add to the current output samples
-			*out1++ += samp * (1.0f - curGrain->pan);				// write to Left channel 
-			*out2++ += samp * curGrain->pan;						// write to Right channel
-
-			curGrain->position += curGrain->rate;					// Update position
-			curGrain->time += 1.0f;									// Update time
-		}
-	}
-	mCloud->gNow = C_TIME;											// increment time
-	mCloud->gState = kFree;											// release lock
-//	printf("\n");
+	SampleBuffer out1 = outputBuffer.buffer(0);
+	SampleBuffer out2 = (outputBuffer.mNumChannels > 1) ? outputBuffer.buffer(1) : NULL;
+	for (unsigned i = 0; i < outputBuffer.mNumChannels; i++)
+		memset(outputBuffer.buffer(i), 0, numFrames * sizeof(sample));
+	mCloud->render(out1, out2, numFrames, mFrameRate);
 }
 
-// GrainCloud implementation -- grain mgmnt loops are forked as a separate threads
-
-// Constructor allocates global pool of MAXGRAINS available grains
+// GrainCloud implementation -- the constructor allocates the grain pool
+
+GrainCloud::GrainCloud(unsigned maxGrains) : mRateBase(1.0f), mRateRange(0.0f),
+				mOffsetBase(0.0f), mOffsetRange(0.0f), mDensityBase(10.0f), mDensityRange(0.0f),
+				mDurationBase(0.1f), mDurationRange(0.0f), mWidthBase(0.5f), mWidthRange(0.0f),
+				mVolumeBase(1.0f), mVolumeRange(0.0f), mEnvelopeBase(0.5f), mEnvelopeRange(0.0f),
+				mSamples(0), numSamples(0), isPlaying(false),
+				mMaxGrains(0), mNumGrains(0), mNumDropped(0),
+				mStart(0), mRate(0), mDuration(0), mPeak(0), mTime(0), mGainL(0), mGainR(0),
+				mNextOnset(0.0), mSeed(0x9E3779B9), mResetPending(false) {
+	setMaxGrains(maxGrains);
+}
 
-GrainCloud::GrainCloud() {
-	Grain * newGrain;
-	Grain * prevGrain;
-	SAFE_MALLOC(prevGrain, Grain, sizeof(Grain));
-	mSilentGrains = prevGrain;		// first in list
-									// allocate a list of passive grains
-	for (unsigned i = 0; i < MAXGRAINS - 1; i++) {
-		SAFE_MALLOC(newGrain, Grain, sizeof(Grain));
-		prevGrain->nextGrain = newGrain;
-		prevGrain = newGrain;
-	}
-	prevGrain->nextGrain = 0;		// set last grain's Next to 0;
-	unsigned count = 0;				// testing: count silent grains
-	for (newGrain = mSilentGrains; newGrain != 0; newGrain = newGrain->nextGrain)
-		count++;
-	logMsg("Create grain lists: %d available", count);
-	mPlayingGrains = 0;				// empty list of active grains
-									// now set up threads
-	spawnerThread = CThread::MakeThread();
-	reaperThread = CThread::MakeThread();
-	threadOn = false; 
+GrainCloud::~GrainCloud() {
 	isPlaying = false;
-	gState = kFree;
-	mSamples = 0;
+	freePool();
 }
 
-// stop threads and delete lists
+void GrainCloud::freePool() {
+	SAFE_FREE(mStart);
+	SAFE_FREE(mRate);
+	SAFE_FREE(mDuration);
+	SAFE_FREE(mPeak);
+	SAFE_FREE(mTime);
+	SAFE_FREE(mGainL);
+	SAFE_FREE(mGainR);
+	mStart = 0;
+	mRate = mDuration = mPeak = mTime = mGainL = mGainR = 0;
+}
 
-GrainCloud::~GrainCloud() {
-	spawnerThread->stopThread(100);
-	reaperThread->stopThread(100);
-	csl::sleepMsec(150);
+// Allocate the structure-of-arrays pool; this drops the live grains, so it's not for the audio thread
+
+void GrainCloud::setMaxGrains(unsigned maxGrains) {
+	freePool();
+	mMaxGrains = csl_max(maxGrains, 1u);
+	SAFE_MALLOC(mStart, double, mMaxGrains);
+	SAFE_MALLOC(mRate, float, mMaxGrains);
+	SAFE_MALLOC(mDuration, float, mMaxGrains);
+	SAFE_MALLOC(mPeak, float, mMaxGrains);
+	SAFE_MALLOC(mTime, float, mMaxGrains);
+	SAFE_MALLOC(mGainL, float, mMaxGrains);
+	SAFE_MALLOC(mGainR, float, mMaxGrains);
+	mNumGrains = 0;
+	mNumDropped = 0;
+	logMsg("Create grain pool: %d available", mMaxGrains);
 }
 
-// Grain creation loop: take the head item of silentGrains, fill it in based on the random ranges,
-// and put it at the head of playingGrains
-
-void * createGrains(void * theArg) {
-	GrainCloud * cloud = (GrainCloud * ) theArg;
-	Grain * newGrain;
-	logMsg("Starting grain creation loop");
-//	printf("\tG: ADDR  \t\tDUR     \tPOS    \tRATE\tPAN\n");
-	while (true) {
-		if ( ! cloud->isPlaying) {
-			logMsg("Grain creation loop exits");
-			return NULL;							// exit thread
-		}
-		while (cloud->gState != kFree)				// wait until done creating samples in other thread
-			csl::sleepMsec(1);
-		cloud->gState = kSched;						// set flag to keep from calculating samples while I'm creating grains
-		
-		if (cloud->isPlaying) {
-			newGrain = cloud->mSilentGrains;		// take the first silent grain and put it into the temp variable
-			if (newGrain == 0) {					// if no free grains, wait a bit
-				printf("\tNo free grains\n");
-//				cloud->reset();						// KLUDJ -- reset all if none free
-				goto next;
-			}
-			cloud->mSilentGrains = newGrain->nextGrain;	// set the temp variable's Next to the head of silentGrains
-													// fill it in from the GUI object's ranges
-			newGrain->position = fRandB(cloud->mOffsetBase, cloud->mOffsetRange) * cloud->numSamples;
-			newGrain->duration = fRandB(cloud->mDurationBase, cloud->mDurationRange) * CGestalt::frameRate();
-			newGrain->rate = fRandB(cloud->mRateBase, cloud->mRateRange);
-			newGrain->amplitude = fRandB(cloud->mVolumeBase, cloud->mVolumeRange) / cloud->mDensityBase;
-			newGrain->time = 0.0f;
-			newGrain->pan = fRandB(cloud->mWidthBase, cloud->mWidthRange);
-			newGrain->env = fRandB(cloud->mEnvelopeBase, cloud->mEnvelopeRange);
-													// delay within the next callback
-			newGrain->delay = (unsigned) ((float) (C_TIME - cloud->gNow) * cloud->sampsPerTick);	
-			newGrain->samples = cloud->mSamples;
-			newGrain->numSamples = cloud->numSamples;
-			newGrain->nextGrain = cloud->mPlayingGrains;	// set the temp variable's Next to the current head of playingGrains
-			cloud->mPlayingGrains = newGrain;		// set the head of playingGrains to the temp variable
-//			printf("\tG: %x\t\t%5.1f  \t%7.2f  \t%4.2f  \t%4.2f\n", 
-//					newGrain, newGrain->duration, newGrain->position, newGrain->rate, newGrain->pan);
-		} else {
-			logMsg("Grain creation loop exits 2");
-			return NULL;							// exit loop
-		}
+// Reset all grains to silent; the audio thread clears the pool at its next block, so the caller
+// can be any thread
 
-next:	cloud->gState = kFree;						// sleep for the inter-grain delay (may not be absolutely accurate)
-		csl::sleepUsec(1000000.0f / fRandB(cloud->mDensityBase, cloud->mDensityRange));
+void GrainCloud::reset() {
+	mResetPending = true;
+}
+
+// A xorshift generator (rand() takes a lock on some platforms); answers 0 - 1 with 24 bits
+
+float GrainCloud::random() {
+	mSeed ^= mSeed << 13;
+	mSeed ^= mSeed >> 17;
+	mSeed ^= mSeed << 5;
+	return (float) (mSeed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Fill in a grain from the cloud's ranges; onset is the frame (with a fraction) in the next block
+// where it starts, which makes its time at the block's first frame -onset
+
+void GrainCloud::spawn(double onset, unsigned frameRate) {
+	if (mNumGrains >= mMaxGrains) {				// no free grains: drop it
+		mNumDropped++;
+		return;
 	}
-	return NULL;									// never reached
+	unsigned which = mNumGrains++;
+	float duration = csl_max(randomB(mDurationBase, mDurationRange) * (float) frameRate, 1.0f);
+	float env = csl_min(csl_max(randomB(mEnvelopeBase, mEnvelopeRange), 0.0f), 1.0f);
+	float pan = randomB(mWidthBase, mWidthRange);
+	float amplitude = randomB(mVolumeBase, mVolumeRange) / mDensityBase;
+	mStart[which] = (double) randomB(mOffsetBase, mOffsetRange) * (double) numSamples;
+	mRate[which] = randomB(mRateBase, mRateRange);
+	mDuration[which] = duration;
+	mPeak[which] = duration * env;
+	mTime[which] = (float) -onset;
+	mGainL[which] = amplitude * (1.0f - pan);
+	mGainR[which] = amplitude * pan;
 }
 
-// Clean up completed grains, taking them off of mPlayingGrains and returning them to mSilentGrains
-
-void * reapGrains(void *theArg) {
-	GrainCloud * cloud = (GrainCloud * ) theArg;
-	Grain *prevGrain, *curGrain, *nextGrain;
-	
-	logMsg("Starting grain culling loop");
-	csl::sleepMsec(200);							// sleep a bit before starting
-	while (true) {
-		if ( ! cloud->isPlaying) {
-			logMsg("Grain culling loop exits");
-			return NULL;							// exit thread
-		}
-		while (cloud->gState != kFree)				// wait until done creating samples in other thread
-			csl::sleepMsec(10);
-		cloud->gState = kSched;						// set flag to keep from calculating samples while I'm creating grains
-		if (cloud->isPlaying) {
-			prevGrain = 0;
-			curGrain = cloud->mPlayingGrains;
-			while (curGrain != 0) {
-				if (curGrain->time >= curGrain->duration) {				// if the position is at the end, free the grain
-					nextGrain = curGrain->nextGrain;
-//					printf("\tK: %x -> %x\n", curGrain, nextGrain);
-					if (prevGrain == 0)									// If it's the first one
-						cloud->mPlayingGrains = nextGrain;
-					else												// else there is a grain before this one
-						prevGrain->nextGrain = nextGrain;
-					curGrain->nextGrain = cloud->mSilentGrains;			// put the free one on the silent list
-					cloud->mSilentGrains = curGrain;
-					curGrain = nextGrain;
-					if (curGrain == 0)
-						goto next;
-				} else {
-					prevGrain = curGrain;
-					curGrain = curGrain->nextGrain;
-				}
-			}
-		} else {
-			logMsg("Grain culling loop exits 2");
-			return NULL;							// exit thread
+// Add a run of count frames of a grain, reading from pos; the run is split where the read position
+// wraps around the ends of the samples, so each piece reads a contiguous span
+
+static void addRun(SampleBuffer left, SampleBuffer right, unsigned count, const sample * src, unsigned length,
+			double pos, float rate, float env, float envStep, float gainL, float gainR) {
+	double len = (double) length;
+	while (count > 0) {
+		double p = fmod(pos, len);
+		if (p < 0.0)
+			p += len;
+		unsigned run = count;					// # of frames before the position leaves [0, length - 1)
+		if (rate > 0.0f) {
+			double room = (len - 1.0 - p) / (double) rate;
+			if (room < (double) count)
+				run = (room > 0.0) ? (unsigned) ceil(room) : 1;
+		} else if (rate < 0.0f) {
+			double room = p / (double) -rate;
+			if (room < (double) count)
+				run = (unsigned) floor(room) + 1;
 		}
-next:	cloud->gState = kFree;
-		csl::sleepMsec(500);						// sleep for 1/2 sec
+		int base = (int) floor(p);
+		VectorOps::grainSum(left, right, run, src, length, base, (float) (p - (double) base), rate,
+				env, envStep, gainL, gainR);
+		left += run;
+		if (right)
+			right += run;
+		pos += (double) run * (double) rate;
+		env += (float) run * envStep;
+		count -= run;
 	}
-	return NULL;									// never reached
 }
 
-// Start the grain-creation thread
-
-void GrainCloud::startThreads() {
-	isPlaying = true;
-	if (threadOn)
-		return; 
-	threadOn = true; 
-	gNow = C_TIME;									// get start time
-	sampsPerTick = (float) CGestalt::frameRate() / (float) C_TIME;
-	logMsg("Starting grain creation/culling threads (%d)", C_TIME);
-	spawnerThread->createThread(createGrains, this);
-	reaperThread->createThread(reapGrains, this);
-	csl::sleepMsec(100);						// sleep for a bit
-	logMsg("Grain threads running");
+// Add a grain's frames in this block: those where its time is within [0, duration), as a rising
+// run (before the envelope's peak) and a falling one
+
+void GrainCloud::renderGrain(unsigned which, SampleBuffer left, SampleBuffer right, unsigned numFrames) {
+	float time = mTime[which];
+	float duration = mDuration[which];
+	float peak = mPeak[which];
+	int first = (time < 0.0f) ? (int) ceilf(-time) : 0;
+	int last = csl_min((int) ceilf(duration - time), (int) numFrames);
+	if (first >= last)
+		return;
+	int mid = csl_min(csl_max((int) ceilf(peak - time), first), last);
+	float gainL = mGainL[which];
+	float gainR = mGainR[which];
+	if ( ! right)								// mono: both pans
+		gainL += gainR;
+	if (mid > first) {							// rising: t / peak
+		float t = time + (float) first;
+		addRun(left + first, right ? right + first : NULL, mid - first, mSamples, numSamples,
+				mStart[which] + (double) t * (double) mRate[which], mRate[which],
+				t / peak, 1.0f / peak, gainL, gainR);
+	}
+	if (last > mid) {							// falling: (duration - t) / (duration - peak)
+		float t = time + (float) mid;
+		float fall = duration - peak;
+		addRun(left + mid, right ? right + mid : NULL, last - mid, mSamples, numSamples,
+				mStart[which] + (double) t * (double) mRate[which], mRate[which],
+				(duration - t) / fall, -1.0f / fall, gainL, gainR);
+	}
 }
 
-// reset the list of grains to be all silent
-	
-void GrainCloud::reset() {
-	unsigned live = 0;							// testing: count killed grains
-	Grain * curGrain = mPlayingGrains;
-	Grain * nextGrain;
-	while (curGrain != 0) {
-		nextGrain = curGrain->nextGrain;
-		curGrain->nextGrain = mSilentGrains;	// put the grain on the silent list
-		mSilentGrains = curGrain;
-		curGrain = nextGrain;
-		live++;
+// The audio thread's loop: schedule the grains that start in this block (sub-sample accurate),
+// play all the live ones, and retire the ones that are done (by moving the last one into their place)
+
+void GrainCloud::render(SampleBuffer left, SampleBuffer right, unsigned numFrames, unsigned frameRate) {
+	if (mResetPending) {
+		mResetPending = false;
+		mNumGrains = 0;
+	}
+	if ((mSamples == NULL) || (numSamples < 2))
+		return;
+	if (isPlaying) {
+		while (mNextOnset < (double) numFrames) {
+			spawn(mNextOnset, frameRate);
+			float density = csl_max(randomB(mDensityBase, mDensityRange), 0.01f);
+			mNextOnset += (double) frameRate / (double) density;
+		}
+		mNextOnset -= (double) numFrames;
+	} else
+		mNextOnset = 0.0;
+	unsigned which = 0;
+	while (which < mNumGrains) {
+		renderGrain(which, left, right, numFrames);
+		mTime[which] += (float) numFrames;
+		if (mTime[which] >= mDuration[which]) {	// done: swap in the last one (which plays next)
+			unsigned end = --mNumGrains;
+			mStart[which] = mStart[end];
+			mRate[which] = mRate[end];
+			mDuration[which] = mDuration[end];
+			mPeak[which] = mPeak[end];
+			mTime[which] = mTime[end];
+			mGainL[which] = mGainL[end];
+			mGainR[which] = mGainR[end];
+		} else
+			which++;
 	}
-	mPlayingGrains = 0;							// empty list
-//	unsigned dead = 0;							// testing: count silent grains
-//	for (curGrain = silentGrains; curGrain != 0; curGrain = curGrain->nextGrain)
-//		dead++;
-//	printf("\nReset grain lists (%d stopped, %d available)\n", live, dead);
 }
@@ -3,42 +3,35 @@
 //
 //	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
 //
+// The GrainCloud holds the cloud's parameters (set from the GUI or another thread) and a pool of
+// grains; its GrainPlayer runs the whole engine in the audio callback. Each block, the player
+// first starts the grains whose onsets fall in it, at their exact (fractional) frame, then adds
+// all of the live grains into the output, and retires the grains that ended. No other thread
+// touches the pool, so there are no locks, and nothing is allocated after the pool is made.
+//
+// The grains are kept as structure-of-arrays (start position, rate, duration, gains, etc.), and
+// each grain's run of frames is read with VectorOps::grainSum() (interpolated gathers, with the
+// triangle envelope as two linear ramps). The pool holds CSL_GRAIN_MAX grains by default; grains
+// that would overflow it are dropped (and counted).
+//
+// Usage:
+//		GrainCloud cloud;
+//		GrainPlayer player(& cloud);
+//		cloud.mSamples = sndFile.mWavetable.buffer(0);
+//		cloud.numSamples = sndFile.duration();
+//		... set the cloud's parameters ...
+//		cloud.start();
+//		theIO->setRoot(player);
+//
 
 #ifndef CSL_GRAN_H
 #define CSL_GRAN_H
 
 #include "CSL_Core.h"		// my superclass
-#include "ThreadUtilities.h"
 
 namespace csl {				// my namespace
 
-#define MAXGRAINS 200
-
-/// Grain data structure
-/// This implementation uses a linked list data structure.
-/// You might want to add a few more members to this for flexibility.
-
-typedef struct Grain {
-	float amplitude;		///< amplitude scale (0 - 1)
-	float rate;				///< playback rate (1.0 for normal pitch, < 0 reads backwards)
-	float duration;			///< duration in samples
-	float time;				///< current time (index) in samples
-	float pan;				///< stereo pan 0 - 1
-	float env;				///< envelope: 0 = perc, 0.5 = triangle, 1 = reverse perc
-	float position;			///< running sample index
-	unsigned delay;			///< initial delay in samples
-	float * samples;		///< sample buffer pointer
-	unsigned numSamples;	///< length of sample vector
-	Grain * nextGrain;		///< A pointer to the next grain in the linked list
-} Grain;
-
-/// This flag is for the app state, so that we don't change the grain lists while calculating samples
-
-typedef enum {			
-	kFree,				///< free state
-	kDSP,				///< calculating audio samples
-	kSched,				///< scheduling grains
-} GrainulatorState;
+#define CSL_GRAIN_MAX 4096			///< default size of a cloud's grain pool
 
 /// GrainCloud -- routine for playing clouds under GUI control.
 /// This could be called a cloud or a stream.
@@ -46,11 +39,18 @@ typedef enum {
 
 class GrainCloud {
 public:
-	GrainCloud();				///< simple constructor
+	GrainCloud(unsigned maxGrains = CSL_GRAIN_MAX);	///< simple constructor
 	~GrainCloud();
-			
-	void startThreads();		///< method to start-up the create/reap threads
-	void reset();				///< reset all grains to silent
+
+	void start() { isPlaying = true; };	///< start spawning grains
+	void stop() { isPlaying = false; };	///< stop spawning (the live grains finish)
+	void startThreads() { start(); };	///< (old name: the grains aren't created by threads any more)
+	void reset();				///< silence all grains (at the start of the next block)
+	void setMaxGrains(unsigned maxGrains);	///< re-size the grain pool (not while playing)
+	unsigned maxGrains() { return mMaxGrains; };
+	unsigned numGrains() { return mNumGrains; };		///< answer the # of live grains
+	unsigned numDropped() { return mNumDropped; };	///< answer the # of grains the pool had no room for
+
 							// public data members (set from GUI)
 	float mRateBase;			///< grain rate base
 	float mRateRange;			///< rate random range
@@ -71,27 +71,41 @@ public:
 	unsigned numSamples;		///< # of samples in buffer
 	bool isPlaying;				///< whether I'm on or off
 
-	Grain * mSilentGrains;		///< shared grain lists - ptr to the free pool (silent)
-	Grain * mPlayingGrains;		///< ptr to the list of active grains
-	GrainulatorState gState;	///< granulator state flag
-	long gNow;					///< clock for accurate timing
-	float sampsPerTick;			///< resolution of hi-res clock(s-rate / 1 billion)
+								/// the audio thread's part: start the grains due in the next
+								/// numFrames and add all the live ones to the outputs
+	void render(SampleBuffer left, SampleBuffer right, unsigned numFrames, unsigned frameRate);
 
 protected:
-	CThread * spawnerThread;	///< thread to create grains
-	CThread * reaperThread;		///< thread to kill finished grains
-	bool threadOn;				///< if the thread's running
+	unsigned mMaxGrains;		///< pool size
+	unsigned mNumGrains;		///< # of live grains (the first mNumGrains in the arrays)
+	unsigned mNumDropped;
+	double * mStart;			///< grain pool: start position in the samples
+	float * mRate;				///< playback rate (1.0 for normal pitch, < 0 reads backwards)
+	float * mDuration;			///< duration in frames
+	float * mPeak;				///< time of the envelope's peak (frames)
+	float * mTime;				///< age at the start of the next block (< 0 = not started yet)
+	float * mGainL;				///< amplitude times the pan gains
+	float * mGainR;
+	double mNextOnset;			///< frames from the start of the next block to the next grain
+	unsigned mSeed;				///< random generator state (the audio thread's own)
+	volatile bool mResetPending;	///< set by reset(), handled by the audio thread
+
+	float random();				///< answer 0 - 1
+	float randomB(float base, float range) { return base + range * (2.0f * random() - 1.0f); };
+	void spawn(double onset, unsigned frameRate);	///< start a grain at a frame in the next block
+	void renderGrain(unsigned which, SampleBuffer left, SampleBuffer right, unsigned numFrames);
+	void freePool();
 };
 
-/// GrainPlayer -- low-level granular synthesis generator, uses a list of current grains.
+/// GrainPlayer -- low-level granular synthesis generator, plays a GrainCloud's grains.
 
 class GrainPlayer : public UnitGenerator {
 public:
 	GrainPlayer(GrainCloud * cloud);
 	~GrainPlayer();
-								/// this sums up the list of live grains -- very simple
+								/// this sums up the cloud's live grains
 	void nextBuffer(Buffer & outputBuffer) throw (CException);
-	
+
 	GrainCloud * mCloud;		///< the cloud I play
 };
 
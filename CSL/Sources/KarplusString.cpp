@@ -4,6 +4,8 @@
 //
 
 #include "KarplusString.h"
+#include <math.h>
+#include <string.h>
 
 using namespace csl;
 
@@ -62,8 +64,10 @@ void KarplusString::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (
 	unsigned numFrames = outputBuffer.mNumFrames;	
 	sample *outPtr = outputBuffer.buffer(outBufNum); // get the pointer to the output buffer to write into
 	sample *delayPtr = mDelayLine.buffer(0); // get the pointer to the delay line storage
-	if ( ! mEnergy)
+	if ( ! mEnergy) {						// done: write (and flag) silence
+		zeroBuffer(outputBuffer, outBufNum);
 		return;
+	}
 	DECLARE_SCALABLE_CONTROLS;
 #ifdef CSL_DEBUG
 	logMsg("Karplus Strong String nextBuffer");
@@ -88,3 +92,233 @@ void KarplusString::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (
 	if (mEnergy)
 		mEnergy--;
 }
+
+///
+/// KarplusBank -- the strings' parameters and states are arrays with one entry per string, in
+/// groups of CSL_STRING_LANES (the layout VectorOps::stringSum() takes); the lines hold
+/// CSL_STRING_LANES interleaved delay lines per group
+///
+
+KarplusBank::KarplusBank(unsigned numStrings, float lowest) : UnitGenerator(),
+				mPosition(0), mLowest(lowest), mDecay(CSL_STRING_DECAY) {
+	mNumChannels = 2;						// stereo (the plucks are panned)
+	mNumGroups = csl_max((numStrings + CSL_STRING_LANES - 1) / CSL_STRING_LANES, 1u);
+	unsigned longest = (unsigned) ceilf((float) mFrameRate / mLowest) + 2;
+	unsigned lineSize = 1;
+	while (lineSize < longest)				// the lines are a power of 2 long
+		lineSize <<= 1;
+	mLineMask = lineSize - 1;
+	unsigned count = mNumGroups * CSL_STRING_LANES;
+	SAFE_MALLOC(mLines, float, mNumGroups * lineSize * CSL_STRING_LANES);
+	memset(mLines, 0, mNumGroups * lineSize * CSL_STRING_LANES * sizeof(float));
+	SAFE_MALLOC(mDelay, int, count);
+	SAFE_MALLOC(mDamp0, float, count);
+	SAFE_MALLOC(mDamp1, float, count);
+	SAFE_MALLOC(mCoeff, float, count);
+	SAFE_MALLOC(mLowpass, float, count);
+	SAFE_MALLOC(mAllpassIn, float, count);
+	SAFE_MALLOC(mAllpassOut, float, count);
+	SAFE_MALLOC(mGainL, float, count);
+	SAFE_MALLOC(mGainR, float, count);
+	SAFE_MALLOC(mEnergy, float, count);
+	SAFE_MALLOC(mQuiet, unsigned, count);
+	SAFE_MALLOC(mActive, bool, count);
+	SAFE_MALLOC(mPluckFreq, float, count);
+	SAFE_MALLOC(mPluckAmp, float, count);
+	SAFE_MALLOC(mPluckPos, float, count);
+	SAFE_MALLOC(mPluckPending, volatile bool, count);
+	for (unsigned i = 0; i < count; i++) {
+		mDelay[i] = 1;
+		mCoeff[i] = 0.0f;
+		mEnergy[i] = 0.0f;
+		mPluckPending[i] = false;
+		retire(i);
+	}
+}
+
+KarplusBank::~KarplusBank() {
+	SAFE_FREE(mLines);
+	SAFE_FREE(mDelay);
+	SAFE_FREE(mDamp0);
+	SAFE_FREE(mDamp1);
+	SAFE_FREE(mCoeff);
+	SAFE_FREE(mLowpass);
+	SAFE_FREE(mAllpassIn);
+	SAFE_FREE(mAllpassOut);
+	SAFE_FREE(mGainL);
+	SAFE_FREE(mGainR);
+	SAFE_FREE(mEnergy);
+	SAFE_FREE(mQuiet);
+	SAFE_FREE(mActive);
+	SAFE_FREE(mPluckFreq);
+	SAFE_FREE(mPluckAmp);
+	SAFE_FREE(mPluckPos);
+	SAFE_FREE(mPluckPending);
+}
+
+// Pick the first free string (so the sounding ones stay packed into the first groups), or else
+// the quietest one, and leave the pluck for the audio thread
+
+unsigned KarplusBank::pluck(float frequency, float amplitude, float position) {
+	unsigned count = numStrings();
+	unsigned which = count;
+	for (unsigned i = 0; i < count; i++) {
+		if ( ! (mActive[i] || mPluckPending[i])) {
+			which = i;
+			break;
+		}
+	}
+	if (which == count) {					// none free: steal the quietest sounding one
+		for (unsigned i = 0; i < count; i++)	// (a pending pluck is never overwritten)
+			if ( ! mPluckPending[i] && ((which == count) || (mEnergy[i] < mEnergy[which])))
+				which = i;
+		if (which == count)					// all plucked this block: drop it
+			return count;
+	}
+	mPluckFreq[which] = frequency;
+	mPluckAmp[which] = amplitude;
+	mPluckPos[which] = csl_min(csl_max(position, -1.0f), 1.0f);
+	csl_memory_barrier();					// publish the pluck's settings before the flag
+	mPluckPending[which] = true;
+	return which;
+}
+
+unsigned KarplusBank::numActive() {
+	unsigned num = 0;
+	for (unsigned i = 0; i < numStrings(); i++)
+		if (mActive[i] || mPluckPending[i])
+			num++;
+	return num;
+}
+
+// Answer the phase delay (in frames) of the allpass (a + z^-1) / (1 + a z^-1) at omega
+
+static float allpassDelay(float a, float omega) {
+	float sn = sinf(omega), cs = cosf(omega);
+	return (atan2f(sn, a + cs) - atan2f(a * sn, 1.0f + a * cs)) / omega;
+}
+
+// Tune the loop. The low-pass is (1 - s) x + s x', with the loss g: s = 0.5 (an average) unless
+// that loses more per period than a decay of mDecay seconds allows, in which case s is made small
+// enough to decay in that time (Jaffe & Smith's decay stretching). The integer delay, the low-pass's
+// phase delay and the allpass's add up to the period; the allpass's share is kept over 0.1 frames
+// (where it is nearly flat), and its coefficient is refined for its phase delay at the fundamental.
+// The string is filled with a period of noise (less its mean, so there's no DC to ring on).
+
+void KarplusBank::excite(unsigned which) {
+	float rate = (float) mFrameRate;
+	float frequency = csl_min(csl_max(mPluckFreq[which], mLowest), rate * 0.25f);
+	float omega = CSL_TWOPI * frequency / rate;
+	float average = cosf(0.5f * omega);				// the average's gain at the fundamental
+	float target = (mDecay > 0.0f) ? powf(0.001f, 1.0f / (frequency * mDecay)) : average;
+	float s = 0.5f, gain = 1.0f;
+	if (target <= average)
+		gain = target / average;
+	else {											// solve |H| = target for s
+		float q = (1.0f - target * target) / (2.0f * (1.0f - cosf(omega)));
+		s = 0.5f * (1.0f - sqrtf(csl_max(1.0f - 4.0f * q, 0.0f)));
+	}
+	mDamp0[which] = gain * (1.0f - s);
+	mDamp1[which] = gain * s;
+	float length = rate / frequency - atan2f(s * sinf(omega), 1.0f - s + s * cosf(omega)) / omega;
+	int delay = csl_min(csl_max((int) floorf(length - 0.1f), 1), (int) mLineMask - 1);
+	float frac = csl_min(csl_max(length - (float) delay, 0.1f), 1.1f);
+	float d = frac;
+	for (unsigned i = 0; i < 3; i++)				// (1 - d) / (1 + d) is right for low frequencies
+		d = csl_max(d + frac - allpassDelay((1.0f - d) / (1.0f + d), omega), 0.05f);
+	mDelay[which] = delay;
+	mCoeff[which] = (1.0f - d) / (1.0f + d);
+	mLowpass[which] = mAllpassIn[which] = mAllpassOut[which] = 0.0f;
+	float angle = (mPluckPos[which] + 1.0f) * CSL_PI * 0.25f;
+	mGainL[which] = mPluckAmp[which] * cosf(angle);
+	mGainR[which] = mPluckAmp[which] * sinf(angle);
+
+	unsigned lane = which % CSL_STRING_LANES;
+	float * line = mLines + (which / CSL_STRING_LANES) * (mLineMask + 1) * CSL_STRING_LANES + lane;
+	unsigned start = mPosition - (unsigned) delay;
+	float mean = 0.0f;
+	for (int i = 0; i < delay; i++) {
+		float value = mExciter.generateNormalizedRandomNumber();
+		line[((start + i) & mLineMask) * CSL_STRING_LANES] = value;
+		mean += value;
+	}
+	mean /= (float) delay;
+	for (int i = 0; i < delay; i++)
+		line[((start + i) & mLineMask) * CSL_STRING_LANES] -= mean;
+	mEnergy[which] = 1.0f;
+	mQuiet[which] = 0;
+	mActive[which] = true;
+	csl_memory_barrier();					// (done reading the settings: the slot can be re-plucked)
+	mPluckPending[which] = false;
+}
+
+// A retired string stays in its group's loop (if the group is still running), but with no loss
+// gain or state it computes zeros
+
+void KarplusBank::retire(unsigned which) {
+	mActive[which] = false;
+	mDamp0[which] = mDamp1[which] = 0.0f;
+	mLowpass[which] = mAllpassIn[which] = mAllpassOut[which] = 0.0f;
+	mGainL[which] = mGainR[which] = 0.0f;
+	mQuiet[which] = 0;
+}
+
+void KarplusBank::dump() {
+	logMsg("a KarplusBank: %d strings (%d sounding), %d-frame lines, decay %g sec",
+			numStrings(), numActive(), mLineMask + 1, mDecay);
+}
+
+// Start the pending plucks, run the groups that have strings sounding, and retire the strings that
+// have been below the floor for a whole period
+
+void KarplusBank::nextBuffer(Buffer & outputBuffer) throw (CException) {
+	unsigned numFrames = outputBuffer.mNumFrames;
+	unsigned count = numStrings();
+	for (unsigned i = 0; i < count; i++) {
+		if (mPluckPending[i]) {
+			csl_memory_barrier();			// read the pluck's settings after the flag
+			excite(i);
+		}
+	}
+	if (numActive() == 0) {					// all quiet: write (and flag) silence
+		for (unsigned i = 0; i < outputBuffer.mNumChannels; i++)
+			zeroBuffer(outputBuffer, i);
+		mPosition += numFrames;
+		return;
+	}
+	SampleBuffer left = outputBuffer.buffer(0);
+	SampleBuffer right = (outputBuffer.mNumChannels > 1) ? outputBuffer.buffer(1) : NULL;
+	for (unsigned i = 0; i < outputBuffer.mNumChannels; i++)
+		memset(outputBuffer.buffer(i), 0, numFrames * sizeof(sample));
+	float quiet = CSL_STRING_FLOOR * CSL_STRING_FLOOR * (float) numFrames;
+	unsigned lineSize = mLineMask + 1;
+	for (unsigned g = 0; g < mNumGroups; g++) {
+		unsigned first = g * CSL_STRING_LANES;
+		bool sounding = false;
+		for (unsigned i = first; i < first + CSL_STRING_LANES; i++)
+			sounding |= mActive[i];
+		if ( ! sounding)
+			continue;
+		float * gainL = mGainL + first;
+		float mono[CSL_STRING_LANES];
+		if ( ! right) {						// mono: both pans
+			for (unsigned i = 0; i < CSL_STRING_LANES; i++)
+				mono[i] = mGainL[first + i] + mGainR[first + i];
+			gainL = mono;
+		}
+		VectorOps::stringSum(left, right, numFrames, mLines + g * lineSize * CSL_STRING_LANES, mLineMask,
+				mPosition, mDelay + first, mDamp0 + first, mDamp1 + first, mCoeff + first, mLowpass + first,
+				mAllpassIn + first, mAllpassOut + first, gainL, mGainR + first, mEnergy + first);
+		for (unsigned i = first; i < first + CSL_STRING_LANES; i++) {
+			if ( ! mActive[i])
+				continue;
+			if (mEnergy[i] < quiet) {
+				mQuiet[i] += numFrames;
+				if (mQuiet[i] > (unsigned) mDelay[i])
+					retire(i);
+			} else
+				mQuiet[i] = 0;
+		}
+	}
+	mPosition += numFrames;
+}
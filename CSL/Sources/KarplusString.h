@@ -21,6 +21,7 @@
 //#include "RingBuffer.h"
 //#include "Filters.h"
 #include "Noise.h"
+#include "VectorOps.h"
 
 namespace csl {					// my namespace
 
@@ -51,6 +52,72 @@ protected:
 	
 };		// end of class
 
+#define CSL_STRING_DECAY 3.0f		///< default decay time (to -60 dB) of the strings in a bank
+#define CSL_STRING_FLOOR 1.0e-4f	///< RMS level (-80 dB) below which a bank's string is retired
+
+///
+/// KarplusBank -- a polyphonic bank of plucked strings.
+///
+/// The strings run CSL_STRING_LANES at a time in the SIMD lanes of VectorOps::stringSum(). Each
+/// string's loop is an integer delay, a 2-tap low-pass and a first-order allpass for the rest of
+/// the period, so the pitch is exact, not rounded to a whole # of frames. The low-pass is set per
+/// string (a plain average for low notes, less damping for high ones) so that all notes decay in
+/// the same time. pluck() picks a free string (or
+/// steals the quietest one without a pluck pending); the audio thread excites it at the start of its next block, and
+/// retires it once it has been below CSL_STRING_FLOOR for a whole period. A group of strings
+/// with none sounding is skipped, and a bank with none writes (flagged) silence.
+///
+/// The output is stereo (each pluck has a pan position); a mono output gets the sum of the pans.
+///
+
+class KarplusBank : public UnitGenerator {
+
+public:								/// make a bank of numStrings (rounded up to a multiple of
+									/// CSL_STRING_LANES) for notes down to lowest Hz
+	KarplusBank(unsigned numStrings = CSL_STRING_LANES, float lowest = 27.5f);
+	~KarplusBank();
+									/// pluck a string (position is the pan, -1 to 1); answers its index
+									/// (or numStrings() if every string already has a pluck pending)
+	unsigned pluck(float frequency, float amplitude = 1.0f, float position = 0.0f);
+	void setDecay(float seconds) { mDecay = seconds; };	///< set the decay time of the next plucks
+	float decay() { return mDecay; };
+	unsigned numStrings() { return mNumGroups * CSL_STRING_LANES; };
+	unsigned numActive();			///< answer the # of sounding strings
+	bool isActive() { return (numActive() > 0); };
+	void dump();					///< print debugging info.
+
+	void nextBuffer(Buffer & outputBuffer) throw (CException);
+
+protected:
+	unsigned mNumGroups;			///< # of groups of CSL_STRING_LANES strings
+	unsigned mLineMask;				///< (length of the delay lines) - 1
+	unsigned mPosition;				///< write position of the current block
+	float mLowest;					///< lowest frequency
+	float mDecay;					///< decay time (sec)
+	float * mLines;					///< the delay lines (interleaved by group)
+	int * mDelay;					///< per-string loop parameters: integer delay,
+	float * mDamp0;					///< low-pass taps (with the loss),
+	float * mDamp1;
+	float * mCoeff;					///< allpass coefficient,
+	float * mLowpass;				///< and filter states
+	float * mAllpassIn;
+	float * mAllpassOut;
+	float * mGainL;					///< output gains
+	float * mGainR;
+	float * mEnergy;				///< sum of squares in the last block
+	unsigned * mQuiet;				///< # of frames below the floor
+	bool * mActive;					///< whether the string is sounding
+	float * mPluckFreq;				///< the plucks to start at the next block
+	float * mPluckAmp;
+	float * mPluckPos;
+	volatile bool * mPluckPending;
+	WhiteNoise mExciter;			///< the noise for the plucks
+
+	void excite(unsigned which);	///< start a pending pluck (in the audio thread)
+	void retire(unsigned which);	///< silence a string
+
+};
+
 }		// end of namespace
 
 #endif
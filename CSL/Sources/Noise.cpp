@@ -14,37 +14,91 @@ using namespace csl;
 
 /// Constructors call UnitGenerator & Scalable constructors
 /// Noise defaults to expansion copy policy (i.e. distinct noise per channel)
-/// if no seed is specified, current clock time is used
+/// if no seed is specified, the default seed (the clock time unless it was set) and the next stream are used
+
+int Noise::sDefaultSeed = 0;
+bool Noise::sHaveDefaultSeed = false;
+unsigned Noise::sNextStream = 0;
+
+void Noise::setDefaultSeed(int seed) {
+	sDefaultSeed = seed;
+	sHaveDefaultSeed = true;
+	sNextStream = 0;
+}
+
+void Noise::nextDefaultStream(int * seed, unsigned * stream) {
+	if ( ! sHaveDefaultSeed) {
+		sDefaultSeed = (int) time(NULL);
+		sHaveDefaultSeed = true;
+	}
+	* seed = sDefaultSeed;
+	* stream = sNextStream++;
+}
 
 Noise::Noise() : 
 	UnitGenerator(), 
-	Scalable(1.f, 0.f), 
-	//mCopyPolicy(kExpand), 
-	mSeed(time(NULL)), 
-	mDivisor(1.0f / (float) 0x7fffffff) {
+	Scalable(1.f, 0.f) {
 	setCopyPolicy(kExpand);
+	nextDefaultStream(& mSeed, & mStream);
+	initKeys();
 }
 
 Noise::Noise(double ampl, double offset) : 
 	UnitGenerator(), 
-	Scalable((float)ampl, (float)offset), 
-	//mCopyPolicy(kExpand), 
-	mSeed(time(NULL)), 
-	mDivisor(1.0f / (float) 0x7fffffff) {
+	Scalable((float)ampl, (float)offset) {
 	setCopyPolicy(kExpand);
+	nextDefaultStream(& mSeed, & mStream);
+	initKeys();
 }
 
 Noise::Noise(int seed, double ampl, double offset) : 
 	UnitGenerator(), 
 	Scalable((float)ampl, (float)offset), 
-	//mCopyPolicy(kExpand),
 	mSeed(seed),
-	mDivisor(1.0f / (float) 0x7fffffff) {
+	mStream(0) {
 	setCopyPolicy(kExpand);
+	initKeys();
+}
+
+// Changing the seed or stream restarts the stream
+// (generateRandomNumber() reads a separate stream, so it doesn't move the buffers' position)
+
+void Noise::setSeed(int seed) {
+	mSeed = seed;
+	initKeys();
+}
+
+void Noise::setStream(unsigned stream) {
+	mStream = stream;
+	initKeys();
+}
+
+void Noise::initKeys() {
+	VectorOps::randomKeys((unsigned) mSeed, mStream, & mKey0, & mKey1);
+	VectorOps::randomKeys(mKey1, mKey0, & mScalarKey0, & mScalarKey1);
+	mCounter = mBlockStart = mScalarCounter = 0;
+}
+
+// Channel 0 uses the stream's keys, and the other channels get keys mixed from them and the channel #
+
+void Noise::channelKeys(unsigned channel, unsigned * key0, unsigned * key1) {
+	if (channel == 0) {
+		* key0 = mKey0;
+		* key1 = mKey1;
+	} else
+		VectorOps::randomKeys(mKey0 ^ VectorOps::randomHash(channel), mKey1 ^ channel, key0, key1);
+}
+
+unsigned Noise::blockPosition(unsigned outBufNum, unsigned numFrames) {
+	if (outBufNum == 0) {
+		mBlockStart = mCounter;
+		mCounter += numFrames;
+	}
+	return mBlockStart;
 }
 
 void Noise::dump() {
-	logMsg("a Noise generator");
+	logMsg("a Noise generator (seed %d, stream %u, at %u)", mSeed, mStream, mCounter);
 	Scalable::dump();
 	UnitGenerator::dump();
 }
@@ -53,19 +107,40 @@ void Noise::dump() {
 /// White noise -- equal power per frequency
 ///
 
+// The whole buffer is made by the vector generator, then scaled
+
 void WhiteNoise::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
 	sample* out = outputBuffer.buffer(outBufNum);	// get ptr to output channel
 	unsigned numFrames = outputBuffer.mNumFrames;			// get buffer length
+	unsigned key0, key1;
 
 	DECLARE_SCALABLE_CONTROLS;				// declare the scale/offset buffers and values
 	LOAD_SCALABLE_CONTROLS;
 #ifdef CSL_DEBUG
 	logMsg("WhiteNoise nextBuffer");
 #endif			
-	for (unsigned i = 0; i < numFrames; i++) {					// sample loop	
-		// call generate_random_number and do the division myself
-		*out++ = ((((float) generateRandomNumber()) * mDivisor) * scaleValue) + offsetValue;		
-		UPDATE_SCALABLE_CONTROLS;							// update the dynamic scale/offset
+	unsigned position = blockPosition(outBufNum, numFrames);
+	if (IS_SCALED_TO_SILENCE) {								// silent scale: just skip this part of the stream
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
+	channelKeys(outBufNum, & key0, & key1);
+	VectorOps::randomFill(out, numFrames, key0, key1, position);
+	if (IS_LINEAR_SCALABLE) {								// fixed/control-rate scale/offset
+		DECLARE_SCALABLE_RAMPS;
+		if ((scaleValue != 1.0f) || (scaleStep != 0.0f))
+			VectorOps::mulRamp(out, out, scaleValue, scaleStep, numFrames);
+		if ((offsetValue != 0.0f) || (offsetStep != 0.0f)) {
+			for (unsigned i = 0; i < numFrames; i++) {
+				out[i] += offsetValue;
+				offsetValue += offsetStep;
+			}
+		}
+	} else {												// audio-rate scale/offset
+		for (unsigned i = 0; i < numFrames; i++) {
+			out[i] = (out[i] * scaleValue) + offsetValue;
+			UPDATE_SCALABLE_CONTROLS;						// update the dynamic scale/offset
+		}
 	}
 }
 
@@ -94,6 +169,7 @@ PinkNoise::PinkNoise(int seed, double ampl, double offset) : Noise(seed, ampl, o
 void PinkNoise::initialize(int numRows) {
 	int i;
 	int pmax;
+	numRows = csl_min(csl_max(numRows, 1), PINK_MAX_RANDOM_ROWS);
 	mPinkIndex = 0;
 	mPinkIndexMask = (1<<numRows) - 1;
 			// Calculate maximum possible signed random value. Extra 1 for white noise always added.
@@ -144,18 +220,60 @@ sample PinkNoise::nextPink() {
 	return output;
 }
 
+// The random bits for a chunk of frames are made at once (2 per frame: one for the row that
+// changes and one for the white noise that's added); the rows are then updated frame by frame
+
 void PinkNoise::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
 	SampleBuffer out = outputBuffer.buffer(outBufNum);
 	unsigned numFrames = outputBuffer.mNumFrames;
+	unsigned bits[2 * CSL_NOISE_CHUNK];
+	unsigned key0, key1;
 
 	DECLARE_SCALABLE_CONTROLS;							// declare the scale/offset buffers and values as above
 #ifdef CSL_DEBUG
-	logMsg("SineAsScaled nextBuffer");
+	logMsg("PinkNoise nextBuffer");
 #endif		
 	LOAD_SCALABLE_CONTROLS;	
-	for (unsigned i = 0; i < numFrames; i++ ) {
-		*out++ = (nextPink() * scaleValue) + offsetValue;		// get a sample
-		UPDATE_SCALABLE_CONTROLS;
+	unsigned position = blockPosition(outBufNum, numFrames);
+	if (IS_SCALED_TO_SILENCE) {						// silent scale: skip this part of the stream
+		zeroBuffer(outputBuffer, outBufNum);		// (the rows hold their values)
+		return;
+	}
+	channelKeys(outBufNum, & key0, & key1);
+	for (unsigned done = 0; done < numFrames; done += CSL_NOISE_CHUNK) {
+		unsigned count = csl_min(numFrames - done, (unsigned) CSL_NOISE_CHUNK);
+		VectorOps::randomBits(bits, 2 * count, key0, key1, 2 * (position + done));
+		for (unsigned i = 0; i < count; i++) {
+			mPinkIndex = (mPinkIndex + 1) & mPinkIndexMask;
+			if (mPinkIndex != 0) {						// replace the row given by the # of trailing zeros
+				int numZeros = 0;
+				int n = mPinkIndex;
+				while ((n & 1) == 0) {
+					n = n >> 1;
+					numZeros++;
+				}
+				int newRandom = ((int) bits[2 * i]) >> PINK_RANDOM_SHIFT;
+				mPinkRunningSum += newRandom - mPinkRows[numZeros];
+				mPinkRows[numZeros] = newRandom;
+			}
+			int sum = mPinkRunningSum + (((int) bits[2 * i + 1]) >> PINK_RANDOM_SHIFT);
+			out[done + i] = mPinkScalar * sum;
+		}
+	}
+	if (IS_LINEAR_SCALABLE) {							// fixed/control-rate scale/offset
+		DECLARE_SCALABLE_RAMPS;
+		if ((scaleValue != 1.0f) || (scaleStep != 0.0f))
+			VectorOps::mulRamp(out, out, scaleValue, scaleStep, numFrames);
+		if ((offsetValue != 0.0f) || (offsetStep != 0.0f)) {
+			for (unsigned i = 0; i < numFrames; i++) {
+				out[i] += offsetValue;
+				offsetValue += offsetStep;
+			}
+		}
+	} else {											// audio-rate scale/offset
+		for (unsigned i = 0; i < numFrames; i++) {
+			out[i] = (out[i] * scaleValue) + offsetValue;
+			UPDATE_SCALABLE_CONTROLS;
+		}
 	}
 }
-
@@ -7,16 +7,25 @@
 #define INCLUDE_Noise_H
 
 #include "CSL_Core.h"			// include the main CSL header; this includes CSL_Types.h and CGestalt.h
+#include "VectorOps.h"			// for the random-number generator
 
 #define PINK_MAX_RANDOM_ROWS	(30)
 #define PINK_RANDOM_BITS   		(24)
-#define PINK_RANDOM_SHIFT  		((sizeof(long)*8)-PINK_RANDOM_BITS)
+#define PINK_RANDOM_SHIFT  		(32 - PINK_RANDOM_BITS)
+
+#define CSL_NOISE_CHUNK 256				///< # of frames of random bits PinkNoise makes at a time
 
 namespace csl {
 
 ///
 /// Abstract Noise class - inherits from UnitGenerator & Scalable, and provides constructors and basic pseudo-raondom methods
 ///
+/// The random numbers come from a counter-based generator (see VectorOps::randomFill()): the value
+/// at a position in the stream depends only on the seed, the stream id and the position, so each
+/// noise (and each channel of it) reads an independent, reproducible stream, whatever order or
+/// thread the buffers are computed in. Noises made without a seed use the default seed and the next
+/// stream id; set the default seed before making them to make a patch repeatable.
+///
 
 class Noise : public UnitGenerator, public Scalable {
 
@@ -24,7 +33,13 @@ public:
 	inline int generateRandomNumber();					///< returns the next pseudo-random number
 	inline float generateNormalizedRandomNumber();		///< returns next pseudo-random normalised to +/- 1.0
 
-	void setSeed(int seed) { mSeed = seed; }			///< set the seed integer for the pseudo-random number generators
+	void setSeed(int seed);								///< set the seed integer for the pseudo-random number generators
+	int seed() { return mSeed; };
+	void setStream(unsigned stream);					///< select one of the seed's streams (restarts it)
+	unsigned stream() { return mStream; };
+	void setPosition(unsigned position) { mCounter = position; };	///< set the position in the stream (frames)
+	unsigned position() { return mCounter; };
+	static void setDefaultSeed(int seed);				///< set the seed of noises made without one
 
 	void dump();										///< Tell me more about what is happening
 
@@ -35,7 +50,24 @@ public:
 	
 protected:
 	int mSeed;											///< seed integer for the pseudo-random number generators
-	float mDivisor;										///< factor to scale ints to +/- 1.0
+	unsigned mStream;									///< stream id
+	unsigned mKey0, mKey1;								///< the generator's keys (from the seed and stream)
+	unsigned mCounter;									///< position of the next buffer in the stream
+	unsigned mBlockStart;								///< position of the current buffer (for channels > 0)
+	unsigned mScalarKey0, mScalarKey1;					///< keys of generateRandomNumber()'s own stream
+	unsigned mScalarCounter;							///< position in generateRandomNumber()'s stream
+
+	void initKeys();									///< derive the keys from the seed and stream
+														/// answer the keys of a channel's stream
+	void channelKeys(unsigned channel, unsigned * key0, unsigned * key1);
+														/// answer the stream position of a buffer (channel 0
+														/// advances the stream; the others follow it)
+	unsigned blockPosition(unsigned outBufNum, unsigned numFrames);
+
+	static int sDefaultSeed;							///< the seed and next stream id of the noises
+	static bool sHaveDefaultSeed;						///< made without a seed
+	static unsigned sNextStream;
+	static void nextDefaultStream(int * seed, unsigned * stream);
 };
 
 ///
@@ -90,16 +122,11 @@ protected:
 // inline functions have to be declared in the header file to avoid linker problems
 
 inline int Noise::generateRandomNumber() {
-	// Calculate pseudo-random 32 bit number based on linear congruential method
-	mSeed = (mSeed * 196314165) + 907633515;
-	return mSeed;
-
+	return (int) VectorOps::randomAt(mScalarKey0, mScalarKey1, mScalarCounter++);
 }	
 
 inline float Noise::generateNormalizedRandomNumber() {
-	// Calculate pseudo-random 32 bit number based on linear congruential method
-	mSeed = (mSeed * 196314165) + 907633515;
-	return (float) mSeed / (float) 0x7fffffff; // dividing by INT_MAX
+	return (float) generateRandomNumber() * CSL_RANDOM_SCALE;
 }
 
 
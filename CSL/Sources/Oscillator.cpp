@@ -4,6 +4,8 @@
 //
 
 #include "Oscillator.h"
+#include "VectorOps.h"
+#include "Spectral.h"
 //#include "SHARC.h"
 #include <math.h>
 
@@ -46,11 +48,11 @@ void Oscillator::dump() {
 //}
 
 WavetableOscillator::WavetableOscillator(float frequency, float ampl, float offset, float phase)
-				: Oscillator(frequency, ampl, offset, phase) {
+				: Oscillator(frequency, ampl, offset, phase), mFixedPhase(0), mLastPhase(-1.0f),
+				mSharedTable(NULL) {
 	mWavetable.setSize(1, DEFAULT_WAVETABLE_SIZE);
-//	mWavetable.allocateBuffers();
 	mInterpolate = kTruncate;
-//	fillSine();
+	fillSine();								// share the default sine (subclasses may drop it)
 }
 
 //WavetableOscillator::WavetableOscillator(SampleBuffer samps, unsigned size) : Oscillator() {
@@ -59,27 +61,54 @@ WavetableOscillator::WavetableOscillator(float frequency, float ampl, float offs
 //	setWaveform(samps, size);	
 //}
 
-WavetableOscillator::WavetableOscillator(Buffer & wave) : Oscillator() {
+WavetableOscillator::WavetableOscillator(Buffer & wave) 
+				: Oscillator(), mFixedPhase(0), mLastPhase(-1.0f), mSharedTable(NULL) {
 	mWavetable.setSize(1, wave.mNumFrames);
 	mInterpolate = kTruncate;
 	setWaveform(wave);	
 }
 
+// The copy holds its own reference to a shared table, gets its own copy of a private one,
+// and points to the same samples as the original if they belong to someone else
+
+WavetableOscillator::WavetableOscillator(WavetableOscillator & other)
+				: Oscillator(other), mInterpolate(other.mInterpolate), mFixedPhase(other.mFixedPhase),
+				mLastPhase(other.mLastPhase), mSharedTable(NULL) {
+	if (other.mSharedTable) {
+		TableRegistry::retain(other.mSharedTable);
+		setSharedTable(other.mSharedTable);
+	} else if (other.mWavetable.mDidIAllocateBuffers) {
+		Buffer & wave = other.mWavetable;
+		mWavetable.setSize(wave.mNumChannels, wave.mNumFrames);
+		mWavetable.allocateBuffers();
+		for (unsigned i = 0; i < wave.mNumChannels; i++)
+			memcpy(mWavetable.buffer(i), wave.buffer(i), wave.mMonoBufferByteSize);
+		mWavetable.mIsPopulated = wave.mIsPopulated;
+	} else if (other.mWavetable.buffers())
+		setWaveform(other.mWavetable, false);
+}
+
 ///< Destructor
 
 WavetableOscillator::~WavetableOscillator() {
 	mWavetable.freeBuffers();
+	TableRegistry::release(mSharedTable);
 }
 
 // Plug in a waveform from a buffer or a simple sample array
 
 void WavetableOscillator::setWaveform(Buffer & wave, bool freBufs) {
 	if (freBufs)
-		mWavetable.freeBuffers();
+		mWavetable.freeBuffers();				// (only frees a table I allocated)
+	TableRegistry::release(mSharedTable);		// drop my reference to a shared table
+	mSharedTable = NULL;
+	if ((mWavetable.buffers() == NULL) || (mWavetable.mNumChannels != wave.mNumChannels)) {
+		if (mWavetable.buffers())
+			delete[] mWavetable.buffers();
+		mWavetable.setBuffers(new SampleBuffer[wave.mNumChannels]);
+	}
 	mWavetable.mNumChannels = wave.mNumChannels;
 	mWavetable.mNumFrames = wave.mNumFrames;
-	if (mWavetable.buffers() == NULL)
-		mWavetable.setBuffers(new SampleBuffer[mNumChannels]);
 	for (unsigned i = 0; i < mWavetable.mNumChannels; i++)
 		mWavetable.setBuffer(i, wave.buffer(i));
 	mWavetable.mMonoBufferByteSize = wave.mMonoBufferByteSize;
@@ -100,90 +129,195 @@ void WavetableOscillator::setWaveform(Buffer & wave, bool freBufs) {
 //	mWavetable.mDidIAllocateBuffers = false;
 //}
 
-//// Shared buffer with a sine of length CGestalt::maxBufferFrames()
+// The shared sine tables: sin() is taken in double per sample (an accumulated phase drifts in
+// single precision)
 
-static Buffer * sSineTable = 0;
+string SineTable::key() {
+	char key[CSL_WORD_LEN];
+	sprintf(key, "sine/%u", mSize);
+	return string(key);
+}
 
-// Create the default wavetable -- 1 cycle of a sine
+void SineTable::fill(Buffer & table) {
+	SampleBuffer ptr = table.buffer(0);
+	double incr = CSL_TWOPI / mSize;
+	for (unsigned i = 0; i < mSize; i++)
+		*ptr++ = (sample) sin(incr * i);
+}
 
-void WavetableOscillator::fillSine() {
-	if ( ! sSineTable) {					// create shared sine table lazily
-		sSineTable = new Buffer(1, DEFAULT_WTABLE_SIZE);
-		sSineTable->allocateBuffers();		// make space
-		SampleBuffer ptr = sSineTable->buffer(0);
-		float incr = CSL_TWOPI / DEFAULT_WTABLE_SIZE;
-		float accum = 0;					// sine fill loop
-		for (unsigned i = 0; i < DEFAULT_WTABLE_SIZE; i++) {
-			*ptr++ = sinf(accum);
-			accum += incr;
-		}
+// Point the wavetable at a registry table; we hold one reference to it until it's replaced
+
+void WavetableOscillator::setSharedTable(Buffer * table) {
+	Buffer * old = mSharedTable;
+	mWavetable.freeBuffers();								// (if they were my own)
+	mSharedTable = table;
+	mWavetable.setSize(1, table ? table->mNumFrames : 0);
+	if (mWavetable.buffers() == NULL)						// (freeBuffers() deletes the pointers)
+		mWavetable.setBuffers(new SampleBuffer[1]);
+	if (table) {
+		mWavetable.setBuffer(0, table->buffer(0));			// point to the shared waveform
+		mWavetable.mAreBuffersAllocated = true;				// fib a bit
+		mWavetable.mDidIAllocateBuffers = false;
+	} else {
+		mWavetable.setBuffer(0, NULL);
+		mWavetable.mAreBuffersAllocated = false;
+		mWavetable.mDidIAllocateBuffers = false;
 	}
-	mWavetable.setSize(1, DEFAULT_WTABLE_SIZE);
-	mWavetable.setBuffer(0, sSineTable->buffer(0));		// point to the shared sine waveform
-	mWavetable.mAreBuffersAllocated = true;					// fib a bit
-	mWavetable.mDidIAllocateBuffers = false;
+	TableRegistry::release(old);
+}
+
+// Use the default wavetable -- 1 cycle of a sine of DEFAULT_WTABLE_SIZE
+
+void WavetableOscillator::fillSine() {
+	SineTable sine;
+	setSharedTable(TableRegistry::acquire(sine));
+}
+
+// answer log2 of the table size if it's a power of two the fixed-point phase can handle, else 0
+
+static inline unsigned tableBits(unsigned tableLength) {
+	if ((tableLength < 4) || (tableLength & (tableLength - 1)))
+		return 0;
+	unsigned bits = 2;
+	while ((1u << bits) < tableLength)
+		bits++;
+	return (bits <= CSL_WTABLE_MAX_BITS) ? bits : 0;
+}
+
+// round a phase increment in 2^32ths of a cycle to a (wrapping) 32-bit step
+
+static inline unsigned fixedStep(double incr) {
+	return (unsigned) (long long) floor(incr + 0.5);
 }
 
-// Oscillate a buffer-full of the stored waveform
+// Oscillate a buffer-full of the stored waveform: first fill the buffer with the raw table values,
+// then apply the scale and offset
 
 void WavetableOscillator::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
 	SampleBuffer buffer = outputBuffer.buffer(outBufNum);	// get pointer to the selected output channel
-	if ( ! mWavetable.mAreBuffersAllocated)						// lazy sine init
-		fillSine();
+	if (( ! mWavetable.mAreBuffersAllocated) || (mWavetable.buffers() == NULL)
+			|| (mWavetable.buffer(0) == NULL)) {			// no table attached: play silence (tables are
+		zeroBuffer(outputBuffer, outBufNum);				// got by setWaveform() or setSharedTable(),
+		return;												// never in the callback)
+	}
 	SampleBuffer waveform = mWavetable.buffer(0);
 	unsigned tableLength = mWavetable.mNumFrames;
-	float rateRecip = (float) tableLength / (float) mFrameRate;
-	float phase = mPhase;									// get a local copy of the phase
 	unsigned numFrames = outputBuffer.mNumFrames;			// the number of frames to fill
 	DECLARE_PHASED_CONTROLS;								// declare the frequency buffer and value
 	DECLARE_SCALABLE_CONTROLS;								// declare the scale/offset buffers and values
 #ifdef CSL_DEBUG
 	logMsg("WavetableOscillator nextBuffer");
 #endif		
-	if ( ! waveform) 
-		return;
+	unsigned taps;											// # of table samples per output sample
+	switch (mInterpolate) {
+	case kTruncate:	taps = 1; break;
+	case kLinear:	taps = 2; break;
+	case kCubic:	taps = 4; break;
+	default:
+		throw LogicError("Unimplemented interpolation policy");
+	}
 	LOAD_PHASED_CONTROLS;									// load the freqC from the constant or dynamic value
 	LOAD_SCALABLE_CONTROLS;									// load the scaleC and offsetC from the constant or dynamic value
-	unsigned int index;
-	sample samp1, samp2;
-	float fraction;
-	switch (mInterpolate) {
-	case kTruncate:											// truncating wavetable lookup
-		for (unsigned i = 0; i < numFrames; i++) {			// sample loop
-			while (phase >= tableLength)					// wrap-around phase
-				phase -= tableLength;
-			while (phase < 0)					// wrap-around phase
-				phase += tableLength;
-			index = (unsigned int) floorf(phase);					// truncate phase to an integer
-			samp1 = waveform[index];						//// WAVE TABLE ACCESS ////
-			*buffer++ = (samp1 * scaleValue) + offsetValue;	// get and scale the table item (truncating look-up)
-			phase += (freqValue * rateRecip);
-			UPDATE_PHASED_CONTROLS;							// update the dynamic frequency
-			UPDATE_SCALABLE_CONTROLS;						// update the dynamic scale/offset
+	bool isSilent = IS_SCALED_TO_SILENCE;					// silent scale: skip the table reads
+	DECLARE_PHASED_RAMPS;									// (but keep the phase running)
+	bool isLinear = IS_LINEAR_PHASED;						// if the freq isn't audio-rate, use the fast loops
+	unsigned sizeBits = tableBits(tableLength);
+	if (sizeBits) {											// power-of-two table: fixed-point phase
+		double stepsPerHz = 4294967296.0 / (double) mFrameRate;
+		if (mPhase != mLastPhase) {							// the phase was set: convert it to a fraction
+			double cycles = (double) mPhase / (double) tableLength;
+			mFixedPhase = fixedStep((cycles - floor(cycles)) * 4294967296.0);
+		}
+		unsigned phase = mFixedPhase;
+		unsigned phases[CSL_WTABLE_CHUNK];					// the phases of a run of frames
+		for (unsigned done = 0; done < numFrames; done += CSL_WTABLE_CHUNK) {
+			unsigned count = csl_min(numFrames - done, (unsigned) CSL_WTABLE_CHUNK);
+			if (isLinear && (freqStep == 0.0f)) {			// fixed/control-rate frequency
+				unsigned incr = fixedStep(freqValue * stepsPerHz);
+				for (unsigned i = 0; i < count; i++) {
+					phases[i] = phase;
+					phase += incr;							// wraps around by itself
+				}
+			} else if (isLinear) {							// ramped frequency
+				for (unsigned i = 0; i < count; i++) {
+					phases[i] = phase;
+					phase += fixedStep(freqValue * stepsPerHz);
+					UPDATE_PHASED_RAMPS;
+				}
+			} else {										// audio-rate frequency
+				for (unsigned i = 0; i < count; i++) {
+					phases[i] = phase;
+					phase += fixedStep(freqValue * stepsPerHz);
+					UPDATE_PHASED_CONTROLS;					// update the dynamic frequency
+				}
+			}												//// WAVE TABLE ACCESS ////
+			if ( ! isSilent)
+				VectorOps::tableLookup(buffer + done, waveform, sizeBits, phases, count, taps);
+		}
+		mFixedPhase = phase;								// store the phase (and the frame # version)
+		mPhase = mLastPhase = (sample) ((double) phase * ((double) tableLength / 4294967296.0));
+	} else if (isSilent) {									// other sizes, silent: just move the phase
+		double rateRecip = (double) tableLength / (double) mFrameRate;
+		double phase = mPhase;
+		for (unsigned i = 0; i < numFrames; i++) {
+			phase += freqValue * rateRecip;
+			if (isLinear) {
+				UPDATE_PHASED_RAMPS;
+			} else {
+				UPDATE_PHASED_CONTROLS;
+			}
 		}
-		break;
-	case kLinear:
-		for (unsigned i = 0; i < numFrames; i++) {			// sample loop
-			index = (unsigned int) floorf(phase);
-			fraction = phase - (float) index;
-			samp1 = waveform[index];						// get sample
-			if (index < (tableLength - 1))
-				samp2 = waveform[index+1];					// and next sample
+		mPhase = (sample) (phase - floor(phase / tableLength) * tableLength);
+	} else {												// other sizes: double phase in frames
+		double rateRecip = (double) tableLength / (double) mFrameRate;
+		double phase = mPhase;								// get a local copy of the phase
+		if (tableLength < 2)
+			taps = 1;
+		for (unsigned i = 0; i < numFrames; i++) {
+			if ((phase >= tableLength) || (phase < 0.0))	// wrap-around phase
+				phase -= floor(phase / tableLength) * tableLength;
+			unsigned index = (unsigned) phase;
+			if (index >= tableLength)						// (rounding in the wrap)
+				index = 0;
+			float fraction = (float) (phase - index);
+			unsigned next = (index + 1 < tableLength) ? index + 1 : 0;
+			if (taps == 1)
+				buffer[i] = waveform[index];
+			else if (taps == 2)
+				buffer[i] = waveform[index] + (waveform[next] - waveform[index]) * fraction;
 			else
-				samp2 = waveform[0];	
-			samp1 += (samp2 - samp1) * fraction;			// and interpolate linear-wise
-			*buffer++ = (samp1 * scaleValue) + offsetValue;	// get and scale the table item (truncating look-up)
-			phase += (freqValue * rateRecip);
-			while (phase >= tableLength)					// wrap-around phase
-				phase -= tableLength;
-			UPDATE_PHASED_CONTROLS;							// update the dynamic frequency
+				buffer[i] = VectorOps::hermite(waveform[index ? index - 1 : tableLength - 1], 
+						waveform[index], waveform[next], 
+						waveform[(next + 1 < tableLength) ? next + 1 : 0], fraction);
+			phase += freqValue * rateRecip;
+			if (isLinear) {
+				UPDATE_PHASED_RAMPS;						// step the ramped frequency (if any)
+			} else {
+				UPDATE_PHASED_CONTROLS;						// update the dynamic frequency
+			}
+		}
+		mPhase = (sample) phase;							// store the temp phase back to the member variable
+	}
+	if (isSilent) {
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
+	if (IS_LINEAR_SCALABLE) {								// fixed/control-rate scale/offset
+		DECLARE_SCALABLE_RAMPS;
+		if ((scaleValue != 1.0f) || (scaleStep != 0.0f))
+			VectorOps::mulRamp(buffer, buffer, scaleValue, scaleStep, numFrames);
+		if ((offsetValue != 0.0f) || (offsetStep != 0.0f)) {
+			for (unsigned i = 0; i < numFrames; i++) {
+				buffer[i] += offsetValue;
+				offsetValue += offsetStep;
+			}
+		}
+	} else {												// audio-rate scale/offset
+		for (unsigned i = 0; i < numFrames; i++) {
+			buffer[i] = (buffer[i] * scaleValue) + offsetValue;
 			UPDATE_SCALABLE_CONTROLS;						// update the dynamic scale/offset
 		}
-		break;
-	default:
-		throw LogicError("Unimplemented truncation policy");
 	}
-	mPhase = phase;											// store the temp phase back to the member variable
 }
 
 // CompOrCacheOscillator implementation
@@ -194,12 +328,46 @@ CompOrCacheOscillator::CompOrCacheOscillator(bool whether, float frequency, floa
 				: WavetableOscillator(frequency, 1.0f, 0.0f, phase), 
 				Cacheable(whether) { }
 
-// Create the default wavetable cache
+// The generator for shared caches: one cycle of the oscillator's wave
+
+namespace csl {
+
+class CacheTable : public TableGenerator {
+public:
+	CacheTable(CompOrCacheOscillator * osc, string key, unsigned size)
+			: mOsc(osc), mKey(key), mSize(size) { };
+	string key() { return mKey; };
+	unsigned numFrames() { return mSize; };
+	void fill(Buffer & table) {
+		table.zeroBuffers();
+		mOsc->nextWaveInto(table.buffer(0), mSize, true);
+	};
+
+protected:
+	CompOrCacheOscillator * mOsc;
+	string mKey;
+	unsigned mSize;
+};
+
+}
+
+// Create the wavetable cache; if the subclass can name its contents, oscillators with the same
+// wave share one table
 
 void CompOrCacheOscillator::createCache(void) {
 	mUseCache = true;
-	mWavetable.allocateBuffers();
-	this->nextWaveInto(mWavetable.buffer(0), mWavetable.mNumFrames, true);
+	unsigned size = DEFAULT_WTABLE_SIZE;
+	string key = this->cacheKey();
+	if (key.empty()) {										// a private table
+		setSharedTable(NULL);
+		mWavetable.setSize(1, size);
+		mWavetable.allocateBuffers();
+		mWavetable.zeroBuffers();
+		this->nextWaveInto(mWavetable.buffer(0), size, true);
+	} else {
+		CacheTable cache(this, key, size);
+		setSharedTable(TableRegistry::acquire(cache));
+	}
 }
 
 // nextBuffer either calls the inherited wavetable method, or does the computation on-demand here
@@ -391,13 +559,13 @@ void Impulse::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CExce
 
 // SumOfSines
 
-SumOfSines::SumOfSines() : CompOrCacheOscillator() { }
+SumOfSines::SumOfSines() : CompOrCacheOscillator(), mIFFT(NULL) { }
 
 SumOfSines::SumOfSines(float frequency) 
-				: CompOrCacheOscillator(false, frequency) { }
+				: CompOrCacheOscillator(false, frequency), mIFFT(NULL) { }
 
 SumOfSines::SumOfSines(PartialDescriptionMode format, unsigned partialCount, ...) 
-				: CompOrCacheOscillator(false) {
+				: CompOrCacheOscillator(false), mIFFT(NULL) {
 	float num=0, amp=0, pha=0;
 	Partial * p;
 	va_list ap;
@@ -432,10 +600,10 @@ SumOfSines::SumOfSines(PartialDescriptionMode format, unsigned partialCount, ...
 // given a SHARC spectrum
 #include "SHARC.h"
 
-SumOfSines::SumOfSines(SHARCSpectrum & spect) {
+SumOfSines::SumOfSines(SHARCSpectrum & spect) : CompOrCacheOscillator(), mIFFT(NULL) {
 	Partial * harm;	
 	for (unsigned i = 0; i < spect._num_partials; i++) {
-		harm = spect._partials[i];
+		harm = & spect._partials[i];
 //		fprintf(stderr, "\t%g  @ %.5f @ %.5f\n", harm->number, harm->amplitude, harm->phase);
 		this->addPartial(harm->number, harm->amplitude, harm->phase);
 	}
@@ -444,7 +612,7 @@ SumOfSines::SumOfSines(SHARCSpectrum & spect) {
 
 // 1/f spectrum + noise
 
-SumOfSines::SumOfSines(unsigned numHarms, float noise) {
+SumOfSines::SumOfSines(unsigned numHarms, float noise) : CompOrCacheOscillator(), mIFFT(NULL) {
 	for (unsigned i = 0; i < numHarms; i++) {
 		float ampl = fRandV(noise) / (float) (i + 2);
 		float phas = fRandV(CSL_PI);
@@ -455,13 +623,42 @@ SumOfSines::SumOfSines(unsigned numHarms, float noise) {
 }
 
 SumOfSines::SumOfSines(float frequency, unsigned numHarms, float noise) 
-			: CompOrCacheOscillator(false, frequency) {
+			: CompOrCacheOscillator(false, frequency), mIFFT(NULL) {
 	for (unsigned i = 0; i < numHarms; i++) {
 		this->addPartial(i, fRandM(0.5f, 1.3f) / (float) i, fRandV(CSL_PI));
 	}
 	this->createCache();							// make the cached wavetable
 }
 
+// the copy shares the partials (as before), and gets its own synthesis engine
+
+SumOfSines::SumOfSines(SumOfSines & other) 
+			: CompOrCacheOscillator(other), mPartials(other.mPartials), mBank(other.mBank), mIFFT(NULL) {
+	if (other.mIFFT)
+		setInverseFFT(other.mIFFT->fftSize());
+}
+
+SumOfSines::~SumOfSines() {
+	if (mIFFT)
+		delete mIFFT;
+}
+
+// Switch between the sine bank and inverse-FFT synthesis
+
+void SumOfSines::setInverseFFT(unsigned fftSize) {
+	if (mIFFT && (mIFFT->fftSize() == fftSize))
+		return;
+	if (mIFFT)
+		delete mIFFT;
+	mIFFT = NULL;
+	if (fftSize == 0)
+		return;
+	if ((fftSize & (fftSize - 1)) || (fftSize < 64))
+		throw LogicError("SumOfSines: the FFT size must be a power of 2 (>= 64)");
+	mIFFT = new IFFTSines(fftSize);
+	mUseCache = false;
+}
+
 // Methods to add partials
 
 void SumOfSines::addPartial(float nu, float amp) {
@@ -504,59 +701,116 @@ void SumOfSines::addPartials(int argc, void ** argv) {
 
 void SumOfSines::clearPartials() {
 	mPartials.clear();
+	mBank.clear();
+	if (mIFFT)
+		mIFFT->clear();
 }
 
-// Do sum-of-sines additive synthesis into the given buffer
+// Copy the partial list to the sine bank (or the IFFT engine): new partials start at their given
+// phase, and the numbers and amplitudes of all of them are refreshed (so partials edited in place
+// follow at control rate)
+
+void SumOfSines::syncBank() {
+	unsigned numPartials = mPartials.size();
+	if (mIFFT) {
+		unsigned numOld = mIFFT->numPartials();
+		if (numPartials != numOld) {
+			mIFFT->setNumPartials(numPartials);
+			for (unsigned i = numOld; i < numPartials; i++)
+				mIFFT->setPartial(i, mPartials[i]->number, mPartials[i]->amplitude, mPartials[i]->phase);
+		}
+		for (unsigned i = 0; i < numPartials; i++) {
+			mIFFT->setRatio(i, mPartials[i]->number);
+			mIFFT->setAmplitude(i, mPartials[i]->amplitude);
+		}
+		return;
+	}
+	unsigned numOld = mBank.numPartials();
+	if (numPartials != numOld) {
+		mBank.setNumPartials(numPartials);
+		for (unsigned i = numOld; i < numPartials; i++)
+			mBank.setPartial(i, mPartials[i]->number, mPartials[i]->amplitude, mPartials[i]->phase);
+	}
+	for (unsigned i = 0; i < numPartials; i++) {
+		mBank.setRatio(i, mPartials[i]->number);
+		mBank.setAmplitude(i, mPartials[i]->amplitude);
+	}
+}
+
+// Do sum-of-sines additive synthesis into the given buffer: a wavetable cycle is summed with sinf(),
+// and the on-the-fly case is done by the sine bank, then scaled
 
 void SumOfSines::nextWaveInto(SampleBuffer dest, unsigned count, bool oneHz) {
-	float incr, t_incr, phase, ampl;
-	SampleBuffer out_ptr;
 	unsigned numFrames = count;							// the number of frames to fill
 	DECLARE_PHASED_CONTROLS;							// declare the frequency buffer and value
 	DECLARE_SCALABLE_CONTROLS;							// declare the scale/offset buffers and values
 
 	if (oneHz) {										// if we're creating a wavetable
-		incr = CSL_TWOPI / (float) count;
-	} else {											// otherwise compute phase increment scale
-		incr = CSL_TWOPI / (float) mFrameRate;
-		LOAD_PHASED_CONTROLS;							// load the freqC from the constant or dynamic value
-		LOAD_SCALABLE_CONTROLS;							// load the scaleC and offsetC from the constant or dynamic value
-	}
-	for (unsigned i = 0; i < mPartials.size(); i++) {	// partials loop
-		Partial * p = mPartials[i];
-		out_ptr = dest;
-		phase = p->phase;
-		t_incr = incr * p->number;
-		ampl = p->amplitude;
-//		fprintf(stderr, "\t\tp%d = i %g : a %g : p %g\n", i, t_incr, ampl, phase);
-		if (oneHz) {
+		float incr = CSL_TWOPI / (float) count;
+		for (unsigned i = 0; i < mPartials.size(); i++) {	// partials loop
+			Partial * p = mPartials[i];
+			SampleBuffer out_ptr = dest;
+			float phase = p->phase;
+			float t_incr = incr * p->number;
+			float ampl = p->amplitude;
 			for (unsigned j = 0; j < numFrames; j++) {	// sample loop
 				*out_ptr++ += (sinf(phase) * ampl);
 				phase += t_incr;
 			}
-		} else {
-			for (unsigned j = 0; j < numFrames; j++) {	// sample loop
-				*out_ptr++ += (sinf(phase) * ampl * scaleValue) + offsetValue;
-				phase += (t_incr * freqValue);
+		}
+		return;
+	}
+	LOAD_PHASED_CONTROLS;								// load the freqC from the constant or dynamic value
+	LOAD_SCALABLE_CONTROLS;								// load the scaleC and offsetC from the constant or dynamic value
+	DECLARE_PHASED_RAMPS;
+	syncBank();
+	if (mIFFT) {										// inverse FFT (control-rate frequency)
+		mIFFT->render(dest, numFrames, freqValue, (float) mFrameRate);
+	} else if (IS_LINEAR_PHASED) {					// fixed/control-rate frequency (a ramp is
+		freqValue += freqStep * (float) numFrames * 0.5f;	// taken at the middle of the block)
+		mBank.render(dest, numFrames, freqValue, (float) mFrameRate);
+	} else {											// audio-rate frequency
+		sample freqs[CSL_SINEBANK_CHUNK];
+		for (unsigned done = 0; done < numFrames; done += CSL_SINEBANK_CHUNK) {
+			unsigned num = csl_min(numFrames - done, (unsigned) CSL_SINEBANK_CHUNK);
+			for (unsigned j = 0; j < num; j++) {
+				freqs[j] = freqValue;
 				UPDATE_PHASED_CONTROLS;					// update the dynamic frequency
-				UPDATE_SCALABLE_CONTROLS;				// update the dynamic scale/offset
-//				if (j == 1) fprintf(stderr, "\t\t\t%g : %g : %g\n", freqValue, scaleValue, offsetValue);
+			}
+			mBank.render(dest + done, num, freqs, (float) mFrameRate);
+		}
+	}
+	if (IS_LINEAR_SCALABLE) {							// fixed/control-rate scale/offset
+		DECLARE_SCALABLE_RAMPS;
+		if ((scaleValue != 1.0f) || (scaleStep != 0.0f))
+			VectorOps::mulRamp(dest, dest, scaleValue, scaleStep, numFrames);
+		if ((offsetValue != 0.0f) || (offsetStep != 0.0f)) {
+			for (unsigned i = 0; i < numFrames; i++) {
+				dest[i] += offsetValue;
+				offsetValue += offsetStep;
 			}
 		}
-		if ( ! oneHz) {
-			freqPort->resetPtr();						// reset control pointers after each loop through a partial
-			scalePort->resetPtr();
-			offsetPort->resetPtr();
-			freqValue = freqPort->nextValue();
-			scaleValue = scalePort->nextValue();
-			offsetValue = offsetPort->nextValue();
+	} else {											// audio-rate scale/offset
+		for (unsigned i = 0; i < numFrames; i++) {
+			dest[i] = (dest[i] * scaleValue) + offsetValue;
+			UPDATE_SCALABLE_CONTROLS;					// update the dynamic scale/offset
 		}
-		while (phase > CSL_TWOPI)						// wrap phase here
-			phase -= CSL_TWOPI;
-		p->phase = phase;
 	}
 }
 
+// The cache key lists the partials (at full precision), so identical spectra share a wavetable
+
+string SumOfSines::cacheKey() {
+	char item[CSL_DEF_LEN];
+	sprintf(item, "sos/%u", (unsigned) DEFAULT_WTABLE_SIZE);
+	string key(item);
+	for (unsigned i = 0; i < mPartials.size(); i++) {
+		sprintf(item, "/%.9g,%.9g,%.9g", mPartials[i]->number, mPartials[i]->amplitude, mPartials[i]->phase);
+		key += item;
+	}
+	return key;
+}
+
 void SumOfSines::dump() {
 	unsigned siz = mPartials.size();
 	logMsg("a SumOfSines: %d partials", siz);
@@ -17,9 +17,13 @@
 #define _Oscillator_H
 
 #include "CSL_Core.h"
+#include "SineBank.h"
+#include "TableRegistry.h"
 #include <stdarg.h>		// for varargs
 
 #define DEFAULT_WAVETABLE_SIZE CSL_mMaxBufferFrames		// use large wave tables by default
+#define CSL_WTABLE_MAX_BITS 18			///< largest power-of-two table that uses the fixed-point phase
+#define CSL_WTABLE_CHUNK 256			///< # of phases computed per table look-up call
 
 namespace csl {
 
@@ -39,7 +43,7 @@ public:								/// Constructor: parameters are optional.
 };
 
 ///
-/// Enumeration for interpolation policies
+/// Enumeration for interpolation policies (kCubic is 4-point Hermite interpolation)
 ///
 
 #ifdef CSL_ENUMS
@@ -60,6 +64,13 @@ typedef enum {
 ///
 /// WavetableOscillator -- Oscillator with a stored wave table that does table look-up.
 /// The default wave table is an 8192-sample sine.
+/// Power-of-two tables (up to 2^CSL_WTABLE_MAX_BITS) keep a 32-bit fixed-point phase, so the
+/// wrap-around is free, and use VectorOps::tableLookup() for the reads and interpolation;
+/// other tables (e.g., transposed sound files) use a double-precision phase.
+/// mPhase is the phase in table frames; it can be set between buffers.
+/// The default sine and cached waveforms are shared through the TableRegistry; they're got when
+/// the oscillator is created (or the cache made), so nothing is built in the audio callback;
+/// an oscillator with no table (e.g., a sound file that isn't loaded) plays silence.
 /// (perhaps accept a vector of freqs and a multichannel buffer?)
 ///
 
@@ -73,6 +84,7 @@ public:
 	WavetableOscillator(Buffer & wave, float frequency = 220.0f, float phase = 0.0f);
 	WavetableOscillator(float frequency = 1, float ampl = 1.0f, float offset = 0.0f, float phase = 0.0f);
 #endif
+	WavetableOscillator(WavetableOscillator & other);	///< copy constructor (shares or copies the table)
 	~WavetableOscillator();				///< Destructor
 	void setWaveform(Buffer & wave, bool freeBufs = true);	///< plug in waveforms
 										/// set the interpolation flag
@@ -84,7 +96,32 @@ public:
 	Buffer mWavetable;					///< the stored wave form
 
 protected:
-	void fillSine();					///< fill the shared wavetable with 1 cycle of a sine wave
+	unsigned mFixedPhase;				///< the fixed-point phase (1 cycle = 2^32)
+	sample mLastPhase;					///< mPhase as of the last buffer (to see if it was reset)
+	Buffer * mSharedTable;				///< the registry table mWavetable points to (or NULL)
+
+	void fillSine();					///< point the wavetable at the shared 1-cycle sine
+										/// point the wavetable at a table got from the TableRegistry
+										/// (releasing the last one); NULL leaves it empty
+	void setSharedTable(Buffer * table);
+
+private:								/// not assignable (use the copy constructor)
+	WavetableOscillator & operator=(const WavetableOscillator & other);
+};
+
+///
+/// SineTable -- the generator for the shared 1-cycle sine tables
+///
+
+class SineTable : public TableGenerator {
+public:
+	SineTable(unsigned size = DEFAULT_WTABLE_SIZE) : mSize(size) { };
+	string key();
+	unsigned numFrames() { return mSize; };
+	void fill(Buffer & table);
+
+protected:
+	unsigned mSize;
 };
 
 ///
@@ -94,11 +131,15 @@ protected:
 class CompOrCacheOscillator : public WavetableOscillator, public Cacheable {
 public:
 	CompOrCacheOscillator(bool whether = false, float frequency = 220, float phase = 0.0);
-	void createCache();
+	void createCache();					///< compute the wavetable (or share an identical one)
 
 protected:
+	friend class CacheTable;
 	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
 	virtual void nextWaveInto(SampleBuffer dest, unsigned count, bool oneHz) = 0;
+										/// answer a key for the contents of the cached wavetable,
+										/// or "" if it can't be shared
+	virtual string cacheKey() { return string(""); };
 };
 
 ///
@@ -189,7 +230,10 @@ typedef enum {
 ///
 /// The constructor takes an int format (1, 2, or 3 elements per overtone), the number of partials, and a list of elements
 ///
-/// This can cache a wavetable (if you use a strictly harmonic overtone series) or compute a buffer on the fly by summation (slow)
+/// This can cache a wavetable (if you use a strictly harmonic overtone series) or compute a buffer on the fly by summation;
+/// the latter uses a SineBank, which copies the partial list's numbers and amplitudes once per block. For very large numbers
+/// of partials, setInverseFFT() switches the on-the-fly synthesis to an IFFTSines (FFT-1 additive synthesis, whose cost is
+/// roughly independent of the partial count, but which follows the frequency and amplitudes once per hop)
 /// 
 /// Examples:
 ///	Format kFrequency = list of values for overtone amplitudes with num = 1, 2, 3..., amps = values, phases = 0
@@ -203,6 +247,7 @@ typedef enum {
 ///
 
 class SHARCSpectrum;
+class IFFTSines;
 
 class SumOfSines : public CompOrCacheOscillator {
 public:
@@ -213,6 +258,8 @@ public:
 													/// given a var-args partials list
 	SumOfSines(PartialDescriptionMode format, unsigned partialCount, ...);
 	SumOfSines(SHARCSpectrum & spect);				/// given a SHARC spectrum
+	SumOfSines(SumOfSines & other);					///< copy constructor
+	~SumOfSines();
 	
 	void addPartial(Partial * pt);
 	void addPartials(unsigned num_p, Partial ** pt);
@@ -220,12 +267,20 @@ public:
 	void addPartial(float nu, float amp);
 	void addPartial(float nu, float amp, float phase);
 	void clearPartials();
+									/// synthesize by inverse FFT with the given FFT size (e.g., CSL_IFFT_SINES_SIZE),
+									/// or 0 to go back to the sine bank; this turns off the cache
+	void setInverseFFT(unsigned fftSize);
+	bool usesInverseFFT() { return (mIFFT != NULL); };
 
 	void dump();						///< print the receiver for debugging
 	
 protected:
 	std::vector<Partial *> mPartials;
+	SineBank mBank;						///< the engine for the non-cached case
+	IFFTSines * mIFFT;					///< or the inverse-FFT one (NULL if not used)
 	void nextWaveInto(SampleBuffer dest, unsigned count, bool oneHz);
+	string cacheKey();					///< the table size and the partials
+	void syncBank();					///< copy the partials to the bank
 
 private:
 	Buffer outputBuffer;			// kludj so we can use the inherited macros
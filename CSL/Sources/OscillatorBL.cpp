@@ -1,130 +1,264 @@
 //
-//  OscillatorBL.cpp -- Band-limited oscillators -- these can use on-demand sine summation, or store their wavetables 
-//		(the latter choice might be dangerous with dynamic frequency control, of course)
+//  OscillatorBL.cpp -- Band-limited oscillators that read shared per-octave ("mipmapped") wavetables
 //	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
 //
 
 #include "OscillatorBL.h"
+#include "VectorOps.h"
 #include <math.h>
 
 using namespace csl;
 
-SquareBL::SquareBL() : SumOfSines() {
-}
-
-SquareBL::SquareBL(float frequency) : SumOfSines(true, frequency) {
-	this->setFrequency(frequency);
-}
+// The content key is the waveform, rate and size
 
-SquareBL::SquareBL(float frequency, float phase) : SumOfSines(true, frequency, phase) {
-	this->setFrequency(frequency);
+string BLTableSet::key() {
+	char key[CSL_WORD_LEN];
+	sprintf(key, "bl/%d/%u/%u", (int) mShape, mFrameRate, numFrames());
+	return string(key);
 }
 
-// Recompute the partials list whenever you change the frequency
+// Table k is used for fundamentals up to 2^(k+1) times the base frequency, so it gets the
+// harmonics below the Nyquist frequency there (and no more than the table size can hold)
 
+unsigned BLTableSet::numHarmonics(unsigned which) {
+	double top = (double) CSL_BL_BASE_FREQ * (double) (2u << which);
+	unsigned num = (unsigned) floor((double) mFrameRate * 0.5 / top);
+	return csl_min(num, (unsigned) ((1u << CSL_BL_TABLE_BITS) / 2 - 1));
+}
 
-void SquareBL::nextWaveInto(sample * dest, unsigned count, bool oneHz) {
-// void SquareBL::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
-	unsigned max_harm = ((float) mFrameRate / (mInputs[CSL_FREQUENCY]->nextValue() * 2.0f ));
-	if (mPartials.size() > max_harm)
-		mPartials.erase(mPartials.begin() + (max_harm - 1), mPartials.end());
-	else if (mPartials.size() < max_harm)
-		for (unsigned i = mPartials.size(); i < max_harm; i += 2)
-			this->addPartial((float)i, 0.5f / i);
-	SumOfSines::nextWaveInto(dest, count, oneHz);
+unsigned BLTableSet::numChannels() {
+	unsigned numTables = 1;
+	while ((numTables < 24) && (numHarmonics(numTables) > 1))
+		numTables++;
+	return numTables;
 }
 
-// If you start cacheing, then compute a new band-limited wavetable
-/*
-status SquareBL::nextWaveInto(sample * dest, unsigned count, bool oneHz) {
-//	float incr = CSL_TWOPI / (count * mFrameRate);
-	float incr = CSL_TWOPI / (float) count;
-	sample frequency = mInputs[CSL_FREQUENCY]->nextValue();
-	sample * out_ptr = dest;
-	sample value;
-	float max_harm;
-	
-	max_harm = floor(((float) mFrameRate) / (frequency * 2.0f ));
-	for (unsigned i = 0; i < count; i++) {		// sample loop
-		value = 0;
-		for (float harm = 1.0; harm <= max_harm ; harm += 2)
-			value +=  sin(harm * phase)  / harm ;
-//		*out_ptr++ = (value * scale) + offset;
-		*out_ptr++ = value;
-		phase += incr;
+// Build the tables, down to the octave that's a plain sine; the series are summed in double
+// from an exact sine table (sin(2 pi h i / N) is entry (h * i) mod N)
+
+void BLTableSet::fill(Buffer & tables) {
+	unsigned size = tables.mNumFrames;
+	unsigned mask = size - 1;
+	unsigned numTables = tables.mNumChannels;
+	BLWaveform shape = mShape;
+	std::vector<double> sines(size);
+	std::vector<double> sum(size);
+	for (unsigned i = 0; i < size; i++)
+		sines[i] = sin(CSL_TWOPI * (double) i / (double) size);
+	for (unsigned k = 0; k < numTables; k++) {
+		unsigned maxHarm = csl_max(numHarmonics(k), 1u);
+		for (unsigned i = 0; i < size; i++)
+			sum[i] = 0.0;
+		for (unsigned h = 1; h <= maxHarm; h++) {
+			double amp;
+			unsigned offset = 0;					// (a quarter cycle for cosines)
+			switch (shape) {
+			case kSquareBL:
+				if ( ! (h & 1))
+					continue;
+				amp = 4.0 / (CSL_PI * h);
+				break;
+			case kSawtoothBL:
+				amp = ((h & 1) ? 2.0 : -2.0) / (CSL_PI * h);
+				break;
+			case kTriangleBL:
+				if ( ! (h & 1))
+					continue;
+				amp = ((h & 2) ? -8.0 : 8.0) / (CSL_PI * CSL_PI * h * h);
+				break;
+			default:								// impulse: a sum of cosines
+				amp = 1.0 / (double) maxHarm;
+				offset = size / 4;
+				break;
+			}
+			for (unsigned i = 0; i < size; i++)
+				sum[i] += amp * sines[(h * i + offset) & mask];
+		}
+		SampleBuffer table = tables.buffer(k);
+		for (unsigned i = 0; i < size; i++)
+			table[i] = (sample) sum[i];
 	}
-	while (phase > CSL_TWOPI)
-		phase -= CSL_TWOPI;
 }
 
-ImpulseBL::ImpulseBL() : CompOrCacheOscillator() { }
+// BandLimitedOscillator implementation
 
-unsigned ImpulseBL::next_buffer(sample * buffer, unsigned num_frames) {
-	float* fp = (float*) buffer;
-	float twopi = (CSL_PI * 2.0);
+BandLimitedOscillator::BandLimitedOscillator(BLWaveform shape, float frequency, float ampl,
+				float offset, float phase)
+				: WavetableOscillator(frequency, ampl, offset, phase),
+				mShape(shape), mTableRate(0) {
+	mInterpolate = kLinear;
+	setShape(shape);
+}
 
-	_frequency->next_buffer(_frequency_buffer, num_frames);
-	_phase->next_buffer(_phase_buffer, num_frames);
-// _duty->next_buffer(_duty_buffer, num_frames);
+BandLimitedOscillator::~BandLimitedOscillator() { }
 
-	float rateRecip = 1.0/_rate;
-	float scale = 0.025/CSL_PI; //4.0 / (CSL_PI );
+// Get the shared tables (the wavetable points at the first one)
 
-	// generate buffer_size 32-bit floats
-	for (unsigned i = 0; i < num_frames; i++) {
-		float nextFloat = 1.0;
-		unsigned num_of_max_harmonic = (unsigned) floor(_rate / (_frequency_buffer[i] * 2)  );
+void BandLimitedOscillator::setShape(BLWaveform shape) {
+	BLTableSet tables(shape, mFrameRate);
+	setSharedTable(TableRegistry::acquire(tables));
+	mShape = shape;
+	mTableRate = mFrameRate;
+}
 
-		for (unsigned which_harmonic = 1; which_harmonic <= num_of_max_harmonic; which_harmonic++) {
-//		for (int which_harmonic = 0; which_harmonic <10; which_harmonic++) {
+// round a phase increment in 2^32ths of a cycle to a (wrapping) 32-bit step
 
-			//float gibbs = cos((which_harmonic-1)*CSL_PI/2/num_of_max_harmonic);
-			nextFloat +=   sin(which_harmonic *  _phase_accumulator);// * gibbs * gibbs ;
-		}
-		(*fp++) = scale * nextFloat;	// set all the channels equal to this float
+static inline unsigned fixedStep(double incr) {
+	return (unsigned) (long long) floor(incr + 0.5);
+}
 
-		static float max_amp = 0;
-		max_amp = (max_amp > scale * nextFloat) ? max_amp : scale * nextFloat;
-		// twopi * the normalized frequency + phase
-		_phase_accumulator += twopi * (_frequency_buffer[i] * rateRecip) + _phase_buffer[i];
+// answer the position of a frequency in octaves above the base frequency
 
-		// wraparound after 2pi radians
-		while (_phase_accumulator > twopi)
-			_phase_accumulator -= twopi;
-	}
-	return num_frames;
+static inline float octaveOf(float frequency) {
+	frequency = fabsf(frequency);
+	if (frequency <= CSL_BL_BASE_FREQ)
+		return 0.0f;
+	return log2f(frequency * (1.0f / CSL_BL_BASE_FREQ));
 }
 
-TriangleBL::TriangleBL() : CompOrCacheOscillator() { }
-
-unsigned TriangleBL::next_buffer(sample * buffer, unsigned num_frames) {
-	float* fp = (float*) buffer;
-	float twopi = (CSL_PI * 2.0);
-
-	_frequency->next_buffer(_frequency_buffer, num_frames);
-	_phase->next_buffer(_phase_buffer, num_frames);
-// _duty->next_buffer(_duty_buffer, num_frames);
-
-	float rateRecip = 1.0/_rate;
-	float scale = 8.0 / (CSL_PI * CSL_PI);
-			// generate buffer_size 32-bit floats
-	for (unsigned i = 0; i < num_frames; i++) {
-		float nextFloat = 0.0;
-		unsigned num_of_max_harmonic = (unsigned) (_rate / (_frequency_buffer[i]  * 2) );
-		for (unsigned which_harmonic = 1; which_harmonic <= num_of_max_harmonic; which_harmonic += 2) {
-//		for (int which_harmonic = 0; which_harmonic <10; which_harmonic++) {
-			nextFloat +=   sin(which_harmonic * _phase_accumulator ) / (which_harmonic * which_harmonic );
+// The phases are computed per chunk as in WavetableOscillator; each chunk reads the table for the
+// octave of its highest frequency and cross-fades towards the next one by the position within
+// that octave (ramped from the chunk's first to its last frequency). Chunks at or above the
+// Nyquist frequency are silent.
+
+void BandLimitedOscillator::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
+	SampleBuffer buffer = outputBuffer.buffer(outBufNum);	// get pointer to the selected output channel
+	unsigned numFrames = outputBuffer.mNumFrames;			// the number of frames to fill
+	DECLARE_PHASED_CONTROLS;								// declare the frequency buffer and value
+	DECLARE_SCALABLE_CONTROLS;								// declare the scale/offset buffers and values
+#ifdef CSL_DEBUG
+	logMsg("BandLimitedOscillator nextBuffer");
+#endif
+	if ((mTableRate != mFrameRate) || ! mSharedTable)		// the rate changed: get other tables
+		setShape(mShape);
+	unsigned taps;											// # of table samples per output sample
+	switch (mInterpolate) {
+	case kTruncate:	taps = 1; break;
+	case kLinear:	taps = 2; break;
+	case kCubic:	taps = 4; break;
+	default:
+		throw LogicError("Unimplemented interpolation policy");
+	}
+	LOAD_PHASED_CONTROLS;									// load the freqC from the constant or dynamic value
+	LOAD_SCALABLE_CONTROLS;									// load the scaleC and offsetC from the constant or dynamic value
+	bool isSilent = IS_SCALED_TO_SILENCE;					// silent scale: skip the table reads
+	DECLARE_PHASED_RAMPS;									// (but keep the phase running)
+	bool isLinear = IS_LINEAR_PHASED;						// if the freq isn't audio-rate, use the fast loops
+	unsigned tableLength = mSharedTable->mNumFrames;
+	unsigned sizeBits = CSL_BL_TABLE_BITS;
+	unsigned lastTable = mSharedTable->mNumChannels - 1;
+	float nyquist = (float) mFrameRate * 0.5f;
+	double stepsPerHz = 4294967296.0 / (double) mFrameRate;
+	if (mPhase != mLastPhase) {								// the phase was set: convert it to a fraction
+		double cycles = (double) mPhase / (double) tableLength;
+		mFixedPhase = fixedStep((cycles - floor(cycles)) * 4294967296.0);
+	}
+	unsigned phase = mFixedPhase;
+	unsigned phases[CSL_WTABLE_CHUNK];						// the phases of a run of frames
+	sample upper[CSL_WTABLE_CHUNK];							// the next table's values
+	for (unsigned done = 0; done < numFrames; done += CSL_WTABLE_CHUNK) {
+		unsigned count = csl_min(numFrames - done, (unsigned) CSL_WTABLE_CHUNK);
+		float firstFreq = freqValue;
+		float maxFreq = fabsf(freqValue);
+		if (isLinear && (freqStep == 0.0f)) {				// fixed/control-rate frequency
+			unsigned incr = fixedStep(freqValue * stepsPerHz);
+			for (unsigned i = 0; i < count; i++) {
+				phases[i] = phase;
+				phase += incr;								// wraps around by itself
+			}
+		} else if (isLinear) {								// ramped frequency
+			for (unsigned i = 0; i < count; i++) {
+				phases[i] = phase;
+				phase += fixedStep(freqValue * stepsPerHz);
+				UPDATE_PHASED_RAMPS;
+			}
+			maxFreq = csl_max(maxFreq, fabsf(freqValue - freqStep));
+		} else {											// audio-rate frequency
+			for (unsigned i = 0; i < count; i++) {
+				phases[i] = phase;
+				phase += fixedStep(freqValue * stepsPerHz);
+				if (fabsf(freqValue) > maxFreq)
+					maxFreq = fabsf(freqValue);
+				UPDATE_PHASED_CONTROLS;						// update the dynamic frequency
+			}
+			firstFreq = maxFreq;							// (no ramp: the fade is by the peak)
+		}
+		SampleBuffer out = buffer + done;
+		if (isSilent)
+			continue;
+		if (maxFreq >= nyquist) {							// no harmonics left
+			memset(out, 0, count * sizeof(sample));
+			continue;
+		}
+		float lastFreq = (isLinear && (freqStep != 0.0f)) ? (freqValue - freqStep) : firstFreq;
+		float first = octaveOf(firstFreq);
+		float last = octaveOf(lastFreq);
+		unsigned which = (unsigned) csl_min(floorf(csl_max(first, last)), (float) lastTable);
+		float fade = csl_min(csl_max(first - which, 0.0f), 1.0f);
+		float fadeEnd = csl_min(csl_max(last - which, 0.0f), 1.0f);
+		if (which == lastTable)								// (the last table is a sine)
+			fade = fadeEnd = 0.0f;
+													//// WAVE TABLE ACCESS ////
+		VectorOps::tableLookup(out, mSharedTable->buffer(which), sizeBits, phases, count, taps);
+		if ((fade > 0.0f) || (fadeEnd > 0.0f)) {			// cross-fade to the next table
+			VectorOps::tableLookup(upper, mSharedTable->buffer(which + 1), sizeBits, phases, count, taps);
+			float fadeStep = (count > 1) ? (fadeEnd - fade) / (float) (count - 1) : 0.0f;
+			for (unsigned i = 0; i < count; i++) {
+				out[i] += (upper[i] - out[i]) * fade;
+				fade += fadeStep;
+			}
+		}
+	}
+	mFixedPhase = phase;									// store the phase (and the frame # version)
+	mPhase = mLastPhase = (sample) ((double) phase * ((double) tableLength / 4294967296.0));
+	if (isSilent) {
+		zeroBuffer(outputBuffer, outBufNum);
+		return;
+	}
+	if (IS_LINEAR_SCALABLE) {								// fixed/control-rate scale/offset
+		DECLARE_SCALABLE_RAMPS;
+		if ((scaleValue != 1.0f) || (scaleStep != 0.0f))
+			VectorOps::mulRamp(buffer, buffer, scaleValue, scaleStep, numFrames);
+		if ((offsetValue != 0.0f) || (offsetStep != 0.0f)) {
+			for (unsigned i = 0; i < numFrames; i++) {
+				buffer[i] += offsetValue;
+				offsetValue += offsetStep;
+			}
+		}
+	} else {												// audio-rate scale/offset
+		for (unsigned i = 0; i < numFrames; i++) {
+			buffer[i] = (buffer[i] * scaleValue) + offsetValue;
+			UPDATE_SCALABLE_CONTROLS;						// update the dynamic scale/offset
 		}
-		(*fp++) = scale * nextFloat;	// set all the channels equal to this float
-		static float max_amp = 0;
-		max_amp = (max_amp > scale * nextFloat) ? max_amp : scale * nextFloat;
-				// twopi * the normalized frequency + phase
-		_phase_accumulator += twopi * (_frequency_buffer[i] * rateRecip) + _phase_buffer[i];
-				// wraparound after 2pi radians
-		while (_phase_accumulator > twopi)
-				_phase_accumulator -= twopi;
 	}
-	return num_frames;
 }
 
-*/
+// The waveform classes just pick their table sets
+
+SquareBL::SquareBL() : BandLimitedOscillator(kSquareBL) { }
+
+SquareBL::SquareBL(float frequency) : BandLimitedOscillator(kSquareBL, frequency) { }
+
+SquareBL::SquareBL(float frequency, float phase)
+				: BandLimitedOscillator(kSquareBL, frequency, 1.0f, 0.0f, phase) { }
+
+SawtoothBL::SawtoothBL() : BandLimitedOscillator(kSawtoothBL) { }
+
+SawtoothBL::SawtoothBL(float frequency) : BandLimitedOscillator(kSawtoothBL, frequency) { }
+
+SawtoothBL::SawtoothBL(float frequency, float phase)
+				: BandLimitedOscillator(kSawtoothBL, frequency, 1.0f, 0.0f, phase) { }
+
+TriangleBL::TriangleBL() : BandLimitedOscillator(kTriangleBL) { }
+
+TriangleBL::TriangleBL(float frequency) : BandLimitedOscillator(kTriangleBL, frequency) { }
+
+TriangleBL::TriangleBL(float frequency, float phase)
+				: BandLimitedOscillator(kTriangleBL, frequency, 1.0f, 0.0f, phase) { }
+
+ImpulseBL::ImpulseBL() : BandLimitedOscillator(kImpulseBL) { }
+
+ImpulseBL::ImpulseBL(float frequency) : BandLimitedOscillator(kImpulseBL, frequency) { }
+
+ImpulseBL::ImpulseBL(float frequency, float phase)
+				: BandLimitedOscillator(kImpulseBL, frequency, 1.0f, 0.0f, phase) { }
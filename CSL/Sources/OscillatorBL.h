@@ -1,8 +1,21 @@
 //
-//  OscillatorBL.h -- Band-limited oscillators -- these can use on-demand sine summation, or store their wavetables 
-//		(the latter choice might be dangerous with dynamic frequency control, of course)
+//  OscillatorBL.h -- Band-limited oscillators that read shared per-octave ("mipmapped") wavetables
 //	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
 //
+// Each waveform is stored as a set of tables, one per octave of fundamental frequency, where
+// table k has only the harmonics that stay below the Nyquist frequency up to 2^(k+1) times the
+// base frequency. The oscillator picks the table for the octave it's playing in and cross-fades
+// towards the next (duller) one as the frequency rises, so a sweep has no aliasing and no steps
+// in its brightness, at the cost of two table look-ups per frame.
+//
+// The tables are built once per (waveform, frame rate) when the first oscillator is created and
+// are shared read-only (through the TableRegistry) by all the oscillators after that.
+//
+// Usage:
+//		SawtoothBL saw(110);						// alias-free sawtooth at 110 Hz
+//		LineSegment sweep(5, 40, 10000);
+//		saw.setFrequency(sweep);					// ...clean all the way up
+//
 
 #ifndef INCLUDE_OscillatorBL_H
 #define INCLUDE_OscillatorBL_H
@@ -11,53 +24,100 @@
 
 namespace csl {
 
+#define CSL_BL_TABLE_BITS 12				///< log2 of the size of the band-limited tables
+#define CSL_BL_BASE_FREQ 10.0f				///< fundamental (Hz) below which the first table is used
+
+///
+/// The band-limited waveforms
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kSquareBL,								///< odd harmonics at 1/n
+	kSawtoothBL,							///< all harmonics at 1/n (rising ramp)
+	kTriangleBL,							///< odd harmonics at 1/n^2
+	kImpulseBL								///< all harmonics at equal level (normalized to a peak of 1)
+} BLWaveform;
+#else
+	#define kSquareBL 0
+	#define kSawtoothBL 1
+	#define kTriangleBL 2
+	#define kImpulseBL 3
+	typedef int BLWaveform;
+#endif
+
 ///
-/// Band-limited square, impulse, and triangle waveform oscillators
+/// BLTableSet -- the generator for a waveform's per-octave tables at a frame rate (one channel
+/// per octave; the tables themselves are shared through the TableRegistry)
 ///
 
-class SquareBL : public SumOfSines {
+class BLTableSet : public TableGenerator {
 public:
-	SquareBL();
-	SquareBL(float frequency);
-	SquareBL(float frequency, float phase);
-	
-//	void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
-	void nextWaveInto(sample * dest, unsigned count, bool oneHz);
+	BLTableSet(BLWaveform shape, unsigned frameRate) : mShape(shape), mFrameRate(frameRate) { };
 
-};
+	string key();
+	unsigned numFrames() { return 1u << CSL_BL_TABLE_BITS; };
+	unsigned numChannels();					///< answer the # of octaves, down to a plain sine
+	void fill(Buffer & tables);
+	unsigned numHarmonics(unsigned which);	///< answer the highest harmonic in table which
 
-/*
-class ImpulseBL : public SumOfSines {
 protected:
-	void nextWaveInto(sample * dest, unsigned count, bool oneHz);
+	BLWaveform mShape;
+	unsigned mFrameRate;
+};
+
+///
+/// BandLimitedOscillator -- a wavetable oscillator that reads a BLTableSet, selecting and
+/// cross-fading the tables by the current frequency (it interpolates linearly by default)
+///
 
+class BandLimitedOscillator : public WavetableOscillator {
 public:
-	ImpulseBL();
-	ImpulseBL(float frequency);
-	ImpulseBL(float frequency, float phase);
-};
+	BandLimitedOscillator(BLWaveform shape, float frequency = 220, float ampl = 1.0,
+						float offset = 0.0, float phase = 0.0);
+	~BandLimitedOscillator();
+
+	BLWaveform shape() { return mShape; };
+	void setShape(BLWaveform shape);		///< switch waveforms (builds the tables if need be)
+											/// get the next buffer of samples
+	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
 
-class TriangleBL : public SumOfSines {
 protected:
-	void nextWaveInto(sample * dest, unsigned count, bool oneHz);
+	BLWaveform mShape;
+	unsigned mTableRate;					///< the rate the tables (mSharedTable) are for
+};
 
+///
+/// Band-limited square, sawtooth, triangle, and impulse waveform oscillators
+///
+
+class SquareBL : public BandLimitedOscillator {
 public:
-	TriangleBL();
-	TriangleBL(float frequency);
-	TriangleBL(float frequency, float phase);
+	SquareBL();
+	SquareBL(float frequency);
+	SquareBL(float frequency, float phase);
 };
 
-class SawtoothBL : public SumOfSines {
-protected:
-	void nextWaveInto(sample * dest, unsigned count, bool oneHz);
-
+class SawtoothBL : public BandLimitedOscillator {
 public:
 	SawtoothBL();
 	SawtoothBL(float frequency);
 	SawtoothBL(float frequency, float phase);
 };
 
-*/
+class TriangleBL : public BandLimitedOscillator {
+public:
+	TriangleBL();
+	TriangleBL(float frequency);
+	TriangleBL(float frequency, float phase);
+};
+
+class ImpulseBL : public BandLimitedOscillator {
+public:
+	ImpulseBL();
+	ImpulseBL(float frequency);
+	ImpulseBL(float frequency, float phase);
+};
 
 }
 
@@ -9,25 +9,35 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <string.h>
 
 using namespace csl;
 
 // SHARCSpectrum implementation
+// Empty constructor (a binary library fills in the fields)
+
+SHARCSpectrum::SHARCSpectrum() : _note_name(0), _midi_key(0), _nom_pitch(0), _actual_pitch(0),
+					_max_amp(0), _num_partials(0), _partials(0), _owns_data(false) { }
+
 // Populating constructor
 
 SHARCSpectrum::SHARCSpectrum(char * folder, char * name, unsigned m_key,
 					float n_pitch, float a_pitch, unsigned m_amp, unsigned n_partials) :
 					_midi_key(m_key), _nom_pitch(n_pitch), _actual_pitch(a_pitch),
-					_max_amp(m_amp), _num_partials(n_partials) {
+					_max_amp(m_amp), _num_partials(n_partials), _owns_data(true) {
 	 _note_name = (char *) malloc(strlen(name) + 1);
 	 strcpy(_note_name, name);
-	_partials = (Partial **) malloc(n_partials * (sizeof(char *)));
-	this->read_from_file(folder, name);
+	_partials = (Partial *) malloc(csl_max(n_partials, 1u) * sizeof(Partial));
+	if ( ! this->read_from_file(folder, name))
+		_num_partials = 0;
 }
 
 SHARCSpectrum::~SHARCSpectrum() { 
+	if ( ! _owns_data)
+		return;
 	free(_note_name);
 	free(_partials);
 }
@@ -41,6 +51,7 @@ bool SHARCSpectrum::SHARCSpectrum::read_from_file(char * folder, char * name) {
 	float amp, phas;
 	Partial * harm;
 	unsigned p_count = 0;
+	unsigned p_lines = 0;
 	
 	sprintf(cmd, "ls %s/*%s.spect", folder, name);
 	inp = popen(cmd, "r");
@@ -63,19 +74,23 @@ bool SHARCSpectrum::SHARCSpectrum::read_from_file(char * folder, char * name) {
 		return false;
 	}
 	while( ! feof(inp)) {
-		fscanf(inp, "%f %f\n", &amp, &phas);
-		harm = (Partial *) malloc(sizeof(Partial));
+		if (fscanf(inp, "%f %f\n", &amp, &phas) != 2)
+			break;
+		p_lines++;
+		if (p_count >= _num_partials)		// (more lines than the CONTENTS file said)
+			continue;
+		harm = & _partials[p_count];
 		harm->number = p_count + 1;
 										// Scale the negative dB value to the range 0-1
 		harm->amplitude = (float) pow(10.0, (((double) amp) / 20.0));
 		harm->phase = phas;
-		_partials[p_count++] = harm;
+		p_count++;
 	}
 //	printf("\tRead %d harmonics (exp %d) for spectrum %s\n", p_count, _num_partials, name);
 	fclose(inp);
-	if (p_count != _num_partials) {
-		printf("\tError: number of partials found (%d) not what I expected (%d) for %s in %s\n",  p_count, _num_partials, name, folder);
-//		return false;
+	if (p_lines != _num_partials) {
+		printf("\tError: number of partials found (%d) not what I expected (%d) for %s in %s\n",  p_lines, _num_partials, name, folder);
+		_num_partials = p_count;
 	}
 	return true;
 }
@@ -88,7 +103,7 @@ void SHARCSpectrum::dump_example() {
 	Partial * harm;	
 	printf("\tFR @ AMP     @ PHA\n");
 	for (unsigned i = 0; i < _num_partials; i++) {
-		harm = _partials[i];
+		harm = & _partials[i];
 		printf("\t%d  @ %.5f @ %.5f\n", ((int) harm->number), harm->amplitude, harm->phase);
 	}
 }
@@ -96,14 +111,37 @@ void SHARCSpectrum::dump_example() {
 // SHARCInstrument implementation
 // Constructor, etc
 
-SHARCInstrument::SHARCInstrument(char * folder, char * name) {
+SHARCInstrument::SHARCInstrument() : _name(0), _num_spectra(0), _spectra(0), _key_index(0),
+					_owns_data(false) { }
+
+SHARCInstrument::SHARCInstrument(char * folder, char * name) : _key_index(0), _owns_data(true) {
 	_num_spectra = 0;
 	_spectra = (SHARCSpectrum **) malloc(MAX_SPECTRA * (sizeof(char *)));
 	this->read_from_TOC(folder, name);
+	this->make_key_index();
 }
 
 SHARCInstrument::~SHARCInstrument() {
+	if ( ! _owns_data)
+		return;
+	for (unsigned i = 0; i < _num_spectra; i++)
+		delete _spectra[i];
 	free(_spectra);
+	free(_key_index);
+	free(_name);
+}
+
+// Index the spectra by MIDI key (the first one wins if there are several per key)
+
+void SHARCInstrument::make_key_index() {
+	if ( ! _key_index)
+		_key_index = (unsigned short *) malloc(SHARC_NUM_KEYS * sizeof(unsigned short));
+	memset(_key_index, 0, SHARC_NUM_KEYS * sizeof(unsigned short));
+	for (unsigned i = 0; i < _num_spectra; i++) {
+		unsigned key = _spectra[i]->_midi_key;
+		if ((key < SHARC_NUM_KEYS) && (_key_index[key] == 0))
+			_key_index[key] = (unsigned short) (i + 1);
+	}
 }
 
 // Load all the samples described in the given CONTENTS file
@@ -126,10 +164,11 @@ bool SHARCInstrument::read_from_TOC(char * folder, char * name) {
 	}
 	   sprintf(f_name, "%s/%s", folder, name);
 								// Read through it line by line, loading the spectra described by the lines
-	while( ! feof(input)) {
-		fscanf(input, "%s %d %d %d %f %f %d %d %d %f %f %f\n",
-			note_name, &note_num, &num_harm, &max_amp, &nom_freq, &real_freq,
-			&m1, &m2, &m3, &dur, &start, &centroid);
+	while(( ! feof(input)) && (_num_spectra < MAX_SPECTRA)) {
+		if (fscanf(input, "%7s %d %d %d %f %f %d %d %d %f %f %f\n",
+				note_name, &note_num, &num_harm, &max_amp, &nom_freq, &real_freq,
+				&m1, &m2, &m3, &dur, &start, &centroid) != 12)
+			break;
 		spect = new SHARCSpectrum(f_name, note_name, note_num, nom_freq, real_freq,
 									max_amp, num_harm);
 		_spectra[_num_spectra++] = spect;
@@ -178,21 +217,43 @@ SHARCSpectrum * SHARCInstrument::spectrum_named(char * name) {
 }
 
 SHARCSpectrum * SHARCInstrument::spectrum_with_key(unsigned key) {
-	for (unsigned i = 0; i < _num_spectra; i++) {
-		if (_spectra[i]->_midi_key == key) {
-			return  _spectra[i];
-		}
-	}
-	return (SHARCSpectrum *) 0;
+	if ((key >= SHARC_NUM_KEYS) || (_key_index == NULL) || (_key_index[key] == 0))
+		return (SHARCSpectrum *) 0;
+	return _spectra[_key_index[key] - 1];
 }
 
+// Look up the key nearest the frequency (SHARC key 57 is A 440) and search outwards in the index;
+// of the spectra at the nearest keys found (and 1 more key out, since the actual pitches vary),
+// take the one whose pitch is closest to the frequency
+
 SHARCSpectrum * SHARCInstrument::spectrum_with_frequency(float freq) {
-	for (unsigned i = 0; i < _num_spectra; i++) {
-		if (_spectra[i]->_actual_pitch == freq) {
-			return  _spectra[i];
+	if ((freq <= 0.0f) || (_key_index == NULL))
+		return (SHARCSpectrum *) 0;
+	int key = (int) floorf(57.0f + 12.0f * log2f(freq / 440.0f) + 0.5f);
+	key = csl_min(csl_max(key, 0), SHARC_NUM_KEYS - 1);
+	SHARCSpectrum * best = 0;
+	float bestDist = 0.0f;
+	int found = -1;								// distance of the first hit
+	for (int dist = 0; dist < SHARC_NUM_KEYS; dist++) {
+		if ((found >= 0) && (dist > found + 1))
+			break;
+		for (int side = -1; side <= 1; side += 2) {
+			int which = key + (dist * side);
+			if ((which < 0) || (which >= SHARC_NUM_KEYS) || (_key_index[which] == 0))
+				continue;
+			SHARCSpectrum * spect = _spectra[_key_index[which] - 1];
+			float pitchDist = fabsf(log2f(spect->_actual_pitch / freq));
+			if ((best == 0) || (pitchDist < bestDist)) {
+				best = spect;
+				bestDist = pitchDist;
+			}
+			if (found < 0)
+				found = dist;
+			if (dist == 0)						// (only look once at the key itself)
+				break;
 		}
 	}
-	return (SHARCSpectrum *) 0;
+	return best;
 }
 
 // Debugging functions
@@ -221,16 +282,31 @@ void SHARCInstrument::dump_example() {
 
 // SHARCLibrary implementation
 
-SHARCLibrary::SHARCLibrary() { }
+SHARCLibrary::SHARCLibrary() : _num_instruments(0), _instruments(0), _mapping(0), _mapping_size(0),
+					_instrument_block(0), _spectrum_block(0), _spectrum_list(0) { }
 
 SHARCLibrary::~SHARCLibrary() { 
+	if (_mapping) {						// loaded from a binary file
+		delete [] _instrument_block;
+		delete [] _spectrum_block;
+		free(_spectrum_list);
+		munmap(_mapping, _mapping_size);
+	} else {
+		for (unsigned i = 0; i < _num_instruments; i++)
+			delete _instruments[i];
+	}
 	free(_instruments);
 }
 
-// Populating constructor
+// Populating constructor -- the name is a SHARC folder or a binary library file
 
-SHARCLibrary::SHARCLibrary(char * name) {
-	_num_instruments = 0;
+SHARCLibrary::SHARCLibrary(char * name) : _num_instruments(0), _instruments(0), _mapping(0),
+					_mapping_size(0), _instrument_block(0), _spectrum_block(0), _spectrum_list(0) {
+	struct stat stat_p;
+	if ((stat(name, &stat_p) == 0) && S_ISREG(stat_p.st_mode)) {
+		this->read_from_DB(name);
+		return;
+	}
 	_instruments = (SHARCInstrument ** ) malloc(MAX_INSTRUMENTS * (sizeof(char *)));
 	this->read_from_directory(name);
 }
@@ -246,7 +322,11 @@ bool SHARCLibrary::read_from_directory(char * folder) {
 					// Iterate over the given folder and its sub-folders	
 	fprintf(stderr, "Loading SHARC database from folder %s\n", folder);
 	dir_p = opendir(folder);
-	while(NULL != (entry_p = readdir(dir_p))) {
+	if (dir_p == NULL) {
+		printf("\tError opening folder %s\n", folder);
+		return false;
+	}
+	while((NULL != (entry_p = readdir(dir_p))) && (_num_instruments < MAX_INSTRUMENTS)) {
 		if (entry_p->d_name[0] != '.') {			// ignore . and ..
 		//	printf("Examining %s \t", entry_p->d_name);
 			sprintf(f_name, "%s/%s", folder, entry_p->d_name);
@@ -269,6 +349,168 @@ bool SHARCLibrary::read_from_directory(char * folder) {
 	return true;
 }
 
+// Binary file reader -- map the file, check that its tables are consistent, and make the instrument
+// and spectrum objects (in 2 blocks) pointing into it
+
+bool SHARCLibrary::read_from_DB(const char * name) {
+	struct stat stat_p;
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		printf("\tError opening file %s\n", name);
+		return false;
+	}
+	if ((fstat(fd, &stat_p) < 0) || (stat_p.st_size < (off_t) sizeof(SHARCFileHeader))) {
+		printf("\tError: %s is not a SHARC library\n", name);
+		close(fd);
+		return false;
+	}
+	unsigned size = (unsigned) stat_p.st_size;
+	void * mapping = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);								// (the mapping stays valid)
+	if (mapping == MAP_FAILED) {
+		printf("\tError mapping file %s\n", name);
+		return false;
+	}
+	char * base = (char *) mapping;
+	SHARCFileHeader * header = (SHARCFileHeader *) base;
+	bool ok = (memcmp(header->magic, SHARC_DB_MAGIC, 8) == 0)		// check the header and tables
+			&& (header->version == SHARC_DB_VERSION) && (header->fileSize == size)
+			&& (header->instrumentOffset <= size) && (header->spectrumOffset <= size)
+			&& (header->partialOffset <= size) && (header->nameOffset <= size)
+			&& (header->numInstruments <= (size - header->instrumentOffset) / sizeof(SHARCFileInstrument))
+			&& (header->numSpectra <= (size - header->spectrumOffset) / sizeof(SHARCFileSpectrum))
+			&& (header->numPartials <= (size - header->partialOffset) / sizeof(Partial))
+			&& (header->nameSize > 0) && (header->nameSize <= size - header->nameOffset)
+			&& (base[header->nameOffset + header->nameSize - 1] == 0);
+	SHARCFileInstrument * insts = (SHARCFileInstrument *) (base + header->instrumentOffset);
+	SHARCFileSpectrum * spects = (SHARCFileSpectrum *) (base + header->spectrumOffset);
+	for (unsigned i = 0; ok && (i < header->numInstruments); i++) {
+		SHARCFileInstrument & in = insts[i];
+		ok = (in.name < header->nameSize) && (in.firstSpectrum <= header->numSpectra)
+				&& (in.numSpectra <= header->numSpectra - in.firstSpectrum);
+		for (unsigned k = 0; ok && (k < SHARC_NUM_KEYS); k++)
+			ok = (in.keyIndex[k] <= in.numSpectra);
+	}
+	for (unsigned i = 0; ok && (i < header->numSpectra); i++) {
+		SHARCFileSpectrum & sp = spects[i];
+		ok = (sp.name < header->nameSize) && (sp.firstPartial <= header->numPartials)
+				&& (sp.numPartials <= header->numPartials - sp.firstPartial);
+	}
+	if ( ! ok) {
+		printf("\tError: %s is not a valid SHARC library (version %d)\n", name, SHARC_DB_VERSION);
+		munmap(mapping, size);
+		return false;
+	}
+	_mapping = mapping;
+	_mapping_size = size;
+	char * names = base + header->nameOffset;
+	Partial * partials = (Partial *) (base + header->partialOffset);
+	_spectrum_block = new SHARCSpectrum[csl_max(header->numSpectra, 1u)];
+	_spectrum_list = (SHARCSpectrum **) malloc(csl_max(header->numSpectra, 1u) * sizeof(SHARCSpectrum *));
+	for (unsigned i = 0; i < header->numSpectra; i++) {
+		SHARCFileSpectrum & sp = spects[i];
+		SHARCSpectrum * spect = & _spectrum_block[i];
+		spect->_note_name = names + sp.name;
+		spect->_midi_key = sp.midiKey;
+		spect->_nom_pitch = sp.nomPitch;
+		spect->_actual_pitch = sp.actualPitch;
+		spect->_max_amp = sp.maxAmp;
+		spect->_num_partials = sp.numPartials;
+		spect->_partials = partials + sp.firstPartial;
+		_spectrum_list[i] = spect;
+	}
+	_instrument_block = new SHARCInstrument[csl_max(header->numInstruments, 1u)];
+	_instruments = (SHARCInstrument **) malloc(csl_max(header->numInstruments, 1u) * sizeof(SHARCInstrument *));
+	for (unsigned i = 0; i < header->numInstruments; i++) {
+		SHARCFileInstrument & in = insts[i];
+		SHARCInstrument * inst = & _instrument_block[i];
+		inst->_name = names + in.name;
+		inst->_num_spectra = in.numSpectra;
+		inst->_spectra = _spectrum_list + in.firstSpectrum;
+		inst->_key_index = in.keyIndex;
+		_instruments[i] = inst;
+	}
+	_num_instruments = header->numInstruments;
+	return true;
+}
+
+// Binary file writer -- lay out the tables (see SHARC.h) and write them in one go
+
+bool SHARCLibrary::storeToDB(const char * filename) {
+	SHARCFileHeader header;
+	unsigned numSpectra = 0, numPartials = 0, nameSize = 0;
+	for (unsigned i = 0; i < _num_instruments; i++) {		// count everything
+		SHARCInstrument * inst = _instruments[i];
+		nameSize += strlen(inst->_name) + 1;
+		numSpectra += inst->_num_spectra;
+		for (unsigned j = 0; j < inst->_num_spectra; j++) {
+			numPartials += inst->_spectra[j]->_num_partials;
+			nameSize += strlen(inst->_spectra[j]->_note_name) + 1;
+		}
+	}
+	memset(& header, 0, sizeof(header));
+	memcpy(header.magic, SHARC_DB_MAGIC, 8);
+	header.version = SHARC_DB_VERSION;
+	header.numInstruments = _num_instruments;
+	header.numSpectra = numSpectra;
+	header.numPartials = numPartials;
+	header.instrumentOffset = sizeof(SHARCFileHeader);
+	header.spectrumOffset = header.instrumentOffset + _num_instruments * sizeof(SHARCFileInstrument);
+	header.partialOffset = header.spectrumOffset + numSpectra * sizeof(SHARCFileSpectrum);
+	header.nameOffset = header.partialOffset + numPartials * sizeof(Partial);
+	header.nameSize = csl_max(nameSize, 1u);
+	header.fileSize = header.nameOffset + header.nameSize;
+
+	char * image = (char *) calloc(header.fileSize, 1);	// build the file image
+	if (image == NULL)
+		return false;
+	memcpy(image, & header, sizeof(header));
+	SHARCFileInstrument * insts = (SHARCFileInstrument *) (image + header.instrumentOffset);
+	SHARCFileSpectrum * spects = (SHARCFileSpectrum *) (image + header.spectrumOffset);
+	Partial * partials = (Partial *) (image + header.partialOffset);
+	char * names = image + header.nameOffset;
+	unsigned spectC = 0, partC = 0, nameC = 0;
+	for (unsigned i = 0; i < _num_instruments; i++) {
+		SHARCInstrument * inst = _instruments[i];
+		SHARCFileInstrument & in = insts[i];
+		in.name = nameC;
+		strcpy(names + nameC, inst->_name);
+		nameC += strlen(inst->_name) + 1;
+		in.firstSpectrum = spectC;
+		in.numSpectra = inst->_num_spectra;
+		if (inst->_key_index)
+			memcpy(in.keyIndex, inst->_key_index, sizeof(in.keyIndex));
+		for (unsigned j = 0; j < inst->_num_spectra; j++) {
+			SHARCSpectrum * spect = inst->_spectra[j];
+			SHARCFileSpectrum & sp = spects[spectC++];
+			sp.name = nameC;
+			strcpy(names + nameC, spect->_note_name);
+			nameC += strlen(spect->_note_name) + 1;
+			sp.midiKey = spect->_midi_key;
+			sp.nomPitch = spect->_nom_pitch;
+			sp.actualPitch = spect->_actual_pitch;
+			sp.maxAmp = spect->_max_amp;
+			sp.firstPartial = partC;
+			sp.numPartials = spect->_num_partials;
+			memcpy(partials + partC, spect->_partials, spect->_num_partials * sizeof(Partial));
+			partC += spect->_num_partials;
+		}
+	}
+	FILE * store = fopen(filename, "wb");
+	if ( ! store) {
+		printf("Error saving SHARC DB - cannot open file %s\n", filename);
+		free(image);
+		return false;
+	}
+	bool ok = (fwrite(image, 1, header.fileSize, store) == header.fileSize);
+	ok = (fclose(store) == 0) && ok;
+	free(image);
+	if (ok)
+		logMsg("Saved SHARC DB %s: %d instruments, %d spectra, %d partials = %d kB",
+				filename, _num_instruments, numSpectra, numPartials, header.fileSize / 1024);
+	return ok;
+}
+
 // Accessing utilities
 
 char ** SHARCLibrary::instrument_names() {
@@ -327,8 +569,19 @@ SHARCLibrary * SHARCLibrary::sSHARCLib = 0;
 void SHARCLibrary::loadDefault() {
 	if (sSHARCLib)
 		return;
+	struct stat stat_p;
+	string db(CGestalt::dataFolder());
+	db += SHARC_DB_NAME;					// map the binary library if there is one
+	if (stat(db.c_str(), &stat_p) == 0) {
+		sSHARCLib = new SHARCLibrary((char *) db.c_str());
+		if (sSHARCLib->_num_instruments > 0) {
+			sSHARCLib->dump_stats();
+			return;
+		}
+		delete sSHARCLib;
+	}
 	string folder(CGestalt::dataFolder());
-	folder += "SHARC";						// load the SHARC library
+	folder += "SHARC";						// else load the SHARC text library
 	sSHARCLib = new SHARCLibrary((char *)folder.c_str());
 	sSHARCLib->dump_stats();
 }
@@ -54,6 +54,20 @@
 //
 // This structure is exactly mapped by the C++ implementation.
 //
+// Parsing the text files takes a few seconds and makes thousands of small objects, so the library
+// can also be stored as a single binary file (storeToDB()), which is memory-mapped at load time and
+// read in place: the instrument and spectrum objects are made in 2 blocks, and their names, partials
+// and key indices point into the mapped file (whose pages the OS shares between processes).
+// loadDefault() uses the binary file SHARC.dat in the data folder if there is one.
+//
+//	CSL SHARC.dat file format (native byte order; all offsets are in bytes from the start)
+//		SHARCFileHeader -- magic "CSLSHARC", version, counts, and the offsets of the tables
+//		instrument table -- a SHARCFileInstrument per instrument: name, its range of spectra, and
+//			an index of its spectra by MIDI key
+//		spectrum table -- a SHARCFileSpectrum per spectrum: name, key, pitches, range of partials
+//		partial table -- the Partial structs of all the spectra (amplitudes are linear)
+//		name table -- the nul-terminated instrument and note names
+//
 // Note: The implementation has UNIX-specific code in it.
 //
 
@@ -67,8 +81,48 @@
 #define MAX_SPECTRA 64
 #define MAX_INSTRUMENTS 40
 
+#define SHARC_NUM_KEYS 128				///< size of the instruments' MIDI key index
+#define SHARC_DB_NAME "SHARC.dat"		///< the binary library in the data folder
+#define SHARC_DB_MAGIC "CSLSHARC"
+#define SHARC_DB_VERSION 1
+
 namespace csl {
 
+///
+/// SHARC.dat file records (see above)
+///
+
+typedef struct {
+	char magic[8];						///< "CSLSHARC" (not nul-terminated)
+	unsigned version;					///< SHARC_DB_VERSION
+	unsigned fileSize;					///< total size in bytes
+	unsigned numInstruments;
+	unsigned numSpectra;
+	unsigned numPartials;
+	unsigned instrumentOffset;			///< table offsets
+	unsigned spectrumOffset;
+	unsigned partialOffset;
+	unsigned nameOffset;
+	unsigned nameSize;
+} SHARCFileHeader;
+
+typedef struct {
+	unsigned name;						///< offset of the name in the name table
+	unsigned firstSpectrum;				///< index of the first spectrum in the spectrum table
+	unsigned numSpectra;
+	unsigned short keyIndex[SHARC_NUM_KEYS];	///< spectrum # + 1 per MIDI key (0 = none)
+} SHARCFileInstrument;
+
+typedef struct {
+	unsigned name;						///< offset of the note name in the name table
+	unsigned midiKey;
+	float nomPitch;
+	float actualPitch;
+	unsigned maxAmp;
+	unsigned firstPartial;				///< index of the first partial in the partial table
+	unsigned numPartials;
+} SHARCFileSpectrum;
+
 ///
 /// SHARC spectrum class
 ///
@@ -82,8 +136,10 @@ public:
 	float _actual_pitch;
 	unsigned _max_amp;
 	unsigned _num_partials;
-	Partial ** _partials;
+	Partial * _partials;				///< the partials (in the mapped file if loaded from one)
+	bool _owns_data;					///< whether I allocated the name and partials
 
+	SHARCSpectrum();					///< empty spectrum (filled in by a binary library)
 	SHARCSpectrum(char * folder, char * name, unsigned m_key, float n_pitch, float a_pitch,
 					unsigned m_amp, unsigned n_partials);
 	~SHARCSpectrum();
@@ -103,7 +159,10 @@ public:				// Data members
 	char * _name;
 	unsigned _num_spectra;
 	SHARCSpectrum ** _spectra;
+	unsigned short * _key_index;	///< spectrum # + 1 per MIDI key (0 = none)
+	bool _owns_data;				///< whether I allocated my name, spectra and index
 					// Constructor
+	SHARCInstrument();				///< empty instrument (filled in by a binary library)
 	SHARCInstrument(char * folder, char * name);
 	~SHARCInstrument();
 					// Accessing
@@ -112,7 +171,9 @@ public:				// Data members
 	float * spectrum_frequencies();
 	SHARCSpectrum * spectrum_named(char * name);
 	SHARCSpectrum * spectrum_with_key(unsigned key);
+					/// the spectrum whose pitch is nearest the given frequency (found via the key index)
 	SHARCSpectrum * spectrum_with_frequency(float freq);
+	void make_key_index();			///< build the key index of a text-loaded instrument
 					// For debugging
 	unsigned count_spectra();
 	unsigned count_partials();
@@ -134,8 +195,10 @@ public:				// Data members
 	SHARCInstrument ** _instruments;
 					// Constructor
 	SHARCLibrary();
-	SHARCLibrary(char * name);
+	SHARCLibrary(char * name);		///< load from a SHARC folder or a SHARC.dat file
 	~SHARCLibrary();
+					/// store the library as a binary file (see above); answer success
+	bool storeToDB(const char * filename);
 					// Accessing
 	char * * instrument_names();
 	SHARCInstrument * instrument_named(const char * name);
@@ -157,6 +220,12 @@ public:				// Data members
 
 private:
 	bool read_from_directory(char * name);
+	bool read_from_DB(const char * name);	///< map a SHARC.dat file
+	void * _mapping;				///< the mapped file (or NULL if loaded from text)
+	unsigned _mapping_size;
+	SHARCInstrument * _instrument_block;	///< the objects made for a mapped file
+	SHARCSpectrum * _spectrum_block;
+	SHARCSpectrum ** _spectrum_list;
 };
 
 }
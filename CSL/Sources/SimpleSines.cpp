@@ -58,7 +58,7 @@ SineAsPhased::SineAsPhased(float frequency, float phase) : UnitGenerator(), Phas
 SineAsPhased::~SineAsPhased() { }		///< Destructor is a no-op
 
 // This monoNextBuffer method looks the same as above, but handles dynamic frequency using
-// the input port map (i.e., the mInputs[CSL_FREQUENCY] expression, which returns a Port object pointer)
+// the input port slots (i.e., the mPortSlots[CSL_FREQUENCY] expression, which returns a Port object pointer)
 
 #ifdef NOT_THIS_WAY		// This is the really verbose way; see below for how to use the macros to make this easier
 
@@ -66,7 +66,7 @@ void SineAsPhased::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (
 	sample * buffer = outputBuffer.buffer(outBufNum);		// get pointer to the selected output channel
 	float rateRecip = CSL_TWOPI / mFrameRate;					// Calculate the phase increment multiplier
 	
-	Port * freqPort = mInputs[CSL_FREQUENCY];					// get the frequency control port from the map
+	Port * freqPort = mPortSlots[CSL_FREQUENCY];				// get the frequency control port from the slots
 	UnitGenerator * freqUG = freqPort->mUGen;					// get its unit generator
 	bool freqDyn = (freqUG != NULL);							// if it's NULL, we have a fixed freq.
 	sample * freq = NULL;										// pointer to freq buffer (if used)
@@ -146,9 +146,9 @@ void SineAsScaled::nextBuffer(Buffer & outBuf, unsigned outBufNum) throw (CExcep
 	sample * buffer = outputBuffer.buffer(outBufNum);		// get pointer to the selected output channel
 	float rateRecip = CSL_TWOPI / mFrameRate;					// Calculate the phase increment multiplier
 
-	Port * freqPort = mInputs[CSL_FREQUENCY];					// get the frequency control port from the map
-	Port * scalePort = mInputs[CSL_SCALE];						// scale control port
-	Port * offsetPort = mInputs[CSL_OFFSET];					// offset control port
+	Port * freqPort = mPortSlots[CSL_FREQUENCY];				// get the frequency control port from the slots
+	Port * scalePort = mPortSlots[CSL_SCALE];					// scale control port
+	Port * offsetPort = mPortSlots[CSL_OFFSET];					// offset control port
 
 	UnitGenerator * freqUG = freqPort->mUGen;					// get its unit generator
 	UnitGenerator * scaleUG = scalePort->mUGen;					// scale unit generator
@@ -0,0 +1,207 @@
+//
+//  SineBank.cpp -- a bank of sinusoidal partials rendered with SIMD kernels
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "SineBank.h"
+#include "VectorOps.h"
+#include <math.h>
+
+using namespace csl;
+
+#define CSL_SINEBANK_ARRAYS 9				// # of arrays in mStorage
+
+SineBank::SineBank(unsigned numPartials)
+			: mNumPartials(0), mNumAlloc(0), mStorage(NULL), mRotFreq(-1.0f), mRotRate(0.0f) {
+	setNumPartials(numPartials);
+}
+
+SineBank::SineBank(const SineBank & other)
+			: mNumPartials(0), mNumAlloc(0), mStorage(NULL), mRotFreq(-1.0f), mRotRate(0.0f) {
+	* this = other;
+}
+
+SineBank & SineBank::operator=(const SineBank & other) {
+	if (this == & other)
+		return * this;
+	allocate(other.mNumAlloc);
+	if (mNumAlloc)
+		memcpy(mStorage, other.mStorage, CSL_SINEBANK_ARRAYS * mNumAlloc * sizeof(float));
+	mNumPartials = other.mNumPartials;
+	mRotFreq = -1.0f;
+	return * this;
+}
+
+SineBank::~SineBank() {
+	if (mStorage)
+		delete[] mStorage;
+}
+
+// (Re)allocate the arrays as one block; the old contents are copied and the new partials zeroed
+// (a zero phasor is invalid, so those get (1, 0) when they're added)
+
+void SineBank::allocate(unsigned numAlloc) {
+	if (numAlloc == mNumAlloc)
+		return;
+	float * storage = NULL;
+	if (numAlloc) {
+		storage = new float[CSL_SINEBANK_ARRAYS * numAlloc];
+		memset(storage, 0, CSL_SINEBANK_ARRAYS * numAlloc * sizeof(float));
+		unsigned numCopy = csl_min(numAlloc, mNumAlloc);
+		for (unsigned i = 0; i < CSL_SINEBANK_ARRAYS; i++)
+			if (numCopy)
+				memcpy(storage + i * numAlloc, mStorage + i * mNumAlloc, numCopy * sizeof(float));
+	}
+	if (mStorage)
+		delete[] mStorage;
+	mStorage = storage;
+	mNumAlloc = numAlloc;
+	mRatio = mStorage;
+	mTarget = mStorage + numAlloc;
+	mAmp = mStorage + 2 * numAlloc;
+	mStep = mStorage + 3 * numAlloc;
+	mRe = mStorage + 4 * numAlloc;
+	mIm = mStorage + 5 * numAlloc;
+	mCos = mStorage + 6 * numAlloc;
+	mSin = mStorage + 7 * numAlloc;
+	mPhase = mStorage + 8 * numAlloc;
+	mRotFreq = -1.0f;
+}
+
+// Grow or shrink the bank; the arrays are padded with silent partials so the kernels can work on
+// whole vectors
+
+void SineBank::setNumPartials(unsigned num) {
+	unsigned numAlloc = (num + CSL_SINEBANK_ALIGN - 1) & ~(CSL_SINEBANK_ALIGN - 1);
+	if (numAlloc > mNumAlloc)
+		allocate(numAlloc);
+	for (unsigned i = mNumPartials; i < num; i++) {
+		mRatio[i] = mTarget[i] = mAmp[i] = mStep[i] = 0.0f;
+		mRe[i] = 1.0f;
+		mIm[i] = 0.0f;
+	}
+	for (unsigned i = num; i < mNumAlloc; i++)			// silence the padding
+		mTarget[i] = mAmp[i] = mStep[i] = 0.0f;
+	mNumPartials = num;
+	mRotFreq = -1.0f;
+}
+
+void SineBank::setPartial(unsigned which, float ratio, float amplitude, float phase) {
+	if (which >= mNumPartials)
+		setNumPartials(which + 1);
+	mRatio[which] = ratio;
+	mTarget[which] = mAmp[which] = amplitude;			// (a new partial doesn't glide in)
+	setPhase(which, phase);
+	mRotFreq = -1.0f;
+}
+
+void SineBank::setRatio(unsigned which, float ratio) {
+	if (mRatio[which] != ratio) {
+		mRatio[which] = ratio;
+		mRotFreq = -1.0f;
+	}
+}
+
+void SineBank::setAmplitude(unsigned which, float amplitude) {
+	mTarget[which] = amplitude;
+}
+
+void SineBank::setPhase(unsigned which, float phase) {
+	mRe[which] = cosf(phase);
+	mIm[which] = sinf(phase);
+}
+
+float SineBank::phase(unsigned which) {
+	return atan2f(mIm[which], mRe[which]);
+}
+
+// Set up the per-frame amplitude steps that take each partial to its target over the block
+// (partials above the Nyquist frequency are muted at once); after the block, set them to the
+// targets exactly
+
+void SineBank::rampAmplitudes(unsigned numFrames, float maxFrequency, float frameRate) {
+	float nyquist = frameRate * 0.5f;
+	float recip = 1.0f / (float) numFrames;
+	for (unsigned i = 0; i < mNumPartials; i++) {
+		if (fabsf(mRatio[i] * maxFrequency) < nyquist) {
+			mStep[i] = (mTarget[i] - mAmp[i]) * recip;
+		} else {
+			mAmp[i] = 0.0f;
+			mStep[i] = 0.0f;
+		}
+	}
+}
+
+void SineBank::settleAmplitudes(float maxFrequency, float frameRate) {
+	float nyquist = frameRate * 0.5f;
+	for (unsigned i = 0; i < mNumPartials; i++)
+		mAmp[i] = (fabsf(mRatio[i] * maxFrequency) < nyquist) ? mTarget[i] : 0.0f;
+}
+
+// The phasors' length drifts slowly with rounding; a first-order correction per block keeps
+// them on the unit circle
+
+void SineBank::normalize() {
+	for (unsigned i = 0; i < mNumPartials; i++) {
+		float gain = 1.5f - 0.5f * (mRe[i] * mRe[i] + mIm[i] * mIm[i]);
+		mRe[i] *= gain;
+		mIm[i] *= gain;
+	}
+}
+
+// Fixed/control-rate frequency: quadrature oscillators (the rotations are computed once per
+// frequency change)
+
+void SineBank::render(SampleBuffer dst, unsigned numFrames, float frequency, float frameRate) {
+	if ((mNumPartials == 0) || (numFrames == 0))
+		return;
+	if ((frequency != mRotFreq) || (frameRate != mRotRate)) {
+		double incr = CSL_TWOPI * (double) frequency / (double) frameRate;
+		for (unsigned i = 0; i < mNumPartials; i++) {
+			mCos[i] = (float) cos(incr * mRatio[i]);
+			mSin[i] = (float) sin(incr * mRatio[i]);
+		}
+		mRotFreq = frequency;
+		mRotRate = frameRate;
+	}
+	rampAmplitudes(numFrames, frequency, frameRate);
+	VectorOps::rotateSum(dst, numFrames, mRe, mIm, mCos, mSin, mAmp, mStep, mNumAlloc);
+	settleAmplitudes(frequency, frameRate);
+	normalize();
+}
+
+// Audio-rate frequency: the fundamental's phase (in cycles from the start of the chunk) is
+// accumulated per frame, and each partial's phase is its start phase plus ratio times that
+
+void SineBank::render(SampleBuffer dst, unsigned numFrames, SampleBuffer frequencies, float frameRate) {
+	if ((mNumPartials == 0) || (numFrames == 0))
+		return;
+	float cycles[CSL_SINEBANK_CHUNK + 1];
+	float recip = 1.0f / frameRate;
+	for (unsigned i = 0; i < mNumPartials; i++)			// the phasors as phases in cycles
+		mPhase[i] = atan2f(mIm[i], mRe[i]) * (1.0f / CSL_TWOPI);
+	for (unsigned done = 0; done < numFrames; done += CSL_SINEBANK_CHUNK) {
+		unsigned count = csl_min(numFrames - done, (unsigned) CSL_SINEBANK_CHUNK);
+		SampleBuffer freqs = frequencies + done;
+		float maxFreq = 0.0f;
+		cycles[0] = 0.0f;
+		for (unsigned j = 0; j < count; j++) {
+			cycles[j + 1] = cycles[j] + freqs[j] * recip;
+			if (fabsf(freqs[j]) > maxFreq)
+				maxFreq = fabsf(freqs[j]);
+		}
+		rampAmplitudes(count, maxFreq, frameRate);
+		VectorOps::sineSum(dst + done, count, cycles, mPhase, mRatio, mAmp, mStep, mNumAlloc);
+		settleAmplitudes(maxFreq, frameRate);
+		for (unsigned i = 0; i < mNumPartials; i++) {	// advance and wrap the phases
+			float phase = mPhase[i] + mRatio[i] * cycles[count];
+			mPhase[i] = phase - floorf(phase);
+		}
+	}
+	for (unsigned i = 0; i < mNumPartials; i++) {		// back to phasors
+		mRe[i] = cosf(CSL_TWOPI * mPhase[i]);
+		mIm[i] = sinf(CSL_TWOPI * mPhase[i]);
+	}
+	mRotFreq = -1.0f;
+}
@@ -0,0 +1,85 @@
+//
+//  SineBank.h -- a bank of sinusoidal partials rendered with SIMD kernels
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// The SineBank is the engine behind the non-cached SumOfSines. It stores its partials as
+// structure-of-arrays (ratio, amplitude, phasor, etc.), so the VectorOps sine-bank kernels can
+// work on 4, 8 or 16 partials per vector. With a fixed or control-rate frequency, each partial
+// is a recursive quadrature oscillator: its phasor is rotated once per frame, and the rotations
+// are recomputed only when the frequency changes. With an audio-rate frequency (FM), each
+// partial's phase follows the fundamental's and a polynomial sine is evaluated per frame.
+//
+// Amplitudes are control-rate: a new value glides linearly over the next block, and partials
+// above the Nyquist frequency are muted instead of aliasing.
+//
+// Usage:
+//		SineBank bank(64);							// 64 silent partials
+//		for (unsigned i = 0; i < 64; i++)
+//			bank.setPartial(i, i + 1, 0.5f / (i + 1));
+//		bank.render(buffer, numFrames, 110.0f, 44100.0f);	// adds 110 Hz sawtooth-like wave
+//
+
+#ifndef CSL_SineBank_H
+#define CSL_SineBank_H
+
+#include "CSL_Core.h"
+
+namespace csl {
+
+#define CSL_SINEBANK_ALIGN 16				///< partial arrays are padded to a multiple of this
+#define CSL_SINEBANK_CHUNK 256				///< # of frames of phases per sineSum() call
+
+///
+/// SineBank -- the partials and their state, with the render loops
+///
+
+class SineBank {
+public:
+	SineBank(unsigned numPartials = 0);		///< Constructor (the partials are silent)
+	SineBank(const SineBank & other);		///< copy constructor (copies the state, too)
+	SineBank & operator=(const SineBank & other);
+	~SineBank();
+
+	unsigned numPartials() { return mNumPartials; };
+	void setNumPartials(unsigned num);		///< grow/shrink the bank (keeps the existing partials)
+	void clear() { setNumPartials(0); };
+											/// set a partial's frequency ratio, amplitude and phase (radians)
+	void setPartial(unsigned which, float ratio, float amplitude, float phase = 0.0f);
+	void setRatio(unsigned which, float ratio);	///< set the frequency ratio (to the fundamental)
+	void setAmplitude(unsigned which, float amplitude);	///< set the amplitude (glides over the next block)
+	void setPhase(unsigned which, float phase);	///< set the phase in radians
+	float ratio(unsigned which) { return mRatio[which]; };
+	float amplitude(unsigned which) { return mTarget[which]; };
+	float phase(unsigned which);			///< answer the current phase in radians
+
+											/// add numFrames of the bank at a fixed frequency to dst
+	void render(SampleBuffer dst, unsigned numFrames, float frequency, float frameRate);
+											/// add numFrames of the bank following the per-frame frequencies
+	void render(SampleBuffer dst, unsigned numFrames, SampleBuffer frequencies, float frameRate);
+
+protected:
+	unsigned mNumPartials;					///< # of partials in use
+	unsigned mNumAlloc;						///< # allocated (a multiple of CSL_SINEBANK_ALIGN)
+	float * mStorage;						///< one block holding all the arrays below
+	float * mRatio;							///< frequency ratios
+	float * mTarget;						///< amplitudes as set
+	float * mAmp;							///< current amplitudes
+	float * mStep;							///< per-frame amplitude steps for this block
+	float * mRe;							///< phasors (cos, sin of the phase)
+	float * mIm;
+	float * mCos;							///< per-frame rotations
+	float * mSin;
+	float * mPhase;							///< phases in cycles (for sineSum)
+	float mRotFreq;							///< the frequency the rotations are for (-1 = stale)
+	float mRotRate;
+
+	void allocate(unsigned numAlloc);		///< (re)allocate the arrays, keeping the contents
+	void rampAmplitudes(unsigned numFrames, float maxFrequency, float frameRate);
+	void settleAmplitudes(float maxFrequency, float frameRate);
+	void normalize();						///< keep the phasors on the unit circle
+};
+
+}
+
+#endif
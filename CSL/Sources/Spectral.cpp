@@ -5,6 +5,7 @@
 
 #include "Spectral.h"
 #include "Window.h"
+#include "VectorOps.h"
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
@@ -20,15 +21,15 @@ FFT::FFT(UnitGenerator & in, int size, CSL_FFTType type)
 			: Effect(in), mFFTSize(size), 
 			  mWrapper(size, type, CSL_FFT_FORWARD), mInBuf(1, size), mWindowBuffer(0) {  
 //	mSampleBuffer = (SampleBuffer) fftwf_malloc(sizeof(SampleBuffer) * mFFTSize);
-	HammingWindow * window = new HammingWindow(mFFTSize);
-	mWindowBuffer = window->window();	///< Buffer to store samples
-	free(window);
+	WindowTable hamming(kHammingWindow, mFFTSize);
+	mWindowTable = TableRegistry::acquire(hamming);	// share the Hamming window
+	mWindowBuffer = mWindowTable->buffer(0);
 	mOverwriteOutput = false;			// leave the spectrum in the buffer by default
 	mInBuf.allocateBuffers();
 }
 
 FFT::~FFT() {
-	free(mWindowBuffer);
+	TableRegistry::release(mWindowTable);
 }
 
 // nextBuffer does the FFT -- note that we override the higher-level version of this method
@@ -149,3 +150,185 @@ void IFFT::nextBuffer(Buffer & outputBuffer) throw (CException) {
 	return;
 }
 
+
+//
+//// IFFTSines = additive synthesis by inverse FFT
+//
+
+IFFTSines::IFFTSines(unsigned fftSize)
+			: mFFTSize(fftSize), mHopSize(fftSize / 4),
+			  mWrapper(fftSize, CSL_FFT_COMPLEX, CSL_FFT_INVERSE),
+			  mSpectrum(1, fftSize + 2), mFrame(1, fftSize), mTail(1, fftSize / 4), mHop(1, fftSize / 4),
+			  mHopPos(fftSize / 4), mNumPartials(0) {
+	mSpectrum.allocateBuffers();
+	mFrame.allocateBuffers();
+	mTail.allocateBuffers();
+	mHop.allocateBuffers();
+	SAFE_MALLOC(mKernel, sample, 2 * CSL_IFFT_SINES_LOBE * (CSL_IFFT_SINES_OVERSAMP + 2));
+	SAFE_MALLOC(mShape, sample, 2 * mHopSize);
+	makeKernel();
+}
+
+IFFTSines::~IFFTSines() {
+	SAFE_FREE(mKernel);
+	SAFE_FREE(mShape);
+}
+
+// Make the table of the window's spectrum over the main lobe (centered on the middle of the frame,
+// and including the IFFT's 1/N and the 1/2 of each of a real sinusoid's 2 images), and the
+// synthesis shape that turns the windowed frame into a triangle over its center half. Row r of
+// the table has the lobe's CSL_IFFT_SINES_LOBE complex values for a partial r/CSL_IFFT_SINES_OVERSAMP
+// of a bin below the first bin's center, so the rows interpolate as whole vectors.
+
+void IFFTSines::makeKernel() {
+	SampleComplexPtr spectrum = (SampleComplexPtr) mSpectrum.buffer(0);
+	SampleBuffer frame = mFrame.buffer(0);				// probe the FFT's scaling and sign
+	memset(spectrum, 0, (mFFTSize / 2 + 1) * sizeof(SampleComplex));
+	cx_r(spectrum[1]) = cx_i(spectrum[1]) = 1.0f;		// should be 2 cos(x) - 2 sin(x)
+	mWrapper.nextBuffer(mSpectrum, mFrame);
+	double gain = 2.0 / frame[0];						// 1 for an unscaled IFFT
+	mImagSign = (frame[mFFTSize / 4] < 0.0f) ? 1.0f : -1.0f;	// -1 if imaginary parts are negated
+	BlackmanHarrisWindow window(mFFTSize);
+	SampleBuffer win = window.window();
+	double center = (double) (mFFTSize / 2);
+	SampleBuffer kernel = mKernel;
+	for (unsigned row = 0; row < CSL_IFFT_SINES_OVERSAMP + 2; row++) {
+		for (unsigned j = 0; j < CSL_IFFT_SINES_LOBE; j++) {
+			double offset = (double) j + ((double) row / CSL_IFFT_SINES_OVERSAMP)
+						- (CSL_IFFT_SINES_LOBE / 2);
+			double angle = -CSL_TWOPI * offset / (double) mFFTSize;
+			double rotRe = cos(angle), rotIm = sin(angle);	// per-sample rotation
+			double re = cos(-angle * center);				// the phasor at sample 0
+			double im = sin(-angle * center);
+			double sumRe = 0.0, sumIm = 0.0;
+			for (unsigned n = 0; n < mFFTSize; n++) {
+				sumRe += win[n] * re;
+				sumIm += win[n] * im;
+				double tmp = re * rotRe - im * rotIm;
+				im = re * rotIm + im * rotRe;
+				re = tmp;
+			}
+			*kernel++ = (sample) (sumRe * gain * 0.5 / mFFTSize);
+			*kernel++ = (sample) (sumIm * gain * 0.5 / mFFTSize * mImagSign);
+		}
+	}
+	for (unsigned i = 0; i < 2 * mHopSize; i++) {
+		int offset = (int) i - (int) mHopSize;
+		float triangle = 1.0f - (float) abs(offset) / (float) mHopSize;
+		mShape[i] = triangle / win[mFFTSize / 2 + offset];
+	}
+}
+
+void IFFTSines::setNumPartials(unsigned num) {
+	mRatio.resize(num, 0.0f);
+	mAmp.resize(num, 0.0f);
+	mPhase.resize(num, 0.0f);
+	mIncr.resize(num, -1.0f);
+	mNumPartials = num;
+}
+
+// set up a partial; its phase increment is marked as unknown (-1) until its first frame
+
+void IFFTSines::setPartial(unsigned which, float ratio, float amplitude, float phase) {
+	if (which >= mNumPartials)
+		setNumPartials(which + 1);
+	mRatio[which] = ratio;
+	mAmp[which] = amplitude;
+	float cycles = phase / CSL_TWOPI;
+	mPhase[which] = cycles - floorf(cycles);
+	mIncr[which] = -1.0f;
+}
+
+// Add the hops to the output, making a new frame whenever the last hop has been used up
+
+void IFFTSines::render(SampleBuffer dst, unsigned numFrames, float frequency, float frameRate) {
+	while (numFrames > 0) {
+		if (mHopPos == mHopSize) {
+			nextHop(frequency, frameRate);
+			mHopPos = 0;
+		}
+		unsigned count = csl_min(numFrames, mHopSize - mHopPos);
+		SampleBuffer hop = mHop.buffer(0) + mHopPos;
+		for (unsigned i = 0; i < count; i++)
+			dst[i] += hop[i];
+		dst += count;
+		numFrames -= count;
+		mHopPos += count;
+	}
+}
+
+// Make the next frame's spectrum and IFFT it. Each partial's lobe is written at its (fractional)
+// bin; bins below 0 belong to its negative-frequency image, so they're folded back conjugated.
+// The IFFT's output is centered on sample 0 (the lobes have no (-1)^k factor), so the frame's
+// center half is at the ends of the buffer.
+
+void IFFTSines::nextHop(float frequency, float frameRate) {
+	SampleComplexPtr spectrum = (SampleComplexPtr) mSpectrum.buffer(0);
+	float binsPerHz = (float) mFFTSize / frameRate;
+	float maxBin = (float) (mFFTSize / 2 - CSL_IFFT_SINES_LOBE / 2);
+	float hopCycles = (float) mHopSize / frameRate;
+	float imagSign = mImagSign;							// (the kernel's imaginary parts have it)
+	memset(spectrum, 0, (mFFTSize / 2 + 1) * sizeof(SampleComplex));
+	for (unsigned i = 0; i < mNumPartials; i++) {
+		float partFreq = fabsf(mRatio[i] * frequency);
+		float incr = partFreq * hopCycles;				// advance to this frame's center
+		float phase = mPhase[i];
+		if (mIncr[i] >= 0.0f) {
+			phase += 0.5f * (mIncr[i] + incr);
+			phase -= (float) (int) phase;				// (the phases are >= 0)
+			mPhase[i] = phase;
+		}
+		mIncr[i] = incr;
+		float amp = mAmp[i];
+		float bin = partFreq * binsPerHz;
+		if ((amp == 0.0f) || (bin >= maxBin))			// silent or (too near) above Nyquist
+			continue;
+		float cosine = phase + 0.25f;					// the partial's complex amplitude (for a
+		if (cosine >= 1.0f)								// sine at this phase, i.e., a cosine 1/4
+			cosine -= 1.0f;								// cycle behind)
+		float cRe = -amp * VectorOps::sinCycles(phase - 0.5f);
+		float cIm = amp * VectorOps::sinCycles(cosine - 0.5f) * imagSign;
+		int first = (int) bin - CSL_IFFT_SINES_LOBE / 2 + 1;
+		float pos = ((float) first - bin + CSL_IFFT_SINES_LOBE / 2) * CSL_IFFT_SINES_OVERSAMP;
+		int row = (int) pos;							// interpolate between 2 rows of the kernel
+		float frac = pos - (float) row;
+		const sample * row0 = mKernel + row * 2 * CSL_IFFT_SINES_LOBE;
+		const sample * row1 = row0 + 2 * CSL_IFFT_SINES_LOBE;
+		sample lobe[2 * CSL_IFFT_SINES_LOBE];
+		for (unsigned j = 0; j < 2 * CSL_IFFT_SINES_LOBE; j++)
+			lobe[j] = row0[j] + frac * (row1[j] - row0[j]);
+		if (first > 0) {								// the usual case
+			sample * bins = (sample *) (spectrum + first);
+			for (unsigned j = 0; j < 2 * CSL_IFFT_SINES_LOBE; j += 2) {
+				bins[j] += cRe * lobe[j] - cIm * lobe[j + 1];
+				bins[j + 1] += cRe * lobe[j + 1] + cIm * lobe[j];
+			}
+			continue;
+		}
+		for (int j = 0; j < CSL_IFFT_SINES_LOBE; j++) {	// near DC, fold the negative bins
+			float re = cRe * lobe[2 * j] - cIm * lobe[2 * j + 1];
+			float im = cRe * lobe[2 * j + 1] + cIm * lobe[2 * j];
+			int which = first + j;
+			if (which > 0) {
+				cx_r(spectrum[which]) += re;
+				cx_i(spectrum[which]) += im;
+			} else if (which < 0) {
+				cx_r(spectrum[-which]) += re;
+				cx_i(spectrum[-which]) -= im;
+			} else {									// DC is its own mirror
+				cx_r(spectrum[0]) += 2.0f * re;
+			}
+		}
+	}
+	cx_i(spectrum[0]) = 0.0f;
+	mWrapper.nextBuffer(mSpectrum, mFrame);				// inverse FFT
+	SampleBuffer frame = mFrame.buffer(0);
+	SampleBuffer tail = mTail.buffer(0);
+	SampleBuffer hop = mHop.buffer(0);
+	SampleBuffer shape = mShape;
+	SampleBuffer rising = frame + mFFTSize - mHopSize;	// the half before the center
+	for (unsigned i = 0; i < mHopSize; i++) {
+		hop[i] = tail[i] + rising[i] * shape[i];		// finish this hop
+		tail[i] = frame[i] * shape[mHopSize + i];		// and keep the falling half
+	}
+}
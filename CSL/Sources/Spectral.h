@@ -35,7 +35,8 @@ protected:
 	int mFFTSize;						///< This should be unsigned, but is signed for compatability with FFTW
 	FFTWrapper mWrapper;				///< actual FFT wrapper object
 	Buffer mInBuf;						///< input buffer
-	SampleBuffer mWindowBuffer;				///< Buffer to store window
+	Buffer * mWindowTable;					///< the shared window table
+	SampleBuffer mWindowBuffer;				///< and its samples
 };
 
 ///
@@ -72,6 +73,66 @@ protected:
 	SampleComplexPtr mSpectrum;			///< spectral data I accumulate
 };
 
+///
+/// IFFTSines -- additive synthesis by inverse FFT (FFT-1), for very large numbers of partials.
+///
+/// Each frame, every partial adds the spectrum of a windowed sinusoid (the main lobe of a
+/// Blackman-Harris window, CSL_IFFT_SINES_LOBE bins wide, taken from a table) to the frame's
+/// spectrum at its frequency, amplitude and phase; one inverse FFT then makes the windowed sum
+/// of all of them. The center half of each frame is divided by the window and faded with a
+/// triangle, and the frames are overlap-added at a hop of 1/4 of the FFT size. The cost is a few
+/// complex multiply-adds per partial per frame plus one FFT, so it's roughly independent of the
+/// number of partials.
+///
+/// The partials' frequencies and amplitudes are taken once per frame (i.e., per hop), and the
+/// output runs one hop behind. It has the same partial set-up calls as the SineBank, so
+/// SumOfSines can use either one (see SumOfSines::setInverseFFT()).
+///
+
+#define CSL_IFFT_SINES_SIZE 2048			///< default FFT size
+#define CSL_IFFT_SINES_LOBE 8				///< # of bins each partial writes
+#define CSL_IFFT_SINES_OVERSAMP 256			///< # of kernel table entries per bin
+
+class IFFTSines {
+public:
+	IFFTSines(unsigned fftSize = CSL_IFFT_SINES_SIZE);	///< Constructor (the size must be a power of 2)
+	~IFFTSines();
+
+	unsigned fftSize() { return mFFTSize; };
+	unsigned hopSize() { return mHopSize; };
+	unsigned numPartials() { return mNumPartials; };
+	void setNumPartials(unsigned num);		///< grow/shrink the partial list (keeps the existing ones)
+	void clear() { setNumPartials(0); };
+											/// set a partial's frequency ratio, amplitude and phase (radians)
+	void setPartial(unsigned which, float ratio, float amplitude, float phase = 0.0f);
+	void setRatio(unsigned which, float ratio) { mRatio[which] = ratio; };
+	void setAmplitude(unsigned which, float amplitude) { mAmp[which] = amplitude; };
+
+											/// add numFrames of the partials at the given frequency to dst
+	void render(SampleBuffer dst, unsigned numFrames, float frequency, float frameRate);
+
+protected:
+	unsigned mFFTSize;						///< FFT length
+	unsigned mHopSize;						///< overlap-add hop (mFFTSize / 4)
+	FFTWrapper mWrapper;					///< the inverse FFT
+	Buffer mSpectrum;						///< the frame's spectrum (complex, mFFTSize / 2 + 1 bins)
+	Buffer mFrame;							///< the IFFT output
+	Buffer mTail;							///< the 2nd half of the last frame (waiting for the next one)
+	Buffer mHop;							///< the finished output hop
+	unsigned mHopPos;						///< read position in mHop
+	SampleBuffer mKernel;					///< rows of the window's spectrum (re, im pairs) across the lobe
+	SampleBuffer mShape;					///< triangle / window over the center half of the frame
+	float mImagSign;						///< -1 if the FFT's imaginary parts are negated
+	unsigned mNumPartials;
+	std::vector<float> mRatio;				///< partial frequency ratios
+	std::vector<float> mAmp;				///< partial amplitudes
+	std::vector<float> mPhase;				///< partial phases in cycles (at the last frame's center)
+	std::vector<float> mIncr;				///< partial phase advances per hop at the last frame (-1 = new)
+
+	void makeKernel();						///< make the lobe table and the synthesis shape
+	void nextHop(float frequency, float frameRate);	///< synthesize the next frame and finish a hop
+};
+
 }
 
 #endif
@@ -8,18 +8,79 @@
 
 using namespace csl;
 
-Window::Window() : UnitGenerator(), mGain(1) {
+// The window functions, filled in double
+
+string WindowTable::key() {
+	char key[CSL_WORD_LEN];
+	sprintf(key, "window/%d/%u/%.9g", (int) mType, mSize, mGain);
+	return string(key);
+}
+
+void WindowTable::fill(Buffer & table) {
+	SampleBuffer windowBufferPtr = table.buffer(0);
+	double increment = CSL_TWOPI / (mSize - 1);
+	switch (mType) {
+	case kRectangularWindow:
+		for (unsigned i = 0; i < mSize; i++ )
+			*windowBufferPtr++ = mGain;
+		break;
+	case kTriangularWindow: {
+		unsigned winHalf = mSize / 2;
+		double step = 1.0 / (double) winHalf;
+		for (unsigned i = 0; i < winHalf; i++ )				// create the rising half
+			*windowBufferPtr++ = (sample) (i * step * mGain);
+		for (unsigned i = winHalf; i < mSize; i++ )		// create the falling half
+			*windowBufferPtr++ = (sample) ((2 * winHalf - i) * step * mGain);
+		break;
+	}
+	case kHannWindow:
+		for (unsigned i = 0; i < mSize; i++ )
+			*windowBufferPtr++ = (sample) (0.5 * (1 - cos(i * increment)) * mGain);
+		break;
+	case kBlackmanWindow:
+		for (unsigned i = 0; i < mSize; i++ )
+			*windowBufferPtr++ = (sample) ((0.42 - 0.5 * cos(i * increment) 
+					+ 0.08 * cos(2 * i * increment)) * mGain);
+		break;
+	case kBlackmanHarrisWindow:
+		for (unsigned i = 0; i < mSize; i++ ) 
+			*windowBufferPtr++ = (sample) ((0.35875 - 0.48829 * cos(i * increment) 
+					+ 0.14128 * cos(2 * i * increment) 
+					- 0.01168 * cos(3 * i * increment)) * mGain);
+		break;
+	case kWelchWindow: {
+		double phase = -1.0;
+		for (unsigned i = 0; i < mSize; i++ )	{			// an equal-power curve
+			*windowBufferPtr++ = (sample) ((1.0 - phase * phase) * mGain);
+			phase += 2.0 / (mSize - 1);
+		}
+		break;
+	}
+	default:												// Hamming
+		for (unsigned i = 0; i < mSize; i++ )
+			*windowBufferPtr++ = (sample) ((0.54 - 0.46 * cos(i * increment)) * mGain);
+		break;
+	}
+}
+
+Window::Window() : UnitGenerator(), mTable(NULL), mGain(1), mType(kHammingWindow) {
 	this->setSize(CGestalt::blockSize());
 }
 
 // Gain is optional and defaults to 1 when not specified.
 
-Window::Window(unsigned windowSize, float gain) : UnitGenerator(), mGain(gain) {
+Window::Window(unsigned windowSize, float gain) 
+			: UnitGenerator(), mTable(NULL), mGain(gain), mType(kHammingWindow) {
+	this->setSize(windowSize);
+}
+
+Window::Window(WindowType type, unsigned windowSize, float gain) 
+			: UnitGenerator(), mTable(NULL), mGain(gain), mType(type) {
 	this->setSize(windowSize);
 }
 
 Window::~Window() {
-	mWindowBuffer.freeBuffers();
+	TableRegistry::release(mTable);
 }
 
 void Window::setGain(float gain) {
@@ -30,11 +91,7 @@ void Window::setGain(float gain) {
 void Window::setSize(unsigned windowSize) {
 	mWindowBufferPos = 0;
 	mWindowSize = windowSize;
-											// If previously allocated, free me first.
-	mWindowBuffer.freeBuffers();
-	mWindowBuffer.setSize(1, mWindowSize);	// Allocate memory to store the window.
-	mWindowBuffer.allocateBuffers();
-	fillWindow();							// Fill the buffer with the window data.
+	fillWindow();							// Get the window data.
 }
 
 void Window::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException) {
@@ -48,83 +105,24 @@ void Window::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CExcept
 	logMsg("Window::nextBuffer");
 #endif
 	for (unsigned i = 0; i < numFrames; i++) {
-		if (windowBufferPos > windowBufferSize)
+		if (windowBufferPos >= windowBufferSize)
 			windowBufferPos = 0;
 		*outputBufferPtr++ = windowBufferPtr[windowBufferPos++];
 	}
 	mWindowBufferPos = windowBufferPos;
 }
 
-void Window::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-			// create the window -- I make a Hamming window, subclasses may override
-	for (unsigned i = 0; i < mWindowSize; i++ )
-		*windowBufferPtr++ = (0.54 - 0.46*cos(CSL_TWOPI*i/(mWindowSize - 1) ));
-}
-
-void RectangularWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	for (unsigned i = 0; i < mWindowSize; i++ )	// create the window 
-		*windowBufferPtr++ = mGain;
-}
+// Get the shared table for my type, size and gain (and let go of the old one)
 
-void TriangularWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	float accum = 0.0f;
-	unsigned winHalf = mWindowSize / 2;
-	float step = 1.0f / ((float) winHalf);
-	for (unsigned i = 0; i < winHalf; i++ ) {	// create the rising half 
-		*windowBufferPtr++ = accum;
-		accum += step;
-	}
-	for (unsigned i = winHalf; i < mWindowSize; i++ ) {	// create the falling half 
-		*windowBufferPtr++ = accum;
-		accum -= step;
-	}
-}
-
-void HammingWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	sample increment = CSL_TWOPI/(mWindowSize - 1);
-	for (unsigned i = 0; i < mWindowSize; i++ )
-		*windowBufferPtr++ = (0.54 - 0.46*cos(i * increment));
-}
-
-void HannWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	sample increment = CSL_TWOPI/(mWindowSize - 1);
-	
-	for (unsigned i = 0; i < mWindowSize; i++ )
-		*windowBufferPtr++ = 0.5 * (1 - cos(i * increment)) * mGain;
-}
-
-void BlackmanWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	sample increment = CSL_TWOPI/(mWindowSize - 1);
-	
-	for (unsigned i = 0; i < mWindowSize; i++ )
-		*windowBufferPtr++ = (0.42 - 0.5 * cos(i * increment) + 0.08 * cos(2 * i * increment)) * mGain;
-}
-
-void BlackmanHarrisWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	sample increment = CSL_TWOPI/(mWindowSize - 1);
-	
-	for (unsigned i = 0; i < mWindowSize; i++ ) 
-		*windowBufferPtr++ = (0.35875 - 0.48829 * cos(i * increment) 
-					+ 0.14128 * cos(2 * i * increment) 
-					- 0.01168 * cos(3 * i * increment)) * mGain;
-}
-
-void WelchWindow::fillWindow() {
-	sample* windowBufferPtr = mWindowBuffer.buffer(0);
-	sample increment = 2.f/(mWindowSize - 1);
-	sample phase = -1.f;
-	
-	for (unsigned i = 0; i < mWindowSize; i++ )	{ // create the window 
-		*windowBufferPtr++ =  (1.f - phase * phase) * mGain;
-		phase += increment;
-	}
+void Window::fillWindow() {
+	WindowTable generator(mType, mWindowSize, mGain);
+	Buffer * old = mTable;
+	mTable = TableRegistry::acquire(generator);
+	mWindowBuffer.setSize(1, mWindowSize);
+	mWindowBuffer.setBuffer(0, mTable->buffer(0));		// point to the shared data
+	mWindowBuffer.mAreBuffersAllocated = true;			// fib a bit
+	mWindowBuffer.mDidIAllocateBuffers = false;
+	TableRegistry::release(old);
 }
 
 void Window::dump() {
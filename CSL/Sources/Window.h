@@ -21,125 +21,155 @@
 #define CSL_WINDOW_H
 
 #include "CSL_Core.h"
+#include "TableRegistry.h"
 
 namespace csl {
 
+///
+/// The window functions
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kRectangularWindow,
+	kTriangularWindow,
+	kHammingWindow,
+	kHannWindow,
+	kBlackmanWindow,
+	kBlackmanHarrisWindow,
+	kWelchWindow
+} WindowType;
+#else
+	#define kRectangularWindow 0
+	#define kTriangularWindow 1
+	#define kHammingWindow 2
+	#define kHannWindow 3
+	#define kBlackmanWindow 4
+	#define kBlackmanHarrisWindow 5
+	#define kWelchWindow 6
+	typedef int WindowType;
+#endif
+
+///
+/// WindowTable -- the generator for the shared window tables (also usable on its own, e.g.,
+///		WindowTable hann(kHannWindow, 1024);
+///		Buffer * table = TableRegistry::acquire(hann);
+///
+
+class WindowTable : public TableGenerator {
+public:
+	WindowTable(WindowType type, unsigned size, float gain = 1.0f)
+			: mType(type), mSize(size), mGain(gain) { };
+	string key();
+	unsigned numFrames() { return mSize; };
+	void fill(Buffer & table);
+
+protected:
+	WindowType mType;
+	unsigned mSize;
+	float mGain;
+};
+
 /// Window; The superclass of all other window function classes in CSL.
-/// Subclasses need only to implement the fillWindow(); and the Constructors.
+/// Subclasses only pass their WindowType to the constructor; the window data is shared through
+/// the TableRegistry by all windows of the same type, size and gain (so don't write into it).
 
 class Window : public UnitGenerator {
 public:				// Constructors:
 	Window();		///< Creates a window using the default Gestalt size and a gain of 1;
-					///< Creates a window (hann) with the specified size and gain (gain is optional).
+					///< Creates a window (hamming) with the specified size and gain (gain is optional).
 	Window(unsigned windowSize, float gain = 1); 
-	~Window();		///< clean-up . . . free the allocated buffer that held the window data.
+	~Window();		///< clean-up . . . release the shared window data.
 
 	void setSize(unsigned windowSize);	///< Set the number of samples the window spans.
 	void setGain(float gain);				///< Set the gain to which the window should be normalized.
 	SampleBuffer window() { return mWindowBuffer.buffer(0); }; ///< Returns a pointer to the window data.
+	WindowType type() { return mType; };	///< Answer the window function
 
 	void nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException);
 	void dump();		///< Print some info about the window.
 	
 protected:
-	Buffer mWindowBuffer;		///< used to store the window
+	Window(WindowType type, unsigned windowSize, float gain);	///< (for the subclasses)
+
+	Buffer mWindowBuffer;		///< points to the shared window data
+	Buffer * mTable;			///< the registry table it points to
 	unsigned mWindowBufferPos; 	///< where am I in the window buffer
 	unsigned mWindowSize;		///< length in samples of the window
 	float mGain;					///< gain for the window
+	WindowType mType;			///< which function
 
-	virtual void fillWindow();		///< subclasses override this to fill the buffer with corresponding function.
+	void fillWindow();			///< get the table for the current type/size/gain
 };
 
 /// RectangularWindow:A rectangular window has all values set to the Gain value, or by default to 1.
 
 class RectangularWindow : public Window {
 public:
-	RectangularWindow() : Window() { }
-	RectangularWindow(unsigned windowSize) : Window(windowSize) { }
-	RectangularWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	RectangularWindow() : Window(kRectangularWindow, CGestalt::blockSize(), 1) { }
+	RectangularWindow(unsigned windowSize) : Window(kRectangularWindow, windowSize, 1) { }
+	RectangularWindow(unsigned windowSize, float gain) : Window(kRectangularWindow, windowSize, gain) { }
 	~RectangularWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 /// TriangularWindow:A triangularWindow window.
 
 class TriangularWindow : public Window {
 public:
-	TriangularWindow() : Window() { }
-	TriangularWindow(unsigned windowSize) : Window(windowSize) { }
-	TriangularWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	TriangularWindow() : Window(kTriangularWindow, CGestalt::blockSize(), 1) { }
+	TriangularWindow(unsigned windowSize) : Window(kTriangularWindow, windowSize, 1) { }
+	TriangularWindow(unsigned windowSize, float gain) : Window(kTriangularWindow, windowSize, gain) { }
 	~TriangularWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 /// HammingWindow: Belongs to the familly of cosine window functions. 
 
 class HammingWindow : public Window {
 public:
-
-	HammingWindow() : Window() { }
-	HammingWindow(unsigned windowSize) : Window(windowSize) { }
-	HammingWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	HammingWindow() : Window(kHammingWindow, CGestalt::blockSize(), 1) { }
+	HammingWindow(unsigned windowSize) : Window(kHammingWindow, windowSize, 1) { }
+	HammingWindow(unsigned windowSize, float gain) : Window(kHammingWindow, windowSize, gain) { }
 	~HammingWindow() { }
-
-protected:
-	void fillWindow();
 };
 
 /// HannWindow
 
 class HannWindow : public Window {
 public:
-	HannWindow() : Window() { }
-	HannWindow(unsigned windowSize) : Window(windowSize) { }
-	HannWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	HannWindow() : Window(kHannWindow, CGestalt::blockSize(), 1) { }
+	HannWindow(unsigned windowSize) : Window(kHannWindow, windowSize, 1) { }
+	HannWindow(unsigned windowSize, float gain) : Window(kHannWindow, windowSize, gain) { }
 	~HannWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 /// BlackmanWindow
 
 class BlackmanWindow : public Window {
 public:
-	BlackmanWindow() : Window() { }
-	BlackmanWindow(unsigned windowSize) : Window(windowSize) { }
-	BlackmanWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	BlackmanWindow() : Window(kBlackmanWindow, CGestalt::blockSize(), 1) { }
+	BlackmanWindow(unsigned windowSize) : Window(kBlackmanWindow, windowSize, 1) { }
+	BlackmanWindow(unsigned windowSize, float gain) : Window(kBlackmanWindow, windowSize, gain) { }
 	~BlackmanWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 /// BlackmanHarrisWindow
 
 class BlackmanHarrisWindow : public Window {
 public:
-	BlackmanHarrisWindow() : Window() { }
-	BlackmanHarrisWindow(unsigned windowSize) : Window(windowSize) { }
-	BlackmanHarrisWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	BlackmanHarrisWindow() : Window(kBlackmanHarrisWindow, CGestalt::blockSize(), 1) { }
+	BlackmanHarrisWindow(unsigned windowSize) : Window(kBlackmanHarrisWindow, windowSize, 1) { }
+	BlackmanHarrisWindow(unsigned windowSize, float gain) : Window(kBlackmanHarrisWindow, windowSize, gain) { }
 	~BlackmanHarrisWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 /// WelchWindow: This is basically an equal-power curve.
 
 class WelchWindow : public Window {
 public:
-	WelchWindow() : Window() { }
-	WelchWindow(unsigned windowSize) : Window(windowSize) { }
-	WelchWindow(unsigned windowSize, float gain) : Window(windowSize, gain) { }
+	WelchWindow() : Window(kWelchWindow, CGestalt::blockSize(), 1) { }
+	WelchWindow(unsigned windowSize) : Window(kWelchWindow, windowSize, 1) { }
+	WelchWindow(unsigned windowSize, float gain) : Window(kWelchWindow, windowSize, gain) { }
 	~WelchWindow() { }
-	
-protected:
-	void fillWindow();
 };
 
 }  // end of namespace
@@ -92,6 +92,7 @@ void BinauralPanner::nextBuffer(Buffer & outputBuffer) throw (CException) {
 		return;
 	}
 	outputBuffer.zeroBuffers();									// clear output
+	mInBuf.mSequence = outputBuffer.mSequence;					// pass on the sequence # for fan-out/prefetch
 
 	for (unsigned i = 0; i < mSources.size(); i++) {			// i loops through sources
 	
@@ -55,6 +55,8 @@ public:
 											/// sums previous data, and takes the IFFT for 
 											/// each of multiple sources
 	void nextBuffer(Buffer &outputBuffer) throw (CException);
+											/// my sources' UGens can be rendered in parallel
+	void parallelInputs(UGenVector & inputs, unsigned maxInputs) { sourceUGens(inputs, maxInputs); };
 
 	unsigned mNumBlocks;					///< # blocks per HRTF
 	unsigned mNumBlocksToSum;				///< # blocks to include in sum per HRTF
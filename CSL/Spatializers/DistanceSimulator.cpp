@@ -10,14 +10,14 @@ using namespace csl;
 
 // DistanceSimulator
 
-DistanceSimulator::DistanceSimulator(UnitGenerator &source) : SpatialSource(source) {
+DistanceSimulator::DistanceSimulator(UnitGenerator &source) : SpatialSource(source), mSource(NULL) {
 	this->addInput(CSL_INPUT, source);
 	mPosition = new CPoint(1.0, 0.0, 0.0); // If my parent is a simple UGen then I own my Position.
 	mIntensityCue = new IntensityAttenuationCue;
 	mAirAbsorptionCue = new AirAbsorptionCue;
 }
 
-DistanceSimulator::DistanceSimulator(SpatialSource &source) : SpatialSource(source) {
+DistanceSimulator::DistanceSimulator(SpatialSource &source) : SpatialSource(source), mSource(& source) {
 	this->addInput(CSL_INPUT, source);
 	mPosition = source.position(); // If my parent is a SpatialSource, then just point to it.
 	mIntensityCue = new IntensityAttenuationCue;
@@ -32,7 +32,15 @@ DistanceSimulator::~DistanceSimulator() {
 /// Returns whether the sound source position changed since last block call.
 
 bool DistanceSimulator::positionChanged() {
-	return ((SpatialSource *) mInputs[CSL_INPUT]->mUGen)->positionChanged();
+	return ((SpatialSource *) mPortSlots[CSL_INPUT]->mUGen)->positionChanged();
+}
+
+/// Answer the UGen below my spatial source (if any)
+
+UnitGenerator * DistanceSimulator::sourceUGen() {
+	if (mSource)
+		return mSource->sourceUGen();
+	return mPortSlots[CSL_INPUT]->mUGen;
 }
 
 // work-horse method
@@ -40,7 +48,7 @@ bool DistanceSimulator::positionChanged() {
 void DistanceSimulator::nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException) {
 	float distance = this->distance();		// I call distance of myself, which in turn points to the source distance.
 											// coded this way, in order to allow UnitGenerators passed to a distance simulator.
-	Port *inPort = mInputs[CSL_INPUT];
+	Port *inPort = mPortSlots[CSL_INPUT];
 	UnitGenerator *inputSound = inPort->mUGen;
 	
 	inputSound->nextBuffer(outputBuffer);			// get its UGen	
@@ -30,10 +30,12 @@ public:
 	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
 										/// Returns wether the sound source position changed since last block call.
 	virtual bool positionChanged();
+										/// Answer the UGen below my spatial source (if any)
+	virtual UnitGenerator * sourceUGen();
 
 protected:
 				// SoundSource ... it refers to its input UGen, but with the knowledge of its position within a space.
-//	SpatialSource *mSource;		// list of spatial inputs
+	SpatialSource *mSource;		///< my spatial input, or NULL if it's a plain UGen
 	IntensityAttenuationCue *mIntensityCue;
 	AirAbsorptionCue *mAirAbsorptionCue;
 
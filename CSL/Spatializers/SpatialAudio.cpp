@@ -127,6 +127,13 @@ void Spatializer::nextBuffer(Buffer &outputBuffer /*, unsigned outBufNum */) thr
 	mPanner->nextBuffer(outputBuffer); 
 }
 
+// my panner's inputs can be rendered in parallel
+
+void Spatializer::parallelInputs(UGenVector & inputs, unsigned maxInputs) {
+	if (mPanner)
+		mPanner->parallelInputs(inputs, maxInputs);
+}
+
 PannerType SpeakerLayoutExpert::findPannerFromLayout(SpeakerLayout *layout) {
 	unsigned numSpeakers = layout->numSpeakers();
 	PannerType type = kVBAP;		// Just default to something that always works.
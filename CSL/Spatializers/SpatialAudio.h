@@ -43,6 +43,7 @@ public:
 	virtual void update(void *arg);	///< called when the speaker layout changes, so panners update precalculated data.
 
 	virtual void nextBuffer(Buffer &outputBuffer /*, unsigned outBufNum */) throw (CException); ///< fill the buffer with data :-)
+	virtual void parallelInputs(UGenVector & inputs, unsigned maxInputs);	///< forward to my panner
 
 private:
 	SpatialPanner *mPanner;
@@ -78,6 +79,7 @@ A subclass could just place any other reverb.
 */
 
 //	Freeverb *mGlobalReverb
+//	(or an FDNReverb: one instance works as a shared send reverb for all the sources; see FDNReverb.h)
 
 /*
 The reverb settings would be set depending on the room specified.
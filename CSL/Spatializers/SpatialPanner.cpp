@@ -51,6 +51,14 @@ void SpatialPanner::addSource(SpatialSource &soundSource) {
 	mCache.push_back(this->cache());
 }
 	
+// add the UGens under my sources to the given list; the sources themselves stay serial,
+// since they reset their position-changed flags in nextBuffer()
+
+void SpatialPanner::sourceUGens(UGenVector & inputs, unsigned maxInputs) {
+	for (unsigned i = 0; (i < mSources.size()) && (i < maxInputs); i++)
+		inputs.push_back(((SpatialSource *) mSources[i])->sourceUGen());
+}
+
 // delete from the list, shifting if necessary
 
 void SpatialPanner::removeSource(SpatialSource &soundSource) {
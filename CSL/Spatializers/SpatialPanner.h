@@ -54,6 +54,9 @@ protected:
 	Buffer mTempBuffer;					///< Buffer used to temporarily hold input source data.
 
 	virtual void *cache();						///< create the cache
+												/// add (up to maxInputs of) my sources' UGens to the list (for
+												/// panners that pull their sources directly, with a stamped mTempBuffer)
+	void sourceUGens(UGenVector & inputs, unsigned maxInputs);
 	virtual void speakerLayoutChanged() { };	///< Called when the speaker layout changes.
 }; 
 
@@ -91,7 +91,7 @@ void SpatialSource::dump() {
 // nextBuffer
 
 void SpatialSource::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException) {
-	Port *inPort = mInputs[CSL_INPUT];
+	Port *inPort = mPortSlots[CSL_INPUT];
 	inPort->mUGen->nextBuffer(outputBuffer);			// get its UGen	
 	mPositionChanged = false;
 }
@@ -61,6 +61,8 @@ public:
 
 										/// Returns whether the sound source position changed since last block call.
 	virtual bool positionChanged() { return mPositionChanged; };
+										/// Answer the UGen that actually generates my samples (used by the GraphExecutor)
+	virtual UnitGenerator * sourceUGen() { return mPortSlots[CSL_INPUT]->mUGen; };
 
 	virtual void nextBuffer(Buffer & outputBuffer, unsigned outBufNum) throw (CException);
 	virtual void nextBuffer(Buffer & outputBuffer) throw (CException);
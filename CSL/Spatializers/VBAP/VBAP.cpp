@@ -395,6 +395,7 @@ void VBAP::nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw(CException
 	unsigned numFrames = outputBuffer.mNumFrames;
 	unsigned numTriplets = mSpeakerSetLayout->mNumTriplets;
 	outputBuffer.zeroBuffers();		// clear output buffer
+	mTempBuffer.mSequence = outputBuffer.mSequence;	// pass on the sequence # for fan-out/prefetch
 
 #ifdef CSL_DEBUG
 	logMsg("VBAP::nextBuffer");
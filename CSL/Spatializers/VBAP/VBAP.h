@@ -69,6 +69,8 @@ public:
 	/// Just as any Effect in CSL, this method gets called at runtime by the audio driver. Here is where the actual processing happens.
 	void nextBuffer(Buffer &outputBuffer) throw (CException);
 	void nextBuffer(Buffer &outputBuffer, unsigned outBufNum) throw (CException);
+										/// my sources' UGens can be rendered in parallel
+	void parallelInputs(UGenVector & inputs, unsigned maxInputs) { sourceUGens(inputs, maxInputs); };
 
 	void dump() { }; ///< Prints useful information about this VBAP instance.
 
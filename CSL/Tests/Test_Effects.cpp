@@ -19,6 +19,7 @@
 
 #include "RingBuffer.h"			/// Utility circular buffer
 #include "Clipper.h"
+#include "FDNReverb.h"
 #include "FIR.h"
 #include "InOut.h"
 
@@ -63,6 +64,22 @@ void testFIR() {
 	logMsg("FIR done.");	
 }
 
+/// Test a long FIR filter -- a 511-tap band-pass (400 - 1100 Hz) on white noise, which is done by
+/// FFT convolution
+
+void testLongFIR() {
+	double resp[] = { 0, 1, 0 };				// amplitudes in the 3 freq bands (i.e., band-pass)
+	double freq[] = { 0, 400, 500, 1000, 1100, 22050 };	// corner freqs of the stop, pass, and stop bands
+	double weight[] = { 10, 1, 10 };			// weights for error (ripple) in the 3 bands
+	FilterSpecification fs(511, 3, freq, resp, weight);	// 511 taps, 3 bands
+	WhiteNoise noise(0.5);						// the sound source
+	FIR vox(noise, fs);							// create the filter
+	MulOp mul(vox, 4);							// scale it back up
+	logMsg("playing %d-tap FIR filtered noise (%s)...", vox.numTaps(), vox.usesFFT() ? "FFT" : "direct");
+	runTest(mul);
+	logMsg("FIR done.");
+}
+
 /// Filter tests
 
 void testFilters() {
@@ -158,6 +175,34 @@ void testDynamicFilters() {
 	logMsg("done.");
 }
 
+/// Test audio-rate sweeps (the coefficients are recomputed every CSL_FILTER_CONTROL_FRAMES
+/// and interpolated, so these shouldn't zipper) and a 6th-order filter run as 3 sections
+
+void testSweptFilters() {
+	float dur = 4.0f;								// seconds to play each test for
+	Sawtooth saw(110, 0.3);							// a bright source
+	Sine lfo(0.5, 1500, 2000);						// audio-rate sweep from 500 to 3500 Hz
+	Butter butter(saw, BW_LOW_PASS, lfo);			// Butterworth LP filter
+	logMsg("playing swept Butterworth low-passed sawtooth...");
+	runTest(butter, dur);
+	logMsg("done.");
+
+	Sine lfo2(4, 800, 1200);						// faster formant sweep
+	Formant formant(saw, lfo2, 0.995f);
+	logMsg("playing swept formant-filtered sawtooth...");
+	runTest(formant, dur);
+	logMsg("done.");
+									// 3 cascaded Butterworth LPs (1, 2 and 4 kHz) multiplied out
+	float bcoeffs[7] = { 4.429330e-06f, 2.657598e-05f, 6.643996e-05f, 8.858661e-05f, 
+						6.643996e-05f, 2.657598e-05f, 4.429330e-06f };
+	float acoeffs[7] = { 1.f, -4.619068f, 8.958502f, -9.355688f, 5.562215f, -1.790289f, 0.2446128f };
+	WhiteNoise white(0.5);
+	Filter filter(white, bcoeffs, acoeffs, 7, 7);
+	logMsg("playing 6th-order low-passed white noise...");
+	runTest(filter, dur);
+	logMsg("done.");
+}
+
 /// Test dynamic BP filter on a sound file
 
 void testDynamicVoice() {
@@ -251,6 +296,90 @@ void testStereoverb() {
 	logMsg("done.\n");
 }
 
+/// Stereo in, stereo out: the filter, reverb and clipper run both channels at once (in SIMD lanes)
+
+void testParallelEffects() {
+	ADSR mEnv(1, 0.005, 0.01, 0.0, 1.5);		// attack-chiff envelope
+	WhiteNoise mChiff;							// attack-chiff noise source
+	mEnv.setScale(2);
+	mChiff.setScale(mEnv);
+	Panner mPanner(mChiff, 0.0);				// stereo panner
+	Sine lfo(0.25, 1000, 1500);					// swept BP filter on both channels
+	StaticVariable bw(200.0f);
+	Butter mFilter(mPanner, BW_BAND_PASS, lfo, bw);
+	Freeverb mReverb(mFilter);					// a reverb per channel
+	mReverb.setRoomSize(0.95);
+	Clipper mClipper(mReverb, -0.5, 0.5);		// and a clipper
+	theIO->setRoot(mClipper);					// start sound output
+	logMsg("playing parallel filter/reverb/clipper test\n");
+	for (unsigned i = 0; i < 8; i++) {			// play a loop of notes
+		mPanner.setPosition(fRand1());			// select a random stereo position
+		mEnv.trigger();							// trigger the burst envelope
+		sleepSec(1.0);
+	}	
+	sleepSec(2);								// sleep at the end to let it die out
+	theIO->clearRoot();	
+	logMsg("done.\n");
+}
+
+/// A shared send reverb: 2 panned noise-burst voices are mixed into a send bus that goes through
+/// one FDN reverb, and the reverb is mixed with the dry voices
+
+void testFDNReverb() {
+	ADSR env1(1, 0.005, 0.01, 0.0, 1.5), env2(1, 0.005, 0.01, 0.0, 1.5);	// attack-chiff envelopes
+	WhiteNoise noise1, noise2;
+	Butter filt1(noise1, BW_BAND_PASS, 1200.0f, 300.0f);	// 2 BP-filtered noise voices
+	Butter filt2(noise2, BW_BAND_PASS, 3000.0f, 600.0f);
+	env1.setScale(10);
+	env2.setScale(10);
+	filt1.setScale(env1);
+	filt2.setScale(env2);
+	Panner pan1(filt1, -0.7), pan2(filt2, 0.7);
+	Mixer send(2);								// the reverb send bus
+	send.addInput(pan1, 0.5);
+	send.addInput(pan2, 0.5);
+	FDNReverb reverb(send, 16, 2);				// 16 lines, stereo out
+	reverb.setDecayTime(3.0);
+	reverb.setRoomSize(0.7);
+	Mixer out(2);								// dry voices + reverb
+	out.addInput(pan1, 0.3);
+	out.addInput(pan2, 0.3);
+	out.addInput(reverb, 0.5);
+	theIO->setRoot(out);
+	reverb.dump();
+	logMsg("playing FDN send reverb test\n");
+	for (unsigned i = 0; i < 8; i++) {
+		if (i & 1)
+			env2.trigger();
+		else
+			env1.trigger();
+		sleepSec(1.0);
+	}
+	sleepSec(4);								// let it die out
+	theIO->clearRoot();
+	logMsg("done.\n");
+}
+
+/// A sparse mix: a burst of enveloped sines into a reverb; once the envelopes end, the silence
+/// flags let the mixer skip its inputs, and the reverb sleeps when its tail has died away
+
+void testSparseMix() {
+	Mixer mix(1);							// mono mixer
+	for (unsigned i = 0; i < 32; i++) {		// short enveloped sines
+		AR * env = new AR(fRandM(0.2, 1.5), 0.01, 0.15);
+		Osc * vox = new Osc(fRandM(200, 2000));
+		vox->setScale(* env);
+		env->trigger();
+		mix.addInput(* vox, 0.05);
+	}
+	Freeverb rev(mix);
+	Panner pan(rev, 0.0);
+	logMsg("playing a sparse mix...");
+	runTest(pan, 15);
+	logMsg("done (the reverb is %s).\n", rev.isAsleep() ? "asleep" : "awake");
+	mix.deleteInputs();						// clean up
+}
+
 ///  Play noise bursts into multi-tap delay line
 
 void testMultiTap() {
@@ -542,12 +671,17 @@ void runTests() {
 testStruct effTestList[] = {
 	"Clipper",				testClipper,		"Demonstrate the signal clipper",
 	"FIR filter",			testFIR,			"Play an FIR band-pass filter",
+	"Long FIR filter",		testLongFIR,		"Play a 511-tap FIR band-pass filter (by FFT)",
 	"All filters",			testFilters,		"Test different filter types",
 	"Filtered snd file",	testDynamicVoice,	"Dynamic BPF on a voice track",
 	"Dynamic filter",		testDynamicFilters,	"Play a dynamic BP filter on noise",
+	"Swept filters",		testSweptFilters,	"Play audio-rate swept LP/formant filters and a 6th-order LP",
 	"Many dynamic filters",	testNDynamicFilters, "Many dynamic filtered-noise instruments",
 	"Reverb",				testReverb,			"Show mono reverb on impulses",
 	"Stereo-verb",			testStereoverb,		"Listen to the stereo reverb",
+	"Parallel effects",		testParallelEffects, "Stereo filter, reverb and clipper in SIMD lanes",
+	"FDN reverb",			testFDNReverb,		"Two voices through a shared FDN send reverb",
+	"Sparse mix",			testSparseMix,		"Play a sparse mix whose reverb sleeps when it's silent",
 	"Multi-tap delay",		testMultiTap,		"Play a multi-tap delay line",
 	"Split/Join filter",	testSplitJoin1,		"Play a splitter/joiner cross-over filter",
 	"Split/Join/Mix filter", testSplitJoin2,	"Play a splitter/joiner/mixer cross-over filter",
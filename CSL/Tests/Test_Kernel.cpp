@@ -0,0 +1,396 @@
+//
+//	Test_Kernel.cpp -- C main functions for the CSL engine tests: parallel rendering, shared
+//	port buffers, SIMD kernels, real-time checks, profiling and offline rendering.
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// This program simply reads the run_tests() function (at the bottom of this file)
+//  and executes a list of basic CSL tests
+//
+
+#ifdef USE_JUCE
+	#include "Test_Support.h"
+#else
+	#define USE_TEST_MAIN			// use the main() function in test_support.h
+	#include "Test_Support.cpp"		// include all of CSL core and the test support functions
+#endif
+
+/////////////////////// Here are the actual unit tests ////////////////////
+
+/// Play the big panning mix with a GraphExecutor, which renders the mixer's inputs
+/// on 3 worker threads (plus the IO thread); this should sound just like the one above
+
+#include "GraphExecutor.h"
+
+void testParallelMix() {
+	int num = 64;							// # of layers
+	float scale = 3.0f / (float) num;		// ampl scale
+	Mixer mix(2);							// stereo mixer
+	for (int i = 0; i < num; i++) {			// loop to add a panning, LFO-controlled osc to the mix
+		Osc * vox = new Osc();
+		RandEnvelope * env = new RandEnvelope(0.5, 80, 180);
+		vox->setFrequency(*env);
+		vox->setScale(scale);
+		Osc * lfo = new Osc(fRandM(0.5, 0.9), 1, 0, fRandM(0, CSL_PI));
+		Panner * pan = new Panner(*vox, *lfo);
+		mix.addInput(*pan);
+	}
+	GraphExecutor exec(3);					// create the executor and plug it into the IO
+	theIO->setExecutor(& exec);
+	logMsg("playing parallel mix of %d panning sins...", num);
+	runTest(mix, 30);
+	logMsg("done.\n");
+	theIO->setExecutor(NULL);
+	mix.deleteInputs();						// clean up
+}
+
+/// Share the port buffers of a big mix with a BufferPlan (ports at the same depth use the same storage)
+
+#include "BufferArena.h"
+
+void testSharedBuffers() {
+	int num = 64;							// # of layers
+	float scale = 3.0f / (float) num;		// ampl scale
+	Mixer mix(2);							// stereo mixer
+	for (int i = 0; i < num; i++) {			// loop to add a panning, filtered, LFO-controlled saw to the mix
+		Sawtooth * vox = new Sawtooth();
+		RandEnvelope * env = new RandEnvelope(0.5, 80, 180);
+		vox->setFrequency(*env);
+		vox->setScale(scale);
+		Butter * filt = new Butter(*vox, BW_LOW_PASS, fRandM(400, 2000));
+		Osc * lfo = new Osc(fRandM(0.5, 0.9), 1, 0, fRandM(0, CSL_PI));
+		Panner * pan = new Panner(*filt, *lfo);
+		mix.addInput(*pan);
+	}
+	BufferPlan plan;						// share the port buffers
+	plan.plan(mix);
+	logMsg("playing mix of %d panning saws with %d shared buffers (%d kB saved)...", 
+			num, plan.numSlots(), plan.bytesSaved() / 1024);
+	runTest(mix, 30);
+	logMsg("done.\n");
+	plan.release();							// give the ports their buffers back
+	mix.deleteInputs();						// clean up
+	logMsg("trimmed %d kB of unused buffer storage", BufferArena::defaultArena()->trim() / 1024);
+}
+
+/// Time the SIMD kernels used by the mixers and panners at each level the CPU supports
+
+#include "VectorOps.h"
+
+void testVectorOps() {
+	logMsg("using %s kernels", VectorOps::levelName(VectorOps::level()));
+	VectorOps::benchmark();
+}
+
+/// Check the interleaving and PCM conversion kernels at each level the CPU supports: interleaving
+/// then deinterleaving gives back the samples (to within 1 LSB for the integer formats), every level
+/// makes the same bytes and samples as the scalar one, and the TPDF dither has the same statistics
+
+#define PCM_TEST_FRAMES 4099				// (not a multiple of 4, so the tails are tested too)
+#define PCM_TEST_CHANS 6
+
+void testPCMConversion() {
+	PCMFormat formats[4] = { kPCMFloat32, kPCMInt16, kPCMInt24, kPCMInt32 };
+	const char * names[4] = { "float32", "int16", "int24", "int32" };
+	float lsbs[4] = { 0.0f, 1.0f / 32767.0f, 1.0f / 8388607.0f, 1.2e-7f };	// (int32 is limited by the float)
+	unsigned chanCounts[3] = { 1, 2, PCM_TEST_CHANS };
+	Buffer in(PCM_TEST_CHANS, PCM_TEST_FRAMES), back(PCM_TEST_CHANS, PCM_TEST_FRAMES);
+	Buffer refBack(PCM_TEST_CHANS, PCM_TEST_FRAMES);
+	in.allocateBuffers();
+	back.allocateBuffers();
+	refBack.allocateBuffers();
+	for (unsigned i = 0; i < PCM_TEST_CHANS; i++) {
+		for (unsigned j = 0; j < PCM_TEST_FRAMES; j++)
+			in.buffer(i)[j] = fRandM(-1.0f, 1.0f);
+		in.buffer(i)[0] = 1.0f;				// full scale
+		in.buffer(i)[1] = -1.0f;
+	}
+	unsigned packedSize = 4 * PCM_TEST_CHANS * PCM_TEST_FRAMES;
+	char * packed = new char[packedSize];
+	char * refPacked = new char[packedSize];
+	SIMDLevel oldLevel = VectorOps::level();
+	unsigned numErrors = 0;
+	double refMean = 0.0, refVariance = 0.25;
+	for (unsigned lev = kSIMDScalar; lev <= (unsigned) VectorOps::bestLevel(); lev++) {
+		if (VectorOps::kernels((SIMDLevel) lev) == NULL)
+			continue;
+		for (unsigned c = 0; c < 3; c++) {
+			unsigned numChans = chanCounts[c];
+			for (unsigned f = 0; f < 4; f++) {
+				unsigned numBytes = VectorOps::formatBytes(formats[f]) * numChans * PCM_TEST_FRAMES;
+				VectorOps::setLevel(kSIMDScalar);	// the reference
+				VectorOps::interleave(in.buffers(), numChans, refPacked, numChans, PCM_TEST_FRAMES, formats[f]);
+				VectorOps::deinterleave(refPacked, numChans, refBack.buffers(), numChans, PCM_TEST_FRAMES, formats[f]);
+				VectorOps::setLevel((SIMDLevel) lev);
+				VectorOps::interleave(in.buffers(), numChans, packed, numChans, PCM_TEST_FRAMES, formats[f]);
+				VectorOps::deinterleave(packed, numChans, back.buffers(), numChans, PCM_TEST_FRAMES, formats[f]);
+				if (memcmp(packed, refPacked, numBytes)) {
+					logMsg(kLogError, "%s interleave of %d %s channels differs from the scalar one",
+							VectorOps::levelName((SIMDLevel) lev), numChans, names[f]);
+					numErrors++;
+				}
+				float maxErr = 0.0f;
+				bool same = true;
+				for (unsigned i = 0; i < numChans; i++) {
+					for (unsigned j = 0; j < PCM_TEST_FRAMES; j++) {
+						maxErr = csl_max(maxErr, fabsf(back.buffer(i)[j] - in.buffer(i)[j]));
+						if (back.buffer(i)[j] != refBack.buffer(i)[j])
+							same = false;
+					}
+				}
+				if ( ! same) {
+					logMsg(kLogError, "%s deinterleave of %d %s channels differs from the scalar one",
+							VectorOps::levelName((SIMDLevel) lev), numChans, names[f]);
+					numErrors++;
+				}
+				if (maxErr > lsbs[f]) {
+					logMsg(kLogError, "%s round trip of %d %s channels is off by %g (%g LSB)",
+							VectorOps::levelName((SIMDLevel) lev), numChans, names[f], maxErr, 
+							(lsbs[f] > 0.0f) ? maxErr / lsbs[f] : 0.0f);
+					numErrors++;
+				}
+			}
+		}
+							// dither: the error of a dithered int16 stereo signal should have a mean of 0
+							// and a variance of 1/4 LSB^2 (TPDF + rounding), as the scalar one does
+		unsigned dither[4] = { 0x12345678, 0x9abcdef1, 0x2468ace0, 0x13579bdf };
+		for (unsigned j = 0; j < PCM_TEST_FRAMES; j++) {
+			in.buffer(0)[j] = fRandM(-0.9f, 0.9f);
+			in.buffer(1)[j] = fRandM(-0.9f, 0.9f);
+		}
+		VectorOps::interleave(in.buffers(), 2, packed, 2, PCM_TEST_FRAMES, kPCMInt16, dither);
+		double sum = 0.0, sumSq = 0.0;
+		short * shorts = (short *) packed;
+		for (unsigned j = 0; j < PCM_TEST_FRAMES; j++) {
+			for (unsigned i = 0; i < 2; i++) {
+				double err = (double) shorts[2 * j + i] - (double) in.buffer(i)[j] * 32767.0;
+				sum += err;
+				sumSq += err * err;
+			}
+		}
+		double mean = sum / (2 * PCM_TEST_FRAMES);
+		double variance = sumSq / (2 * PCM_TEST_FRAMES) - mean * mean;
+		if (lev == kSIMDScalar) {
+			refMean = mean;
+			refVariance = variance;
+		}
+		if ((fabs(mean) > 0.03) || (fabs(variance - 0.25) > 0.03)
+				|| (fabs(mean - refMean) > 0.03) || (fabs(variance - refVariance) > 0.03)) {
+			logMsg(kLogError, "%s dither error: mean %.4f, variance %.4f LSB^2 (scalar %.4f, %.4f; expected 0, 0.25)",
+					VectorOps::levelName((SIMDLevel) lev), mean, variance, refMean, refVariance);
+			numErrors++;
+		} else
+			logMsg("%s dither error: mean %.4f, variance %.4f LSB^2", 
+					VectorOps::levelName((SIMDLevel) lev), mean, variance);
+	}
+	VectorOps::setLevel(oldLevel);
+	delete[] packed;
+	delete[] refPacked;
+	if (numErrors)
+		logMsg(kLogError, "PCM conversion: %d checks failed", numErrors);
+	else
+		logMsg("PCM conversion: the round trips are within 1 LSB and all levels match the scalar one");
+}
+
+/// Play a panning mix and list the calls that weren't real-time-safe (build with CSL_RT_CHECK)
+
+#include "RealTimeCheck.h"
+
+void testRealTimeCheck() {
+#ifndef CSL_RT_CHECK
+	logMsg("CSL_RT_CHECK isn't defined; the checks are compiled out");
+#endif
+	Mixer mix(2);							// stereo mixer
+	UGenVector parts;						// (to delete when done)
+	for (unsigned i = 0; i < 8; i++) {		// panning sines with random frequencies
+		Osc * vox = new Osc(fRandM(200, 800), 0.1);
+		Osc * lfo = new Osc(fRandM(0.2, 0.6), 1, 0, fRandM(0, CSL_PI));
+		Panner * pan = new Panner(* vox, * lfo);
+		mix.addInput(pan);
+		parts.push_back(vox);
+		parts.push_back(lfo);
+		parts.push_back(pan);
+	}
+	RealTimeCheck::reset();
+	logMsg("playing a panning mix with real-time safety checks...");
+	runTest(mix, 5);
+	for (unsigned i = 0; i < CSL_NUM_RT_VIOLATIONS; i++)
+		logMsg("\t%s: %d", RealTimeCheck::kindName((RTViolation) i), RealTimeCheck::count((RTViolation) i));
+	logMsg("done.\n");
+	for (unsigned i = 0; i < parts.size(); i++)		// clean up
+		delete parts[i];
+}
+
+/// Profile a mix of filtered, panning saws and log where the time goes (build with CSL_PROFILE)
+
+#include "UGenProfiler.h"
+
+void testProfiler() {
+#ifndef CSL_PROFILE
+	logMsg("CSL_PROFILE isn't defined; the profiling hooks are compiled out");
+#endif
+	Mixer mix(2);							// stereo mixer
+	UGenVector parts;						// (to delete when done)
+	for (unsigned i = 0; i < 16; i++) {		// filtered saws with LFO panners
+		Sawtooth * vox = new Sawtooth(fRandM(80, 240), 0.1);
+		Butter * filt = new Butter(* vox, BW_LOW_PASS, fRandM(400, 2000));
+		Osc * lfo = new Osc(fRandM(0.2, 0.6), 1, 0, fRandM(0, CSL_PI));
+		Panner * pan = new Panner(* filt, * lfo);
+		mix.addInput(pan);
+		parts.push_back(vox);
+		parts.push_back(filt);
+		parts.push_back(lfo);
+		parts.push_back(pan);
+	}
+	UGenProfiler::reset();
+	UGenProfiler::setEnabled(true);
+	logMsg("playing a profiled mix...");
+	runTest(mix, 5);
+	UGenProfiler::setEnabled(false);
+	UGenProfiler::logStats();
+	UGenProfiler::writeFolded("csl_profile.folded");
+	logMsg("done (wrote csl_profile.folded).\n");
+	for (unsigned i = 0; i < parts.size(); i++)		// clean up
+		delete parts[i];
+}
+
+/// Render a big mix to a file faster than real time, at the graph's block size
+
+#include "OfflineRenderer.h"
+
+void testOfflineRender() {
+	OfflineRenderer rend(2);				// stereo (CGestalt is left alone, so this can run
+											// while the IO is playing)
+	rend.setThreads(4);						// render the voices on 4 worker threads
+	Mixer mix(2);							// stereo mixer
+	UGenVector parts;						// (to delete when done)
+	for (unsigned i = 0; i < 64; i++) {		// filtered saws with LFO panners
+		Sawtooth * vox = new Sawtooth(fRandM(80, 240), 0.03);
+		Butter * filt = new Butter(* vox, BW_LOW_PASS, fRandM(400, 2000));
+		Osc * lfo = new Osc(fRandM(0.2, 0.6), 1, 0, fRandM(0, CSL_PI));
+		Panner * pan = new Panner(* filt, * lfo);
+		mix.addInput(pan);
+		parts.push_back(vox);
+		parts.push_back(filt);
+		parts.push_back(lfo);
+		parts.push_back(pan);
+	}
+	logMsg("rendering 60 sec of a 64-voice mix...");
+	try {
+		rend.render(mix, "csl_offline.aiff", 60.0f);
+		logMsg("done (wrote csl_offline.aiff at %.1f blocks/sec, %.1f x real time).\n",
+				rend.blocksPerSecond(), rend.realTimeFactor());
+	} catch (CException & ex) {
+		logMsg(kLogError, "offline render failed: %s", ex.what());
+	}
+	for (unsigned i = 0; i < parts.size(); i++)		// clean up
+		delete parts[i];
+}
+
+/// Check that the noises are repeatable: the same seed and stream make the same samples, and a mix
+/// of noises rendered on worker threads is bit-identical to the same mix rendered on one thread
+
+#include "Noise.h"
+
+static void makeNoiseMix(Mixer & mix, UGenVector & parts) {
+	for (unsigned i = 0; i < 16; i++) {		// filtered white and pink noises, each on its own stream
+		Noise * vox;
+		if (i & 1)
+			vox = new PinkNoise(1234, 0.05);
+		else
+			vox = new WhiteNoise(1234, 0.05);
+		vox->setStream(i);
+		Butter * filt = new Butter(* vox, BW_LOW_PASS, 200.0f + 100.0f * i);
+		Panner * pan = new Panner(* filt, (i / 7.5f) - 1.0f);
+		mix.addInput(pan);
+		parts.push_back(vox);
+		parts.push_back(filt);
+		parts.push_back(pan);
+	}
+}
+
+static unsigned countDifferences(Buffer & a, Buffer & b) {
+	unsigned diffs = 0;
+	for (unsigned i = 0; i < a.mNumChannels; i++)
+		for (unsigned j = 0; j < a.mNumFrames; j++)
+			if (a.buffer(i)[j] != b.buffer(i)[j])
+				diffs++;
+	return diffs;
+}
+
+void testNoiseRepeatability() {
+	unsigned numFrames = 5 * CGestalt::frameRate();
+	unsigned numErrors = 0;
+	Buffer out1(2, numFrames), out2(2, numFrames);
+	out1.allocateBuffers();
+	out2.allocateBuffers();
+	OfflineRenderer rend(2);
+	WhiteNoise white1(1234), white2(1234), white3(1234);
+	white1.setStream(7);					// same seed and stream...
+	white2.setStream(7);
+	white3.setStream(8);					// ... and a different stream
+	Buffer mono1(1, numFrames), mono2(1, numFrames);
+	mono1.allocateBuffers();
+	mono2.allocateBuffers();
+	rend.render(white1, mono1);
+	rend.render(white2, mono2);
+	if (countDifferences(mono1, mono2)) {
+		logMsg(kLogError, "two white noises with the same seed and stream differ");
+		numErrors++;
+	}
+	rend.render(white3, mono2);
+	if (countDifferences(mono1, mono2) < numFrames / 2) {
+		logMsg(kLogError, "two white noises on different streams are alike");
+		numErrors++;
+	}
+	Mixer mix1(2), mix2(2);					// the same mix of noises, twice
+	UGenVector parts;
+	makeNoiseMix(mix1, parts);
+	makeNoiseMix(mix2, parts);
+	rend.render(mix1, out1);				// on the calling thread
+	rend.setThreads(4);
+	rend.render(mix2, out2);				// and on 4 worker threads
+	unsigned diffs = countDifferences(out1, out2);
+	if (diffs) {
+		logMsg(kLogError, "the parallel render differs from the serial one in %d samples", diffs);
+		numErrors++;
+	}
+	for (unsigned i = 0; i < parts.size(); i++)		// clean up
+		delete parts[i];
+	if (numErrors)
+		logMsg(kLogError, "noise repeatability: %d checks failed", numErrors);
+	else
+		logMsg("noise repeatability: the seeded noises and the parallel render match");
+}
+
+//////// RUN_TESTS Function ////////
+
+#ifndef USE_JUCE
+
+void runTests() {
+//	testParallelMix();
+//	testSharedBuffers();
+	testVectorOps();
+//	testPCMConversion();
+//	testRealTimeCheck();
+//	testProfiler();
+//	testOfflineRender();
+//	testNoiseRepeatability();
+}
+
+#else
+
+// test list for Juce GUI
+
+testStruct kernTestList[] = {
+	"Parallel mixer",		testParallelMix,		"Render a big mixer's inputs on worker threads",
+	"Shared port buffers",	testSharedBuffers,		"Share the port buffers of a big mixer",
+	"SIMD kernels",			testVectorOps,			"Benchmark the vectorized mixing kernels",
+	"PCM conversion",		testPCMConversion,		"Check the interleaving, PCM conversion and dither kernels",
+	"Real-time check",		testRealTimeCheck,		"List the unsafe calls made in the callback",
+	"UGen profiler",		testProfiler,			"Profile a mix and log the time per UGen",
+	"Offline render",		testOfflineRender,		"Render a big mix to a file faster than real time",
+	"Noise repeatability",	testNoiseRepeatability,	"Check seeded noises and parallel renders are bit-identical",
+	NULL,					NULL,					NULL
+};
+
+#endif
@@ -20,6 +20,31 @@
 #endif
 
 #include "SimpleSines.h"
+#include "OscillatorBL.h"
+
+/// Answer the wall-clock time in seconds, for timing the oscillators (clock() would answer the
+/// CPU time of the whole process, which includes the IO thread)
+
+#ifdef CSL_WINDOWS
+	#include <windows.h>
+
+static double wallSeconds() {
+	LARGE_INTEGER freq, tick;
+	QueryPerformanceFrequency(& freq);
+	QueryPerformanceCounter(& tick);
+	return (double) tick.QuadPart / (double) freq.QuadPart;
+}
+#else
+	#include <sys/time.h>
+
+static double wallSeconds() {
+	struct timeval now;
+	gettimeofday(& now, NULL);
+	return (double) now.tv_sec + (double) now.tv_usec * 1.0e-6;
+}
+#endif
+
+#define CSL_TWOPI_D 6.283185307179586		///< 2 pi in double precision (for the reference signals)
 
 /////////////////////// Here are the actual unit tests ////////////////////
 
@@ -149,6 +174,77 @@ void testWavetableInterpolation() {
 	logMsg("playing interpolating wavetable...");
 	runTest(wav);							// re-play test
 	logMsg("done.\n");
+	sleepMsec(250);
+	wav.setInterpolate(kCubic);				// 4-point Hermite interpolation
+	logMsg("playing cubic-interpolating wavetable...");
+	runTest(wav);
+	logMsg("done.\n");
+}
+
+/// Check the shared sine table and the error of each interpolation policy against a computed sine,
+/// then time a bank of wavetable oscillators with each policy and log how many of them one core
+/// could run in real time
+
+void testWavetableLoad() {
+	const unsigned numOscs = 100, numBlocks = 400;
+	InterpolationPolicy policies[3] = { kTruncate, kLinear, kCubic };
+	const char * names[3] = { "truncating", "linear", "cubic" };
+	unsigned numErrors = 0;
+	Buffer out(1, CGestalt::blockSize());
+	out.allocateBuffers();
+	WavetableOscillator sine(441.0f);
+	unsigned tableLength = sine.mWavetable.mNumFrames;
+	SampleBuffer table = sine.mWavetable.buffer(0);
+	for (unsigned i = 0; i < tableLength; i++) {
+		double expected = sin(CSL_TWOPI_D * i / tableLength);
+		if (fabs(table[i] - expected) > 1.0e-6) {
+			logMsg(kLogError, "sine table entry %d of %d is %g, not %g", i, tableLength, table[i], expected);
+			numErrors++;
+			break;
+		}
+	}
+								// truncation can be off by one table step of the sine; the
+								// interpolated policies should be good to about float precision
+	double bounds[3] = { CSL_TWOPI_D / tableLength + 1.0e-6, 1.0e-6, 1.0e-6 };
+	for (unsigned p = 0; p < 3; p++) {
+		WavetableOscillator osc(441.0f);
+		osc.setInterpolate(policies[p]);
+		double maxErr = 0.0;
+		unsigned frame = 0;
+		for (unsigned b = 0; b < 8; b++) {
+			osc.nextBuffer(out, 0);
+			for (unsigned i = 0; i < out.mNumFrames; i++, frame++) {
+				double err = fabs(out.buffer(0)[i] - sin(CSL_TWOPI_D * fmod(441.0 * frame / CGestalt::frameRate(), 1.0)));
+				if (err > maxErr)
+					maxErr = err;
+			}
+		}
+		if (maxErr > bounds[p]) {
+			logMsg(kLogError, "%s: the error is %g (more than %g)", names[p], maxErr, bounds[p]);
+			numErrors++;
+		} else
+			logMsg("%s: the error is %g", names[p], maxErr);
+	}
+	for (unsigned p = 0; p < 3; p++) {
+		WavetableOscillator * oscs[numOscs];
+		for (unsigned i = 0; i < numOscs; i++) {
+			oscs[i] = new WavetableOscillator(fRandM(100, 1000), 0.01);
+			oscs[i]->setInterpolate(policies[p]);
+		}
+		double t0 = wallSeconds();
+		for (unsigned b = 0; b < numBlocks; b++)
+			for (unsigned i = 0; i < numOscs; i++)
+				oscs[i]->nextBuffer(out, 0);
+		double secs = wallSeconds() - t0;
+		double played = (double) numBlocks * CGestalt::blockSize() / CGestalt::frameRateF();
+		logMsg("%s: %.2f ns/sample, %.0f oscillators per core", names[p],
+				secs * 1.0e9 / ((double) numOscs * numBlocks * CGestalt::blockSize()),
+				(secs > 0.0) ? numOscs * played / secs : 0.0);
+		for (unsigned i = 0; i < numOscs; i++)
+			delete oscs[i];
+	}
+	if (numErrors)
+		logMsg(kLogError, "wavetable check: %d errors", numErrors);
 }
 
 /// AM and FM using the dynamic scale and frequency inputs
@@ -175,6 +271,27 @@ void testAMFMSin() {
 	logMsg("FM sin done.\n");
 }
 
+/// Control-rate modulators: the LFOs are evaluated once per block (stepped, then ramped)
+
+void testControlRate() {
+	Osc osc;							// carrier
+	Osc vibrato(5, 10, 220);			// vibrato LFO: freq, scale, offset
+	Osc tremolo(3, 0.2, 0.3);			// tremolo LFO
+	osc.setFrequency(vibrato);
+	osc.setScale(tremolo);
+	logMsg("playing audio-rate LFOs...");
+	runTest(osc);
+	vibrato.setControlRate();			// one value per block
+	tremolo.setControlRate();
+	logMsg("playing control-rate LFOs...");
+	runTest(osc);
+	vibrato.setControlRate(true);		// one value per block, ramped
+	tremolo.setControlRate(true);
+	logMsg("playing ramped control-rate LFOs...");
+	runTest(osc);
+	logMsg("control-rate LFOs done.\n");
+}
+
 /// use the dumpTest call to dump the whole graph
 
 void dumpAMFMSin() {
@@ -254,6 +371,201 @@ void testSumOfSinesNonCached() {
 	logMsg("sum of sines done.");
 }
 
+/// Answer how close (the signal-to-error ratio in dB) numBlocks of a UGen's output are to the sum
+/// of a list of Sine oscillators, with the UGen's output delay frames late
+
+static double snrAgainstSines(UnitGenerator & gen, UGenVector & sines, unsigned numBlocks, unsigned delay) {
+	unsigned blockSize = CGestalt::blockSize();
+	unsigned numFrames = numBlocks * blockSize;
+	Buffer out(1, blockSize), one(1, blockSize), got(1, numFrames), want(1, numFrames);
+	out.allocateBuffers();
+	one.allocateBuffers();
+	got.allocateBuffers();
+	want.allocateBuffers();
+	want.zeroBuffers();
+	for (unsigned b = 0; b < numBlocks; b++) {
+		gen.nextBuffer(out, 0);
+		memcpy(got.buffer(0) + b * blockSize, out.buffer(0), blockSize * sizeof(sample));
+		for (unsigned k = 0; k < sines.size(); k++) {
+			sines[k]->nextBuffer(one, 0);
+			for (unsigned j = 0; j < blockSize; j++)
+				want.buffer(0)[b * blockSize + j] += one.buffer(0)[j];
+		}
+	}
+	double signal = 0.0, error = 0.0;
+	for (unsigned j = 0; j + delay < numFrames; j++) {
+		double err = got.buffer(0)[j + delay] - want.buffer(0)[j];
+		signal += want.buffer(0)[j] * want.buffer(0)[j];
+		error += err * err;
+	}
+	return (error > 0.0) ? 10.0 * log10(signal / error) : 999.0;
+}
+
+/// A stiff-string spectrum of 200 partials, computed on the fly by the sine bank: check it against
+/// a sum of Sine oscillators, time it, then play it with a vibrato (so it takes the audio-rate
+/// frequency path)
+
+void testSumOfSinesBank() {
+	const unsigned numPartials = 200, numBlocks = 400;
+	float nyquist = CGestalt::frameRateF() * 0.5f;
+	SumOfSines vox(110);
+	UGenVector sines;						// the partials as Sines (the bank leaves out those above
+	for (unsigned i = 1; i <= numPartials; i++) {		// the Nyquist frequency)
+		float ratio = i * sqrtf(1.0f + 0.0004f * i * i);
+		float phase = fRandZ() * CSL_TWOPI;
+		vox.addPartial(ratio, 0.5f / i, phase);
+		if (110.0f * ratio < nyquist)
+			sines.push_back(new Sine(110.0f * ratio, 0.3f * 0.5f / i, 0.0f, phase));
+	}
+	vox.setScale(0.3);
+	double snr = snrAgainstSines(vox, sines, 8, 0);
+	if (snr < 40.0)
+		logMsg(kLogError, "sine bank vs. summed Sines: %.1f dB signal-to-error (less than 40)", snr);
+	else
+		logMsg("sine bank vs. summed Sines: %.1f dB signal-to-error", snr);
+	for (unsigned i = 0; i < sines.size(); i++)
+		delete sines[i];
+	Buffer out(1, CGestalt::blockSize());
+	out.allocateBuffers();
+	UnitGenerator & gen = vox;
+	double t0 = wallSeconds();
+	for (unsigned b = 0; b < numBlocks; b++)
+		gen.nextBuffer(out, 0);
+	double secs = wallSeconds() - t0;
+	double played = (double) numBlocks * CGestalt::blockSize() / CGestalt::frameRateF();
+	logMsg("%d partials: %.1f%% of one core", numPartials, secs * 100.0 / played);
+	Sine vib(5, 3, 110);					// +- 3 Hz vibrato
+	vox.setFrequency(vib);
+	logMsg("playing sine-bank sum of sines...");
+	runTest(vox, 5);
+	logMsg("sum of sines done.");
+}
+
+/// A dense inharmonic pad of 2000 partials: check the inverse FFT version against a sum of Sine
+/// oscillators, time it on the sine bank and by inverse FFT, then play the IFFT version
+
+void testSumOfSinesIFFT() {
+	const unsigned numPartials = 2000, numBlocks = 200;
+	SumOfSines vox(55);
+	UGenVector sines;						// the partials as Sines (all below 8.4 kHz)
+	for (unsigned i = 0; i < numPartials; i++) {
+		float ratio = 1.0f + fRandZ() * 150.0f;
+		float phase = fRandZ() * CSL_TWOPI;
+		vox.addPartial(ratio, 0.5f / numPartials, phase);
+		sines.push_back(new Sine(55.0f * ratio, 0.3f * 0.5f / numPartials, 0.0f, phase));
+	}
+	vox.setScale(0.3);
+	vox.setInverseFFT(CSL_IFFT_SINES_SIZE);	// (its output is one hop, 1/4 of the FFT, late)
+	double snr = snrAgainstSines(vox, sines, 16, CSL_IFFT_SINES_SIZE / 4);
+	if (snr < 30.0)
+		logMsg(kLogError, "inverse FFT vs. summed Sines: %.1f dB signal-to-error (less than 30)", snr);
+	else
+		logMsg("inverse FFT vs. summed Sines: %.1f dB signal-to-error", snr);
+	for (unsigned i = 0; i < sines.size(); i++)
+		delete sines[i];
+	Buffer out(1, CGestalt::blockSize());
+	out.allocateBuffers();
+	UnitGenerator & gen = vox;
+	double played = (double) numBlocks * CGestalt::blockSize() / CGestalt::frameRateF();
+	for (unsigned pass = 0; pass < 2; pass++) {
+		vox.setInverseFFT(pass ? CSL_IFFT_SINES_SIZE : 0);
+		double t0 = wallSeconds();
+		for (unsigned b = 0; b < numBlocks; b++)
+			gen.nextBuffer(out, 0);
+		double secs = wallSeconds() - t0;
+		logMsg("%d partials, %s: %.1f%% of one core", numPartials, 
+				pass ? "inverse FFT" : "sine bank", secs * 100.0 / played);
+	}
+	logMsg("playing IFFT sum of sines...");
+	runTest(vox, 5);
+	logMsg("sum of sines done.");
+}
+
+/// Answer the aliasing level (in dB) of a UGen playing a harmonic tone with a period of exactly
+/// 1 / cycles of BL_TEST_FFT frames: the power in the bins away from the harmonics relative to the
+/// power in them (over a Hann-windowed FFT)
+
+#define BL_TEST_FFT 8192
+
+static double aliasLevel(UnitGenerator & gen, unsigned cycles) {
+	Buffer out(1, CGestalt::blockSize()), wave(1, BL_TEST_FFT), mags(1, BL_TEST_FFT);
+	out.allocateBuffers();
+	wave.allocateBuffers();
+	mags.allocateBuffers();
+	for (unsigned done = 0; done < BL_TEST_FFT; done += out.mNumFrames) {
+		gen.nextBuffer(out, 0);
+		memcpy(wave.buffer(0) + done, out.buffer(0), 
+				csl_min(out.mNumFrames, BL_TEST_FFT - done) * sizeof(sample));
+	}
+	for (unsigned i = 0; i < BL_TEST_FFT; i++)
+		wave.buffer(0)[i] *= 0.5f - 0.5f * cosf(CSL_TWOPI * i / BL_TEST_FFT);
+	FFTWrapper fft(BL_TEST_FFT, CSL_FFT_REAL, CSL_FFT_FORWARD);
+	fft.nextBuffer(wave, mags);				// (magnitudes)
+	double harmonics = 0.0, aliases = 0.0;
+	for (unsigned bin = 1; bin < BL_TEST_FFT / 2; bin++) {
+		unsigned off = bin % cycles;			// distance to the nearest harmonic
+		off = csl_min(off, cycles - off);
+		double power = mags.buffer(0)[bin] * mags.buffer(0)[bin];
+		if (off <= 2)							// (the Hann window's main lobe)
+			harmonics += power;
+		else
+			aliases += power;
+	}
+	return (aliases > 0.0) ? 10.0 * log10(aliases / harmonics) : -999.0;
+}
+
+/// Check that the band-limited sawtooth doesn't alias at a few fixed frequencies, then sweep it up
+/// to 10 kHz (no aliasing on the way) and time it
+
+void testBandLimitedSweep() {
+	unsigned cycles[5] = { 186, 557, 931, 1490, 1858 };	// ~1, 3, 5, 8 and 10 kHz
+	for (unsigned i = 0; i < 5; i++) {
+		float freq = CGestalt::frameRateF() * cycles[i] / BL_TEST_FFT;
+		SawtoothBL saw(freq);
+		double level = aliasLevel(saw, cycles[i]);
+		if (level > -90.0)
+			logMsg(kLogError, "band-limited sawtooth at %.0f Hz: aliasing at %.1f dB (more than -90)", freq, level);
+		else
+			logMsg("band-limited sawtooth at %.0f Hz: aliasing at %.1f dB", freq, level);
+	}
+	SawtoothBL vox;
+	LineSegment gliss(5, 40, 10000);		// freq line (dur val1, val2)
+	vox.setFrequency(gliss);
+	vox.setScale(0.2);
+	Buffer out(1, CGestalt::blockSize());
+	out.allocateBuffers();
+	UnitGenerator & gen = vox;
+	unsigned numBlocks = (unsigned) (5.0f * CGestalt::frameRateF() / CGestalt::blockSize());
+	double t0 = wallSeconds();
+	for (unsigned b = 0; b < numBlocks; b++)
+		gen.nextBuffer(out, 0);
+	double secs = wallSeconds() - t0;
+	logMsg("band-limited sweep: %.2f%% of one core", secs * 100.0 / 5.0);
+	SawtoothBL vox2;						// play a fresh one
+	LineSegment gliss2(5, 40, 10000);
+	vox2.setFrequency(gliss2);
+	vox2.setScale(0.2);
+	logMsg("playing band-limited sawtooth sweep...");
+	runTest(vox2, 5);
+	logMsg("band-limited sweep done.");
+}
+
+/// Create a few oscillators, windows and caches and show which tables they share
+
+void testSharedTables() {
+	WindowTable hann(kHannWindow, 1024);
+	TableRegistry::prewarm(hann);						// as at start-up
+	Osc sines[8];
+	SawtoothBL saws[4];
+	HannWindow win1(1024), win2(1024);
+	SumOfSines vox1(kFreqAmp, 3, 1.0, 0.3, 2.0, 0.2, 3.0, 0.1);
+	SumOfSines vox2(kFreqAmp, 3, 1.0, 0.3, 2.0, 0.2, 3.0, 0.1);
+	vox1.createCache();
+	vox2.createCache();
+	TableRegistry::dump();
+	logMsg("%d tables, %d bytes", TableRegistry::numTables(), TableRegistry::bytesInUse());
+}
+
 /// Load an oscillator's wave table from a file -- a single cycle of the vowel "oo" from the word "moon"
 
 void testWaveTableFromFile() {
@@ -329,6 +641,88 @@ void test_SHARC2() {
 	runTest(pan, dur);							// run test fcn
 	logMsg("done.\n");
 }
+
+/// Convert the SHARC text library to a binary file (in a temporary file, so loadDefault() doesn't
+/// pick it up), time loading both, and check that the mapped library matches the text one
+
+#include <sys/time.h>
+#include <unistd.h>
+
+void test_SHARC_DB() {
+	struct timeval then, now;
+	string folder(CGestalt::dataFolder());
+	folder += "SHARC";
+	gettimeofday(& then, NULL);
+	SHARCLibrary text((char *) folder.c_str());		// parse the text files
+	gettimeofday(& now, NULL);
+	logMsg("parsed the SHARC folder in %.3f sec", (now.tv_sec - then.tv_sec) + (now.tv_usec - then.tv_usec) * 1e-6);
+	char db[CSL_NAME_LEN];
+	strcpy(db, "/tmp/" SHARC_DB_NAME ".XXXXXX");
+	int fd = mkstemp(db);
+	if (fd < 0) {
+		logMsg(kLogError, "couldn't make a temporary file");
+		return;
+	}
+	close(fd);
+	if ( ! text.storeToDB(db)) {
+		logMsg(kLogError, "couldn't write %s", db);
+		unlink(db);
+		return;
+	}
+	gettimeofday(& then, NULL);
+	SHARCLibrary binary(db);						// map the binary file
+	gettimeofday(& now, NULL);
+	logMsg("mapped %s in %.3f msec", db, ((now.tv_sec - then.tv_sec) + (now.tv_usec - then.tv_usec) * 1e-6) * 1000.0);
+	binary.dump_stats();
+	SHARCInstrument * inst = binary.instrument_named("oboe");
+	if (inst) {
+		SHARCSpectrum * spect = inst->spectrum_with_frequency(440.0f);
+		if (spect)
+			logMsg("oboe spectrum nearest 440 Hz: %s (%g Hz, %d partials)",
+					spect->_note_name, spect->_actual_pitch, spect->_num_partials);
+	}
+	unsigned numSpectra = 0, numPartials = 0, numErrors = 0;
+	if (binary._num_instruments != text._num_instruments) {
+		logMsg(kLogError, "%d instruments mapped, %d parsed", binary._num_instruments, text._num_instruments);
+		numErrors++;
+	}
+	for (unsigned i = 0; (i < binary._num_instruments) && (i < text._num_instruments); i++) {
+		SHARCInstrument * bi = binary._instruments[i];
+		SHARCInstrument * ti = text._instruments[i];
+		if (strcmp(bi->_name, ti->_name) || (bi->_num_spectra != ti->_num_spectra)) {
+			logMsg(kLogError, "instrument %d: %s (%d spectra) mapped, %s (%d) parsed", i,
+					bi->_name, bi->_num_spectra, ti->_name, ti->_num_spectra);
+			numErrors++;
+			continue;
+		}
+		for (unsigned j = 0; j < bi->_num_spectra; j++) {
+			SHARCSpectrum * bs = bi->_spectra[j];
+			SHARCSpectrum * ts = ti->_spectra[j];
+			numSpectra++;
+			if (strcmp(bs->_note_name, ts->_note_name) || (bs->_midi_key != ts->_midi_key)
+					|| (bs->_actual_pitch != ts->_actual_pitch) || (bs->_num_partials != ts->_num_partials)) {
+				logMsg(kLogError, "%s spectrum %s differs", bi->_name, ts->_note_name);
+				numErrors++;
+				continue;
+			}
+			for (unsigned k = 0; k < bs->_num_partials; k++) {
+				Partial & bp = bs->_partials[k];
+				Partial & tp = ts->_partials[k];
+				numPartials++;
+				if ((bp.number != tp.number) || (bp.amplitude != tp.amplitude) || (bp.phase != tp.phase)) {
+					logMsg(kLogError, "%s spectrum %s partial %d differs", bi->_name, ts->_note_name, k);
+					numErrors++;
+				}
+			}
+		}
+	}
+	unlink(db);
+	if (numErrors)
+		logMsg(kLogError, "the mapped library differs from the text one in %d places", numErrors);
+	else
+		logMsg("the mapped library matches the text one: %d instruments, %d spectra, %d partials",
+				text._num_instruments, numSpectra, numPartials);
+}
 #endif
 
 //////// RUN_TESTS Function ////////
@@ -358,16 +752,23 @@ testStruct oscTestList[] = {
 	"Standard waveforms",		testBasicWaves,		"Demonstrate the standard wave forms",
 	"Scaled sine",				testScaledSin,		"Play a scaled-quiet sine wave",
 	"Wavetable interpolation",	testWavetableInterpolation,	"Show truncated/interpolated wave tables",
+	"Wavetable load",			testWavetableLoad,			"Time wavetable oscillators per interpolation policy",
 	"AM/FM sines",				testAMFMSin,				"Play an AM and FM sine wave",
 	"Dump AM/FM sines",			dumpAMFMSin,				"Dump the graph of the AM/FM sine",
+	"Control-rate LFOs",		testControlRate,			"Compare audio-, control- and ramped-rate modulators",
 	"SumOfSines cached",		testSumOfSinesCached,		"Play a sum-of-sines additive oscillator",
 	"SumOfSines non-cached",	testSumOfSinesNonCached,	"Play an uncached inharmonic sum-of-sines", 
+	"SumOfSines bank",			testSumOfSinesBank,			"Time and play 200 partials on the sine bank",
+	"SumOfSines IFFT",			testSumOfSinesIFFT,			"Time and play 2000 partials by inverse FFT",
+	"Band-limited sweep",		testBandLimitedSweep,		"Time and play an alias-free sawtooth sweep",
+	"Shared tables",			testSharedTables,			"Show the wavetables and windows shared by the registry",
 	"SumOfSines build",			testSumOfSinesSteps,		"Build up a harmonic series on a sum-of-sines",
 	"SumOfSines 1/f",			testSumOfSines1F,			"Play a 1/f spectrum sum-of-sines",
 	"Wavetable from file",		testWaveTableFromFile,		"Play a wave table from a sound file",
 #ifndef CSL_WINDOWS
 	"SHARC SOS",				test_SHARC,					"Load/print the SHARC timbre database, play example",
 	"Vector SHARC",				test_SHARC2,				"Show vector cross-fade of SHARC spectra",
+	"SHARC database",			test_SHARC_DB,				"Convert the SHARC library to a binary file, map and check it",
 #endif
 	NULL,						NULL,				NULL
 };
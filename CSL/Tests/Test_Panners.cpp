@@ -13,11 +13,7 @@
 	#include "Test_Support.cpp"		// include all of CSL core and the test support functions
 #endif
 
-//#define USE_CONVOLVER
-
-#ifdef USE_CONVOLVER
 #include "Convolver.h"				// FFT-based convolver
-#endif
 
 /////////////////////// Here are the actual unit tests ////////////////////
 
@@ -154,13 +150,12 @@ void testCMapIO() {
 
 ////////// Convolution
 
-#ifdef USE_CONVOLVER
+/// Play a sound file, then the same file through a convolution reverb with an IR read from a file
 
 void testConvolver() {
-	JSoundFile fi(CGestalt::dataFolder(), "rim3_L.aiff");
-	try {
-		fi.openForRead();
-	} catch (CException) {
+	SoundFile fi(CGestalt::dataFolder() + "rim3_L.aiff");
+	SoundFile ir(CGestalt::dataFolder() + "Quadraverb_large_L.aiff");
+	if ( ! (fi.isValid() && ir.isValid())) {
 		logMsg(kLogError, "Cannot read sound file...");
 		return;
 	}
@@ -168,16 +163,14 @@ void testConvolver() {
 	fi.trigger();
 	runTest(fi);
 	logMsg("sound file player done.\n");
-					// Create convolver; FFT size will be block size * 2
-	Convolver cv(CGestalt::dataFolder(), "Quadraverb_large_L.aiff");	
-	cv.setInput(fi);
+	Convolver cv(fi, ir);				// the partitioned convolver (1 worker thread)
+	cv.dump();
 	logMsg("playing convolver...");
 	fi.trigger();
 	runTest(cv);
 	fi.trigger();
 	runTest(cv);
-	fi.close();
-	logMsg("convolver done.\n");
+	logMsg("convolver done (%d late jobs).\n", cv.lateJobs());
 }
 
 #define IRLEN (44100 * 4)			// 4 sec. IR
@@ -197,9 +190,7 @@ void testConvolver2() {
 	float * samp = buf.buffer(0);
 	for (unsigned i = 0; i < IRLEN; i += 5000)
 		samp[i] = 1 / (1 + (sqrt(i) / 5000));
-									// Create convolver; FFT size will be block size * 2
-	Convolver cv(buf);
-	cv.setInput(nois);
+	Convolver cv(nois, buf);		// convolve with the IR buffer
 	logMsg("playing convolver...");
 	env.trigger();
 	runTest(cv);
@@ -217,8 +208,8 @@ void testConvolver3() {
 	env.trigger();
 	runTest(nois);
 	logMsg("done.\n");
-	Convolver cv(CGestalt::dataFolder(), "3.3s_LargeCathedral_mono.aiff");	
-	cv.setInput(nois);
+	SoundFile ir(CGestalt::dataFolder() + "3.3s_LargeCathedral_mono.aiff");
+	Convolver cv(nois, ir);	
 	logMsg("playing convolver...");
 	env.trigger();
 	runTest(cv);
@@ -229,7 +220,36 @@ void testConvolver3() {
 	logMsg("convolver done.\n");
 }
 
-#endif
+/// Noise bursts panned into a "true stereo" convolution reverb; the IR's 4 channels
+/// (L->L, L->R, R->L, R->R) are 2.5 seconds of decaying noise
+
+void testConvolver4() {
+	unsigned irLen = (unsigned) (2.5f * CGestalt::frameRate());
+	Buffer ir(4, irLen);
+	ir.allocateBuffers();
+	for (unsigned c = 0; c < 4; c++) {
+		float gain = ((c == 0) || (c == 3)) ? 0.02f : 0.01f;	// less crosstalk
+		for (unsigned i = 0; i < irLen; i++)
+			ir.buffer(c)[i] = fRand1() * gain * expf(-6.9f * (float) i / (float) irLen);
+	}
+	WhiteNoise nois;
+	AR env(0.05, 0.0001, 0.049);
+	nois.setScale(env);
+	Panner pan(nois, 0.0);
+	Convolver cv(pan, ir, kConvolveAuto, 2);	// true stereo, 2 worker threads
+	cv.setDryLevel(0.5f);
+	cv.dump();
+	theIO->setRoot(cv);
+	logMsg("playing true-stereo convolver...");
+	for (unsigned i = 0; i < 6; i++) {
+		pan.setPosition(fRand1());
+		env.trigger();
+		sleepSec(1.5);
+	}
+	sleepSec(2.5);					// let it die out
+	theIO->clearRoot();
+	logMsg("convolver done (%d late jobs).\n", cv.lateJobs());
+}
 
 #ifndef CSL_WINDOWS
 
@@ -419,6 +439,7 @@ void runTests() {
 //	testConvolver();
 //	testConvolver2();
 //	testConvolver3();
+//	testConvolver4();
 //	testOscBank();
 //	testCMapIO();
 	test_Binaural_horiz();
@@ -436,11 +457,10 @@ testStruct panTestList[] = {
 	"Mixer",				testSineMixer,			"Mixer with 4 sine inputs (slow sum-of-sines)",
 	"Panning mixer",		testPanMix,				"Play a panning stereo mixer",
 	"Bigger panning mixer",	testBigPanMix,			"Test a mixer with many inputs",
-#ifdef USE_CONVOLVER
-	"Test convolver",		testConvolver,			"Test a convolver",
-	"Test convolver 2",		testConvolver2,			"Test a convolver",
-	"Test convolver 3",		testConvolver3,			"Test a convolver",
-#endif
+	"Test convolver",		testConvolver,			"Convolve a sound file with an IR file",
+	"Test convolver 2",		testConvolver2,			"Convolve noise bursts with an echo IR",
+	"Test convolver 3",		testConvolver3,			"Convolve noise bursts with a cathedral IR",
+	"True-stereo convolver", testConvolver4,		"Pan noise bursts into a 4-channel IR",
 	"Osc bank",				testOscBank,			"Mix a bank of oscillators",
 	"Channel-mapped IO",	testCMapIO,				"Demonstrate channel-mapped IO",
 #ifndef CSL_WINDOWS
@@ -113,6 +113,27 @@ done:
 	}
 }
 
+/// Play arpeggii on a bank of 64 strings (a new note every 30 msec, each ringing for 4 sec),
+/// and report how many strings were sounding
+
+void testStringBank() {
+	KarplusBank bank(64);					// 64 strings, down to A0
+	bank.setDecay(4.0f);
+	theIO->setRoot(bank);					// send the bank to IO
+	logMsg("playing a 64-string bank...");
+	for (unsigned i = 0; i < 300; i++) {	// 300 notes, in arpeggii of 6
+		int key = 36 + ((i / 6) % 5) * 5 + (i % 6) * 7;
+		bank.pluck(keyToFreq(key), 0.15f, fRandM(-0.8f, 0.8f));
+		if (sleepSec(0.03))
+			break;
+		if ((i % 50) == 49)
+			logMsg("\t%d strings sounding", bank.numActive());
+	}
+	sleepSec(4.0);
+	logMsg("done (%d strings sounding).", bank.numActive());
+	theIO->clearRoot();
+}
+
 ///////////////// SoundFile tests ////////
 
 /// Test the sound file player - mono, stereo input files
@@ -381,11 +402,40 @@ void testGrainCloud() {
 	cloud.mEnvelopeBase = 0.5f;
 	cloud.mEnvelopeRange = 0.49f;
 	logMsg("playing Granular cloud.");
-	cloud.startThreads();					// start the grain create/reap threads
+	cloud.start();							// start spawning grains
 	runTest(player, 15);
-	logMsg("done.");
-	cloud.isPlaying = false;
-	sleepSec(0.5);
+	logMsg("done (%d grains dropped).", cloud.numDropped());
+	cloud.stop();
+}
+
+// A dense cloud: thousands of short grains at once, with sample-accurate onsets
+
+void testDenseCloud() {
+	GrainCloud cloud;
+	GrainPlayer player(& cloud);
+	SoundFile sndFile(CGestalt::dataFolder() + "MKG1a1b.aiff");
+
+	cloud.mSamples = sndFile.mWavetable.buffer(0);
+	cloud.numSamples = sndFile.duration();
+	cloud.mRateBase = 1.0f;
+	cloud.mRateRange = 0.05f;
+	cloud.mOffsetBase = 0.5f;
+	cloud.mOffsetRange = 0.1f;
+	cloud.mDurationBase = 0.5f;
+	cloud.mDurationRange = 0.2f;
+	cloud.mDensityBase = 4000.0f;			// ~2000 grains sounding at a time
+	cloud.mDensityRange = 1000.0f;
+	cloud.mWidthBase = 0.5f;
+	cloud.mWidthRange = 0.5f;
+	cloud.mVolumeBase = 8.0f;
+	cloud.mVolumeRange = 4.0f;
+	cloud.mEnvelopeBase = 0.5f;
+	cloud.mEnvelopeRange = 0.3f;
+	logMsg("playing dense grain cloud.");
+	cloud.start();
+	runTest(player, 10);
+	logMsg("done (%d grains playing, %d dropped).", cloud.numGrains(), cloud.numDropped());
+	cloud.stop();
 }
 
 #endif
@@ -453,6 +503,7 @@ testStruct srcTestList[] = {
 	"Noise tests",				testNoises,				"Test noise generators",
 	"Plucked string",			testString,				"Waves of string arpeggii, stereo with reverb",
 	"String melodies",			testStringChorus,		"Many random string arpeggii",
+	"String bank",				testStringBank,			"Fast arpeggii on a 64-string bank",
 	"Mono snd file player",		testMonoFilePlayer,		"Test playing a sound file",
 	"Stereo snd file player",	testStereoFilePlayer,	"Play a stereo sound file",
 #ifdef USE_MP3	
@@ -469,6 +520,7 @@ testStruct srcTestList[] = {
 	"Vector IFFT",				test_vector_ifft,		"Vector synthesis with 2 IFFTs",
 #ifndef CSL_WINDOWS
 	"Soundfile granulation",	testGrainCloud,			"Random sound file granulation example",
+	"Dense grain cloud",		testDenseCloud,			"Thousands of overlapping grains",
 #endif
 	NULL,						NULL,					NULL
 };
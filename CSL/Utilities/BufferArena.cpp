@@ -0,0 +1,377 @@
+//
+//  BufferArena.cpp -- aligned sample storage and graph-wide buffer sharing
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "BufferArena.h"
+#include "GraphExecutor.h"		// (for its lane limit)
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+	#include <malloc.h>
+#else
+	#include <sched.h>
+#endif
+
+using namespace csl;
+
+// aligned system allocation (the chunks and the blocks too big for the size classes)
+
+static void * alignedMalloc(unsigned numBytes) {
+	void * ptr = NULL;
+#ifdef WIN32
+	ptr = _aligned_malloc(numBytes, CSL_BUFFER_ALIGN);
+#else
+	if (posix_memalign(& ptr, CSL_BUFFER_ALIGN, numBytes) != 0)
+		ptr = NULL;
+#endif
+	return ptr;
+}
+
+static void alignedFree(void * ptr) {
+#ifdef WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+#pragma mark BufferArena
+
+// the default arena is created on first use and never deleted (Buffers may outlive main())
+
+BufferArena * BufferArena::defaultArena() {
+	static BufferArena * sDefault = NULL;
+	if (sDefault == NULL)
+		sDefault = new BufferArena;
+	return sDefault;
+}
+
+BufferArena::BufferArena() : mNext(NULL), mLeft(0), mLock(0), mBytesInUse(0), mBytesReserved(0),
+				mLimit(0) {
+	for (unsigned i = 0; i < CSL_ARENA_CLASSES; i++)
+		mFree[i] = NULL;
+}
+
+BufferArena::~BufferArena() {
+	for (unsigned i = 0; i < mChunks.size(); i++)
+		alignedFree(mChunks[i]);
+}
+
+// the spin lock; this is only contended when buffers are allocated on several threads at once
+
+void BufferArena::lock() {
+	while ( ! csl_atomic_cas(& mLock, 0, 1)) {
+#ifndef WIN32
+		sched_yield();
+#endif
+	}
+}
+
+void BufferArena::unlock() {
+	csl_memory_barrier();
+	mLock = 0;
+}
+
+// size classes are 64 bytes, then 128 << n and 192 << n (all multiples of CSL_BUFFER_ALIGN)
+
+unsigned BufferArena::classSize(unsigned which) {
+	if (which == 0)
+		return CSL_BUFFER_ALIGN;
+	unsigned size = (2 * CSL_BUFFER_ALIGN) << ((which - 1) / 2);
+	if (((which - 1) % 2) == 1)
+		size += size / 2;
+	return size;
+}
+
+// answer the smallest class numBytes fits in, or CSL_ARENA_CLASSES if it's too big
+
+unsigned BufferArena::sizeClass(unsigned numBytes) {
+	unsigned which = 0;
+	while ((which < CSL_ARENA_CLASSES) && (classSize(which) < numBytes))
+		which++;
+	return which;
+}
+
+// binary search of the (sorted) chunks for the one holding the given block
+
+unsigned BufferArena::chunkOf(void * block) {
+	unsigned lo = 0;
+	unsigned hi = mChunks.size();
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+		if ((char *) block < mChunks[mid])
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return lo;
+}
+
+// answer a block from the free list, the current chunk, or a new chunk
+
+SampleBuffer BufferArena::allocate(unsigned numBytes) throw (MemoryError) {
+	unsigned which = sizeClass(numBytes);
+	if (which >= CSL_ARENA_CLASSES) {				// big blocks go straight to the system
+		void * ptr = alignedMalloc(numBytes);
+		if (ptr == NULL)
+			throw MemoryError("can't allocate buffer storage");
+		csl_atomic_add(& mBytesInUse, numBytes);
+		return (SampleBuffer) ptr;
+	}
+	unsigned size = classSize(which);
+	void * ptr;
+	lock();
+	if (mFree[which]) {								// pop the free list
+		ptr = mFree[which];
+		mFree[which] = * ((void **) ptr);
+	} else {
+		if (mLeft < size) {							// get a new chunk (the rest of the old one is lost)
+			if (mLimit && (mBytesReserved + CSL_ARENA_CHUNK > mLimit))
+				trimLocked();						// (over the limit: free what we can first)
+			if (mLimit && (mBytesReserved + CSL_ARENA_CHUNK > mLimit)) {
+				unlock();
+				throw MemoryError("buffer arena limit reached");
+			}
+			mNext = (char *) alignedMalloc(CSL_ARENA_CHUNK);
+			if (mNext == NULL) {
+				mLeft = 0;
+				unlock();
+				throw MemoryError("can't allocate buffer arena chunk");
+			}
+			unsigned pos = 0;						// keep the chunks sorted
+			while ((pos < mChunks.size()) && (mChunks[pos] < mNext))
+				pos++;
+			mChunks.insert(mChunks.begin() + pos, mNext);
+			mChunkUse.insert(mChunkUse.begin() + pos, 0);
+			mLeft = CSL_ARENA_CHUNK;
+			mBytesReserved += CSL_ARENA_CHUNK;
+		}
+		ptr = mNext;
+		mNext += size;
+		mLeft -= size;
+	}
+	mChunkUse[chunkOf(ptr)]++;
+	mBytesInUse += size;
+	unlock();
+	return (SampleBuffer) ptr;
+}
+
+// push a block onto its free list
+
+void BufferArena::release(SampleBuffer block, unsigned numBytes) {
+	if (block == NULL)
+		return;
+	unsigned which = sizeClass(numBytes);
+	if (which >= CSL_ARENA_CLASSES) {
+		alignedFree(block);
+		csl_atomic_add(& mBytesInUse, - (long) numBytes);
+		return;
+	}
+	lock();
+	* ((void **) block) = mFree[which];
+	mFree[which] = block;
+	mChunkUse[chunkOf(block)]--;
+	mBytesInUse -= classSize(which);
+	unlock();
+}
+
+// Give the chunks none of whose blocks are in use back to the system: first drop their
+// blocks from the free lists, then free them (this isn't real-time-safe)
+
+unsigned BufferArena::trim() {
+	lock();
+	unsigned freed = trimLocked();
+	unlock();
+	return freed;
+}
+
+unsigned BufferArena::trimLocked() {
+	for (unsigned i = 0; i < CSL_ARENA_CLASSES; i++) {
+		void ** link = & mFree[i];
+		while (* link) {
+			if (mChunkUse[chunkOf(* link)] == 0)
+				* link = * ((void **) * link);		// unlink it
+			else
+				link = (void **) * link;
+		}
+	}
+	unsigned freed = 0;
+	for (unsigned i = mChunks.size(); i-- > 0; ) {
+		if (mChunkUse[i] != 0)
+			continue;
+		if ((mNext != NULL) && (mNext >= mChunks[i]) && (mNext <= mChunks[i] + CSL_ARENA_CHUNK)) {
+			mNext = NULL;							// (it's the current chunk)
+			mLeft = 0;
+		}
+		alignedFree(mChunks[i]);
+		mChunks.erase(mChunks.begin() + i);
+		mChunkUse.erase(mChunkUse.begin() + i);
+		mBytesReserved -= CSL_ARENA_CHUNK;
+		freed += CSL_ARENA_CHUNK;
+	}
+	return freed;
+}
+
+#pragma mark BufferPlan
+
+BufferPlan::BufferPlan(BufferArena * arena) : mArena(arena), mBytesSaved(0) {
+	if (mArena == NULL)
+		mArena = BufferArena::defaultArena();
+}
+
+BufferPlan::~BufferPlan() {
+	release();
+}
+
+// Answer the nodes the given one pulls: the UGens plugged into its ports, plus the
+// sources it declares as parallel inputs (e.g., a Mixer's or panner's sources)
+
+void BufferPlan::children(UnitGenerator * node, UGenVector & kids) {
+	kids.clear();
+	node->parallelInputs(kids, (unsigned) -1);
+	Controllable * cont = dynamic_cast<Controllable *>(node);
+	if (cont == NULL)
+		return;
+	PortMap & ports = cont->inputs();
+	for (PortMap::iterator it = ports.begin(); it != ports.end(); it++) {
+		Port * thePort = it->second;
+		if (thePort && thePort->mUGen)
+			kids.push_back(thePort->mUGen);
+	}
+}
+
+// 1st pass: count the paths to each node and its parents in the plan; only descend on the first visit
+
+void BufferPlan::countPaths(UnitGenerator * node) {
+	if (mVisits[node]++ > 0)
+		return;
+	UGenVector kids;
+	children(node, kids);
+	for (unsigned i = 0; i < kids.size(); i++) {
+		unsigned j = 0;
+		while ((j < i) && (kids[j] != kids[i]))		// (count each parent once)
+			j++;
+		if (j == i)
+			mParents[kids[i]]++;
+		countPaths(kids[i]);
+	}
+}
+
+// 2nd pass: give each port of an unshared node the slot for its (lane, depth, index)
+
+void BufferPlan::assign(UnitGenerator * node, unsigned lane, unsigned depth, bool shared) {
+	if (mAssigned[node])
+		return;
+	mAssigned[node] = true;
+	if (mLanes.find(node) != mLanes.end())
+		lane = mLanes[node];
+	if ((mVisits[node] > 1) || (node->numOutputs() > 1))
+		shared = true;						// fan-out: this node's depth isn't unique
+	if (node->keepsInputs())
+		shared = true;						// its inputs are read outside its nextBuffer()
+	if ((depth > 0) && (node->numOutputs() > mParents[node]))
+		shared = true;						// an output outside the plan may pull it at any time
+	Controllable * cont = shared ? NULL : dynamic_cast<Controllable *>(node);
+	if (cont) {
+		PortMap & ports = cont->inputs();
+		unsigned index = 0;
+		for (PortMap::iterator it = ports.begin(); it != ports.end(); it++) {
+			Port * thePort = it->second;
+			if ((thePort == NULL) || (thePort->mUGen == NULL) || (thePort->mBuffer == NULL))
+				continue;
+			Buffer * buf = thePort->mBuffer;
+			if ( ! buf->mDidIAllocateBuffers)		// not a plain port buffer
+				continue;
+			unsigned numBytes = buf->mNumChannels * BufferArena::stride(buf->mNumAlloc);
+			mPorts.push_back(thePort);
+			mPortSlots.push_back(slotFor(lane, depth, index++, numBytes));
+			mBytesSaved += numBytes;
+		}
+	}
+	UGenVector kids;
+	children(node, kids);
+	for (unsigned i = 0; i < kids.size(); i++)
+		assign(kids[i], lane, depth + 1, shared);
+}
+
+// answer the index of the slot for the given key, growing it to numBytes if needed
+
+unsigned BufferPlan::slotFor(unsigned lane, unsigned depth, unsigned index, unsigned numBytes) {
+	for (unsigned i = 0; i < mSlots.size(); i++) {
+		PlanSlot & slot = mSlots[i];
+		if ((slot.mLane == lane) && (slot.mDepth == depth) && (slot.mIndex == index)) {
+			if (slot.mBytes < numBytes)
+				slot.mBytes = numBytes;
+			return i;
+		}
+	}
+	PlanSlot slot;
+	slot.mLane = lane;
+	slot.mDepth = depth;
+	slot.mIndex = index;
+	slot.mBytes = numBytes;
+	slot.mStorage = NULL;
+	mSlots.push_back(slot);
+	return mSlots.size() - 1;
+}
+
+// Plan the graph: walk it twice, then allocate the slots and point the ports' buffers at them.
+// This must not be called while the graph is being rendered.
+
+unsigned BufferPlan::plan(UnitGenerator & root, bool parallel) {
+	release();
+	if (parallel) {							// find the lanes the same way the GraphExecutor does
+		UGenVector lanes;
+		UnitGenerator * node = & root;
+		for (unsigned depth = 0; depth < 4; depth++) {
+			lanes.clear();
+			node->parallelInputs(lanes, CSL_MAX_EXEC_NODES);
+			if (lanes.size() != 1)
+				break;
+			node = lanes[0];
+		}
+		if (lanes.size() > 1)
+			for (unsigned i = 0; i < lanes.size(); i++)
+				mLanes[lanes[i]] = i + 1;
+	}
+	countPaths(& root);
+	assign(& root, 0, 0, false);
+	mVisits.clear();
+	mParents.clear();
+	mLanes.clear();
+	mAssigned.clear();
+
+	for (unsigned i = 0; i < mSlots.size(); i++) {
+		mSlots[i].mStorage = mArena->allocate(mSlots[i].mBytes);
+		memset(mSlots[i].mStorage, 0, mSlots[i].mBytes);
+		mBytesSaved -= mSlots[i].mBytes;
+	}
+	for (unsigned i = 0; i < mPorts.size(); i++) {
+		mPorts[i]->mBuffer->shareStorage(mSlots[mPortSlots[i]].mStorage);
+		mPorts[i]->resetPtr();
+	}
+	logMsg("BufferPlan: %d ports share %d buffers (%d bytes saved)",
+			mPorts.size(), mSlots.size(), mBytesSaved);
+	return mPorts.size();
+}
+
+// give the ports back their own buffers (unless they've re-allocated them since) and free the slots
+
+void BufferPlan::release() {
+	for (unsigned i = 0; i < mPorts.size(); i++) {
+		Buffer * buf = mPorts[i]->mBuffer;
+		if ( ! buf->mDidIAllocateBuffers) {
+			buf->setSizeOnly(buf->mNumChannels, buf->mNumAlloc);
+			buf->allocateBuffers();
+			mPorts[i]->resetPtr();
+		}
+	}
+	for (unsigned i = 0; i < mSlots.size(); i++)
+		mArena->release(mSlots[i].mStorage, mSlots[i].mBytes);
+	mPorts.clear();
+	mPortSlots.clear();
+	mSlots.clear();
+	mBytesSaved = 0;
+}
@@ -0,0 +1,142 @@
+//
+//  BufferArena.h -- aligned sample storage and graph-wide buffer sharing
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// The BufferArena hands out 64-byte-aligned blocks of sample storage carved out of large
+// chunks, and keeps released blocks on per-size-class free lists, so buffers that are
+// re-allocated (e.g., as voices come and go) don't go back to the system allocator.
+// The size classes go up in steps of 2 and 1.5 (64, 128, 192, 256, 384, ...), so a block
+// wastes at most a third of its size. trim() gives the chunks whose blocks are all free back
+// to the system, and setLimit() puts a bound on the storage the arena takes (it trims, then
+// throws a MemoryError, when a new chunk would go over it).
+// Buffer::allocateBuffers() takes one contiguous planar block from the default arena for
+// all of its channels; each channel starts on an aligned boundary (see BufferArena::stride()),
+// so SIMD loads and stores never split a cache line.
+//
+// The BufferPlan is a liveness pass over a DSP graph: a Port's buffer is only live from
+// the time its consumer pulls it until the consumer's nextBuffer() returns, and two
+// consumers at the same depth below the root are never active at the same time (they're
+// both called in turn from the same parent chain). So the ports of all consumers at the
+// same depth can share one set of buffers. Nodes that are reachable along more than one
+// path (fan-out) keep private buffers, as do the nodes below them, since their depth isn't
+// unique. If the graph is rendered by a GraphExecutor, plan it "parallel" so that each
+// independent sub-graph (lane) gets its own set of shared buffers.
+// Only the readers the plan can see are accounted for, so a node keeps its own buffers (as do
+// the nodes below it) if one of its outputs isn't in the plan (it may be pulled at any time)
+// or if it reads its inputs' buffers after its nextBuffer() returns (keepsInputs(), e.g., FanOut).
+//
+// Usage:
+//		BufferPlan plan;				// declare this after the graph (it must be deleted first)
+//		plan.plan(mix);					// share the port buffers below the mixer
+//		logMsg("saved %d bytes", plan.bytesSaved());
+//
+
+#ifndef CSL_BufferArena_H
+#define CSL_BufferArena_H
+
+#include "CSL_Core.h"
+
+namespace csl {
+
+#define CSL_BUFFER_ALIGN 64					///< byte alignment of sample storage (cache line/AVX-512)
+#define CSL_ARENA_CHUNK (256 * 1024)		///< bytes per arena chunk
+#define CSL_ARENA_CLASSES 24				///< # of size classes (64 bytes to 256 kB)
+
+///
+/// BufferArena -- an aligned, pooling allocator for sample storage
+///
+
+class BufferArena {
+public:
+	BufferArena();								///< Constructor (allocates nothing)
+	~BufferArena();								///< Destructor frees all the chunks
+
+	static BufferArena * defaultArena();		///< the arena used by Buffer::allocateBuffers()
+												/// answer the aligned byte size of a channel of numFrames
+	static unsigned stride(unsigned numFrames) {
+		return (numFrames * sizeof(sample) + CSL_BUFFER_ALIGN - 1) & ~(CSL_BUFFER_ALIGN - 1);
+	};
+												/// answer an aligned block of at least numBytes
+	SampleBuffer allocate(unsigned numBytes) throw (MemoryError);
+												/// return a block (pass the size it was allocated with)
+	void release(SampleBuffer block, unsigned numBytes);
+
+	unsigned trim();							///< free the unused chunks; answer the # of bytes freed
+												/// get/set the max # of bytes of chunks (0 = no limit)
+	unsigned limit() { return mLimit; };
+	void setLimit(unsigned numBytes) { mLimit = numBytes; };
+
+	unsigned bytesInUse() { return (unsigned) mBytesInUse; };	///< answer the # of bytes handed out
+	unsigned bytesReserved() { return mBytesReserved; };		///< answer the # of bytes taken from the system
+
+protected:
+	std::vector<char *> mChunks;				///< the big blocks we carve up (sorted by address)
+	std::vector<unsigned> mChunkUse;			///< and the # of blocks of each one handed out
+	char * mNext;								///< the free space in the current chunk
+	unsigned mLeft;								///< and its size
+	void * mFree[CSL_ARENA_CLASSES];			///< free lists (linked through the blocks' 1st word)
+	AtomicCounter mLock;						///< spin lock around the lists
+	AtomicCounter mBytesInUse;					///< statistics
+	unsigned mBytesReserved;
+	unsigned mLimit;
+
+	unsigned sizeClass(unsigned numBytes);		///< answer the size class index for numBytes
+	static unsigned classSize(unsigned which);	///< answer the block size of a size class
+	unsigned chunkOf(void * block);				///< answer the index of the chunk a block is in
+	unsigned trimLocked();						///< trim() with the lock held
+	void lock();								///< grab/release the spin lock
+	void unlock();
+};
+
+///
+/// PlanSlot -- a shared buffer for all the ports at a given depth/index/lane
+///
+
+typedef struct {
+	unsigned mLane;				///< which parallel sub-graph
+	unsigned mDepth;			///< depth of the consumer below the root
+	unsigned mIndex;			///< index of the port within the consumer
+	unsigned mBytes;			///< max size needed by the ports that share it
+	SampleBuffer mStorage;		///< the storage (from the arena)
+} PlanSlot;
+
+///
+/// BufferPlan -- share the port buffers of a graph based on their liveness
+///
+
+class BufferPlan {
+public:
+	BufferPlan(BufferArena * arena = NULL);		///< Constructor (default arena if NULL)
+	~BufferPlan();								///< Destructor restores the ports' private buffers
+
+												/// plan the graph below the given root; answer the # of shared ports
+												/// (parallel: give each independent sub-graph its own slots)
+	unsigned plan(UnitGenerator & root, bool parallel = false);
+	void release();								///< give the ports back their own buffers
+
+	unsigned numPorts() { return mPorts.size(); };		///< answer the # of shared ports
+	unsigned numSlots() { return mSlots.size(); };		///< answer the # of shared buffers
+	unsigned bytesSaved() { return mBytesSaved; };		///< answer the storage savings
+
+protected:
+	BufferArena * mArena;						///< where the slots come from
+	std::vector<PlanSlot> mSlots;				///< the shared buffers
+	std::vector<Port *> mPorts;					///< the ports that use them
+	std::vector<unsigned> mPortSlots;			///< and which slot each one uses
+	unsigned mBytesSaved;
+												/// graph walk state
+	std::map<UnitGenerator *, unsigned> mVisits;	///< # of paths to each node
+	std::map<UnitGenerator *, unsigned> mParents;	///< # of nodes in the plan that pull each node
+	std::map<UnitGenerator *, unsigned> mLanes;		///< the lane roots
+	std::map<UnitGenerator *, bool> mAssigned;		///< nodes whose ports are done
+
+	void children(UnitGenerator * node, UGenVector & kids);	///< answer the nodes pulled by the given one
+	void countPaths(UnitGenerator * node);					///< 1st pass: find the fan-out nodes
+	void assign(UnitGenerator * node, unsigned lane, unsigned depth, bool shared);	///< 2nd pass
+	unsigned slotFor(unsigned lane, unsigned depth, unsigned index, unsigned numBytes);
+};
+
+}
+
+#endif
@@ -17,7 +17,7 @@
 #include "BinaryOp.h"
 #include "Clipper.h"			/// clipper/distortion
 #include "DelayLine.h"
-//#include "Convolver.h"
+#include "Convolver.h"			/// partitioned convolution
 //#include "FDN.h"
 
 #ifndef CSL_WINDOWS
@@ -0,0 +1,182 @@
+//
+//  GraphExecutor.cpp -- multi-threaded pre-rendering of independent sub-graphs
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "GraphExecutor.h"
+#include "RealTimeCheck.h"
+#include "UGenProfiler.h"
+#include <sched.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+using namespace csl;
+
+// Constructor starts the worker threads; they sleep on the semaphore until there's work.
+// (It's a named semaphore, as unnamed ones aren't supported everywhere; the name is unlinked
+// right away.)
+
+GraphExecutor::GraphExecutor(unsigned numThreads, bool realTime)
+			: mNumThreads(numThreads), mWake(NULL), mRunning(true),
+			  mNumFrames(0), mSequence(0), mNextNode(0), mNodesLeft(0), mActive(0) {
+	if (mNumThreads > CSL_MAX_EXEC_THREADS)
+		mNumThreads = CSL_MAX_EXEC_THREADS;
+	mCandidates.reserve(CSL_MAX_EXEC_NODES);	// so the callback never grows them
+	mNodes.reserve(CSL_MAX_EXEC_NODES);
+	char name[64];
+	sprintf(name, "/csl_exec_%d_%lx", (int) getpid(), (unsigned long) this);
+	mWake = sem_open(name, O_CREAT | O_EXCL, 0600, 0);
+	if (mWake == (sem_t *) SEM_FAILED) {
+		logMsg(kLogError, "GraphExecutor: can't create the wake-up semaphore; rendering serially");
+		mWake = NULL;
+		mNumThreads = 0;
+	} else
+		sem_unlink(name);
+	pthread_attr_t attr;
+	pthread_attr_init(& attr);
+	if (realTime) {						// ask for RT priority; this fails silently if we're not allowed
+		struct sched_param param;
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+		pthread_attr_setinheritsched(& attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(& attr, SCHED_FIFO);
+		pthread_attr_setschedparam(& attr, & param);
+	}
+	unsigned started = 0;				// (only the threads that started count)
+	for (unsigned i = 0; i < mNumThreads; i++) {
+		int err = pthread_create(& mThreads[started], & attr, workerLoop, this);
+		if ((err != 0) && realTime)		// retry w/o RT scheduling
+			err = pthread_create(& mThreads[started], NULL, workerLoop, this);
+		if (err == 0)
+			started++;
+		else
+			logMsg(kLogError, "GraphExecutor: can't start worker thread %d (error %d)", i, err);
+	}
+	pthread_attr_destroy(& attr);
+	mNumThreads = started;
+	logMsg("GraphExecutor: started %d worker threads", mNumThreads);
+}
+
+// Destructor stops and joins the workers
+
+GraphExecutor::~GraphExecutor() {
+	while (mActive > 0)					// let the workers finish the last batch
+		sched_yield();
+	mRunning = false;
+	csl_memory_barrier();
+	for (unsigned i = 0; i < mNumThreads; i++)
+		sem_post(mWake);
+	for (unsigned i = 0; i < mNumThreads; i++)
+		pthread_join(mThreads[i], NULL);
+	if (mWake)
+		sem_close(mWake);
+}
+
+// Collect the root's independent inputs; if there's only one, look inside it
+// (e.g., a Spatializer or an Effect wrapped around a Mixer)
+
+void GraphExecutor::collectInputs(UnitGenerator & root, UGenVector & inputs) {
+	UnitGenerator * node = & root;
+	for (unsigned depth = 0; depth < 4; depth++) {
+		inputs.clear();
+		node->parallelInputs(inputs, CSL_MAX_EXEC_NODES);	// (never more than mCandidates holds)
+		if (inputs.size() != 1)
+			break;
+		node = inputs[0];
+	}
+}
+
+// Set up the graph's independent inputs to cache their output; this allocates the caches,
+// so it's done here rather than in the callback (it works on its own list, so it's safe to
+// call while the callback is running)
+
+void GraphExecutor::prepare(UnitGenerator & root) {
+	UGenVector inputs;
+	collectInputs(root, inputs);
+	if (inputs.size() < 2)				// nothing to run in parallel
+		return;
+	for (UGenVector::iterator it = inputs.begin(); it != inputs.end(); it++)
+		(*it)->setCacheOutput(true);	// results go into the output caches
+}
+
+// Pre-render the given graph's independent inputs for the sequence # of the given buffer
+
+void GraphExecutor::prefetch(UnitGenerator & root, Buffer & outputBuffer) {
+	collectInputs(root, mCandidates);
+	if (mCandidates.size() < 2)			// nothing to run in parallel
+		return;
+	render(mCandidates, outputBuffer.mNumFrames, outputBuffer.mSequence);
+}
+
+// Render the given list of UGens concurrently; this hands the list to the workers and
+// then helps out, returning once all the nodes are done. Only nodes that cache their output
+// (see prepare()) are taken; the rest are left to the serial pull.
+// A worker counts as active from the post until it's done with the batch, so once none are,
+// no one is reading the node list and it's safe to swap in the new one.
+
+void GraphExecutor::render(UGenVector & nodes, unsigned numFrames, unsigned sequence) {
+	while (mActive > 0)							// let late workers leave the last batch
+		csl_memory_barrier();
+	mNodes.clear();
+	for (UGenVector::iterator it = nodes.begin(); it != nodes.end(); it++)
+		if ((*it)->cachesOutput() && (mNodes.size() < mNodes.capacity()))
+			mNodes.push_back(*it);				// (never grows the list)
+	mNumFrames = numFrames;
+	mSequence = sequence;
+	mNextNode = 0;
+	mNodesLeft = (long) mNodes.size();
+	mActive = (long) mNumThreads;
+	csl_memory_barrier();						// publish the batch before waking the workers
+	for (unsigned i = 0; i < mNumThreads; i++)
+		sem_post(mWake);
+
+	runNodes();									// help out
+	while (mNodesLeft > 0)						// wait for the stragglers
+		csl_memory_barrier();
+}
+
+// Claim and render nodes until none are left; they render straight into their output
+// caches (see UnitGenerator::outputView()) under their fan-out locks; a node whose cache
+// is too small for the block is left to the serial pull
+
+void GraphExecutor::runNodes() {
+	unsigned numNodes = mNodes.size();
+	UnitGenerator::setBlockSequence(mSequence);	// (it's per-thread) so port buffers get the right seq #
+	while (true) {
+		unsigned index = (unsigned) csl_atomic_add(& mNextNode, 1);
+		if (index >= numNodes)
+			return;
+		UnitGenerator * node = mNodes[index];
+		try {
+			CSL_RT_UGEN_SCOPE(node);
+			CSL_PROFILE_SCOPE(node);
+			if (node->isActive())
+				node->outputView(mNumFrames, mSequence);
+		} catch (CException & ex) {
+			logMsg(kLogError, "GraphExecutor error: %s", ex.what());
+		}
+		csl_atomic_add(& mNodesLeft, -1);
+	}
+}
+
+// Worker thread function: wait to be posted, then run nodes
+
+void * GraphExecutor::workerLoop(void * arg) {
+	GraphExecutor * exec = (GraphExecutor *) arg;
+	while (true) {
+		if (sem_wait(exec->mWake) != 0) {
+			if (errno == EINTR)					// (interrupted by a signal)
+				continue;
+			break;
+		}
+		if ( ! exec->mRunning)
+			break;
+		{
+			CSL_RT_CALLBACK_SCOPE();			// workers render for the callback
+			exec->runNodes();
+		}
+		csl_atomic_add(& exec->mActive, -1);
+	}
+	return NULL;
+}
@@ -0,0 +1,82 @@
+//
+//  GraphExecutor.h -- multi-threaded pre-rendering of independent sub-graphs
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// The GraphExecutor owns a pool of worker threads that are woken once per IO callback.
+// Before the IO pulls its graph, it calls prefetch(), which asks the graph root for its
+// parallelInputs() (e.g., the sources of a Mixer or SpatialPanner) and renders these
+// sub-graphs concurrently on the workers (and on the calling thread).
+//
+// Each sub-graph root is put into cache-output mode by prepare() (outside the callback, as
+// that allocates the caches), so the pre-rendered block is rendered into its output cache
+// with the block's sequence number; when the root mixer/panner then pulls its inputs in the
+// normal serial order, they are served from the cache. Nodes that are shared between
+// sub-graphs are protected by the UnitGenerator fan-out lock and sequence check, so they're
+// computed exactly once per block, and the summing order is unchanged, so the output is
+// identical to the serial case. Inputs that weren't prepared (e.g., added to a mixer later)
+// are left to the serial pull.
+//
+// prefetch() doesn't allocate or take locks: the workers sleep on a semaphore, are posted
+// once per batch, and claim nodes with atomic counters.
+//
+// Usage:
+//		GraphExecutor exec(3);			// 3 worker threads + the IO thread
+//		theIO->setExecutor(& exec);		// (this and IO::setRoot() call prepare())
+//
+
+#ifndef CSL_GraphExecutor_H
+#define CSL_GraphExecutor_H
+
+#include "CSL_Core.h"
+#include <pthread.h>
+#include <semaphore.h>
+
+namespace csl {
+
+#define CSL_MAX_EXEC_THREADS 32			///< max # of worker threads
+#define CSL_MAX_EXEC_NODES 1024			///< max # of sub-graphs per batch (the lists are reserved up front)
+
+///
+/// GraphExecutor -- a worker pool that pre-renders a graph's independent inputs
+///
+
+class GraphExecutor {
+public:
+	GraphExecutor(unsigned numThreads = 2, bool realTime = true);	///< Constructor starts the workers
+	~GraphExecutor();												///< Destructor stops them
+
+	unsigned numThreads() { return mNumThreads; };	///< answer the # of worker threads
+													/// set up the given graph's independent inputs to be
+													/// pre-rendered (allocates their output caches, so
+													/// call it outside the callback when the graph changes)
+	void prepare(UnitGenerator & root);
+													/// pre-render the given graph's independent inputs
+													/// for the sequence # of the given buffer
+	void prefetch(UnitGenerator & root, Buffer & outputBuffer);
+													/// render the given list of UGens concurrently
+	void render(UGenVector & nodes, unsigned numFrames, unsigned sequence);
+
+protected:
+	unsigned mNumThreads;						///< # of worker threads
+	pthread_t mThreads[CSL_MAX_EXEC_THREADS];	///< the workers
+	sem_t * mWake;								///< posted once per worker for each batch of work
+	volatile bool mRunning;						///< cleared to stop the workers
+
+	UGenVector mCandidates;						///< the graph's independent inputs
+	UGenVector mNodes;							///< the current batch of sub-graph roots
+	unsigned mNumFrames;						///< and its block size
+	unsigned mSequence;							///< and its sequence #
+	AtomicCounter mNextNode;					///< index of the next node to claim
+	AtomicCounter mNodesLeft;					///< # of nodes not yet finished
+	AtomicCounter mActive;						///< # of workers posted but not yet done with the batch
+
+	void runNodes();							///< claim and render nodes until none are left
+	static void * workerLoop(void * arg);		///< worker thread function
+												/// find the independent sub-graphs
+	void collectInputs(UnitGenerator & root, UGenVector & inputs);
+};
+
+}
+
+#endif
@@ -0,0 +1,209 @@
+//
+//  RealTimeCheck.cpp -- debugging support for finding calls that aren't safe in the audio callback
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "RealTimeCheck.h"
+#include <stdlib.h>
+#include <typeinfo>
+#include <new>
+#ifdef __GNUC__
+	#include <cxxabi.h>						// to demangle the class names
+#endif
+#if (defined(__linux__) || defined(__APPLE__)) && ! defined(ANDROID)
+	#include <execinfo.h>
+	#define CSL_RT_BACKTRACE
+#endif
+
+using namespace csl;
+
+// Per-thread state: are we in the callback, which UGens are we rendering, and are we in report()
+// (which may allocate and log, and mustn't report itself)
+
+static CSL_THREAD_LOCAL unsigned sCallbackDepth = 0;
+static CSL_THREAD_LOCAL unsigned sNumUGens = 0;
+static CSL_THREAD_LOCAL UnitGenerator * sUGens[CSL_RT_MAX_DEPTH];
+static CSL_THREAD_LOCAL unsigned sReporting = 0;
+
+// Global state: the switches, counts and the (kind, class) pairs that have been logged
+
+static bool sEnabled = true;
+static bool sAbort = false;
+static bool sBacktrace = true;
+static AtomicCounter sCounts[CSL_NUM_RT_VIOLATIONS];
+static AtomicCounter sNumReported = 0;
+static RTViolation sReportedKinds[CSL_RT_MAX_REPORTS];
+static const char * sReportedClasses[CSL_RT_MAX_REPORTS];
+
+#pragma mark Hooks
+
+#ifdef CSL_RT_CHECK
+
+// the function behind CSL_RT_CHECK_CALL; this has to be cheap outside of the callback
+
+void csl::rtCheckCall(RTViolation kind, const char * what) {
+	if ((sCallbackDepth == 0) || (sReporting > 0) || ( ! sEnabled))
+		return;
+	RealTimeCheck::report(kind, what);
+}
+
+// Replace the global allocation operators so that any heap use in the callback is caught
+// (STL containers, strings, SAFE_MALLOC, etc.)
+
+void * operator new(size_t size) throw (std::bad_alloc) {
+	CSL_RT_CHECK_CALL(kRTAllocation, "operator new");
+	void * ptr = malloc(size ? size : 1);
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void * operator new[](size_t size) throw (std::bad_alloc) {
+	CSL_RT_CHECK_CALL(kRTAllocation, "operator new[]");
+	void * ptr = malloc(size ? size : 1);
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void * ptr) throw () {
+	if (ptr == NULL)
+		return;
+	CSL_RT_CHECK_CALL(kRTAllocation, "operator delete");
+	free(ptr);
+}
+
+void operator delete[](void * ptr) throw () {
+	if (ptr == NULL)
+		return;
+	CSL_RT_CHECK_CALL(kRTAllocation, "operator delete[]");
+	free(ptr);
+}
+
+#endif // CSL_RT_CHECK
+
+#pragma mark RealTimeCheck
+
+void RealTimeCheck::setEnabled(bool onOff) { sEnabled = onOff; }
+
+bool RealTimeCheck::enabled() { return sEnabled; }
+
+void RealTimeCheck::setAbort(bool onOff) { sAbort = onOff; }
+
+void RealTimeCheck::setBacktrace(bool onOff) { sBacktrace = onOff; }
+
+unsigned RealTimeCheck::count(RTViolation kind) {
+	return (kind < CSL_NUM_RT_VIOLATIONS) ? (unsigned) sCounts[kind] : 0;
+}
+
+unsigned RealTimeCheck::totalCount() {
+	unsigned total = 0;
+	for (unsigned i = 0; i < CSL_NUM_RT_VIOLATIONS; i++)
+		total += (unsigned) sCounts[i];
+	return total;
+}
+
+void RealTimeCheck::reset() {
+	for (unsigned i = 0; i < CSL_NUM_RT_VIOLATIONS; i++)
+		sCounts[i] = 0;
+	sNumReported = 0;
+}
+
+const char * RealTimeCheck::kindName(RTViolation kind) {
+	static const char * names[CSL_NUM_RT_VIOLATIONS] = {
+			"heap allocation", "lock", "sleep", "exception", "blocking I/O" };
+	return (kind < CSL_NUM_RT_VIOLATIONS) ? names[kind] : "unknown";
+}
+
+bool RealTimeCheck::inCallback() { return sCallbackDepth > 0; }
+
+void RealTimeCheck::enterCallback() { sCallbackDepth++; }
+
+void RealTimeCheck::exitCallback() {
+	if (sCallbackDepth > 0)
+		sCallbackDepth--;
+}
+
+// the UGen stack only keeps the outermost CSL_RT_MAX_DEPTH entries, but counts them all
+
+void RealTimeCheck::pushUGen(UnitGenerator * ugen) {
+	if (sNumUGens < CSL_RT_MAX_DEPTH)
+		sUGens[sNumUGens] = ugen;
+	sNumUGens++;
+}
+
+void RealTimeCheck::popUGen() {
+	if (sNumUGens > 0)
+		sNumUGens--;
+}
+
+// answer the demangled form of a class name from typeid(), without the csl:: prefix
+
+string RealTimeCheck::className(const char * name) {
+#ifdef __GNUC__
+	int status = 0;
+	char * demangled = abi::__cxa_demangle(name, NULL, NULL, & status);
+	if (demangled) {
+		string result(demangled);
+		free(demangled);
+		if (result.compare(0, 5, "csl::") == 0)
+			result.erase(0, 5);
+		return result;
+	}
+#endif
+	return string(name);
+}
+
+// answer whether this is the first violation of the given kind from the given class (and note it)
+
+static bool firstReport(RTViolation kind, const char * key) {
+	unsigned numReported = (unsigned) sNumReported;
+	for (unsigned i = 0; (i < numReported) && (i < CSL_RT_MAX_REPORTS); i++)
+		if ((sReportedKinds[i] == kind) && (sReportedClasses[i] == key))
+			return false;
+	unsigned slot = (unsigned) csl_atomic_add(& sNumReported, 1);
+	if (slot < CSL_RT_MAX_REPORTS) {
+		sReportedKinds[slot] = kind;
+		sReportedClasses[slot] = key;
+	}
+	return true;
+}
+
+// Count a violation, and log it with the UGen chain and a backtrace if it's the first
+// from this class; the type_info name pointer serves as the class key
+
+void RealTimeCheck::report(RTViolation kind, const char * what) {
+	if (kind >= CSL_NUM_RT_VIOLATIONS)
+		return;
+	sReporting++;
+	csl_atomic_add(& sCounts[kind], 1);
+	unsigned depth = csl_min(sNumUGens, (unsigned) CSL_RT_MAX_DEPTH);
+	UnitGenerator * ugen = depth ? sUGens[depth - 1] : NULL;
+	const char * key = ugen ? typeid(* ugen).name() : "";
+	if (firstReport(kind, key)) {
+		string chain;
+		for (int i = (int) depth - 1; i >= 0; i--) {		// innermost first
+			if ((i < (int) depth - 1) && (sUGens[i] == sUGens[i + 1]))
+				continue;									// (pushed by both pullInput and nextBuffer)
+			if ( ! chain.empty())
+				chain += " <- ";
+			chain += className(typeid(* sUGens[i]).name());
+		}
+		if (chain.empty())
+			chain = "IO::pullInput";
+		logMsg(kLogError, "RealTimeCheck: %s (%s) in the audio callback\n\tin %s",
+				kindName(kind), what, chain.c_str());
+#ifdef CSL_RT_BACKTRACE
+		if (sBacktrace) {
+			void * frames[32];
+			int numFrames = backtrace(frames, 32);
+			if (numFrames > 2)								// skip report() and rtCheckCall()
+				backtrace_symbols_fd(frames + 2, numFrames - 2, 2);
+		}
+#endif
+	}
+	sReporting--;
+	if (sAbort)
+		abort();
+}
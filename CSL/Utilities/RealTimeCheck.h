@@ -0,0 +1,84 @@
+//
+//  RealTimeCheck.h -- debugging support for finding calls that aren't safe in the audio callback
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// When CSL is built with CSL_RT_CHECK defined (see CSL_Types.h), the calls that can block the
+// audio thread report themselves: heap allocation and free (global operator new/delete),
+// Synch locks and waits, sleepUsec() and friends, CException construction, logMsg() and sound
+// file reads/writes. A call is only a violation if the calling thread is inside IO::pullInput()
+// (or is a GraphExecutor worker rendering part of the graph for it).
+//
+// The first violation of each kind from each UGen class is logged with the chain of UGens
+// being rendered (innermost first) and, where the platform has it, a native backtrace; all of
+// them are counted. Call setAbort(true) to stop at the first one (e.g., under a debugger).
+//
+// Usage (in a -DCSL_RT_CHECK build):
+//		RealTimeCheck::setEnabled(true);		// the default
+//		... run the graph for a while ...
+//		logMsg("%d allocations in the callback", RealTimeCheck::count(kRTAllocation));
+//
+
+#ifndef CSL_RealTimeCheck_H
+#define CSL_RealTimeCheck_H
+
+#include "CSL_Core.h"
+
+namespace csl {
+
+#define CSL_RT_MAX_DEPTH 64					///< max depth of the UGen chain we keep track of
+#define CSL_RT_MAX_REPORTS 128				///< max # of (kind, class) pairs logged in detail
+
+///
+/// RealTimeCheck -- the checker's (static) state and reporting
+///
+
+class RealTimeCheck {
+public:
+	static void setEnabled(bool onOff);			///< turn checking on/off (default on)
+	static bool enabled();
+	static void setAbort(bool onOff);			///< abort() on the first violation (default off)
+	static void setBacktrace(bool onOff);		///< log native backtraces (default on)
+
+	static unsigned count(RTViolation kind);	///< answer the # of violations of a kind so far
+	static unsigned totalCount();				///< answer the # of violations so far
+	static void reset();						///< clear the counts and the list of logged ones
+	static const char * kindName(RTViolation kind);	///< answer "heap allocation", etc.
+	static string className(const char * name);	///< demangle a class name from typeid()
+
+	static bool inCallback();					///< answer whether this thread is in the callback
+	static void enterCallback();				///< mark this thread as in/out of the callback
+	static void exitCallback();
+	static void pushUGen(UnitGenerator * ugen);	///< keep track of which UGen this thread is rendering
+	static void popUGen();
+												/// report a violation (called via CSL_RT_CHECK_CALL)
+	static void report(RTViolation kind, const char * what);
+};
+
+///
+/// Scope guards for IO::pullInput() and the UGen calls; these pop themselves if an exception is thrown
+///
+
+class RTCallbackScope {
+public:
+	RTCallbackScope() { RealTimeCheck::enterCallback(); };
+	~RTCallbackScope() { RealTimeCheck::exitCallback(); };
+};
+
+class RTUGenScope {
+public:
+	RTUGenScope(UnitGenerator * ugen) { RealTimeCheck::pushUGen(ugen); };
+	~RTUGenScope() { RealTimeCheck::popUGen(); };
+};
+
+#ifdef CSL_RT_CHECK
+	#define CSL_RT_CALLBACK_SCOPE()		RTCallbackScope rtCallbackScope
+	#define CSL_RT_UGEN_SCOPE(ugen)		RTUGenScope rtUGenScope(ugen)
+#else
+	#define CSL_RT_CALLBACK_SCOPE()
+	#define CSL_RT_UGEN_SCOPE(ugen)
+#endif
+
+}
+
+#endif
@@ -185,7 +185,7 @@ RingBuffer::RingBuffer(UnitGenerator & input, unsigned int nmChannels, unsigned
 // Buffer nextBuffer reads from the default tap
 
 void RingBuffer::nextBuffer(Buffer &outputBuffer) throw(CException) {
-	if (mInputs[CSL_INPUT]) {
+	if (mPortSlots[CSL_INPUT]) {
 		Effect::pullInput(outputBuffer);
 		writeBuffer(outputBuffer);
 	}
@@ -0,0 +1,169 @@
+//
+//  TableRegistry.cpp -- a shared, reference-counted store of read-only tables
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "TableRegistry.h"
+#include <pthread.h>
+
+using namespace csl;
+
+// A registered table and its clients (pre-warming counts as one client that never lets go)
+
+typedef struct {
+	Buffer * table;
+	unsigned refs;
+	bool pinned;
+} TableEntry;
+
+typedef std::map<string, TableEntry> TableMap;
+
+// The tables (by key) and the lock that guards them; the lock is held while a table is built,
+// so two clients asking for the same new table don't both build it
+
+static TableMap * sTables = NULL;
+static pthread_mutex_t sTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+static TableMap & tables() {
+	if ( ! sTables)
+		sTables = new TableMap;
+	return * sTables;
+}
+
+// answer the entry for a table (by pointer), or end()
+
+static TableMap::iterator entryFor(Buffer * table) {
+	TableMap::iterator it;
+	for (it = tables().begin(); it != tables().end(); it++)
+		if (it->second.table == table)
+			break;
+	return it;
+}
+
+// Find or build a table; the contents are filled in before anyone else can see it. Anything a
+// build throws (CExceptions, bad_alloc or whatever the generator throws) releases the lock and
+// the half-built table before it's passed on.
+
+Buffer * TableRegistry::acquire(TableGenerator & generator) {
+	string key = generator.key();
+	TableEntry entry;
+	entry.table = NULL;
+	pthread_mutex_lock(& sTableLock);
+	try {
+		TableMap::iterator it = tables().find(key);
+		if (it != tables().end()) {
+			it->second.refs++;
+			pthread_mutex_unlock(& sTableLock);
+			return it->second.table;
+		}
+		CSL_RT_CHECK_CALL(kRTAllocation, "TableRegistry::acquire (building a table)");
+		entry.table = new Buffer(generator.numChannels(), generator.numFrames());
+		entry.table->allocateBuffers();
+		generator.fill(* entry.table);
+		entry.table->mIsPopulated = true;
+		entry.table->mAreBuffersZero = false;
+		entry.refs = 1;
+		entry.pinned = false;
+		tables()[key] = entry;
+	} catch (...) {
+		pthread_mutex_unlock(& sTableLock);
+		if (entry.table)
+			delete entry.table;
+		throw;
+	}
+	pthread_mutex_unlock(& sTableLock);
+	return entry.table;
+}
+
+Buffer * TableRegistry::find(const string & key) {
+	Buffer * table = NULL;
+	pthread_mutex_lock(& sTableLock);
+	TableMap::iterator it = tables().find(key);
+	if (it != tables().end()) {
+		it->second.refs++;
+		table = it->second.table;
+	}
+	pthread_mutex_unlock(& sTableLock);
+	return table;
+}
+
+void TableRegistry::retain(Buffer * table) {
+	pthread_mutex_lock(& sTableLock);
+	TableMap::iterator it = entryFor(table);
+	if (it != tables().end())
+		it->second.refs++;
+	pthread_mutex_unlock(& sTableLock);
+}
+
+// Drop a reference; the last one frees the table (unless it's pinned)
+
+void TableRegistry::release(Buffer * table) {
+	if (table == NULL)
+		return;
+	Buffer * dead = NULL;
+	pthread_mutex_lock(& sTableLock);
+	TableMap::iterator it = entryFor(table);
+	if (it == tables().end()) {
+		pthread_mutex_unlock(& sTableLock);
+		logMsg(kLogError, "TableRegistry::release: unknown table");
+		return;
+	}
+	if (it->second.refs > 0)
+		it->second.refs--;
+	if ((it->second.refs == 0) && ! it->second.pinned) {
+		dead = it->second.table;
+		tables().erase(it);
+	}
+	pthread_mutex_unlock(& sTableLock);
+	if (dead)
+		delete dead;							// (the Buffer frees its storage)
+}
+
+// Build (or find) a table and pin it
+
+void TableRegistry::prewarm(TableGenerator & generator) {
+	Buffer * table = acquire(generator);
+	pthread_mutex_lock(& sTableLock);
+	TableMap::iterator it = entryFor(table);
+	if (it != tables().end()) {
+		it->second.pinned = true;
+		it->second.refs--;						// (the pin replaces our reference)
+	}
+	pthread_mutex_unlock(& sTableLock);
+}
+
+unsigned TableRegistry::numTables() {
+	pthread_mutex_lock(& sTableLock);
+	unsigned num = tables().size();
+	pthread_mutex_unlock(& sTableLock);
+	return num;
+}
+
+unsigned TableRegistry::bytesInUse() {
+	unsigned bytes = 0;
+	pthread_mutex_lock(& sTableLock);
+	for (TableMap::iterator it = tables().begin(); it != tables().end(); it++)
+		bytes += it->second.table->mNumChannels * it->second.table->mNumFrames * sizeof(sample);
+	pthread_mutex_unlock(& sTableLock);
+	return bytes;
+}
+
+unsigned TableRegistry::refCount(const string & key) {
+	unsigned refs = 0;
+	pthread_mutex_lock(& sTableLock);
+	TableMap::iterator it = tables().find(key);
+	if (it != tables().end())
+		refs = it->second.refs;
+	pthread_mutex_unlock(& sTableLock);
+	return refs;
+}
+
+void TableRegistry::dump() {
+	pthread_mutex_lock(& sTableLock);
+	logMsg("TableRegistry: %d tables", tables().size());
+	for (TableMap::iterator it = tables().begin(); it != tables().end(); it++)
+		logMsg("\t%s: %d x %d, %d refs%s", it->first.c_str(), it->second.table->mNumChannels,
+				it->second.table->mNumFrames, it->second.refs, it->second.pinned ? " (pre-warmed)" : "");
+	pthread_mutex_unlock(& sTableLock);
+}
@@ -0,0 +1,69 @@
+//
+//  TableRegistry.h -- a shared, reference-counted store of read-only tables (wavetables, windows)
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// Tables are addressed by their contents: a TableGenerator answers a key string that names
+// everything the table depends on (its kind, its parameters and its size), and the registry
+// builds each table once and hands the same Buffer to every client that asks for the same key.
+// Clients release their tables when they're done (e.g., in their destructors), and a table is
+// freed when its last client lets go, unless it was pre-warmed.
+//
+// Building a table allocates and can take a while, so it should happen when the UGens are
+// created, not in the audio callback; prewarm() builds tables at start-up and keeps them for
+// the life of the program, so later clients only do a look-up.
+//
+// Usage:
+//		WindowTable hann(kHannWindow, 1024);
+//		TableRegistry::prewarm(hann);				// at start-up
+//		...
+//		Buffer * table = TableRegistry::acquire(hann);	// shares the pre-warmed table
+//		...
+//		TableRegistry::release(table);
+//
+
+#ifndef CSL_TableRegistry_H
+#define CSL_TableRegistry_H
+
+#include "CSL_Core.h"
+#include <map>
+
+namespace csl {
+
+///
+/// TableGenerator -- the description of a table: its key, its shape and how to fill it
+///
+
+class TableGenerator {
+public:
+	virtual ~TableGenerator() { }
+	virtual string key() = 0;					///< answer the content key (unique for the contents)
+	virtual unsigned numFrames() = 0;			///< answer the table size
+	virtual unsigned numChannels() { return 1; };	///< answer the # of tables in the set
+	virtual void fill(Buffer & table) = 0;		///< fill in the (allocated) table
+};
+
+///
+/// TableRegistry -- the shared tables (all static)
+///
+
+class TableRegistry {
+public:
+												/// answer the table for a generator, building it if it's
+												/// new; the caller must release() it
+	static Buffer * acquire(TableGenerator & generator);
+	static Buffer * find(const string & key);	///< answer a table that exists (and retain it), or NULL
+	static void retain(Buffer * table);			///< add a reference to a table
+	static void release(Buffer * table);		///< drop a reference (NULL is ignored)
+												/// build a table now and keep it until the program exits
+	static void prewarm(TableGenerator & generator);
+
+	static unsigned numTables();				///< answer the # of tables in the registry
+	static unsigned bytesInUse();				///< answer the size of all of the tables
+	static unsigned refCount(const string & key);	///< answer the # of clients of a table
+	static void dump();							///< log the tables and their clients
+};
+
+}
+
+#endif
@@ -69,11 +69,17 @@ SynchPthread::~SynchPthread() {
 
 // The following functions are just wrappers around the pthreads respective commands.
 
-int SynchPthread::lock() { return pthread_mutex_lock(&mMutex); }
+int SynchPthread::lock() { 
+	CSL_RT_CHECK_CALL(kRTLock, "Synch::lock");
+	return pthread_mutex_lock(&mMutex); 
+}
 
 int SynchPthread::unlock() { return pthread_mutex_unlock(&mMutex); }
 
-int SynchPthread::condWait() { return pthread_cond_wait(&mCond, &mMutex); }
+int SynchPthread::condWait() { 
+	CSL_RT_CHECK_CALL(kRTLock, "Synch::condWait");
+	return pthread_cond_wait(&mCond, &mMutex); 
+}
 
 int SynchPthread::condSignal() { return pthread_cond_signal(&mCond); }
 
@@ -0,0 +1,354 @@
+//
+//  UGenProfiler.cpp -- per-UnitGenerator hierarchical CPU profiling
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+
+#include "UGenProfiler.h"
+#include "RealTimeCheck.h"			// for className()
+#include <stdio.h>
+#include <time.h>
+#include <typeinfo>
+#include <algorithm>
+
+using namespace csl;
+
+// A node of a thread's call tree; node 0 is the (empty) root, whose children are the outermost calls
+
+typedef struct {
+	UnitGenerator * mUGen;
+	const char * mTypeName;		// typeid() name, taken when the node is made (the UGen may be gone later)
+	int mParent;				// tree links (indices; -1 = none)
+	int mFirstChild;
+	int mNextSibling;
+	unsigned mDepth;
+	unsigned mCalls;			// totals
+	unsigned mBlocks;
+	Cycles mInclusive;
+	Cycles mExclusive;
+	Cycles mMaxBlock;
+	Cycles mLastBlock;
+	Cycles mBlockInclusive;		// the block in progress
+	Cycles mBlockExclusive;
+	unsigned mBlockCalls;
+} ProfileNode;
+
+// A call in progress
+
+typedef struct {
+	int mNode;					// its tree node
+	Cycles mStart;				// cycle count on entry
+	Cycles mChildren;			// cycles spent in the calls it made
+	unsigned mReentries;		// nested calls to the same UGen (e.g., pullInput, then nextBuffer)
+} ProfileFrame;
+
+// A thread's tree and call stack
+
+typedef struct {
+	unsigned mIndex;
+	unsigned mNumNodes;
+	unsigned mDepth;
+	unsigned mSkipped;			// nested calls that didn't fit (tree full or too deep)
+	ProfileNode mNodes[CSL_PROFILE_MAX_NODES];
+	ProfileFrame mStack[CSL_PROFILE_MAX_DEPTH];
+} ThreadProfile;
+
+bool UGenProfiler::sEnabled = false;
+
+static CSL_THREAD_LOCAL ThreadProfile * sProfile = NULL;
+static ThreadProfile * sThreads[CSL_PROFILE_MAX_THREADS];
+static AtomicCounter sNumThreads = 0;
+
+// clear a node's statistics
+
+static void clearNode(ProfileNode & node) {
+	node.mCalls = node.mBlocks = node.mBlockCalls = 0;
+	node.mInclusive = node.mExclusive = node.mMaxBlock = node.mLastBlock = 0;
+	node.mBlockInclusive = node.mBlockExclusive = 0;
+}
+
+// make all the threads' profiles up front (in setEnabled(), before any callback runs)
+
+static void makeProfiles() {
+	if (sThreads[0])
+		return;
+	for (unsigned index = 0; index < CSL_PROFILE_MAX_THREADS; index++) {
+		ThreadProfile * prof = new ThreadProfile;
+		prof->mIndex = index;
+		prof->mNumNodes = 1;
+		prof->mDepth = 0;
+		prof->mSkipped = 0;
+		ProfileNode & root = prof->mNodes[0];
+		root.mUGen = NULL;
+		root.mTypeName = "";
+		root.mParent = root.mFirstChild = root.mNextSibling = -1;
+		root.mDepth = 0;
+		clearNode(root);
+		sThreads[index] = prof;
+	}
+	csl_memory_barrier();
+}
+
+// answer the calling thread's profile, claiming the next free one the first time a thread is seen
+// (this doesn't allocate); answer NULL if there are too many threads
+
+static ThreadProfile * threadProfile() {
+	if (sProfile)
+		return sProfile;
+	unsigned index = (unsigned) csl_atomic_add(& sNumThreads, 1);
+	if ((index >= CSL_PROFILE_MAX_THREADS) || (sThreads[index] == NULL)) {
+		csl_atomic_add(& sNumThreads, -1);
+		return NULL;
+	}
+	sProfile = sThreads[index];
+	return sProfile;
+}
+
+// answer the child of the given node for the given UGen, adding it if it's new (-1 if the tree is full)
+
+static int childFor(ThreadProfile * prof, int parent, UnitGenerator * ugen) {
+	ProfileNode * nodes = prof->mNodes;
+	for (int kid = nodes[parent].mFirstChild; kid >= 0; kid = nodes[kid].mNextSibling)
+		if (nodes[kid].mUGen == ugen)
+			return kid;
+	if (prof->mNumNodes >= CSL_PROFILE_MAX_NODES)
+		return -1;
+	int which = (int) prof->mNumNodes;
+	ProfileNode & node = nodes[which];
+	node.mUGen = ugen;
+	node.mTypeName = typeid(* ugen).name();
+	node.mParent = parent;
+	node.mFirstChild = -1;
+	node.mDepth = nodes[parent].mDepth + 1;
+	clearNode(node);
+	node.mNextSibling = nodes[parent].mFirstChild;
+	csl_memory_barrier();					// (readers on other threads walk the tree)
+	nodes[parent].mFirstChild = which;
+	prof->mNumNodes++;
+	return which;
+}
+
+#pragma mark Hooks
+
+// Start timing a call
+
+void UGenProfiler::enter(UnitGenerator * ugen) {
+	ThreadProfile * prof = threadProfile();
+	if (prof == NULL)
+		return;
+	if (prof->mSkipped > 0) {				// inside a call we aren't tracking
+		prof->mSkipped++;
+		return;
+	}
+	unsigned depth = prof->mDepth;
+	if (depth > 0) {
+		ProfileFrame & top = prof->mStack[depth - 1];
+		if (prof->mNodes[top.mNode].mUGen == ugen) {
+			top.mReentries++;
+			return;
+		}
+	}
+	int node = (depth < CSL_PROFILE_MAX_DEPTH)
+			? childFor(prof, depth ? prof->mStack[depth - 1].mNode : 0, ugen)
+			: -1;
+	if (node < 0) {
+		prof->mSkipped++;
+		return;
+	}
+	ProfileFrame & frame = prof->mStack[depth];
+	frame.mNode = node;
+	frame.mChildren = 0;
+	frame.mReentries = 0;
+	prof->mDepth++;
+	frame.mStart = cycles();
+}
+
+// Stop timing a call; when the outermost call returns, close the thread's block
+
+void UGenProfiler::exit() {
+	Cycles now = cycles();
+	ThreadProfile * prof = sProfile;
+	if (prof == NULL)
+		return;
+	if (prof->mSkipped > 0) {
+		prof->mSkipped--;
+		return;
+	}
+	if (prof->mDepth == 0)
+		return;
+	ProfileFrame & frame = prof->mStack[prof->mDepth - 1];
+	if (frame.mReentries > 0) {
+		frame.mReentries--;
+		return;
+	}
+	Cycles elapsed = now - frame.mStart;
+	ProfileNode & node = prof->mNodes[frame.mNode];
+	node.mBlockInclusive += elapsed;
+	node.mBlockExclusive += (elapsed > frame.mChildren) ? (elapsed - frame.mChildren) : 0;
+	node.mBlockCalls++;
+	prof->mDepth--;
+	if (prof->mDepth > 0) {
+		prof->mStack[prof->mDepth - 1].mChildren += elapsed;
+		return;
+	}
+	for (unsigned i = 1; i < prof->mNumNodes; i++) {		// end of block: fold into the totals
+		ProfileNode & each = prof->mNodes[i];
+		if (each.mBlockCalls == 0)
+			continue;
+		each.mCalls += each.mBlockCalls;
+		each.mBlocks++;
+		each.mInclusive += each.mBlockInclusive;
+		each.mExclusive += each.mBlockExclusive;
+		each.mLastBlock = each.mBlockInclusive;
+		if (each.mBlockInclusive > each.mMaxBlock)
+			each.mMaxBlock = each.mBlockInclusive;
+		each.mBlockInclusive = each.mBlockExclusive = 0;
+		each.mBlockCalls = 0;
+	}
+}
+
+#pragma mark Queries
+
+// turn it on; the thread profiles are made the first time, so the audio thread never allocates them
+
+void UGenProfiler::setEnabled(bool onOff) {
+	if (onOff)
+		makeProfiles();
+	sEnabled = onOff;
+}
+
+// zero the statistics; the trees are kept, since the threads may be using them
+
+void UGenProfiler::reset() {
+	unsigned numThreads = csl_min((unsigned) sNumThreads, (unsigned) CSL_PROFILE_MAX_THREADS);
+	for (unsigned t = 0; t < numThreads; t++) {
+		ThreadProfile * prof = sThreads[t];
+		for (unsigned i = 0; i < prof->mNumNodes; i++)
+			clearNode(prof->mNodes[i]);
+	}
+}
+
+// answer the nodes of all the threads' trees (parents before children)
+
+void UGenProfiler::entries(std::vector<ProfileEntry> & list) {
+	list.clear();
+	unsigned numThreads = csl_min((unsigned) sNumThreads, (unsigned) CSL_PROFILE_MAX_THREADS);
+	for (unsigned t = 0; t < numThreads; t++) {
+		ThreadProfile * prof = sThreads[t];
+		unsigned numNodes = prof->mNumNodes;
+		std::vector<string> paths(numNodes);
+		for (unsigned i = 1; i < numNodes; i++) {
+			ProfileNode & node = prof->mNodes[i];
+			ProfileEntry entry;
+			entry.mUGen = node.mUGen;
+			entry.mClass = RealTimeCheck::className(node.mTypeName);
+			entry.mPath = (node.mParent > 0) ? paths[node.mParent] + ";" + entry.mClass : entry.mClass;
+			paths[i] = entry.mPath;
+			entry.mThread = t;
+			entry.mDepth = node.mDepth - 1;
+			entry.mCalls = node.mCalls;
+			entry.mBlocks = node.mBlocks;
+			entry.mInclusive = node.mInclusive;
+			entry.mExclusive = node.mExclusive;
+			entry.mMaxBlock = node.mMaxBlock;
+			entry.mLastBlock = node.mLastBlock;
+			list.push_back(entry);
+		}
+	}
+}
+
+// Measure the cycle counter against the process clock (once, ~20 msec)
+
+double UGenProfiler::cyclesPerSecond() {
+	static double sRate = 0.0;
+	if (sRate > 0.0)
+		return sRate;
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86) || defined(__aarch64__)
+	clock_t c0 = clock();
+	Cycles t0 = cycles();
+	clock_t c1;
+	while ((c1 = clock()) - c0 < (CLOCKS_PER_SEC / 50))
+		;
+	Cycles t1 = cycles();
+	sRate = (double) (t1 - t0) * CLOCKS_PER_SEC / (double) (c1 - c0);
+#else
+	sRate = 1.0e9;							// the fallback counter is in nsec
+#endif
+	return sRate;
+}
+
+static bool moreExclusive(const ProfileEntry & a, const ProfileEntry & b) {
+	return a.mExclusive > b.mExclusive;
+}
+
+// log the top nodes by exclusive time (with the average and max usec per block)
+
+void UGenProfiler::logStats(unsigned maxLines) {
+	std::vector<ProfileEntry> list;
+	entries(list);
+	std::sort(list.begin(), list.end(), moreExclusive);
+	Cycles total = 0;
+	for (unsigned i = 0; i < list.size(); i++)
+		total += list[i].mExclusive;
+	if (total == 0) {
+		logMsg("UGenProfiler: no samples");
+		return;
+	}
+	double usec = 1.0e6 / cyclesPerSecond();
+	logMsg("UGenProfiler: %5s %9s %9s %9s  %s", "excl%", "excl us", "incl us", "max us", "path");
+	for (unsigned i = 0; (i < list.size()) && (i < maxLines); i++) {
+		ProfileEntry & e = list[i];
+		double blocks = e.mBlocks ? (double) e.mBlocks : 1.0;
+		logMsg("UGenProfiler: %5.1f %9.2f %9.2f %9.2f  %s",
+				100.0 * (double) e.mExclusive / (double) total,
+				e.mExclusive * usec / blocks, e.mInclusive * usec / blocks,
+				e.mMaxBlock * usec, e.mPath.c_str());
+	}
+}
+
+// write the trees as JSON: the counter rate and an array of nodes (parents before children)
+
+bool UGenProfiler::writeJSON(const char * path) {
+	FILE * out = fopen(path, "w");
+	if (out == NULL) {
+		logMsg(kLogError, "UGenProfiler: can't write %s", path);
+		return false;
+	}
+	std::vector<ProfileEntry> list;
+	entries(list);
+	fprintf(out, "{\n\t\"cyclesPerSecond\": %.0f,\n\t\"nodes\": [", cyclesPerSecond());
+	for (unsigned i = 0; i < list.size(); i++) {
+		ProfileEntry & e = list[i];
+		fprintf(out, "%s\n\t\t{ \"thread\": %u, \"depth\": %u, \"path\": \"%s\", \"class\": \"%s\", "
+				"\"calls\": %u, \"blocks\": %u, \"inclusive\": %llu, \"exclusive\": %llu, "
+				"\"maxBlock\": %llu, \"lastBlock\": %llu }",
+				i ? "," : "", e.mThread, e.mDepth, e.mPath.c_str(), e.mClass.c_str(),
+				e.mCalls, e.mBlocks, e.mInclusive, e.mExclusive, e.mMaxBlock, e.mLastBlock);
+	}
+	fprintf(out, "\n\t]\n}\n");
+	fclose(out);
+	return true;
+}
+
+// write "folded stacks" (path, space, exclusive cycles); threads are prefixed if there's more than one
+
+bool UGenProfiler::writeFolded(const char * path) {
+	FILE * out = fopen(path, "w");
+	if (out == NULL) {
+		logMsg(kLogError, "UGenProfiler: can't write %s", path);
+		return false;
+	}
+	std::vector<ProfileEntry> list;
+	entries(list);
+	bool threads = (sNumThreads > 1);
+	for (unsigned i = 0; i < list.size(); i++) {
+		ProfileEntry & e = list[i];
+		if (e.mExclusive == 0)
+			continue;
+		if (threads)
+			fprintf(out, "thread %u;", e.mThread);
+		fprintf(out, "%s %llu\n", e.mPath.c_str(), e.mExclusive);
+	}
+	fclose(out);
+	return true;
+}
@@ -0,0 +1,134 @@
+//
+//  UGenProfiler.h -- per-UnitGenerator hierarchical CPU profiling
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// When CSL is built with CSL_PROFILE defined, each UGen call made through the graph (IO::pullInput(),
+// Controllable::pullInput(), UnitGenerator::nextBuffer(), outputView() and the GraphExecutor)
+// is timed with the CPU's cycle counter. Each thread keeps its own call tree (so the same UGen
+// reached along two paths, or rendered on two threads, shows up twice), and accumulates the
+// inclusive cycles (the call and everything it pulls) and exclusive cycles (the call itself)
+// for each node. When a thread's outermost call returns -- once per block for the audio thread,
+// once per node for a GraphExecutor worker -- the block's numbers are added to the totals and
+// the per-block maximum. The hot path doesn't allocate or lock: the trees are fixed-size
+// arrays (CSL_PROFILE_MAX_NODES nodes per thread), all made by setEnabled(true) before the
+// graph runs; a thread claims one the first time it's seen.
+//
+// The results can be read at run time with entries() (e.g., from a GUI timer; the numbers aren't
+// read atomically, so they're approximate while the graph runs), logged, or written as JSON or
+// as "folded stacks" (one "Mixer;Panner;Osc cycles" line per tree node) for flame-graph tools.
+//
+// Usage (in a -DCSL_PROFILE build):
+//		UGenProfiler::setEnabled(true);
+//		... run the graph for a while ...
+//		UGenProfiler::logStats();
+//		UGenProfiler::writeFolded("csl.folded");		// then: flamegraph.pl csl.folded > csl.svg
+//
+
+#ifndef CSL_UGenProfiler_H
+#define CSL_UGenProfiler_H
+
+#include "CSL_Core.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+	#include <intrin.h>
+#else
+	#include <time.h>
+#endif
+
+namespace csl {
+
+#define CSL_PROFILE_MAX_NODES 1024			///< max # of call-tree nodes per thread
+#define CSL_PROFILE_MAX_DEPTH 64			///< max call depth per thread
+#define CSL_PROFILE_MAX_THREADS 32			///< max # of threads profiled
+
+typedef unsigned long long Cycles;			///< a cycle count (or ns where there's no cycle counter)
+
+///
+/// ProfileEntry -- the statistics for one node of a call tree (as answered by UGenProfiler::entries())
+///
+
+typedef struct {
+	UnitGenerator * mUGen;		///< the UGen
+	string mClass;				///< its class name
+	string mPath;				///< the call path ("Mixer;Panner;WavetableOscillator")
+	unsigned mThread;			///< which thread's tree it's in (0 = the first one seen)
+	unsigned mDepth;			///< depth in the tree (0 = called by the IO)
+	unsigned mCalls;			///< # of calls
+	unsigned mBlocks;			///< # of blocks in which it was called
+	Cycles mInclusive;			///< total cycles including the UGens it pulled
+	Cycles mExclusive;			///< total cycles in the UGen itself
+	Cycles mMaxBlock;			///< max inclusive cycles in one block
+	Cycles mLastBlock;			///< inclusive cycles in the last block
+} ProfileEntry;
+
+///
+/// UGenProfiler -- the static front-end to the per-thread call trees
+///
+
+class UGenProfiler {
+public:
+												/// turn profiling on/off (default off); turning it on makes
+												/// the thread profiles, so do it before the graph runs
+	static void setEnabled(bool onOff);
+	static bool enabled() { return sEnabled; };
+	static void reset();						///< zero the statistics (keeps the trees)
+
+												/// answer all the nodes of all the threads' trees
+	static void entries(std::vector<ProfileEntry> & list);
+	static double cyclesPerSecond();			///< answer the (measured) cycle counter rate
+	static void logStats(unsigned maxLines = 20);	///< log the nodes with the most exclusive cycles
+	static bool writeJSON(const char * path);	///< write the trees as JSON
+	static bool writeFolded(const char * path);	///< write folded stacks (exclusive cycles)
+
+												/// read the cycle counter
+	static inline Cycles cycles() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		return __rdtsc();
+#elif defined(__aarch64__)
+		Cycles val;
+		__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (val));
+		return val;
+#else
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, & now);
+		return (Cycles) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+	};
+												/// the per-call hooks (see UGenProfileScope)
+	static void enter(UnitGenerator * ugen);
+	static void exit();
+
+protected:
+	static bool sEnabled;
+};
+
+///
+/// Scope guard used by the CSL_PROFILE_SCOPE macro (it's a no-op if profiling was off on entry)
+///
+
+class UGenProfileScope {
+public:
+	UGenProfileScope(UnitGenerator * ugen) : mActive(UGenProfiler::enabled()) {
+		if (mActive)
+			UGenProfiler::enter(ugen);
+	};
+	~UGenProfileScope() {
+		if (mActive)
+			UGenProfiler::exit();
+	};
+protected:
+	bool mActive;
+};
+
+#ifdef CSL_PROFILE
+	#define CSL_PROFILE_SCOPE(ugen)		UGenProfileScope profileScope(ugen)
+#else
+	#define CSL_PROFILE_SCOPE(ugen)
+#endif
+
+}
+
+#endif
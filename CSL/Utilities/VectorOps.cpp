@@ -0,0 +1,1828 @@
+//
+//  VectorOps.cpp -- vectorized sample-buffer kernels with run-time CPU dispatch
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// The SIMD versions are all generated by the DEFINE_VECTOR_KERNELS macro from a handful of
+// per-instruction-set macros (load, store, add, etc.). On gcc/clang each function is
+// compiled with a target attribute, so this file doesn't need -mavx2 etc. and the rest of
+// CSL can be built for the baseline CPU.
+//
+
+#include "VectorOps.h"
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define CSL_VECTOR_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define CSL_TARGET(isa)
+	#else
+		#define CSL_TARGET(isa) __attribute__((target(isa)))
+	#endif
+#endif
+
+using namespace csl;
+
+#pragma mark Scalar
+
+// Plain C versions (used on other CPUs and for the loop tails of the SIMD versions)
+
+static void add_scalar(SampleBuffer dst, SampleBuffer src, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] += src[i];
+}
+
+static void scaleAdd_scalar(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] += src[i] * gain;
+}
+
+static void mul_scalar(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] = src[i] * gain;
+}
+
+static void mulRamp_scalar(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] = src[i] * (gain + (float) i * step);
+}
+
+static void scaleAddRamp_scalar(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] += src[i] * (gain + (float) i * step);
+}
+
+static void fill_scalar(SampleBuffer dst, sample value, unsigned n) {
+	for (unsigned i = 0; i < n; i++)
+		dst[i] = value;
+}
+
+static sample sum_scalar(SampleBuffer src, unsigned n) {
+	sample acc = 0.0f;
+	for (unsigned i = 0; i < n; i++)
+		acc += src[i];
+	return acc;
+}
+
+static sample dot_scalar(SampleBuffer a, SampleBuffer b, unsigned n) {
+	sample acc = 0.0f;
+	for (unsigned i = 0; i < n; i++)
+		acc += a[i] * b[i];
+	return acc;
+}
+
+static sample maxAbs_scalar(SampleBuffer src, unsigned n) {
+	sample peak = 0.0f;
+	for (unsigned i = 0; i < n; i++) {
+		sample val = fabsf(src[i]);
+		if (val > peak)
+			peak = val;
+	}
+	return peak;
+}
+
+static void minMax_scalar(SampleBuffer src, unsigned n, sample * minVal, sample * maxVal) {
+	if (n == 0) {
+		*minVal = *maxVal = 0.0f;
+		return;
+	}
+	sample lo = src[0], hi = src[0];
+	for (unsigned i = 1; i < n; i++) {
+		if (src[i] < lo) lo = src[i];
+		if (src[i] > hi) hi = src[i];
+	}
+	*minVal = lo;
+	*maxVal = hi;
+}
+
+static void clip_scalar(SampleBuffer dst, SampleBuffer src, sample lo, sample hi, unsigned n) {
+	for (unsigned i = 0; i < n; i++) {
+		sample v = src[i];
+		if (v < lo)
+			v = lo;
+		if (v > hi)
+			v = hi;
+		dst[i] = v;
+	}
+}
+
+static VectorKernels sScalarKernels = {
+	add_scalar, scaleAdd_scalar, mul_scalar, mulRamp_scalar, scaleAddRamp_scalar,
+	fill_scalar, sum_scalar, dot_scalar, maxAbs_scalar, minMax_scalar, clip_scalar
+};
+
+#ifdef CSL_VECTOR_X86
+
+// lane offsets for the gain ramps
+
+static const float sLaneIndex[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+//
+// The kernel template: SUF is the name suffix, TGT the target ISA string, VT the vector type
+// and W its width; the remaining arguments are the intrinsics (or macros) to use
+//
+
+#define DEFINE_VECTOR_KERNELS(SUF, TGT, VT, W, LD, ST, ADD, MUL, SET1, MAX, MIN, ABS)	\
+																				\
+CSL_TARGET(TGT) static void add_##SUF(SampleBuffer dst, SampleBuffer src, unsigned n) {	\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		ST(dst + i, ADD(LD(dst + i), LD(src + i)));								\
+	add_scalar(dst + i, src + i, n - i);										\
+}																				\
+CSL_TARGET(TGT) static void scaleAdd_##SUF(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {	\
+	VT g = SET1(gain);															\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		ST(dst + i, ADD(LD(dst + i), MUL(LD(src + i), g)));					\
+	scaleAdd_scalar(dst + i, src + i, gain, n - i);								\
+}																				\
+CSL_TARGET(TGT) static void mul_##SUF(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {	\
+	VT g = SET1(gain);															\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		ST(dst + i, MUL(LD(src + i), g));										\
+	mul_scalar(dst + i, src + i, gain, n - i);									\
+}																				\
+CSL_TARGET(TGT) static void mulRamp_##SUF(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {	\
+	VT stepV = SET1(step);														\
+	VT idx = LD((float *) sLaneIndex);											\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W) {												\
+		VT g = ADD(SET1(gain + (float) i * step), MUL(idx, stepV));				\
+		ST(dst + i, MUL(LD(src + i), g));										\
+	}																			\
+	mulRamp_scalar(dst + i, src + i, gain + (float) i * step, step, n - i);		\
+}																				\
+CSL_TARGET(TGT) static void scaleAddRamp_##SUF(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {	\
+	VT stepV = SET1(step);														\
+	VT idx = LD((float *) sLaneIndex);											\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W) {												\
+		VT g = ADD(SET1(gain + (float) i * step), MUL(idx, stepV));				\
+		ST(dst + i, ADD(LD(dst + i), MUL(LD(src + i), g)));					\
+	}																			\
+	scaleAddRamp_scalar(dst + i, src + i, gain + (float) i * step, step, n - i);	\
+}																				\
+CSL_TARGET(TGT) static void fill_##SUF(SampleBuffer dst, sample value, unsigned n) {	\
+	VT v = SET1(value);															\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		ST(dst + i, v);															\
+	fill_scalar(dst + i, value, n - i);											\
+}																				\
+CSL_TARGET(TGT) static sample sum_##SUF(SampleBuffer src, unsigned n) {		\
+	VT acc = SET1(0.0f);														\
+	float lanes[W];																\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		acc = ADD(acc, LD(src + i));											\
+	ST(lanes, acc);																\
+	sample total = sum_scalar(src + i, n - i);									\
+	for (unsigned j = 0; j < W; j++)											\
+		total += lanes[j];														\
+	return total;																\
+}																				\
+CSL_TARGET(TGT) static sample dot_##SUF(SampleBuffer a, SampleBuffer b, unsigned n) {	\
+	VT acc = SET1(0.0f);														\
+	float lanes[W];																\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		acc = ADD(acc, MUL(LD(a + i), LD(b + i)));								\
+	ST(lanes, acc);																\
+	sample total = dot_scalar(a + i, b + i, n - i);								\
+	for (unsigned j = 0; j < W; j++)											\
+		total += lanes[j];														\
+	return total;																\
+}																				\
+CSL_TARGET(TGT) static sample maxAbs_##SUF(SampleBuffer src, unsigned n) {		\
+	VT peak = SET1(0.0f);														\
+	float lanes[W];																\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		peak = MAX(peak, ABS(LD(src + i)));										\
+	ST(lanes, peak);															\
+	sample total = maxAbs_scalar(src + i, n - i);								\
+	for (unsigned j = 0; j < W; j++)											\
+		if (lanes[j] > total)													\
+			total = lanes[j];													\
+	return total;																\
+}																				\
+CSL_TARGET(TGT) static void minMax_##SUF(SampleBuffer src, unsigned n, sample * minVal, sample * maxVal) {	\
+	if (n < W) {																\
+		minMax_scalar(src, n, minVal, maxVal);									\
+		return;																	\
+	}																			\
+	VT lo = LD(src), hi = lo;													\
+	float loLanes[W], hiLanes[W];												\
+	unsigned i = W;																\
+	for ( ; i + W <= n; i += W) {												\
+		VT v = LD(src + i);														\
+		lo = MIN(lo, v);														\
+		hi = MAX(hi, v);														\
+	}																			\
+	ST(loLanes, lo);															\
+	ST(hiLanes, hi);															\
+	sample loV = loLanes[0], hiV = hiLanes[0];									\
+	for (unsigned j = 1; j < W; j++) {											\
+		if (loLanes[j] < loV) loV = loLanes[j];									\
+		if (hiLanes[j] > hiV) hiV = hiLanes[j];									\
+	}																			\
+	for ( ; i < n; i++) {														\
+		if (src[i] < loV) loV = src[i];											\
+		if (src[i] > hiV) hiV = src[i];											\
+	}																			\
+	*minVal = loV;																\
+	*maxVal = hiV;																\
+}																				\
+CSL_TARGET(TGT) static void clip_##SUF(SampleBuffer dst, SampleBuffer src, sample lo, sample hi, unsigned n) {	\
+	VT vLo = SET1(lo), vHi = SET1(hi);											\
+	unsigned i = 0;																\
+	for ( ; i + W <= n; i += W)													\
+		ST(dst + i, MIN(MAX(LD(src + i), vLo), vHi));							\
+	clip_scalar(dst + i, src + i, lo, hi, n - i);								\
+}																				\
+static VectorKernels s##SUF##Kernels = {										\
+	add_##SUF, scaleAdd_##SUF, mul_##SUF, mulRamp_##SUF, scaleAddRamp_##SUF,	\
+	fill_##SUF, sum_##SUF, dot_##SUF, maxAbs_##SUF, minMax_##SUF, clip_##SUF	\
+};
+
+#pragma mark SSE2
+
+#define SSE_ABS(x)		_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)))
+
+DEFINE_VECTOR_KERNELS(SSE2, "sse2", __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_mul_ps,
+		_mm_set1_ps, _mm_max_ps, _mm_min_ps, SSE_ABS)
+
+#pragma mark AVX2
+
+#define AVX_ABS(x)		_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)))
+
+DEFINE_VECTOR_KERNELS(AVX2, "avx2", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_mul_ps,
+		_mm256_set1_ps, _mm256_max_ps, _mm256_min_ps, AVX_ABS)
+
+#pragma mark AVX-512
+
+#define AVX512_ABS(x)	_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(0x7fffffff)))
+
+DEFINE_VECTOR_KERNELS(AVX512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_mul_ps,
+		_mm512_set1_ps, _mm512_max_ps, _mm512_min_ps, AVX512_ABS)
+
+#endif // CSL_VECTOR_X86
+
+#pragma mark VectorOps
+
+VectorKernels * VectorOps::sKernels = & sScalarKernels;
+SIMDLevel VectorOps::sLevel = kSIMDScalar;
+
+// Ask the CPU what it has; the AVX levels also need OS support for saving the wider registers
+
+SIMDLevel VectorOps::bestLevel() {
+#ifdef CSL_VECTOR_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if ( ! (osxsave && avx))
+		return (info[3] & (1 << 26)) ? kSIMDSSE2 : kSIMDScalar;
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6)				// XMM and YMM state
+		return kSIMDSSE2;
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1 << 16)) && ((xcr0 & 0xe0) == 0xe0))	// AVX-512F and ZMM state
+		return kSIMDAVX512;
+	if (info[1] & (1 << 5))					// AVX2
+		return kSIMDAVX2;
+	return kSIMDSSE2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return kSIMDAVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return kSIMDAVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return kSIMDSSE2;
+#endif
+#endif
+	return kSIMDScalar;
+}
+
+// answer the table for the given level
+
+VectorKernels * VectorOps::kernels(SIMDLevel level) {
+	switch (level) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDSSE2:		return & sSSE2Kernels;
+	case kSIMDAVX2:		return & sAVX2Kernels;
+	case kSIMDAVX512:	return & sAVX512Kernels;
+#endif
+	case kSIMDScalar:	return & sScalarKernels;
+	default:			return NULL;
+	}
+}
+
+const char * VectorOps::levelName(SIMDLevel level) {
+	static const char * names[CSL_NUM_SIMD_LEVELS] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+	return (level < CSL_NUM_SIMD_LEVELS) ? names[level] : "unknown";
+}
+
+SIMDLevel VectorOps::level() {
+	return sLevel;
+}
+
+// Pick the best table once, when the library is loaded, so the kernels (which may be called from
+// several threads at once) never write it; until then the scalar table is used
+
+class VectorOpsInit {
+public:
+	VectorOpsInit() { VectorOps::setLevel(VectorOps::bestLevel()); };
+};
+
+static VectorOpsInit sVectorOpsInit;
+
+// select a level; anything the CPU can't run falls back to the best one it can
+
+void VectorOps::setLevel(SIMDLevel level) {
+	SIMDLevel best = bestLevel();
+	if (level > best)
+		level = best;
+	VectorKernels * table = kernels(level);
+	if (table == NULL) {
+		level = kSIMDScalar;
+		table = & sScalarKernels;
+	}
+	sLevel = level;
+	sKernels = table;
+}
+
+// Time the main kernels at each level the CPU supports; this logs ns per sample
+
+void VectorOps::benchmark(unsigned numFrames, unsigned numReps) {
+	Buffer bufs(3, numFrames);
+	bufs.allocateBuffers();
+	SampleBuffer a = bufs.buffer(0), b = bufs.buffer(1), c = bufs.buffer(2);
+	for (unsigned i = 0; i < numFrames; i++) {
+		a[i] = fRandM(-1.0f, 1.0f);
+		b[i] = fRandM(-1.0f, 1.0f);
+	}
+	SIMDLevel oldLevel = level();
+	double scale = 1.0e9 / ((double) CLOCKS_PER_SEC * numFrames * numReps);
+	for (unsigned lev = kSIMDScalar; lev <= (unsigned) bestLevel(); lev++) {
+		VectorKernels * k = kernels((SIMDLevel) lev);
+		if (k == NULL)
+			continue;
+		volatile sample sink = 0.0f;			// keep the reductions from being optimized away
+		clock_t t0 = clock();
+		for (unsigned r = 0; r < numReps; r++)
+			k->scaleAdd(c, a, 0.5f, numFrames);
+		clock_t t1 = clock();
+		for (unsigned r = 0; r < numReps; r++)
+			k->mulRamp(c, a, 0.1f, 0.0001f, numFrames);
+		clock_t t2 = clock();
+		for (unsigned r = 0; r < numReps; r++)
+			sink = sink + k->maxAbs(a, numFrames);
+		clock_t t3 = clock();
+		for (unsigned r = 0; r < numReps; r++)
+			sink = sink + k->dot(a, b, numFrames);
+		clock_t t4 = clock();
+		logMsg("VectorOps %-8s scaleAdd %6.3f  mulRamp %6.3f  maxAbs %6.3f  dot %6.3f ns/sample",
+				levelName((SIMDLevel) lev), (t1 - t0) * scale, (t2 - t1) * scale, (t3 - t2) * scale, (t4 - t3) * scale);
+	}
+	setLevel(oldLevel);
+}
+
+#pragma mark Interleaving
+
+// PCM conversion: floats are scaled to the full-scale value of the format, dithered, clipped
+// and rounded. (The int32 scale is the largest float below 2^31, so +1.0 doesn't overflow.)
+
+unsigned VectorOps::formatBytes(PCMFormat format) {
+	switch (format) {
+	case kPCMInt16:		return 2;
+	case kPCMInt24:		return 3;
+	default:			return 4;
+	}
+}
+
+static inline float fullScale(PCMFormat format) {
+	switch (format) {
+	case kPCMInt16:		return 32767.0f;
+	case kPCMInt24:		return 8388607.0f;
+	case kPCMInt32:		return 2147483520.0f;
+	default:			return 1.0f;
+	}
+}
+
+static inline float inverseScale(PCMFormat format) {
+	switch (format) {
+	case kPCMInt16:		return 1.0f / 32767.0f;
+	case kPCMInt24:		return 1.0f / 8388607.0f;
+	case kPCMInt32:		return 1.0f / 2147483647.0f;
+	default:			return 1.0f;
+	}
+}
+
+// TPDF dither is the difference of 2 uniform randoms (-1 to +1 LSB, triangular); the generator
+// is xorshift32, and its top 23 bits become the mantissa of a float in [1, 2)
+
+static inline unsigned xorshift(unsigned & x) {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static inline float uniformOf(unsigned x) {
+	union { unsigned i; float f; } bits;
+	bits.i = (x >> 9) | 0x3f800000;
+	return bits.f - 1.0f;
+}
+
+static inline float tpdf(unsigned * state) {
+	float a = uniformOf(xorshift(state[0]));
+	return a - uniformOf(xorshift(state[0]));
+}
+
+// convert and store one sample
+
+static inline void putSample(char * dst, sample value, PCMFormat format, unsigned * dither) {
+	if (format == kPCMFloat32) {
+		* (float *) dst = value;
+		return;
+	}
+	float full = fullScale(format);
+	float val = value * full;
+	if (dither)
+		val += tpdf(dither);
+	if (val > full)
+		val = full;
+	else if (val < - full - 1.0f)
+		val = - full - 1.0f;
+	int ival = (int) lrintf(val);				// (round to nearest even, like _mm_cvtps_epi32)
+	switch (format) {
+	case kPCMInt16:
+		* (short *) dst = (short) ival;
+		break;
+	case kPCMInt24:
+		dst[0] = (char) (ival & 0xff);
+		dst[1] = (char) ((ival >> 8) & 0xff);
+		dst[2] = (char) ((ival >> 16) & 0xff);
+		break;
+	default:
+		* (int *) dst = ival;
+		break;
+	}
+}
+
+// load and convert one sample
+
+static inline sample getSample(const char * src, PCMFormat format) {
+	const unsigned char * bytes = (const unsigned char *) src;
+	switch (format) {
+	case kPCMInt16:
+		return (sample) (* (const short *) src) * inverseScale(format);
+	case kPCMInt24:
+		return (sample) (bytes[0] | (bytes[1] << 8) | (((signed char) bytes[2]) << 16)) * inverseScale(format);
+	case kPCMInt32:
+		return (sample) (* (const int *) src) * inverseScale(format);
+	default:
+		return * (const float *) src;
+	}
+}
+
+// The scalar versions work on a range of channels and frames (so they can do the SIMD tails)
+
+static void interleave_scalar(SampleBuffer * chans, unsigned fromChan, unsigned toChan, char * out,
+			unsigned outChans, unsigned fromFrame, unsigned toFrame, PCMFormat format, unsigned * dither) {
+	unsigned bytes = VectorOps::formatBytes(format);
+	for (unsigned frame = fromFrame; frame < toFrame; frame++) {
+		char * dst = out + (frame * outChans + fromChan) * bytes;
+		for (unsigned chan = fromChan; chan < toChan; chan++, dst += bytes)
+			putSample(dst, chans[chan][frame], format, dither);
+	}
+}
+
+static void deinterleave_scalar(const char * in, unsigned inChans, SampleBuffer * chans, unsigned fromChan,
+			unsigned toChan, unsigned fromFrame, unsigned toFrame, PCMFormat format) {
+	unsigned bytes = VectorOps::formatBytes(format);
+	for (unsigned frame = fromFrame; frame < toFrame; frame++) {
+		const char * src = in + (frame * inChans + fromChan) * bytes;
+		for (unsigned chan = fromChan; chan < toChan; chan++, src += bytes)
+			chans[chan][frame] = getSample(src, format);
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+// 4 lanes of xorshift and TPDF noise
+
+CSL_TARGET("sse2") static inline __m128i xorshift_SSE2(__m128i x) {
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+CSL_TARGET("sse2") static inline __m128 uniformOf_SSE2(__m128i x) {
+	__m128i bits = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+	return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f));
+}
+
+CSL_TARGET("sse2") static inline __m128 tpdf_SSE2(__m128i * state) {
+	__m128i a = xorshift_SSE2(* state);
+	__m128i b = xorshift_SSE2(a);
+	* state = b;
+	return _mm_sub_ps(uniformOf_SSE2(a), uniformOf_SSE2(b));
+}
+
+// convert and store 4 consecutive samples (a frame of 4 channels or 2 stereo frames)
+
+CSL_TARGET("sse2") static inline void store4_SSE2(char * dst, __m128 val, PCMFormat format,
+			__m128 full, __m128 least, __m128i * dither) {
+	if (format == kPCMFloat32) {
+		_mm_storeu_ps((float *) dst, val);
+		return;
+	}
+	val = _mm_mul_ps(val, full);
+	if (dither)
+		val = _mm_add_ps(val, tpdf_SSE2(dither));
+	__m128i ival = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(val, full), least));
+	switch (format) {
+	case kPCMInt16:
+		_mm_storel_epi64((__m128i *) dst, _mm_packs_epi32(ival, ival));
+		break;
+	case kPCMInt24: {
+		int ints[4];
+		_mm_storeu_si128((__m128i *) ints, ival);
+		for (unsigned i = 0; i < 4; i++, dst += 3) {
+			dst[0] = (char) (ints[i] & 0xff);
+			dst[1] = (char) ((ints[i] >> 8) & 0xff);
+			dst[2] = (char) ((ints[i] >> 16) & 0xff);
+		}
+		break;
+	}
+	default:
+		_mm_storeu_si128((__m128i *) dst, ival);
+		break;
+	}
+}
+
+// load and convert 4 consecutive samples
+
+CSL_TARGET("sse2") static inline __m128 load4_SSE2(const char * src, PCMFormat format, __m128 inverse) {
+	__m128i ival;
+	switch (format) {
+	case kPCMFloat32:
+		return _mm_loadu_ps((const float *) src);
+	case kPCMInt16:						// sign-extend the shorts into the top halves, then shift down
+		ival = _mm_loadl_epi64((const __m128i *) src);
+		ival = _mm_srai_epi32(_mm_unpacklo_epi16(ival, ival), 16);
+		break;
+	case kPCMInt24: {
+		const unsigned char * bytes = (const unsigned char *) src;
+		int ints[4];
+		for (unsigned i = 0; i < 4; i++, bytes += 3)
+			ints[i] = bytes[0] | (bytes[1] << 8) | (((signed char) bytes[2]) << 16);
+		ival = _mm_loadu_si128((const __m128i *) ints);
+		break;
+	}
+	default:
+		ival = _mm_loadu_si128((const __m128i *) src);
+		break;
+	}
+	return _mm_mul_ps(_mm_cvtepi32_ps(ival), inverse);
+}
+
+// Interleave: mono is a straight conversion, stereo uses unpack (2 frames per vector), and
+// other channel counts are done in 4x4 blocks (4 frames of 4 channels) with a transpose
+
+CSL_TARGET("sse2") static void interleave_SSE2(SampleBuffer * chans, unsigned numChans, char * out,
+			unsigned outChans, unsigned numFrames, PCMFormat format, unsigned * dither) {
+	unsigned bytes = VectorOps::formatBytes(format);
+	unsigned frameBytes = outChans * bytes;
+	unsigned numFrames4 = numFrames & ~3u;
+	__m128 full = _mm_set1_ps(fullScale(format));
+	__m128 least = _mm_set1_ps(- fullScale(format) - 1.0f);
+	__m128i state = _mm_setzero_si128();
+	__m128i * noise = NULL;
+	if (dither) {
+		state = _mm_loadu_si128((const __m128i *) dither);
+		noise = & state;
+	}
+	unsigned chan = 0;
+	if ((numChans == 1) && (outChans == 1)) {
+		for (unsigned frame = 0; frame < numFrames4; frame += 4)
+			store4_SSE2(out + frame * bytes, _mm_loadu_ps(chans[0] + frame), format, full, least, noise);
+		chan = 1;
+	} else if ((numChans == 2) && (outChans == 2)) {
+		SampleBuffer left = chans[0], right = chans[1];
+		for (unsigned frame = 0; frame < numFrames4; frame += 4) {
+			__m128 lVal = _mm_loadu_ps(left + frame);
+			__m128 rVal = _mm_loadu_ps(right + frame);
+			char * dst = out + frame * frameBytes;
+			store4_SSE2(dst, _mm_unpacklo_ps(lVal, rVal), format, full, least, noise);
+			store4_SSE2(dst + 4 * bytes, _mm_unpackhi_ps(lVal, rVal), format, full, least, noise);
+		}
+		chan = 2;
+	} else {
+		for ( ; chan + 4 <= numChans; chan += 4) {
+			SampleBuffer c0 = chans[chan], c1 = chans[chan + 1], c2 = chans[chan + 2], c3 = chans[chan + 3];
+			for (unsigned frame = 0; frame < numFrames4; frame += 4) {
+				__m128 r0 = _mm_loadu_ps(c0 + frame);
+				__m128 r1 = _mm_loadu_ps(c1 + frame);
+				__m128 r2 = _mm_loadu_ps(c2 + frame);
+				__m128 r3 = _mm_loadu_ps(c3 + frame);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				char * dst = out + frame * frameBytes + chan * bytes;
+				store4_SSE2(dst, r0, format, full, least, noise);
+				store4_SSE2(dst + frameBytes, r1, format, full, least, noise);
+				store4_SSE2(dst + 2 * frameBytes, r2, format, full, least, noise);
+				store4_SSE2(dst + 3 * frameBytes, r3, format, full, least, noise);
+			}
+		}
+	}
+	if (dither)
+		_mm_storeu_si128((__m128i *) dither, state);
+								// the last few frames of the blocked channels, then the other channels
+	interleave_scalar(chans, 0, chan, out, outChans, numFrames4, numFrames, format, dither);
+	interleave_scalar(chans, chan, numChans, out, outChans, 0, numFrames, format, dither);
+}
+
+// De-interleave: the inverse (stereo uses shuffles to pick the even and odd samples)
+
+CSL_TARGET("sse2") static void deinterleave_SSE2(const char * in, unsigned inChans, SampleBuffer * chans,
+			unsigned numChans, unsigned numFrames, PCMFormat format) {
+	unsigned bytes = VectorOps::formatBytes(format);
+	unsigned frameBytes = inChans * bytes;
+	unsigned numFrames4 = numFrames & ~3u;
+	__m128 inverse = _mm_set1_ps(inverseScale(format));
+	unsigned chan = 0;
+	if ((numChans == 1) && (inChans == 1)) {
+		for (unsigned frame = 0; frame < numFrames4; frame += 4)
+			_mm_storeu_ps(chans[0] + frame, load4_SSE2(in + frame * bytes, format, inverse));
+		chan = 1;
+	} else if ((numChans == 2) && (inChans == 2)) {
+		SampleBuffer left = chans[0], right = chans[1];
+		for (unsigned frame = 0; frame < numFrames4; frame += 4) {
+			const char * src = in + frame * frameBytes;
+			__m128 lo = load4_SSE2(src, format, inverse);
+			__m128 hi = load4_SSE2(src + 4 * bytes, format, inverse);
+			_mm_storeu_ps(left + frame, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(right + frame, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		chan = 2;
+	} else {
+		for ( ; chan + 4 <= numChans; chan += 4) {
+			SampleBuffer c0 = chans[chan], c1 = chans[chan + 1], c2 = chans[chan + 2], c3 = chans[chan + 3];
+			for (unsigned frame = 0; frame < numFrames4; frame += 4) {
+				const char * src = in + frame * frameBytes + chan * bytes;
+				__m128 r0 = load4_SSE2(src, format, inverse);
+				__m128 r1 = load4_SSE2(src + frameBytes, format, inverse);
+				__m128 r2 = load4_SSE2(src + 2 * frameBytes, format, inverse);
+				__m128 r3 = load4_SSE2(src + 3 * frameBytes, format, inverse);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(c0 + frame, r0);
+				_mm_storeu_ps(c1 + frame, r1);
+				_mm_storeu_ps(c2 + frame, r2);
+				_mm_storeu_ps(c3 + frame, r3);
+			}
+		}
+	}
+	deinterleave_scalar(in, inChans, chans, 0, chan, numFrames4, numFrames, format);
+	deinterleave_scalar(in, inChans, chans, chan, numChans, 0, numFrames, format);
+}
+
+#endif // CSL_VECTOR_X86
+
+// The front-end: the transposes are load/store bound, so SSE2 is as good as the wider sets
+
+void VectorOps::interleave(SampleBuffer * chans, unsigned numChans, void * out, unsigned outChans,
+			unsigned numFrames, PCMFormat format, unsigned * dither) {
+#ifdef CSL_VECTOR_X86
+	if (level() >= kSIMDSSE2) {
+		interleave_SSE2(chans, numChans, (char *) out, outChans, numFrames, format, dither);
+		return;
+	}
+#endif
+	interleave_scalar(chans, 0, numChans, (char *) out, outChans, 0, numFrames, format, dither);
+}
+
+void VectorOps::deinterleave(void * in, unsigned inChans, SampleBuffer * chans, unsigned numChans,
+			unsigned numFrames, PCMFormat format) {
+#ifdef CSL_VECTOR_X86
+	if (level() >= kSIMDSSE2) {
+		deinterleave_SSE2((const char *) in, inChans, chans, numChans, numFrames, format);
+		return;
+	}
+#endif
+	deinterleave_scalar((const char *) in, inChans, chans, 0, numChans, 0, numFrames, format);
+}
+
+#pragma mark Wavetable look-up
+
+// The phases are 32-bit fractions of a cycle: the top sizeBits bits are the table index, and the
+// next 24 bits below them are the interpolation fraction (converted exactly to a float)
+
+#define CSL_FRACTION_SCALE (1.0f / 16777216.0f)
+
+static void tableLookup_scalar(SampleBuffer dst, const sample * table, unsigned sizeBits,
+			const unsigned * phases, unsigned n, unsigned taps) {
+	unsigned shift = 32 - sizeBits;
+	unsigned mask = (1u << sizeBits) - 1;
+	if (taps == 1) {
+		for (unsigned i = 0; i < n; i++)
+			dst[i] = table[phases[i] >> shift];
+	} else if (taps == 2) {
+		for (unsigned i = 0; i < n; i++) {
+			unsigned idx = phases[i] >> shift;
+			float frac = (float) ((phases[i] << sizeBits) >> 8) * CSL_FRACTION_SCALE;
+			sample x1 = table[idx];
+			dst[i] = x1 + (table[(idx + 1) & mask] - x1) * frac;
+		}
+	} else {
+		for (unsigned i = 0; i < n; i++) {
+			unsigned idx = phases[i] >> shift;
+			float frac = (float) ((phases[i] << sizeBits) >> 8) * CSL_FRACTION_SCALE;
+			dst[i] = VectorOps::hermite(table[(idx - 1) & mask], table[idx],
+						table[(idx + 1) & mask], table[(idx + 2) & mask], frac);
+		}
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+// Hermite interpolation of 4 (or 8 or 16) frames at once
+
+#define DEFINE_HERMITE(SUF, TGT, VT, ADD, SUB, MUL, SET1)							\
+CSL_TARGET(TGT) static inline VT hermite_##SUF(VT x0, VT x1, VT x2, VT x3, VT frac) {	\
+	VT c1 = MUL(SET1(0.5f), SUB(x2, x0));											\
+	VT c2 = ADD(SUB(x0, MUL(SET1(2.5f), x1)), SUB(MUL(SET1(2.0f), x2), MUL(SET1(0.5f), x3)));	\
+	VT c3 = ADD(MUL(SET1(0.5f), SUB(x3, x0)), MUL(SET1(1.5f), SUB(x1, x2)));		\
+	return ADD(MUL(ADD(MUL(ADD(MUL(c3, frac), c2), frac), c1), frac), x1);			\
+}
+
+DEFINE_HERMITE(SSE2, "sse2", __m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps)
+DEFINE_HERMITE(AVX2, "avx2", __m256, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps)
+DEFINE_HERMITE(AVX512, "avx512f", __m512, _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps)
+
+// SSE2 has no gather, so each lane loads the 4 neighbouring table samples as a vector (or picks
+// them one by one where they wrap around the end), and a transpose turns the 4 rows into the
+// 4 taps of 4 frames
+
+CSL_TARGET("sse2") static inline __m128 tableRow_SSE2(const sample * table, unsigned first, unsigned mask) {
+	if (first <= mask - 3)									// (also false for first = -1)
+		return _mm_loadu_ps(table + first);
+	return _mm_setr_ps(table[first & mask], table[(first + 1) & mask],
+						table[(first + 2) & mask], table[(first + 3) & mask]);
+}
+
+CSL_TARGET("sse2") static void tableLookup_SSE2(SampleBuffer dst, const sample * table, unsigned sizeBits,
+			const unsigned * phases, unsigned n, unsigned taps) {
+	unsigned mask = (1u << sizeBits) - 1;
+	__m128i shift = _mm_cvtsi32_si128(32 - sizeBits);
+	__m128i fracShift = _mm_cvtsi32_si128(sizeBits);
+	__m128 fracScale = _mm_set1_ps(CSL_FRACTION_SCALE);
+	unsigned first = (taps == 4) ? (unsigned) -1 : 0;		// the cubic rows start 1 sample back
+	unsigned idx[4];
+	unsigned i = 0;
+	for ( ; i + 4 <= n; i += 4) {
+		__m128i phase = _mm_loadu_si128((const __m128i *) (phases + i));
+		_mm_storeu_si128((__m128i *) idx, _mm_srl_epi32(phase, shift));
+		if (taps == 1) {
+			_mm_storeu_ps(dst + i, _mm_setr_ps(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]));
+			continue;
+		}
+		__m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(_mm_sll_epi32(phase, fracShift), 8)), fracScale);
+		__m128 r0 = tableRow_SSE2(table, idx[0] + first, mask);
+		__m128 r1 = tableRow_SSE2(table, idx[1] + first, mask);
+		__m128 r2 = tableRow_SSE2(table, idx[2] + first, mask);
+		__m128 r3 = tableRow_SSE2(table, idx[3] + first, mask);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		if (taps == 2)
+			_mm_storeu_ps(dst + i, _mm_add_ps(r0, _mm_mul_ps(_mm_sub_ps(r1, r0), frac)));
+		else
+			_mm_storeu_ps(dst + i, hermite_SSE2(r0, r1, r2, r3, frac));
+	}
+	tableLookup_scalar(dst + i, table, sizeBits, phases + i, n - i, taps);
+}
+
+// AVX2 and AVX-512 gather each tap (the masked indices of the neighbours) directly
+
+#define DEFINE_TABLE_LOOKUP(SUF, TGT, VT, VI, W, LDI, ST, SRL, SLL, SRLI, AND, ADDI, SET1I,	\
+			CVT, GATHER, ADD, SUB, MUL, SET1)												\
+CSL_TARGET(TGT) static void tableLookup_##SUF(SampleBuffer dst, const sample * table,		\
+			unsigned sizeBits, const unsigned * phases, unsigned n, unsigned taps) {		\
+	__m128i shift = _mm_cvtsi32_si128(32 - sizeBits);										\
+	__m128i fracShift = _mm_cvtsi32_si128(sizeBits);										\
+	VI mask = SET1I((1 << sizeBits) - 1);													\
+	VT fracScale = SET1(CSL_FRACTION_SCALE);												\
+	unsigned i = 0;																			\
+	for ( ; i + W <= n; i += W) {															\
+		VI phase = LDI((const VI *) (phases + i));											\
+		VI idx = SRL(phase, shift);															\
+		VT x1 = GATHER(idx, table);															\
+		if (taps == 1) {																	\
+			ST(dst + i, x1);																\
+			continue;																		\
+		}																					\
+		VT frac = MUL(CVT(SRLI(SLL(phase, fracShift), 8)), fracScale);						\
+		VT x2 = GATHER(AND(ADDI(idx, SET1I(1)), mask), table);								\
+		if (taps == 2) {																	\
+			ST(dst + i, ADD(x1, MUL(SUB(x2, x1), frac)));									\
+			continue;																		\
+		}																					\
+		VT x0 = GATHER(AND(ADDI(idx, SET1I(-1)), mask), table);								\
+		VT x3 = GATHER(AND(ADDI(idx, SET1I(2)), mask), table);								\
+		ST(dst + i, hermite_##SUF(x0, x1, x2, x3, frac));									\
+	}																						\
+	tableLookup_scalar(dst + i, table, sizeBits, phases + i, n - i, taps);					\
+}
+
+#define AVX2_GATHER(idx, table)		_mm256_i32gather_ps(table, idx, 4)
+#define AVX512_GATHER(idx, table)	_mm512_i32gather_ps(idx, table, 4)
+
+DEFINE_TABLE_LOOKUP(AVX2, "avx2", __m256, __m256i, 8, _mm256_loadu_si256, _mm256_storeu_ps,
+		_mm256_srl_epi32, _mm256_sll_epi32, _mm256_srli_epi32, _mm256_and_si256, _mm256_add_epi32,
+		_mm256_set1_epi32, _mm256_cvtepi32_ps, AVX2_GATHER, _mm256_add_ps, _mm256_sub_ps,
+		_mm256_mul_ps, _mm256_set1_ps)
+
+DEFINE_TABLE_LOOKUP(AVX512, "avx512f", __m512, __m512i, 16, _mm512_loadu_si512, _mm512_storeu_ps,
+		_mm512_srl_epi32, _mm512_sll_epi32, _mm512_srli_epi32, _mm512_and_si512, _mm512_add_epi32,
+		_mm512_set1_epi32, _mm512_cvtepi32_ps, AVX512_GATHER, _mm512_add_ps, _mm512_sub_ps,
+		_mm512_mul_ps, _mm512_set1_ps)
+
+#endif // CSL_VECTOR_X86
+
+// The front-end picks the version for the current level
+
+void VectorOps::tableLookup(SampleBuffer dst, const sample * table, unsigned sizeBits,
+			const unsigned * phases, unsigned n, unsigned taps) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		tableLookup_AVX512(dst, table, sizeBits, phases, n, taps);
+		return;
+	case kSIMDAVX2:
+		tableLookup_AVX2(dst, table, sizeBits, phases, n, taps);
+		return;
+	case kSIMDSSE2:
+		tableLookup_SSE2(dst, table, sizeBits, phases, n, taps);
+		return;
+#endif
+	default:
+		tableLookup_scalar(dst, table, sizeBits, phases, n, taps);
+	}
+}
+
+#pragma mark Sine banks
+
+// The partials are summed a chunk of frames at a time: each group of W partials adds its W lanes
+// into a row per frame, and the rows are summed across at the end of the chunk (so there's only
+// one horizontal sum per frame, however many partials there are)
+
+#define CSL_SINE_CHUNK 64
+
+static void rotateSum_scalar(SampleBuffer dst, unsigned n, float * re, float * im, const float * c,
+			const float * s, float * amp, const float * ampStep, unsigned numPartials) {
+	for (unsigned k = 0; k < numPartials; k++) {
+		float r = re[k], i = im[k], a = amp[k];
+		for (unsigned j = 0; j < n; j++) {
+			dst[j] += a * i;
+			float nr = r * c[k] - i * s[k];
+			i = r * s[k] + i * c[k];
+			r = nr;
+			a += ampStep[k];
+		}
+		re[k] = r;
+		im[k] = i;
+		amp[k] = a;
+	}
+}
+
+static void sineSum_scalar(SampleBuffer dst, unsigned n, const float * cycles, const float * phase,
+			const float * ratio, float * amp, const float * ampStep, unsigned numPartials) {
+	for (unsigned k = 0; k < numPartials; k++) {
+		float a = amp[k];
+		for (unsigned j = 0; j < n; j++) {
+			float x = phase[k] + ratio[k] * cycles[j];
+			dst[j] += a * VectorOps::sinCycles(x - floorf(x + 0.5f));
+			a += ampStep[k];
+		}
+		amp[k] = a;
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+//
+// The sine-bank template: RND rounds to the nearest integer, SIGN masks the sign bit and XOR flips it
+//
+
+#define DEFINE_SINE_KERNELS(SUF, TGT, VT, W, LD, ST, ADD, SUB, MUL, SET1, MIN, ABS, SIGN, XOR, RND)	\
+																				\
+CSL_TARGET(TGT) static inline void sumRows_##SUF(SampleBuffer dst, float * rows, unsigned count) {	\
+	for (unsigned j = 0; j < count; j++) {										\
+		float total = 0.0f;														\
+		for (unsigned l = 0; l < W; l++)										\
+			total += rows[j * W + l];											\
+		dst[j] += total;														\
+	}																			\
+}																				\
+CSL_TARGET(TGT) static void rotateSum_##SUF(SampleBuffer dst, unsigned n, float * re, float * im,	\
+			const float * c, const float * s, float * amp, const float * ampStep, unsigned numPartials) {	\
+	float rows[CSL_SINE_CHUNK * W];												\
+	unsigned numVec = numPartials - (numPartials % W);							\
+	for (unsigned start = 0; start < n; start += CSL_SINE_CHUNK) {				\
+		unsigned count = csl_min(n - start, (unsigned) CSL_SINE_CHUNK);			\
+		for (unsigned j = 0; j < count; j++)									\
+			ST(rows + j * W, SET1(0.0f));										\
+		for (unsigned k = 0; k < numVec; k += W) {								\
+			VT vr = LD(re + k), vi = LD(im + k), vc = LD(c + k), vs = LD(s + k);	\
+			VT va = LD(amp + k), vd = LD(ampStep + k);							\
+			for (unsigned j = 0; j < count; j++) {								\
+				ST(rows + j * W, ADD(LD(rows + j * W), MUL(va, vi)));			\
+				VT nr = SUB(MUL(vr, vc), MUL(vi, vs));							\
+				vi = ADD(MUL(vr, vs), MUL(vi, vc));								\
+				vr = nr;														\
+				va = ADD(va, vd);												\
+			}																	\
+			ST(re + k, vr);														\
+			ST(im + k, vi);														\
+			ST(amp + k, va);													\
+		}																		\
+		sumRows_##SUF(dst + start, rows, count);								\
+	}																			\
+	rotateSum_scalar(dst, n, re + numVec, im + numVec, c + numVec, s + numVec,	\
+			amp + numVec, ampStep + numVec, numPartials - numVec);				\
+}																				\
+CSL_TARGET(TGT) static void sineSum_##SUF(SampleBuffer dst, unsigned n, const float * cycles,	\
+			const float * phase, const float * ratio, float * amp, const float * ampStep, unsigned numPartials) {	\
+	float rows[CSL_SINE_CHUNK * W];												\
+	unsigned numVec = numPartials - (numPartials % W);							\
+	VT one = SET1(1.0f), two = SET1(2.0f), pi = SET1(CSL_PI);					\
+	VT k3 = SET1(-1.6666667e-1f), k5 = SET1(8.3333333e-3f), k7 = SET1(-1.9841270e-4f);	\
+	VT k9 = SET1(2.7557319e-6f), k11 = SET1(-2.5052108e-8f);					\
+	for (unsigned start = 0; start < n; start += CSL_SINE_CHUNK) {				\
+		unsigned count = csl_min(n - start, (unsigned) CSL_SINE_CHUNK);			\
+		for (unsigned j = 0; j < count; j++)									\
+			ST(rows + j * W, SET1(0.0f));										\
+		for (unsigned k = 0; k < numVec; k += W) {								\
+			VT vp = LD(phase + k), vq = LD(ratio + k);							\
+			VT va = LD(amp + k), vd = LD(ampStep + k);							\
+			for (unsigned j = 0; j < count; j++) {								\
+				VT x = ADD(vp, MUL(vq, SET1(cycles[start + j])));				\
+				VT v = MUL(two, SUB(x, RND(x)));		/* 2 * (x wrapped to +-0.5) */	\
+				VT a = ABS(v);													\
+				a = MIN(a, SUB(one, a));				/* fold to 0 - 0.5 */	\
+				VT y = MUL(pi, a);												\
+				VT y2 = MUL(y, y);												\
+				VT p = ADD(k9, MUL(y2, k11));									\
+				p = ADD(k7, MUL(y2, p));										\
+				p = ADD(k5, MUL(y2, p));										\
+				p = ADD(k3, MUL(y2, p));										\
+				p = MUL(y, ADD(one, MUL(y2, p)));								\
+				ST(rows + j * W, ADD(LD(rows + j * W), MUL(va, XOR(p, SIGN(v)))));	\
+				va = ADD(va, vd);												\
+			}																	\
+			ST(amp + k, va);													\
+		}																		\
+		sumRows_##SUF(dst + start, rows, count);								\
+	}																			\
+	sineSum_scalar(dst, n, cycles, phase + numVec, ratio + numVec,				\
+			amp + numVec, ampStep + numVec, numPartials - numVec);				\
+}
+
+#define SSE_SIGN(x)		_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)))
+#define SSE_RND(x)		_mm_cvtepi32_ps(_mm_cvtps_epi32(x))
+
+DEFINE_SINE_KERNELS(SSE2, "sse2", __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps,
+		_mm_mul_ps, _mm_set1_ps, _mm_min_ps, SSE_ABS, SSE_SIGN, _mm_xor_ps, SSE_RND)
+
+#define AVX_SIGN(x)		_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000)))
+#define AVX_RND(x)		_mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+DEFINE_SINE_KERNELS(AVX2, "avx2", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps,
+		_mm256_mul_ps, _mm256_set1_ps, _mm256_min_ps, AVX_ABS, AVX_SIGN, _mm256_xor_ps, AVX_RND)
+
+#define AVX512_SIGN(x)	_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(0x80000000)))
+#define AVX512_XOR(x, y)	_mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x), _mm512_castps_si512(y)))
+#define AVX512_RND(x)	_mm512_roundscale_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+DEFINE_SINE_KERNELS(AVX512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_sub_ps,
+		_mm512_mul_ps, _mm512_set1_ps, _mm512_min_ps, AVX512_ABS, AVX512_SIGN, AVX512_XOR, AVX512_RND)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::rotateSum(SampleBuffer dst, unsigned n, float * re, float * im, const float * c,
+			const float * s, float * amp, const float * ampStep, unsigned numPartials) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		rotateSum_AVX512(dst, n, re, im, c, s, amp, ampStep, numPartials);
+		return;
+	case kSIMDAVX2:
+		rotateSum_AVX2(dst, n, re, im, c, s, amp, ampStep, numPartials);
+		return;
+	case kSIMDSSE2:
+		rotateSum_SSE2(dst, n, re, im, c, s, amp, ampStep, numPartials);
+		return;
+#endif
+	default:
+		rotateSum_scalar(dst, n, re, im, c, s, amp, ampStep, numPartials);
+	}
+}
+
+void VectorOps::sineSum(SampleBuffer dst, unsigned n, const float * cycles, const float * phase,
+			const float * ratio, float * amp, const float * ampStep, unsigned numPartials) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		sineSum_AVX512(dst, n, cycles, phase, ratio, amp, ampStep, numPartials);
+		return;
+	case kSIMDAVX2:
+		sineSum_AVX2(dst, n, cycles, phase, ratio, amp, ampStep, numPartials);
+		return;
+	case kSIMDSSE2:
+		sineSum_SSE2(dst, n, cycles, phase, ratio, amp, ampStep, numPartials);
+		return;
+#endif
+	default:
+		sineSum_scalar(dst, n, cycles, phase, ratio, amp, ampStep, numPartials);
+	}
+}
+
+#pragma mark Grains
+
+// Each frame reads the source at offset + j * rate frames from base (with linear interpolation),
+// scales it by the envelope env + j * envStep, and adds it to the output(s) with the pan gains.
+// The read index is clamped to the source, so a run that ends right at the edge (or a rounding
+// error) never reads outside of it.
+
+static void grainSum_scalar(SampleBuffer left, SampleBuffer right, unsigned n, const sample * src,
+			unsigned length, int base, float offset, float rate, float env, float envStep,
+			float gainL, float gainR) {
+	float lo = (float) -base;
+	float hi = (float) ((int) length - 2 - base);
+	for (unsigned j = 0; j < n; j++) {
+		float p = offset + (float) j * rate;
+		float fl = floorf(p);
+		float frac = p - fl;
+		int idx = base + (int) csl_min(csl_max(fl, lo), hi);
+		sample x = src[idx] + (src[idx + 1] - src[idx]) * frac;
+		x *= env + (float) j * envStep;
+		left[j] += x * gainL;
+		if (right)
+			right[j] += x * gainR;
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+// SSE2 has no floor or gather: the floor is a truncation corrected for negative values, and the
+// taps are loaded one lane at a time
+
+CSL_TARGET("sse2") static void grainSum_SSE2(SampleBuffer left, SampleBuffer right, unsigned n,
+			const sample * src, unsigned length, int base, float offset, float rate, float env,
+			float envStep, float gainL, float gainR) {
+	__m128 vOff = _mm_set1_ps(offset), vRate = _mm_set1_ps(rate);
+	__m128 vEnv = _mm_set1_ps(env), vStep = _mm_set1_ps(envStep);
+	__m128 vL = _mm_set1_ps(gainL), vR = _mm_set1_ps(gainR), one = _mm_set1_ps(1.0f);
+	__m128 lo = _mm_set1_ps((float) -base), hi = _mm_set1_ps((float) ((int) length - 2 - base));
+	int idx[4];
+	unsigned i = 0;
+	for ( ; i + 4 <= n; i += 4) {
+		__m128 k = _mm_add_ps(_mm_set1_ps((float) i), _mm_loadu_ps(sLaneIndex));
+		__m128 p = _mm_add_ps(vOff, _mm_mul_ps(k, vRate));
+		__m128 fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(p));
+		fl = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, p), one));
+		__m128 frac = _mm_sub_ps(p, fl);
+		fl = _mm_min_ps(_mm_max_ps(fl, lo), hi);
+		_mm_storeu_si128((__m128i *) idx, _mm_add_epi32(_mm_set1_epi32(base), _mm_cvttps_epi32(fl)));
+		__m128 x1 = _mm_setr_ps(src[idx[0]], src[idx[1]], src[idx[2]], src[idx[3]]);
+		__m128 x2 = _mm_setr_ps(src[idx[0] + 1], src[idx[1] + 1], src[idx[2] + 1], src[idx[3] + 1]);
+		__m128 x = _mm_add_ps(x1, _mm_mul_ps(_mm_sub_ps(x2, x1), frac));
+		x = _mm_mul_ps(x, _mm_add_ps(vEnv, _mm_mul_ps(k, vStep)));
+		_mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(x, vL)));
+		if (right)
+			_mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(x, vR)));
+	}
+	grainSum_scalar(left + i, right ? right + i : NULL, n - i, src, length, base, offset + (float) i * rate,
+			rate, env + (float) i * envStep, envStep, gainL, gainR);
+}
+
+// AVX2 and AVX-512 floor the positions directly and gather the two taps
+
+#define DEFINE_GRAIN_SUM(SUF, TGT, VT, VI, W, LD, ST, ADD, SUB, MUL, SET1, MIN, MAX, FLOOR,	\
+			CVTT, ADDI, SET1I, GATHER)														\
+CSL_TARGET(TGT) static void grainSum_##SUF(SampleBuffer left, SampleBuffer right, unsigned n,	\
+			const sample * src, unsigned length, int base, float offset, float rate, float env,	\
+			float envStep, float gainL, float gainR) {										\
+	VT vOff = SET1(offset), vRate = SET1(rate), vEnv = SET1(env), vStep = SET1(envStep);	\
+	VT vL = SET1(gainL), vR = SET1(gainR);													\
+	VT lo = SET1((float) -base), hi = SET1((float) ((int) length - 2 - base));				\
+	VI vBase = SET1I(base), one = SET1I(1);													\
+	unsigned i = 0;																			\
+	for ( ; i + W <= n; i += W) {															\
+		VT k = ADD(SET1((float) i), LD(sLaneIndex));										\
+		VT p = ADD(vOff, MUL(k, vRate));													\
+		VT fl = FLOOR(p);																	\
+		VT frac = SUB(p, fl);																\
+		VI idx = ADDI(vBase, CVTT(MIN(MAX(fl, lo), hi)));									\
+		VT x1 = GATHER(idx, src);															\
+		VT x2 = GATHER(ADDI(idx, one), src);												\
+		VT x = MUL(ADD(x1, MUL(SUB(x2, x1), frac)), ADD(vEnv, MUL(k, vStep)));				\
+		ST(left + i, ADD(LD(left + i), MUL(x, vL)));										\
+		if (right)																			\
+			ST(right + i, ADD(LD(right + i), MUL(x, vR)));									\
+	}																						\
+	grainSum_scalar(left + i, right ? right + i : NULL, n - i, src, length, base,			\
+			offset + (float) i * rate, rate, env + (float) i * envStep, envStep, gainL, gainR);	\
+}
+
+#define AVX_FLOOR(x)	_mm256_floor_ps(x)
+#define AVX512_FLOOR(x)	_mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+
+DEFINE_GRAIN_SUM(AVX2, "avx2", __m256, __m256i, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps,
+		_mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, _mm256_min_ps, _mm256_max_ps, AVX_FLOOR,
+		_mm256_cvttps_epi32, _mm256_add_epi32, _mm256_set1_epi32, AVX2_GATHER)
+
+DEFINE_GRAIN_SUM(AVX512, "avx512f", __m512, __m512i, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps,
+		_mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps, _mm512_min_ps, _mm512_max_ps, AVX512_FLOOR,
+		_mm512_cvttps_epi32, _mm512_add_epi32, _mm512_set1_epi32, AVX512_GATHER)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::grainSum(SampleBuffer left, SampleBuffer right, unsigned n, const sample * src,
+			unsigned length, int base, float offset, float rate, float env, float envStep,
+			float gainL, float gainR) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		grainSum_AVX512(left, right, n, src, length, base, offset, rate, env, envStep, gainL, gainR);
+		return;
+	case kSIMDAVX2:
+		grainSum_AVX2(left, right, n, src, length, base, offset, rate, env, envStep, gainL, gainR);
+		return;
+	case kSIMDSSE2:
+		grainSum_SSE2(left, right, n, src, length, base, offset, rate, env, envStep, gainL, gainR);
+		return;
+#endif
+	default:
+		grainSum_scalar(left, right, n, src, length, base, offset, rate, env, envStep, gainL, gainR);
+	}
+}
+
+#pragma mark String banks
+
+// Each string's loop is: x = its line delay frames ago; y = damp0 * x + damp1 * the previous x (a
+// 2-tap low-pass, with the loss); z = coeff * (y - the previous z) + the previous y (the allpass);
+// z is written into the line and added to the outputs. The groups of W strings run through a chunk
+// of frames at a time, and add into rows that are summed across at the end (as in the sine banks).
+
+#define CSL_STRING_CHUNK 64
+#define CSL_STRING_SHIFT 4				// log2(CSL_STRING_LANES)
+
+static void stringSum_scalar(SampleBuffer left, SampleBuffer right, unsigned n, float * lines,
+			unsigned lineMask, unsigned position, const int * delay, const float * damp0,
+			const float * damp1, const float * coeff, float * lowpass, float * allpassIn, float * allpassOut,
+			const float * gainL, const float * gainR, float * energy) {
+	for (unsigned k = 0; k < CSL_STRING_LANES; k++) {
+		float lp = lowpass[k], ai = allpassIn[k], ao = allpassOut[k], e = 0.0f;
+		for (unsigned j = 0; j < n; j++) {
+			unsigned p = position + j;
+			float x = lines[(((p - delay[k]) & lineMask) << CSL_STRING_SHIFT) + k];
+			float y = damp0[k] * x + damp1[k] * lp;
+			lp = x;
+			float z = coeff[k] * (y - ao) + ai;
+			ai = y;
+			ao = z;
+			lines[((p & lineMask) << CSL_STRING_SHIFT) + k] = z;
+			left[j] += z * gainL[k];
+			if (right)
+				right[j] += z * gainR[k];
+			e += z * z;
+		}
+		lowpass[k] = lp;
+		allpassIn[k] = ai;
+		allpassOut[k] = ao;
+		energy[k] = e;
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+// SSE2 has no gather: the taps are loaded one lane at a time
+
+CSL_TARGET("sse2") static inline __m128 gather_SSE2(__m128i idx, const float * table) {
+	int i[4];
+	_mm_storeu_si128((__m128i *) i, idx);
+	return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+#define SSE_GATHER(idx, table)		gather_SSE2(idx, table)
+
+#define DEFINE_STRING_SUM(SUF, TGT, VT, VI, W, LD, ST, ADD, SUB, MUL, SET1, LDI, SUBI, ANDI,	\
+			SLLI, ADDI, SET1I, CVTT, GATHER)													\
+CSL_TARGET(TGT) static void stringSum_##SUF(SampleBuffer left, SampleBuffer right, unsigned n,	\
+			float * lines, unsigned lineMask, unsigned position, const int * delay,				\
+			const float * damp0, const float * damp1, const float * coeff, float * lowpass,		\
+			float * allpassIn, float * allpassOut, const float * gainL, const float * gainR,	\
+			float * energy) {																	\
+	float rowsL[CSL_STRING_CHUNK * W];															\
+	float rowsR[CSL_STRING_CHUNK * W];															\
+	VI vMask = SET1I((int) lineMask);															\
+	for (unsigned k = 0; k < CSL_STRING_LANES; k++)												\
+		energy[k] = 0.0f;																		\
+	for (unsigned start = 0; start < n; start += CSL_STRING_CHUNK) {							\
+		unsigned count = csl_min(n - start, (unsigned) CSL_STRING_CHUNK);						\
+		for (unsigned j = 0; j < count; j++) {													\
+			ST(rowsL + j * W, SET1(0.0f));														\
+			ST(rowsR + j * W, SET1(0.0f));														\
+		}																						\
+		for (unsigned k = 0; k < CSL_STRING_LANES; k += W) {									\
+			VT vD0 = LD(damp0 + k), vD1 = LD(damp1 + k), vCoeff = LD(coeff + k);				\
+			VT vL = LD(gainL + k), vR = LD(gainR + k);											\
+			VT lp = LD(lowpass + k), ai = LD(allpassIn + k), ao = LD(allpassOut + k);			\
+			VT e = LD(energy + k);																\
+			VI vDelay = LDI((const VI *) (delay + k));											\
+			VI lane = ADDI(SET1I((int) k), CVTT(LD(sLaneIndex)));								\
+			for (unsigned j = 0; j < count; j++) {												\
+				unsigned p = position + start + j;												\
+				VI idx = ADDI(SLLI(ANDI(SUBI(SET1I((int) p), vDelay), vMask), CSL_STRING_SHIFT), lane);	\
+				VT x = GATHER(idx, lines);														\
+				VT y = ADD(MUL(vD0, x), MUL(vD1, lp));											\
+				lp = x;																			\
+				VT z = ADD(MUL(vCoeff, SUB(y, ao)), ai);										\
+				ai = y;																			\
+				ao = z;																			\
+				ST(lines + ((p & lineMask) << CSL_STRING_SHIFT) + k, z);						\
+				ST(rowsL + j * W, ADD(LD(rowsL + j * W), MUL(z, vL)));							\
+				ST(rowsR + j * W, ADD(LD(rowsR + j * W), MUL(z, vR)));							\
+				e = ADD(e, MUL(z, z));															\
+			}																					\
+			ST(lowpass + k, lp);																\
+			ST(allpassIn + k, ai);																\
+			ST(allpassOut + k, ao);																\
+			ST(energy + k, e);																	\
+		}																						\
+		sumRows_##SUF(left + start, rowsL, count);												\
+		if (right)																				\
+			sumRows_##SUF(right + start, rowsR, count);											\
+	}																							\
+}
+
+DEFINE_STRING_SUM(SSE2, "sse2", __m128, __m128i, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps,
+		_mm_mul_ps, _mm_set1_ps, _mm_loadu_si128, _mm_sub_epi32, _mm_and_si128, _mm_slli_epi32,
+		_mm_add_epi32, _mm_set1_epi32, _mm_cvttps_epi32, SSE_GATHER)
+
+DEFINE_STRING_SUM(AVX2, "avx2", __m256, __m256i, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps,
+		_mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, _mm256_loadu_si256, _mm256_sub_epi32,
+		_mm256_and_si256, _mm256_slli_epi32, _mm256_add_epi32, _mm256_set1_epi32, _mm256_cvttps_epi32,
+		AVX2_GATHER)
+
+DEFINE_STRING_SUM(AVX512, "avx512f", __m512, __m512i, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps,
+		_mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps, _mm512_loadu_si512, _mm512_sub_epi32,
+		_mm512_and_si512, _mm512_slli_epi32, _mm512_add_epi32, _mm512_set1_epi32, _mm512_cvttps_epi32,
+		AVX512_GATHER)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::stringSum(SampleBuffer left, SampleBuffer right, unsigned n, float * lines,
+			unsigned lineMask, unsigned position, const int * delay, const float * damp0,
+			const float * damp1, const float * coeff, float * lowpass, float * allpassIn, float * allpassOut,
+			const float * gainL, const float * gainR, float * energy) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		stringSum_AVX512(left, right, n, lines, lineMask, position, delay, damp0, damp1, coeff,
+				lowpass, allpassIn, allpassOut, gainL, gainR, energy);
+		return;
+	case kSIMDAVX2:
+		stringSum_AVX2(left, right, n, lines, lineMask, position, delay, damp0, damp1, coeff,
+				lowpass, allpassIn, allpassOut, gainL, gainR, energy);
+		return;
+	case kSIMDSSE2:
+		stringSum_SSE2(left, right, n, lines, lineMask, position, delay, damp0, damp1, coeff,
+				lowpass, allpassIn, allpassOut, gainL, gainR, energy);
+		return;
+#endif
+	default:
+		stringSum_scalar(left, right, n, lines, lineMask, position, delay, damp0, damp1, coeff,
+				lowpass, allpassIn, allpassOut, gainL, gainR, energy);
+	}
+}
+
+#pragma mark Channel lanes
+
+// The lane kernels work on rows of numLanes channels; each version does the groups of W lanes it
+// can, starting at lane k, and answers where it stopped, so the dispatchers run the widest version
+// first and pass what's left to the narrower ones (and finally to the scalar loop)
+
+static unsigned biquadLanes_scalar(float * rows, unsigned numLanes, unsigned k, unsigned n,
+			const float * coeffs, const float * steps, float * z1, float * z2) {
+	for ( ; k < numLanes; k++) {
+		float b0 = coeffs[0], b1 = coeffs[1], b2 = coeffs[2], a1 = coeffs[3], a2 = coeffs[4];
+		float s1 = z1[k], s2 = z2[k];
+		float * p = rows + k;
+		for (unsigned j = 0; j < n; j++, p += numLanes) {
+			if (steps) {
+				b0 += steps[0]; b1 += steps[1]; b2 += steps[2]; a1 += steps[3]; a2 += steps[4];
+			}
+			float x = *p;
+			float y = b0 * x + s1;
+			s1 = b1 * x - a1 * y + s2;
+			s2 = b2 * x - a2 * y;
+			*p = y;
+		}
+		z1[k] = s1;
+		z2[k] = s2;
+	}
+	return k;
+}
+
+// As Freeverb's undenormalise(): 0 any value whose exponent is 0
+
+static inline float flushDenormal(float x) {
+	union { float f; unsigned u; } bits;
+	bits.f = x;
+	return ((bits.u & 0x7f800000) == 0) ? 0.0f : x;
+}
+
+static unsigned combLanes_scalar(float * sum, const float * in, unsigned numLanes, unsigned k, unsigned n,
+			float * line, unsigned size, unsigned index, float * store, float damp1, float damp2, float feedback) {
+	for ( ; k < numLanes; k++) {
+		float st = store[k];
+		unsigned pos = index;
+		for (unsigned j = 0; j < n; j++) {
+			float * tap = line + pos * numLanes + k;
+			float out = flushDenormal(*tap);
+			st = flushDenormal(out * damp2 + st * damp1);
+			*tap = in[j * numLanes + k] + st * feedback;
+			sum[j * numLanes + k] += out;
+			if (++pos >= size)
+				pos = 0;
+		}
+		store[k] = st;
+	}
+	return k;
+}
+
+static unsigned allpassLanes_scalar(float * rows, unsigned numLanes, unsigned k, unsigned n, float * line,
+			unsigned size, unsigned index, float feedback) {
+	for ( ; k < numLanes; k++) {
+		unsigned pos = index;
+		for (unsigned j = 0; j < n; j++) {
+			float * tap = line + pos * numLanes + k;
+			float * p = rows + j * numLanes + k;
+			float bufout = flushDenormal(*tap);
+			float x = *p;
+			*tap = x + bufout * feedback;
+			*p = bufout - x;
+			if (++pos >= size)
+				pos = 0;
+		}
+	}
+	return k;
+}
+
+#ifdef CSL_VECTOR_X86
+
+// Denormal flushing: clear the lanes whose exponent bits are all 0
+
+#define SSE_FLUSH(x)	_mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_castps_si128(x),	\
+			_mm_set1_epi32(0x7f800000)), _mm_setzero_si128())), x)
+#define AVX_FLUSH(x)	_mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(		\
+			_mm256_castps_si256(x), _mm256_set1_epi32(0x7f800000)), _mm256_setzero_si256())), x)
+#define AVX512_FLUSH(x)	_mm512_maskz_mov_ps(_mm512_test_epi32_mask(_mm512_castps_si512(x),				\
+			_mm512_set1_epi32(0x7f800000)), x)
+
+#define DEFINE_LANE_KERNELS(SUF, TGT, VT, W, LD, ST, ADD, SUB, MUL, SET1, FLUSH)				\
+CSL_TARGET(TGT) static unsigned biquadLanes_##SUF(float * rows, unsigned numLanes, unsigned k,		\
+			unsigned n, const float * coeffs, const float * steps, float * z1, float * z2) {		\
+	for ( ; k + W <= numLanes; k += W) {														\
+		VT b0 = SET1(coeffs[0]), b1 = SET1(coeffs[1]), b2 = SET1(coeffs[2]);					\
+		VT a1 = SET1(coeffs[3]), a2 = SET1(coeffs[4]);											\
+		VT s1 = LD(z1 + k), s2 = LD(z2 + k);													\
+		float * p = rows + k;																	\
+		if (steps) {																			\
+			VT d0 = SET1(steps[0]), d1 = SET1(steps[1]), d2 = SET1(steps[2]);					\
+			VT e1 = SET1(steps[3]), e2 = SET1(steps[4]);										\
+			for (unsigned j = 0; j < n; j++, p += numLanes) {									\
+				b0 = ADD(b0, d0); b1 = ADD(b1, d1); b2 = ADD(b2, d2);							\
+				a1 = ADD(a1, e1); a2 = ADD(a2, e2);												\
+				VT x = LD(p);																	\
+				VT y = ADD(MUL(b0, x), s1);														\
+				s1 = ADD(SUB(MUL(b1, x), MUL(a1, y)), s2);										\
+				s2 = SUB(MUL(b2, x), MUL(a2, y));												\
+				ST(p, y);																		\
+			}																					\
+		} else {																				\
+			for (unsigned j = 0; j < n; j++, p += numLanes) {									\
+				VT x = LD(p);																	\
+				VT y = ADD(MUL(b0, x), s1);														\
+				s1 = ADD(SUB(MUL(b1, x), MUL(a1, y)), s2);										\
+				s2 = SUB(MUL(b2, x), MUL(a2, y));												\
+				ST(p, y);																		\
+			}																					\
+		}																						\
+		ST(z1 + k, s1);																			\
+		ST(z2 + k, s2);																			\
+	}																							\
+	return k;																					\
+}																								\
+CSL_TARGET(TGT) static unsigned combLanes_##SUF(float * sum, const float * in, unsigned numLanes,	\
+			unsigned k, unsigned n, float * line, unsigned size, unsigned index, float * store,		\
+			float damp1, float damp2, float feedback) {												\
+	VT vD1 = SET1(damp1), vD2 = SET1(damp2), vFb = SET1(feedback);								\
+	for ( ; k + W <= numLanes; k += W) {														\
+		VT st = LD(store + k);																	\
+		unsigned pos = index;																	\
+		for (unsigned j = 0; j < n; j++) {														\
+			float * tap = line + pos * numLanes + k;											\
+			VT out = FLUSH(LD(tap));															\
+			st = FLUSH(ADD(MUL(out, vD2), MUL(st, vD1)));										\
+			ST(tap, ADD(LD(in + j * numLanes + k), MUL(st, vFb)));								\
+			ST(sum + j * numLanes + k, ADD(LD(sum + j * numLanes + k), out));					\
+			if (++pos >= size)																	\
+				pos = 0;																		\
+		}																						\
+		ST(store + k, st);																		\
+	}																							\
+	return k;																					\
+}																								\
+CSL_TARGET(TGT) static unsigned allpassLanes_##SUF(float * rows, unsigned numLanes, unsigned k,	\
+			unsigned n, float * line, unsigned size, unsigned index, float feedback) {			\
+	VT vFb = SET1(feedback);																	\
+	for ( ; k + W <= numLanes; k += W) {														\
+		unsigned pos = index;																	\
+		for (unsigned j = 0; j < n; j++) {														\
+			float * tap = line + pos * numLanes + k;											\
+			float * p = rows + j * numLanes + k;												\
+			VT bufout = FLUSH(LD(tap));															\
+			VT x = LD(p);																		\
+			ST(tap, ADD(x, MUL(bufout, vFb)));													\
+			ST(p, SUB(bufout, x));																\
+			if (++pos >= size)																	\
+				pos = 0;																		\
+		}																						\
+	}																							\
+	return k;																					\
+}
+
+DEFINE_LANE_KERNELS(SSE2, "sse2", __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps,
+		_mm_mul_ps, _mm_set1_ps, SSE_FLUSH)
+DEFINE_LANE_KERNELS(AVX2, "avx2", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps,
+		_mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, AVX_FLUSH)
+DEFINE_LANE_KERNELS(AVX512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps,
+		_mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps, AVX512_FLUSH)
+
+#endif // CSL_VECTOR_X86
+
+// The dispatchers fall through from the widest version the CPU has to the narrower ones
+
+void VectorOps::biquadLanes(float * rows, unsigned numLanes, unsigned n, const float * coeffs,
+			const float * steps, float * z1, float * z2) {
+	unsigned k = 0;
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		k = biquadLanes_AVX512(rows, numLanes, k, n, coeffs, steps, z1, z2);
+		// fall through
+	case kSIMDAVX2:
+		k = biquadLanes_AVX2(rows, numLanes, k, n, coeffs, steps, z1, z2);
+		// fall through
+	case kSIMDSSE2:
+		k = biquadLanes_SSE2(rows, numLanes, k, n, coeffs, steps, z1, z2);
+#endif
+		// fall through
+	default:
+		biquadLanes_scalar(rows, numLanes, k, n, coeffs, steps, z1, z2);
+	}
+}
+
+void VectorOps::combLanes(float * sum, const float * in, unsigned numLanes, unsigned n, float * line,
+			unsigned size, unsigned index, float * store, float damp1, float damp2, float feedback) {
+	unsigned k = 0;
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		k = combLanes_AVX512(sum, in, numLanes, k, n, line, size, index, store, damp1, damp2, feedback);
+		// fall through
+	case kSIMDAVX2:
+		k = combLanes_AVX2(sum, in, numLanes, k, n, line, size, index, store, damp1, damp2, feedback);
+		// fall through
+	case kSIMDSSE2:
+		k = combLanes_SSE2(sum, in, numLanes, k, n, line, size, index, store, damp1, damp2, feedback);
+#endif
+		// fall through
+	default:
+		combLanes_scalar(sum, in, numLanes, k, n, line, size, index, store, damp1, damp2, feedback);
+	}
+}
+
+void VectorOps::allpassLanes(float * rows, unsigned numLanes, unsigned n, float * line, unsigned size,
+			unsigned index, float feedback) {
+	unsigned k = 0;
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		k = allpassLanes_AVX512(rows, numLanes, k, n, line, size, index, feedback);
+		// fall through
+	case kSIMDAVX2:
+		k = allpassLanes_AVX2(rows, numLanes, k, n, line, size, index, feedback);
+		// fall through
+	case kSIMDSSE2:
+		k = allpassLanes_SSE2(rows, numLanes, k, n, line, size, index, feedback);
+#endif
+		// fall through
+	default:
+		allpassLanes_scalar(rows, numLanes, k, n, line, size, index, feedback);
+	}
+}
+
+#pragma mark FDN mixing
+
+// The feedback-delay-network matrices, applied to one frame of all the lines at a time; the vector
+// versions do W frames at once (each line's block is a vector), and answer where they stopped.
+// Hadamard is log2(numLines) stages of sum/difference butterflies, scaled at the end; Householder
+// subtracts 2 / numLines of the lines' sum from each line.
+
+#define CSL_FDN_MIX_LINES 32
+
+static unsigned fdnMix_scalar(float * lines, unsigned numLines, unsigned stride, unsigned j, unsigned n,
+			bool householder) {
+	float v[CSL_FDN_MIX_LINES];
+	float g = householder ? (2.0f / numLines) : (1.0f / sqrtf((float) numLines));
+	for ( ; j < n; j++) {
+		for (unsigned k = 0; k < numLines; k++)
+			v[k] = lines[k * stride + j];
+		if (householder) {
+			float sum = 0.0f;
+			for (unsigned k = 0; k < numLines; k++)
+				sum += v[k];
+			sum *= g;
+			for (unsigned k = 0; k < numLines; k++)
+				lines[k * stride + j] = v[k] - sum;
+		} else {
+			for (unsigned h = 1; h < numLines; h <<= 1)
+				for (unsigned i = 0; i < numLines; i += 2 * h)
+					for (unsigned k = i; k < i + h; k++) {
+						float x = v[k], y = v[k + h];
+						v[k] = x + y;
+						v[k + h] = x - y;
+					}
+			for (unsigned k = 0; k < numLines; k++)
+				lines[k * stride + j] = v[k] * g;
+		}
+	}
+	return j;
+}
+
+#ifdef CSL_VECTOR_X86
+
+#define DEFINE_FDN_MIX(SUF, TGT, VT, W, LD, ST, ADD, SUB, MUL, SET1)								\
+CSL_TARGET(TGT) static unsigned fdnMix_##SUF(float * lines, unsigned numLines, unsigned stride,		\
+			unsigned j, unsigned n, bool householder) {												\
+	VT v[CSL_FDN_MIX_LINES];																	\
+	VT g = SET1(householder ? (2.0f / numLines) : (1.0f / sqrtf((float) numLines)));			\
+	for ( ; j + W <= n; j += W) {																\
+		for (unsigned k = 0; k < numLines; k++)													\
+			v[k] = LD(lines + k * stride + j);													\
+		if (householder) {																		\
+			VT sum = v[0];																		\
+			for (unsigned k = 1; k < numLines; k++)												\
+				sum = ADD(sum, v[k]);															\
+			sum = MUL(sum, g);																	\
+			for (unsigned k = 0; k < numLines; k++)												\
+				ST(lines + k * stride + j, SUB(v[k], sum));										\
+		} else {																				\
+			for (unsigned h = 1; h < numLines; h <<= 1)											\
+				for (unsigned i = 0; i < numLines; i += 2 * h)									\
+					for (unsigned k = i; k < i + h; k++) {										\
+						VT x = v[k], y = v[k + h];												\
+						v[k] = ADD(x, y);														\
+						v[k + h] = SUB(x, y);													\
+					}																			\
+			for (unsigned k = 0; k < numLines; k++)												\
+				ST(lines + k * stride + j, MUL(v[k], g));										\
+		}																						\
+	}																							\
+	return j;																					\
+}
+
+DEFINE_FDN_MIX(SSE2, "sse2", __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps,
+		_mm_mul_ps, _mm_set1_ps)
+DEFINE_FDN_MIX(AVX2, "avx2", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps,
+		_mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps)
+DEFINE_FDN_MIX(AVX512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps,
+		_mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::fdnMix(float * lines, unsigned numLines, unsigned stride, unsigned n, bool householder) {
+	unsigned j = 0;
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		j = fdnMix_AVX512(lines, numLines, stride, j, n, householder);
+		// fall through
+	case kSIMDAVX2:
+		j = fdnMix_AVX2(lines, numLines, stride, j, n, householder);
+		// fall through
+	case kSIMDSSE2:
+		j = fdnMix_SSE2(lines, numLines, stride, j, n, householder);
+#endif
+		// fall through
+	default:
+		fdnMix_scalar(lines, numLines, stride, j, n, householder);
+	}
+}
+
+#pragma mark Spectra
+
+// Complex multiply-add: the real parts of a are duplicated across each pair and multiplied by b, the
+// imaginary parts are multiplied by b with its pairs swapped, and the 2 are subtracted (even lanes)
+// or added (odd lanes)
+
+static void complexMulAdd_scalar(float * dst, const float * a, const float * b, unsigned numBins) {
+	for (unsigned k = 0; k < 2 * numBins; k += 2) {
+		float re = a[k] * b[k] - a[k + 1] * b[k + 1];
+		float im = a[k] * b[k + 1] + a[k + 1] * b[k];
+		dst[k] += re;
+		dst[k + 1] += im;
+	}
+}
+
+#ifdef CSL_VECTOR_X86
+
+#define SSE_CMUL(x, y)	_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(x, x, 0xA0), y),					\
+			_mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(x, x, 0xF5), _mm_shuffle_ps(y, y, 0xB1)),		\
+			_mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f)))
+#define AVX_CMUL(x, y)	_mm256_addsub_ps(_mm256_mul_ps(_mm256_moveldup_ps(x), y),				\
+			_mm256_mul_ps(_mm256_movehdup_ps(x), _mm256_permute_ps(y, 0xB1)))
+#define AVX512_CMUL(x, y)	_mm512_fmaddsub_ps(_mm512_moveldup_ps(x), y,						\
+			_mm512_mul_ps(_mm512_movehdup_ps(x), _mm512_permute_ps(y, 0xB1)))
+
+#define DEFINE_COMPLEX_MUL_ADD(SUF, TGT, VT, W, LD, ST, ADD, CMUL)								\
+CSL_TARGET(TGT) static void complexMulAdd_##SUF(float * dst, const float * a, const float * b,	\
+			unsigned numBins) {																	\
+	unsigned n = 2 * numBins;																	\
+	unsigned i = 0;																				\
+	for ( ; i + W <= n; i += W) {																\
+		VT x = LD(a + i), y = LD(b + i);														\
+		ST(dst + i, ADD(LD(dst + i), CMUL(x, y)));												\
+	}																							\
+	complexMulAdd_scalar(dst + i, a + i, b + i, (n - i) / 2);									\
+}
+
+DEFINE_COMPLEX_MUL_ADD(SSE2, "sse2", __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, SSE_CMUL)
+DEFINE_COMPLEX_MUL_ADD(AVX2, "avx2", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, AVX_CMUL)
+DEFINE_COMPLEX_MUL_ADD(AVX512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps,
+		AVX512_CMUL)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::complexMulAdd(float * dst, const float * a, const float * b, unsigned numBins) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		complexMulAdd_AVX512(dst, a, b, numBins);
+		return;
+	case kSIMDAVX2:
+		complexMulAdd_AVX2(dst, a, b, numBins);
+		return;
+	case kSIMDSSE2:
+		complexMulAdd_SSE2(dst, a, b, numBins);
+		return;
+#endif
+	default:
+		complexMulAdd_scalar(dst, a, b, numBins);
+	}
+}
+
+#pragma mark Random numbers
+
+// The generator is counter-based: value j of a stream is a keyed hash of counter + j (2 rounds of
+// a 32-bit integer hash, with one key word mixed in before each), so any run of it can be made
+// independently, W lanes at a time, and the 2 keys select the stream
+
+static void randomBits_scalar(unsigned * dst, unsigned n, unsigned key0, unsigned key1, unsigned counter) {
+	for (unsigned j = 0; j < n; j++)
+		dst[j] = VectorOps::randomAt(key0, key1, counter + j);
+}
+
+static void randomFill_scalar(SampleBuffer dst, unsigned n, unsigned key0, unsigned key1, unsigned counter) {
+	for (unsigned j = 0; j < n; j++)
+		dst[j] = (float) (int) VectorOps::randomAt(key0, key1, counter + j) * CSL_RANDOM_SCALE;
+}
+
+#ifdef CSL_VECTOR_X86
+
+// SSE2 has no 32-bit multiply (that's SSE4.1), so it's made of 2 widening ones
+
+CSL_TARGET("sse2") static inline __m128i mullo_SSE2(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+#define DEFINE_RANDOM_KERNELS(SUF, TGT, VT, VI, W, STI, ST, XORI, ADDI, SRLI, MULLO, SET1I,	\
+			SET1, MUL, CVT, CVTT, LD)															\
+CSL_TARGET(TGT) static inline VI randomHash_##SUF(VI x) {									\
+	x = MULLO(XORI(x, SRLI(x, 16)), SET1I(CSL_RANDOM_MUL1));									\
+	x = MULLO(XORI(x, SRLI(x, 15)), SET1I(CSL_RANDOM_MUL2));									\
+	return XORI(x, SRLI(x, 16));															\
+}																							\
+CSL_TARGET(TGT) static inline VI randomAt_##SUF(VI count, VI k0, VI k1) {					\
+	return randomHash_##SUF(XORI(randomHash_##SUF(XORI(count, k0)), k1));					\
+}																							\
+CSL_TARGET(TGT) static void randomBits_##SUF(unsigned * dst, unsigned n, unsigned key0,		\
+			unsigned key1, unsigned counter) {												\
+	VI k0 = SET1I(key0), k1 = SET1I(key1), step = SET1I(W);									\
+	VI count = ADDI(SET1I(counter), CVTT(LD(sLaneIndex)));									\
+	unsigned i = 0;																			\
+	for ( ; i + W <= n; i += W) {															\
+		STI((VI *) (dst + i), randomAt_##SUF(count, k0, k1));								\
+		count = ADDI(count, step);															\
+	}																						\
+	randomBits_scalar(dst + i, n - i, key0, key1, counter + i);								\
+}																							\
+CSL_TARGET(TGT) static void randomFill_##SUF(SampleBuffer dst, unsigned n, unsigned key0,	\
+			unsigned key1, unsigned counter) {												\
+	VI k0 = SET1I(key0), k1 = SET1I(key1), step = SET1I(W);									\
+	VI count = ADDI(SET1I(counter), CVTT(LD(sLaneIndex)));									\
+	VT scale = SET1(CSL_RANDOM_SCALE);														\
+	unsigned i = 0;																			\
+	for ( ; i + W <= n; i += W) {															\
+		ST(dst + i, MUL(CVT(randomAt_##SUF(count, k0, k1)), scale));						\
+		count = ADDI(count, step);															\
+	}																						\
+	randomFill_scalar(dst + i, n - i, key0, key1, counter + i);								\
+}
+
+DEFINE_RANDOM_KERNELS(SSE2, "sse2", __m128, __m128i, 4, _mm_storeu_si128, _mm_storeu_ps, _mm_xor_si128,
+		_mm_add_epi32, _mm_srli_epi32, mullo_SSE2, _mm_set1_epi32, _mm_set1_ps, _mm_mul_ps,
+		_mm_cvtepi32_ps, _mm_cvttps_epi32, _mm_loadu_ps)
+
+DEFINE_RANDOM_KERNELS(AVX2, "avx2", __m256, __m256i, 8, _mm256_storeu_si256, _mm256_storeu_ps,
+		_mm256_xor_si256, _mm256_add_epi32, _mm256_srli_epi32, _mm256_mullo_epi32, _mm256_set1_epi32,
+		_mm256_set1_ps, _mm256_mul_ps, _mm256_cvtepi32_ps, _mm256_cvttps_epi32, _mm256_loadu_ps)
+
+DEFINE_RANDOM_KERNELS(AVX512, "avx512f", __m512, __m512i, 16, _mm512_storeu_si512, _mm512_storeu_ps,
+		_mm512_xor_si512, _mm512_add_epi32, _mm512_srli_epi32, _mm512_mullo_epi32, _mm512_set1_epi32,
+		_mm512_set1_ps, _mm512_mul_ps, _mm512_cvtepi32_ps, _mm512_cvttps_epi32, _mm512_loadu_ps)
+
+#endif // CSL_VECTOR_X86
+
+void VectorOps::randomBits(unsigned * dst, unsigned n, unsigned key0, unsigned key1, unsigned counter) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		randomBits_AVX512(dst, n, key0, key1, counter);
+		return;
+	case kSIMDAVX2:
+		randomBits_AVX2(dst, n, key0, key1, counter);
+		return;
+	case kSIMDSSE2:
+		randomBits_SSE2(dst, n, key0, key1, counter);
+		return;
+#endif
+	default:
+		randomBits_scalar(dst, n, key0, key1, counter);
+	}
+}
+
+void VectorOps::randomFill(SampleBuffer dst, unsigned n, unsigned key0, unsigned key1, unsigned counter) {
+	switch (level()) {
+#ifdef CSL_VECTOR_X86
+	case kSIMDAVX512:
+		randomFill_AVX512(dst, n, key0, key1, counter);
+		return;
+	case kSIMDAVX2:
+		randomFill_AVX2(dst, n, key0, key1, counter);
+		return;
+	case kSIMDSSE2:
+		randomFill_SSE2(dst, n, key0, key1, counter);
+		return;
+#endif
+	default:
+		randomFill_scalar(dst, n, key0, key1, counter);
+	}
+}
+
+// Derive a stream's 2 keys from a seed and a stream id (splitmix64, so nearby seeds and ids give
+// unrelated keys)
+
+void VectorOps::randomKeys(unsigned seed, unsigned stream, unsigned * key0, unsigned * key1) {
+	unsigned long long z = ((unsigned long long) seed << 32) | stream;
+	z += 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	* key0 = (unsigned) z;
+	* key1 = (unsigned) (z >> 32);
+}
@@ -0,0 +1,272 @@
+//
+//  VectorOps.h -- vectorized sample-buffer kernels with run-time CPU dispatch
+//
+//	See the copyright notice and acknowledgment of authors in the file COPYRIGHT
+//
+// The VectorOps class is the one place where CSL's inner-loop primitives (summing, scaled
+// accumulation, gain ramps, reductions and dot products) are written with SIMD intrinsics.
+// Each primitive exists in a scalar version and (on x86) SSE2, AVX2 and AVX-512 versions;
+// the best set the CPU supports is chosen when the library is loaded (by a static initializer,
+// so the kernel calls only read the table), and can be overridden with setLevel() (e.g., to
+// compare them with benchmark()) while nothing is rendering.
+//
+// All kernels use unaligned loads and stores, so they work on any sample pointer; buffers
+// from the BufferArena are 64-byte aligned, so the common case doesn't split cache lines.
+// The source and destination may be the same (in-place), but must not otherwise overlap.
+//
+// The interleave/deinterleave functions transpose between CSL's planar buffers and the
+// interleaved layout of sound files and drivers (4x4 blocks of frames and channels, with a
+// special case for stereo), converting to/from the integer PCM formats in the same pass.
+//
+// tableLookup() is the inner loop of the wavetable oscillators: it reads a power-of-two table at
+// a run of 32-bit fixed-point phases (the whole word is one cycle), with truncation or linear or
+// 4-point Hermite interpolation. The table indices wrap with a mask, and the SIMD versions read
+// several frames at once (with gathers on AVX2 and AVX-512).
+//
+// rotateSum() and sineSum() are the inner loops of the SineBank: they add a bank of sinusoids to
+// a buffer, with the partials in structure-of-arrays form so that each vector holds 4, 8 or 16 of
+// them. rotateSum() runs recursive quadrature oscillators (one complex multiply per partial per
+// frame); sineSum() evaluates a polynomial sine at phases that follow a per-frame frequency.
+//
+// grainSum() is the inner loop of the granulator: one grain's run of frames, read from the source
+// at a fractional rate (gathered taps, linear interpolation), enveloped and panned.
+//
+// stringSum() is the inner loop of the KarplusBank: CSL_STRING_LANES plucked strings, each a delay
+// line with a 2-tap low-pass loss filter and a first-order allpass for the fractional part of its
+// length. The lines are interleaved (one row of CSL_STRING_LANES samples per position), so each
+// frame writes a row with one store and reads the strings' taps with a gather.
+//
+// biquadLanes(), combLanes() and allpassLanes() run the same filter on many channels at once, for the
+// effects' kParallel path: the channels are interleaved into rows (one sample per channel per frame),
+// each lane of a vector is a channel, and the state stays in registers across a run of frames. The
+// coefficients (ramped, for the biquads) are shared by all the lanes, the state is per-channel, and
+// any number of channels works (the widest vectors first, then narrower ones, then scalar lanes).
+//
+// complexMulAdd() multiplies 2 spectra (interleaved real/imaginary pairs) and adds the product to a
+// third; it's the inner loop of FFT convolution.
+//
+// randomBits() and randomFill() are a counter-based random number generator: value j of a stream
+// is a keyed hash of its counter, so a block of values is made W lanes at a time and any part of
+// a stream can be (re-)made without running through the rest. Streams are selected by their 2
+// keys, which randomKeys() derives from a seed and a stream id.
+//
+// Usage:
+//		VectorOps::scaleAdd(out, in, 0.5f, numFrames);		// out += in * 0.5
+//		float peak = VectorOps::maxAbs(in, numFrames);
+//		VectorOps::interleave(chans, 2, shorts, 2, numFrames, kPCMInt16, ditherState);
+//
+
+#ifndef CSL_VectorOps_H
+#define CSL_VectorOps_H
+
+#include "CSL_Core.h"
+#include <math.h>
+
+namespace csl {
+
+///
+/// SIMD instruction set levels
+///
+
+#ifdef CSL_ENUMS
+typedef enum {
+	kSIMDScalar = 0,			///< plain C loops
+	kSIMDSSE2,					///< 4-wide
+	kSIMDAVX2,					///< 8-wide
+	kSIMDAVX512					///< 16-wide
+} SIMDLevel;
+#else
+	#define kSIMDScalar 0
+	#define kSIMDSSE2 1
+	#define kSIMDAVX2 2
+	#define kSIMDAVX512 3
+	typedef int SIMDLevel;
+#endif
+
+#define CSL_NUM_SIMD_LEVELS 4
+
+///
+/// VectorKernels -- the table of kernel functions for one instruction set
+///
+
+typedef struct {
+								/// dst[i] += src[i]
+	void (* add)(SampleBuffer dst, SampleBuffer src, unsigned n);
+								/// dst[i] += src[i] * gain
+	void (* scaleAdd)(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n);
+								/// dst[i] = src[i] * gain
+	void (* mul)(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n);
+								/// dst[i] = src[i] * (gain + i * step)
+	void (* mulRamp)(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n);
+								/// dst[i] += src[i] * (gain + i * step)
+	void (* scaleAddRamp)(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n);
+								/// dst[i] = value
+	void (* fill)(SampleBuffer dst, sample value, unsigned n);
+								/// answer the sum of src[i]
+	sample (* sum)(SampleBuffer src, unsigned n);
+								/// answer the sum of a[i] * b[i]
+	sample (* dot)(SampleBuffer a, SampleBuffer b, unsigned n);
+								/// answer the max of |src[i]|
+	sample (* maxAbs)(SampleBuffer src, unsigned n);
+								/// answer the min and max of src[i]
+	void (* minMax)(SampleBuffer src, unsigned n, sample * minVal, sample * maxVal);
+								/// dst[i] = src[i] limited to [lo, hi] (hi wins if lo > hi)
+	void (* clip)(SampleBuffer dst, SampleBuffer src, sample lo, sample hi, unsigned n);
+} VectorKernels;
+
+#define CSL_STRING_LANES 16				///< # of strings in a stringSum() group (one row of the lines)
+
+#define CSL_RANDOM_MUL1 0x7feb352d				///< the multipliers of the random-number hash
+#define CSL_RANDOM_MUL2 0x846ca68b
+#define CSL_RANDOM_SCALE (1.0f / 2147483648.0f)	///< scales a (signed) random value to [-1, 1)
+
+///
+/// VectorOps -- static front-end to the kernel table selected for this CPU
+///
+
+class VectorOps {
+public:
+	static SIMDLevel bestLevel();				///< answer the best level this CPU (and OS) supports
+	static SIMDLevel level();					///< answer the level in use
+	static void setLevel(SIMDLevel level);		///< select a level (limited to the best one)
+	static const char * levelName(SIMDLevel level);	///< answer "scalar", "SSE2", etc.
+	static VectorKernels * kernels(SIMDLevel level);	///< answer the table for a level (NULL if not built)
+												/// time the kernels at each supported level (logs the results)
+	static void benchmark(unsigned numFrames = 512, unsigned numReps = 20000);
+
+												/// the kernels (see VectorKernels for the semantics)
+	static inline void add(SampleBuffer dst, SampleBuffer src, unsigned n) {
+		table()->add(dst, src, n);
+	};
+	static inline void scaleAdd(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {
+		table()->scaleAdd(dst, src, gain, n);
+	};
+	static inline void mul(SampleBuffer dst, SampleBuffer src, sample gain, unsigned n) {
+		table()->mul(dst, src, gain, n);
+	};
+	static inline void mulRamp(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {
+		table()->mulRamp(dst, src, gain, step, n);
+	};
+	static inline void scaleAddRamp(SampleBuffer dst, SampleBuffer src, sample gain, sample step, unsigned n) {
+		table()->scaleAddRamp(dst, src, gain, step, n);
+	};
+	static inline void fill(SampleBuffer dst, sample value, unsigned n) {
+		table()->fill(dst, value, n);
+	};
+	static inline sample sum(SampleBuffer src, unsigned n) {
+		return table()->sum(src, n);
+	};
+	static inline sample dot(SampleBuffer a, SampleBuffer b, unsigned n) {
+		return table()->dot(a, b, n);
+	};
+	static inline sample maxAbs(SampleBuffer src, unsigned n) {
+		return table()->maxAbs(src, n);
+	};
+	static inline void minMax(SampleBuffer src, unsigned n, sample * minVal, sample * maxVal) {
+		table()->minMax(src, n, minVal, maxVal);
+	};
+	static inline void clip(SampleBuffer dst, SampleBuffer src, sample lo, sample hi, unsigned n) {
+		table()->clip(dst, src, lo, hi, n);
+	};
+												/// copy numChans planar channels into the first numChans columns
+												/// of an interleaved buffer of outChans, converting to format
+												/// (dither: 4 words of generator state, or NULL for none)
+	static void interleave(SampleBuffer * chans, unsigned numChans, void * out, unsigned outChans,
+						unsigned numFrames, PCMFormat format = kPCMFloat32, unsigned * dither = NULL);
+												/// copy the first numChans columns of an interleaved buffer of
+												/// inChans into planar channels, converting from format
+	static void deinterleave(void * in, unsigned inChans, SampleBuffer * chans, unsigned numChans,
+						unsigned numFrames, PCMFormat format = kPCMFloat32);
+	static unsigned formatBytes(PCMFormat format);	///< answer the bytes per sample of a format
+												/// read a table of (1 << sizeBits) samples at n fixed-point
+												/// phases using 1 (truncate), 2 (linear) or 4 (cubic) taps
+	static void tableLookup(SampleBuffer dst, const sample * table, unsigned sizeBits,
+						const unsigned * phases, unsigned n, unsigned taps);
+												/// dst[j] += sum of amp[k] * im[k] over the partials, where
+												/// each frame (re, im) is rotated by (c, s) and amp += ampStep
+	static void rotateSum(SampleBuffer dst, unsigned n, float * re, float * im, const float * c,
+						const float * s, float * amp, const float * ampStep, unsigned numPartials);
+												/// dst[j] += sum of amp[k] * sin(2pi (phase[k] + ratio[k] * cycles[j]))
+												/// (the phases are in cycles); amp += ampStep each frame
+	static void sineSum(SampleBuffer dst, unsigned n, const float * cycles, const float * phase,
+						const float * ratio, float * amp, const float * ampStep, unsigned numPartials);
+												/// add a grain's run of n frames: src (length frames) is read
+												/// at base + offset + j * rate with linear interpolation, times
+												/// the envelope env + j * envStep; right may be NULL (mono)
+	static void grainSum(SampleBuffer left, SampleBuffer right, unsigned n, const sample * src,
+						unsigned length, int base, float offset, float rate, float env, float envStep,
+						float gainL, float gainR);
+												/// run a group of strings for n frames and add them to the
+												/// outputs (right may be NULL); frame j writes the row at
+												/// (position + j) & lineMask of lines and string k reads its
+												/// row delay[k] before it; energy[k] = the sum of its squares
+	static void stringSum(SampleBuffer left, SampleBuffer right, unsigned n, float * lines,
+						unsigned lineMask, unsigned position, const int * delay, const float * damp0,
+						const float * damp1, const float * coeff, float * lowpass, float * allpassIn, float * allpassOut,
+						const float * gainL, const float * gainR, float * energy);
+												/// run n rows of numLanes channels (in place) through a
+												/// transposed-direct-form-II biquad: coeffs are b0, b1, b2,
+												/// a1, a2 (each += steps before each frame, if steps isn't
+												/// NULL); z1 and z2 are the channels' state
+	static void biquadLanes(float * rows, unsigned numLanes, unsigned n, const float * coeffs,
+						const float * steps, float * z1, float * z2);
+												/// add a Freeverb comb (line: size rows, read/written at
+												/// index + j) over n rows of input into sum; store is the
+												/// channels' damping-filter state
+	static void combLanes(float * sum, const float * in, unsigned numLanes, unsigned n, float * line,
+						unsigned size, unsigned index, float * store, float damp1, float damp2, float feedback);
+												/// run n rows (in place) through a Freeverb allpass
+	static void allpassLanes(float * rows, unsigned numLanes, unsigned n, float * line, unsigned size,
+						unsigned index, float feedback);
+												/// mix frames [0, n) of numLines (8, 16 or 32) blocks of
+												/// samples (stride apart) in place by an orthogonal matrix:
+												/// Hadamard / sqrt(numLines), or I - (2 / numLines) 1 1'
+	static void fdnMix(float * lines, unsigned numLines, unsigned stride, unsigned n, bool householder);
+												/// dst[k] += a[k] * b[k] for numBins complex #s
+												/// (each an interleaved real/imaginary pair)
+	static void complexMulAdd(float * dst, const float * a, const float * b, unsigned numBins);
+												/// dst[j] = the stream's 32-bit value # counter + j
+	static void randomBits(unsigned * dst, unsigned n, unsigned key0, unsigned key1, unsigned counter);
+												/// dst[j] = the stream's value # counter + j in [-1, 1)
+	static void randomFill(SampleBuffer dst, unsigned n, unsigned key0, unsigned key1, unsigned counter);
+												/// answer the keys of stream # stream of a seed
+	static void randomKeys(unsigned seed, unsigned stream, unsigned * key0, unsigned * key1);
+												/// answer a stream's value # counter (what randomBits() makes)
+	static inline unsigned randomAt(unsigned key0, unsigned key1, unsigned counter) {
+		return randomHash(randomHash(counter ^ key0) ^ key1);
+	};
+	static inline unsigned randomHash(unsigned x) {	///< a 32-bit integer hash (a permutation)
+		x = (x ^ (x >> 16)) * CSL_RANDOM_MUL1;
+		x = (x ^ (x >> 15)) * CSL_RANDOM_MUL2;
+		return x ^ (x >> 16);
+	};
+	static inline float sinCycles(float x) {	///< sin(2pi x) by polynomial, for -0.5 <= x <= 0.5
+		float v = 2.0f * x;
+		float a = fabsf(v);
+		if (a > 0.5f)
+			a = 1.0f - a;
+		float y = CSL_PI * a;
+		float y2 = y * y;
+		float p = y * (1.0f + y2 * (-1.6666667e-1f + y2 * (8.3333333e-3f + y2 * (-1.9841270e-4f
+					+ y2 * (2.7557319e-6f + y2 * -2.5052108e-8f)))));
+		return (v < 0.0f) ? -p : p;
+	};
+												/// 4-point Hermite interpolation between x1 and x2
+	static inline sample hermite(sample x0, sample x1, sample x2, sample x3, float frac) {
+		sample c1 = 0.5f * (x2 - x0);
+		sample c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+		sample c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+		return ((c3 * frac + c2) * frac + c1) * frac + x1;
+	};
+
+protected:
+	static VectorKernels * sKernels;			///< the table in use (selected when the library is loaded)
+	static SIMDLevel sLevel;					///< and its level
+	static inline VectorKernels * table() {		///< answer the current table
+		return sKernels;
+	};
+};
+
+}
+
+#endif
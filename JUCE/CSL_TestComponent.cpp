@@ -41,6 +41,7 @@ extern testStruct srcTestList[];
 extern testStruct envTestList[];
 extern testStruct effTestList[];
 extern testStruct panTestList[];
+extern testStruct kernTestList[];
 #ifdef USE_JMIDI
 extern testStruct ctrlTestList[];
 #endif
@@ -52,6 +53,7 @@ testStruct * allTests[] = {
 	envTestList,
 	effTestList,
 	panTestList,
+	kernTestList,
 #ifdef USE_JMIDI
 	ctrlTestList,
 #endif
@@ -64,6 +66,7 @@ const char * allTestNames[] = {
 	"Envelope Tests",
 	"Effect Tests",
 	"Panner Tests",
+	"Kernel Tests",
 #ifdef USE_JMIDI
 	"Control Tests",
 #endif
@@ -76,6 +79,7 @@ const char * allTestFiles[] = {
 	"Test_Envelopes.cpp",
 	"Test_Effects.cpp",
 	"Test_Panners.cpp",
+	"Test_Kernel.cpp",
 #ifdef USE_JMIDI
 	"Test_Control.cpp",
 #endif
@@ -89,9 +93,9 @@ testStruct * gTestList;				// global menu
 void dumpTestList() {
 	printf("\nMenu List\n");
 #ifdef USE_JMIDI
-	unsigned numSuites = 7;
+	unsigned numSuites = 8;
 #else
-	unsigned numSuites = 6;
+	unsigned numSuites = 7;
 #endif
 	for (unsigned i = 0; i < numSuites; i++) {
 		gTestList = allTests[i];
@@ -252,10 +256,13 @@ CSLComponent::CSLComponent ()
     familyCombo->addItem ("Envelopes", 3);
     familyCombo->addItem ("Effects", 4);
     familyCombo->addItem ("Panners", 5);
+	familyCombo->addItem ("Kernel", 6);
 #ifdef USE_JMIDI
-    familyCombo->addItem ("Controls", 6);
+	familyCombo->addItem ("Controls", 7);
+	familyCombo->addItem ("Audio", 8);
+#else
+	familyCombo->addItem ("Audio", 7);		// (the IDs index allTests)
 #endif
-	familyCombo->addItem ("Audio", 7);
     familyCombo->addListener (this);
 
     addAndMakeVisible (recordButton = new ToggleButton ("new toggle button"));